@@ -0,0 +1,249 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  AudioMetrics.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <string>
+
+#include "AudioMetrics.h"
+
+namespace PKIsensee
+{
+
+namespace
+{
+
+struct MetricInfo
+{
+  const char* name;
+  const char* unit;
+  bool        isTime; // traced as a span rather than a counter
+};
+
+constexpr MetricInfo kMetricInfo[] =
+{
+  { "refillTime",           "ns",      true },
+  { "eventToRefillLatency", "ns",      true },
+  { "queueDepthAtRefill",   "buffers", false },
+  { "deviceWriteTime",      "ns",      true },
+  { "decodeTime",           "ns",      true },
+};
+static_assert( std::size( kMetricInfo ) == AudioMetrics::kMetricCount );
+
+constexpr const char* kCounterNames[] =
+{
+  "refills",
+  "underruns",
+  "buffersWritten",
+  "samplesDecoded",
+};
+static_assert( std::size( kCounterNames ) == AudioMetrics::kCounterCount );
+
+constexpr double kPercentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+constexpr const char* kPercentileNames[] = { "p50", "p90", "p99", "p999" };
+
+// Nanoseconds as microseconds with three decimals, Chrome's time unit
+void AppendMicroseconds( std::string& json, uint64_t nanoseconds )
+{
+  auto fraction = std::to_string( 1000 + ( nanoseconds % 1000 ) );
+  json += std::to_string( nanoseconds / 1000 );
+  json += '.';
+  json += fraction.substr( 1 );
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+AudioMetrics::AudioMetrics()
+  : epoch_( Clock::now() )
+{
+}
+
+// Reuses the block of a thread that has exited, if any
+AudioMetrics::ThreadMetrics* AudioMetrics::AcquireThreadMetrics()
+{
+  std::lock_guard<std::mutex> lock( mutex_ );
+  for( auto& threadMetrics : threadMetrics_ )
+  {
+    bool isInUse = false;
+    if( threadMetrics->isInUse.compare_exchange_strong( isInUse, true, std::memory_order_acquire ) )
+      return threadMetrics.get();
+  }
+  threadMetrics_.push_back( std::make_unique<ThreadMetrics>() );
+  auto* threadMetrics = threadMetrics_.back().get();
+  threadMetrics->threadIndex = static_cast<uint32_t>( threadMetrics_.size() );
+  threadMetrics->isInUse.store( true, std::memory_order_relaxed );
+  return threadMetrics;
+}
+
+AudioMetrics::Snapshot AudioMetrics::GetSnapshot() const
+{
+  Snapshot snapshot;
+  std::lock_guard<std::mutex> lock( mutex_ );
+  for( size_t i = 0; i < kCounterCount; ++i )
+    for( const auto& threadMetrics : threadMetrics_ )
+      snapshot.counters[ i ] += threadMetrics->counters[ i ].load( std::memory_order_relaxed );
+
+  for( size_t i = 0; i < kMetricCount; ++i )
+  {
+    auto& histogram = snapshot.histograms[ i ];
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    for( const auto& threadMetrics : threadMetrics_ )
+    {
+      const auto& buckets = threadMetrics->buckets[ i ];
+      for( size_t bucket = 0; bucket < LatencyHistogram::kBucketCount; ++bucket )
+      {
+        auto count = buckets[ bucket ].load( std::memory_order_relaxed );
+        if( count != 0 )
+          histogram.Add( bucket, count );
+      }
+      sum += threadMetrics->sums[ i ].load( std::memory_order_relaxed );
+      max = std::max( max, threadMetrics->maxes[ i ].load( std::memory_order_relaxed ) );
+    }
+    histogram.SetSumAndMax( sum, max );
+  }
+  return snapshot;
+}
+
+AudioMetrics::Snapshot AudioMetrics::Snapshot::Since( const Snapshot& earlier ) const
+{
+  Snapshot snapshot;
+  for( size_t i = 0; i < kCounterCount; ++i )
+    snapshot.counters[ i ] = counters[ i ] - std::min( counters[ i ], earlier.counters[ i ] );
+  for( size_t i = 0; i < kMetricCount; ++i )
+    snapshot.histograms[ i ] = histograms[ i ].Since( earlier.histograms[ i ] );
+  return snapshot;
+}
+
+std::string AudioMetrics::Snapshot::ToJson() const
+{
+  std::string json = "{\n  \"counters\": {";
+  for( size_t i = 0; i < kCounterCount; ++i )
+  {
+    json += ( i == 0 ) ? "\n    \"" : ",\n    \"";
+    json += kCounterNames[ i ];
+    json += "\": ";
+    json += std::to_string( counters[ i ] );
+  }
+  json += "\n  },\n  \"histograms\": {";
+  for( size_t i = 0; i < kMetricCount; ++i )
+  {
+    const auto& histogram = histograms[ i ];
+    json += ( i == 0 ) ? "\n    \"" : ",\n    \"";
+    json += kMetricInfo[ i ].name;
+    json += "\": { \"unit\": \"";
+    json += kMetricInfo[ i ].unit;
+    json += "\", \"count\": ";
+    json += std::to_string( histogram.GetCount() );
+    json += ", \"mean\": ";
+    json += std::to_string( static_cast<uint64_t>( histogram.GetMean() + 0.5 ) );
+    json += ", \"max\": ";
+    json += std::to_string( histogram.GetMax() );
+    for( size_t p = 0; p < std::size( kPercentiles ); ++p )
+    {
+      json += ", \"";
+      json += kPercentileNames[ p ];
+      json += "\": ";
+      json += std::to_string( histogram.GetValueAtPercentile( kPercentiles[ p ] ) );
+    }
+    json += " }";
+  }
+  json += "\n  }\n}\n";
+  return json;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Each thread's ring is read oldest first. An event is kept only if its
+// sequence number is the one expected before and after reading it, which
+// rules out one the thread was overwriting at the time.
+
+std::string AudioMetrics::GetChromeTrace() const
+{
+  std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool isFirst = true;
+  auto beginEvent = [&]
+  {
+    json += isFirst ? "\n" : ",\n";
+    isFirst = false;
+  };
+
+  std::lock_guard<std::mutex> lock( mutex_ );
+  for( const auto& threadMetrics : threadMetrics_ )
+  {
+    auto tid = std::to_string( threadMetrics->threadIndex );
+    beginEvent();
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid +
+            ",\"args\":{\"name\":\"audio metrics " + tid + "\"}}";
+
+    auto end = threadMetrics->traceEventCount.load( std::memory_order_acquire );
+    auto begin = ( end > kTraceEventsPerThread ) ? end - kTraceEventsPerThread : 0;
+    for( auto index = begin; index < end; ++index )
+    {
+      const auto& traceEvent = threadMetrics->traceEvents[ index % kTraceEventsPerThread ];
+      if( traceEvent.sequence.load( std::memory_order_acquire ) != index + 1 )
+        continue;
+      auto time = traceEvent.time.load( std::memory_order_relaxed );
+      auto value = traceEvent.value.load( std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if( traceEvent.sequence.load( std::memory_order_relaxed ) != index + 1 )
+        continue;
+
+      auto eventId = static_cast<uint32_t>( value >> kEventIdShift );
+      value &= kMaxTraceValue;
+      beginEvent();
+      if( eventId >= kCounterEventBase )
+      {
+        assert( eventId - kCounterEventBase < kCounterCount );
+        json += "{\"name\":\"";
+        json += kCounterNames[ eventId - kCounterEventBase ];
+        json += "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+        AppendMicroseconds( json, time );
+        json += "}";
+        continue;
+      }
+
+      assert( eventId < kMetricCount );
+      const auto& info = kMetricInfo[ eventId ];
+      json += "{\"name\":\"";
+      json += info.name;
+      json += info.isTime ? "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid : std::string( "\",\"ph\":\"C\",\"pid\":1" );
+      json += ",\"ts\":";
+      AppendMicroseconds( json, time );
+      if( info.isTime )
+      {
+        json += ",\"dur\":";
+        AppendMicroseconds( json, value );
+        json += "}";
+      }
+      else
+      {
+        json += ",\"args\":{\"";
+        json += info.unit;
+        json += "\":" + std::to_string( value ) + "}}";
+      }
+    }
+  }
+  json += "\n]}\n";
+  return json;
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,442 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  AudioMetrics.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// What the audio path measures. Times are in nanoseconds.
+
+enum class AudioMetric : uint32_t
+{
+  RefillTime,           // WaveOut::Update() with buffers to look at
+  EventToRefillLatency, // from the device returning a buffer to Update() seeing it
+  QueueDepthAtRefill,   // buffers still queued at the device when Update() runs
+  DeviceWriteTime,      // WinWaveOut::Write()
+  DecodeTime,           // WinMediaSourceReader::ReadSample(), per sample
+  Count
+};
+
+enum class AudioCounter : uint32_t
+{
+  Refills,
+  Underruns,      // every buffer done while data remained
+  BuffersWritten, // to the device
+  SamplesDecoded,
+  Count
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Histogram in the style of HdrHistogram: each power of two is split into
+// kSubBucketCount buckets, so any recorded value is known to within about 3%
+// no matter its size, in a fixed 8 KB. Values from zero to kMaxValue (about
+// 68 seconds in nanoseconds) are tracked; larger ones count as kMaxValue.
+// Not thread-safe; AudioMetrics snapshots are LatencyHistograms.
+
+class LatencyHistogram
+{
+public:
+  static constexpr uint32_t kSubBucketBits = 5;
+  static constexpr size_t   kSubBucketCount = size_t( 1 ) << kSubBucketBits;
+  static constexpr uint64_t kMaxValue = ( uint64_t( 1 ) << 36 ) - 1;
+  static constexpr size_t   kBucketCount = ( 2 * kSubBucketCount ) + ( 30 * kSubBucketCount );
+
+  LatencyHistogram()
+    : buckets_( kBucketCount )
+  {
+  }
+
+  // Values below 2 * kSubBucketCount have a bucket each
+  static size_t GetBucketIndex( uint64_t value )
+  {
+    value = std::min( value, kMaxValue );
+    if( value < 2 * kSubBucketCount )
+      return static_cast<size_t>( value );
+    auto shift = static_cast<uint32_t>( std::bit_width( value ) ) - ( kSubBucketBits + 1 );
+    return ( shift + 1 ) * kSubBucketCount + static_cast<size_t>( ( value >> shift ) - kSubBucketCount );
+  }
+
+  // Largest value that lands in the bucket
+  static uint64_t GetBucketUpperBound( size_t index )
+  {
+    assert( index < kBucketCount );
+    if( index < 2 * kSubBucketCount )
+      return index;
+    auto shift = ( index / kSubBucketCount ) - 1;
+    auto subBucket = ( index % kSubBucketCount ) + kSubBucketCount;
+    return ( uint64_t( subBucket + 1 ) << shift ) - 1;
+  }
+
+  void Record( uint64_t value, uint64_t count = 1 )
+  {
+    buckets_[ GetBucketIndex( value ) ] += count;
+    count_ += count;
+    sum_ += value * count;
+    max_ = std::max( max_, value );
+  }
+
+  // Adds counts recorded elsewhere
+  void Add( size_t bucketIndex, uint64_t count )
+  {
+    buckets_[ bucketIndex ] += count;
+    count_ += count;
+  }
+
+  void Merge( const LatencyHistogram& histogram )
+  {
+    for( size_t i = 0; i < kBucketCount; ++i )
+      buckets_[ i ] += histogram.buckets_[ i ];
+    count_ += histogram.count_;
+    sum_ += histogram.sum_;
+    max_ = std::max( max_, histogram.max_ );
+  }
+
+  // What was recorded since earlier, a snapshot of the same histogram. The
+  // maximum can't be taken back out, so it's this histogram's.
+  LatencyHistogram Since( const LatencyHistogram& earlier ) const
+  {
+    LatencyHistogram histogram;
+    for( size_t i = 0; i < kBucketCount; ++i )
+      histogram.buckets_[ i ] = buckets_[ i ] - std::min( buckets_[ i ], earlier.buckets_[ i ] );
+    histogram.count_ = count_ - std::min( count_, earlier.count_ );
+    histogram.sum_ = sum_ - std::min( sum_, earlier.sum_ );
+    histogram.max_ = histogram.count_ ? max_ : 0;
+    return histogram;
+  }
+
+  void SetSumAndMax( uint64_t sum, uint64_t max )
+  {
+    sum_ = sum;
+    max_ = max;
+  }
+
+  uint64_t GetCount() const
+  {
+    return count_;
+  }
+
+  uint64_t GetMax() const
+  {
+    return max_;
+  }
+
+  double GetMean() const
+  {
+    return count_ ? static_cast<double>( sum_ ) / static_cast<double>( count_ ) : 0.0;
+  }
+
+  // Upper bound of the bucket holding the value at percentile (0 to 100);
+  // never more than the maximum recorded
+  uint64_t GetValueAtPercentile( double percentile ) const
+  {
+    if( count_ == 0 )
+      return 0;
+    auto rank = static_cast<uint64_t>( std::clamp( percentile, 0.0, 100.0 ) / 100.0 * static_cast<double>( count_ ) );
+    rank = std::clamp<uint64_t>( rank, 1, count_ );
+    uint64_t seen = 0;
+    for( size_t i = 0; i < kBucketCount; ++i )
+    {
+      seen += buckets_[ i ];
+      if( seen >= rank )
+        return std::min( GetBucketUpperBound( i ), max_ );
+    }
+    return max_;
+  }
+
+  uint64_t GetBucketCount( size_t index ) const
+  {
+    return buckets_[ index ];
+  }
+
+private:
+  std::vector<uint64_t> buckets_;
+  uint64_t              count_ = 0;
+  uint64_t              sum_ = 0;
+  uint64_t              max_ = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Process-wide instrumentation for the audio path; get it with
+// GetAudioMetrics(). Off until SetEnabled( true ), when each probe costs a
+// single relaxed load.
+//
+// Each thread that records gets its own block of counters, histograms and a
+// ring of its most recent trace events, and is the only writer to it, so
+// recording takes no locks and no atomic read-modify-writes; a thread's
+// first record registers its block. Snapshots and traces may be taken from
+// any thread at any time and add up every block. Blocks outlive their
+// threads; a new thread reuses one whose thread has exited, so the totals
+// keep every count. Counts are never reset; to report an interval, subtract
+// an earlier snapshot with Since().
+//
+//    GetAudioMetrics().SetEnabled( true );
+//    ...
+//    auto snapshot = GetAudioMetrics().GetSnapshot();
+//    auto p99 = snapshot.GetHistogram( AudioMetric::RefillTime ).GetValueAtPercentile( 99.0 );
+//    std::ofstream( "trace.json" ) << GetAudioMetrics().GetChromeTrace(); // open in chrome://tracing
+
+class AudioMetrics
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kMetricCount = static_cast<size_t>( AudioMetric::Count );
+  static constexpr size_t kCounterCount = static_cast<size_t>( AudioCounter::Count );
+  static constexpr size_t kTraceEventsPerThread = 2048;
+
+  struct Snapshot
+  {
+    std::array<uint64_t, kCounterCount>         counters = {};
+    std::array<LatencyHistogram, kMetricCount> histograms;
+
+    uint64_t GetCounter( AudioCounter counter ) const
+    {
+      return counters[ static_cast<size_t>( counter ) ];
+    }
+
+    const LatencyHistogram& GetHistogram( AudioMetric metric ) const
+    {
+      return histograms[ static_cast<size_t>( metric ) ];
+    }
+
+    Snapshot Since( const Snapshot& earlier ) const;
+
+    // Counters, then count, mean, max and percentiles of each histogram
+    std::string ToJson() const;
+  };
+
+  // Disable copy/move
+  AudioMetrics( const AudioMetrics& ) = delete;
+  AudioMetrics& operator=( const AudioMetrics& ) = delete;
+  AudioMetrics( AudioMetrics&& ) = delete;
+  AudioMetrics& operator=( AudioMetrics&& ) = delete;
+
+  void SetEnabled( bool isEnabled )
+  {
+    isEnabled_.store( isEnabled, std::memory_order_relaxed );
+  }
+
+  bool IsEnabled() const
+  {
+    return isEnabled_.load( std::memory_order_relaxed );
+  }
+
+  void Add( AudioCounter counter, uint64_t count = 1 )
+  {
+    if( IsEnabled() )
+      Increment( GetThreadMetrics().counters[ static_cast<size_t>( counter ) ], count );
+  }
+
+  // Counts one occurrence and traces it as an instant event
+  void Mark( AudioCounter counter, Clock::time_point time )
+  {
+    if( !IsEnabled() )
+      return;
+    auto& threadMetrics = GetThreadMetrics();
+    Increment( threadMetrics.counters[ static_cast<size_t>( counter ) ], 1 );
+    Trace( threadMetrics, kCounterEventBase + static_cast<uint32_t>( counter ), time, 1 );
+  }
+
+  // Records value, and traces it at time; for times, the span starts at time
+  void Record( AudioMetric metric, uint64_t value, Clock::time_point time )
+  {
+    if( !IsEnabled() )
+      return;
+    auto& threadMetrics = GetThreadMetrics();
+    auto index = static_cast<size_t>( metric );
+    Increment( threadMetrics.buckets[ index ][ LatencyHistogram::GetBucketIndex( value ) ], 1 );
+    Increment( threadMetrics.sums[ index ], value );
+    if( value > threadMetrics.maxes[ index ].load( std::memory_order_relaxed ) )
+      threadMetrics.maxes[ index ].store( value, std::memory_order_relaxed );
+    Trace( threadMetrics, static_cast<uint32_t>( metric ), time, value );
+  }
+
+  void Record( AudioMetric metric, Clock::time_point start, Clock::time_point end )
+  {
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count();
+    Record( metric, static_cast<uint64_t>( std::max<int64_t>( nanoseconds, 0 ) ), start );
+  }
+
+  Snapshot GetSnapshot() const;
+
+  // Most recent events of every thread in Chrome's trace event format (JSON),
+  // for chrome://tracing or ui.perfetto.dev. Times are spans, queue depth is
+  // a counter track and underruns are instant events.
+  std::string GetChromeTrace() const;
+
+private:
+  friend AudioMetrics& GetAudioMetrics();
+
+  AudioMetrics();
+
+  static constexpr uint32_t kCounterEventBase = 0x80;
+  static constexpr uint32_t kEventIdShift = 56;
+
+  using Buckets = std::array<std::atomic<uint64_t>, LatencyHistogram::kBucketCount>;
+
+  // Written under a per-event sequence number, so readers can tell an event
+  // being overwritten from a whole one
+  struct alignas( 32 ) TraceEvent
+  {
+    std::atomic<uint64_t> sequence = 0; // event number + 1; zero while written
+    std::atomic<uint64_t> time = 0;     // nanoseconds since the metrics were created
+    std::atomic<uint64_t> value = 0;    // event id in the top byte
+  };
+
+  // Everything but the buckets and events fits in two cache lines, so a
+  // probe touches few lines even when the thread has been asleep
+  struct alignas( 64 ) ThreadMetrics
+  {
+    std::array<std::atomic<uint64_t>, kCounterCount> counters = {};
+    std::array<std::atomic<uint64_t>, kMetricCount>  sums = {};
+    std::array<std::atomic<uint64_t>, kMetricCount>  maxes = {};
+    std::atomic<uint64_t>                            traceEventCount = 0;
+    std::atomic<bool>                                isInUse = false;
+    uint32_t                                         threadIndex = 0;
+    std::array<Buckets, kMetricCount>                buckets;
+    std::array<TraceEvent, kTraceEventsPerThread>    traceEvents;
+  };
+
+  // Releases the block when its thread exits
+  struct ThreadMetricsLease
+  {
+    ThreadMetrics* threadMetrics = nullptr;
+
+    ~ThreadMetricsLease()
+    {
+      if( threadMetrics != nullptr )
+        threadMetrics->isInUse.store( false, std::memory_order_release );
+    }
+  };
+
+  // Only the owning thread writes, so a load and a store will do
+  static void Increment( std::atomic<uint64_t>& value, uint64_t count )
+  {
+    value.store( value.load( std::memory_order_relaxed ) + count, std::memory_order_relaxed );
+  }
+
+  ThreadMetrics& GetThreadMetrics()
+  {
+    thread_local ThreadMetricsLease lease;
+    if( lease.threadMetrics == nullptr )
+      lease.threadMetrics = AcquireThreadMetrics();
+    return *lease.threadMetrics;
+  }
+
+  ThreadMetrics* AcquireThreadMetrics();
+
+  void Trace( ThreadMetrics& threadMetrics, uint32_t eventId, Clock::time_point time, uint64_t value )
+  {
+    auto index = threadMetrics.traceEventCount.load( std::memory_order_relaxed );
+    auto& traceEvent = threadMetrics.traceEvents[ index % kTraceEventsPerThread ];
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>( time - epoch_ ).count();
+    traceEvent.sequence.store( 0, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    traceEvent.time.store( static_cast<uint64_t>( std::max<int64_t>( nanoseconds, 0 ) ), std::memory_order_relaxed );
+    traceEvent.value.store( ( uint64_t( eventId ) << kEventIdShift ) | std::min( value, kMaxTraceValue ),
+                            std::memory_order_relaxed );
+    traceEvent.sequence.store( index + 1, std::memory_order_release );
+    threadMetrics.traceEventCount.store( index + 1, std::memory_order_release );
+  }
+
+  static constexpr uint64_t kMaxTraceValue = ( uint64_t( 1 ) << kEventIdShift ) - 1;
+
+private:
+  std::atomic<bool>                           isEnabled_ = false;
+  Clock::time_point                           epoch_;
+  mutable std::mutex                          mutex_; // guards the list, not the blocks
+  std::vector<std::unique_ptr<ThreadMetrics>> threadMetrics_;
+
+}; // class AudioMetrics
+
+inline AudioMetrics& GetAudioMetrics()
+{
+  static AudioMetrics audioMetrics;
+  return audioMetrics;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Records the time from construction to destruction, when metrics are enabled.
+// Code that reads the clock anyway can pass in its reading as the start, so
+// the timer only adds the read at the end.
+
+class AudioMetricTimer
+{
+public:
+  explicit AudioMetricTimer( AudioMetric metric )
+    : metric_( metric ),
+      isEnabled_( GetAudioMetrics().IsEnabled() )
+  {
+    if( isEnabled_ )
+      start_ = AudioMetrics::Clock::now();
+  }
+
+  AudioMetricTimer( AudioMetric metric, AudioMetrics::Clock::time_point start )
+    : start_( start ),
+      metric_( metric ),
+      isEnabled_( GetAudioMetrics().IsEnabled() )
+  {
+  }
+
+  ~AudioMetricTimer()
+  {
+    if( isEnabled_ )
+      GetAudioMetrics().Record( metric_, start_, AudioMetrics::Clock::now() );
+  }
+
+  // Disable copy/move
+  AudioMetricTimer( const AudioMetricTimer& ) = delete;
+  AudioMetricTimer& operator=( const AudioMetricTimer& ) = delete;
+  AudioMetricTimer( AudioMetricTimer&& ) = delete;
+  AudioMetricTimer& operator=( AudioMetricTimer&& ) = delete;
+
+  bool IsEnabled() const
+  {
+    return isEnabled_;
+  }
+
+  // Only meaningful if IsEnabled()
+  AudioMetrics::Clock::time_point GetStart() const
+  {
+    return start_;
+  }
+
+private:
+  AudioMetrics::Clock::time_point start_;
+  AudioMetric                     metric_;
+  bool                            isEnabled_;
+};
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  AudioThreadPriority.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+
+#if defined( _WIN32 )
+#define NOMINMAX 1
+#include "windows.h"
+#include "avrt.h"
+#pragma comment(lib, "avrt.lib")
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#endif
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Raises the calling thread to audio priority for the lifetime of the object.
+// On Windows the thread joins the MMCSS "Pro Audio" task, which boosts it
+// above normal threads without starving the system; if MMCSS is unavailable
+// it falls back to THREAD_PRIORITY_TIME_CRITICAL. Elsewhere it asks for
+// SCHED_FIFO, and where that isn't permitted (no CAP_SYS_NICE or rtprio
+// limit), for a lower nice value. Failure leaves the thread as it was, so
+// callers needn't check; IsRealTime() reports what was granted.
+//
+//    std::thread audioThread( [&] { AudioThreadPriority priority; for( ;; ) { ... } } );
+
+class AudioThreadPriority
+{
+public:
+  AudioThreadPriority()
+  {
+#if defined( _WIN32 )
+    DWORD taskIndex = 0;
+    mmcss_ = ::AvSetMmThreadCharacteristicsW( L"Pro Audio", &taskIndex );
+    if( mmcss_ != NULL )
+    {
+      ::AvSetMmThreadPriority( mmcss_, AVRT_PRIORITY_HIGH );
+      isRealTime_ = true;
+      return;
+    }
+    oldPriority_ = ::GetThreadPriority( ::GetCurrentThread() );
+    isRaised_ = ::SetThreadPriority( ::GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL ) != FALSE;
+#else
+    // Low in the FIFO range, so kernel threads and other real-time work still win
+    pthread_getschedparam( pthread_self(), &oldPolicy_, &oldParam_ );
+    sched_param param = {};
+    param.sched_priority = sched_get_priority_min( SCHED_FIFO ) + kFifoPriorityOffset;
+    if( pthread_setschedparam( pthread_self(), SCHED_FIFO, &param ) == 0 )
+    {
+      isRealTime_ = true;
+      return;
+    }
+
+    // Linux keeps a nice value per thread; PRIO_PROCESS 0 is this thread
+    oldNice_ = getpriority( PRIO_PROCESS, 0 );
+    isRaised_ = setpriority( PRIO_PROCESS, 0, kNiceValue ) == 0;
+#endif
+  }
+
+  ~AudioThreadPriority()
+  {
+#if defined( _WIN32 )
+    if( mmcss_ != NULL )
+      ::AvRevertMmThreadCharacteristics( mmcss_ );
+    else if( isRaised_ )
+      ::SetThreadPriority( ::GetCurrentThread(), oldPriority_ );
+#else
+    if( isRealTime_ )
+      pthread_setschedparam( pthread_self(), oldPolicy_, &oldParam_ );
+    else if( isRaised_ )
+      setpriority( PRIO_PROCESS, 0, oldNice_ );
+#endif
+  }
+
+  // Disable copy/move
+  AudioThreadPriority( const AudioThreadPriority& ) = delete;
+  AudioThreadPriority& operator=( const AudioThreadPriority& ) = delete;
+  AudioThreadPriority( AudioThreadPriority&& ) = delete;
+  AudioThreadPriority& operator=( AudioThreadPriority&& ) = delete;
+
+  // True if scheduled ahead of all normal threads (MMCSS or SCHED_FIFO)
+  bool IsRealTime() const
+  {
+    return isRealTime_;
+  }
+
+  // True if raised at all
+  bool IsRaised() const
+  {
+    return isRealTime_ || isRaised_;
+  }
+
+private:
+#if defined( _WIN32 )
+  HANDLE      mmcss_ = NULL;
+  int         oldPriority_ = THREAD_PRIORITY_NORMAL;
+#else
+  static constexpr int kFifoPriorityOffset = 10;
+  static constexpr int kNiceValue = -10;
+
+  int         oldPolicy_ = SCHED_OTHER;
+  sched_param oldParam_ = {};
+  int         oldNice_ = 0;
+#endif
+  bool        isRealTime_ = false;
+  bool        isRaised_ = false;
+
+}; // class AudioThreadPriority
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  BatchDecoder.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Decodes a list of files across a pool of worker threads. Each worker
+// constructs one FileDecoder, then repeatedly claims the next undecoded file
+// from a shared counter, so a worker that draws short files simply claims
+// more of them and no thread sits idle while work remains. Results are
+// returned in completion order, not list order.
+//
+// FileDecoder is constructed once per worker thread, which is where a
+// decoding library is initialized, and provides:
+//
+//    using Result = ...; // movable, with a size_t fileIndex member
+//    Result Decode( const std::filesystem::path& file );
+//
+// See WinMediaBatchDecoder for Media Foundation.
+
+template<typename FileDecoder>
+class BatchDecoder
+{
+public:
+  using Result = typename FileDecoder::Result;
+
+  explicit BatchDecoder( size_t workerCount = std::thread::hardware_concurrency() )
+    :
+    workerCount_( std::max<size_t>( workerCount, 1 ) )
+  {
+  }
+
+  // Disable copy/move
+  BatchDecoder( const BatchDecoder& ) = delete;
+  BatchDecoder& operator=( const BatchDecoder& ) = delete;
+  BatchDecoder( BatchDecoder&& ) = delete;
+  BatchDecoder& operator=( BatchDecoder&& ) = delete;
+
+  ~BatchDecoder()
+  {
+    Cancel();
+  }
+
+  // Any container of items convertible to std::filesystem::path, e.g. Util::FileList
+  template<typename FileList>
+  void Start( const FileList& fileList )
+  {
+    Cancel();
+    files_.assign( std::begin( fileList ), std::end( fileList ) );
+    nextFile_ = 0;
+    resultsTaken_ = 0;
+    isCancelled_ = false;
+    auto workerCount = std::min( workerCount_, files_.size() );
+    for( size_t i = 0; i < workerCount; ++i )
+      workers_.emplace_back( [this] { Worker(); } );
+  }
+
+  // Blocks until the next file finishes decoding; false once every file has
+  // been returned or the batch was cancelled
+  bool GetResult( Result& result )
+  {
+    std::unique_lock<std::mutex> lock( mutex_ );
+    resultReady_.wait( lock, [this] { return !results_.empty() || IsDone(); } );
+    if( results_.empty() )
+      return false;
+    result = std::move( results_.front() );
+    results_.pop_front();
+    ++resultsTaken_;
+    return true;
+  }
+
+  size_t GetFileCount() const
+  {
+    return files_.size();
+  }
+
+  // Files not yet started are skipped; files being decoded are finished first
+  void Cancel()
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      isCancelled_ = true;
+    }
+    resultReady_.notify_all();
+    for( auto& worker : workers_ )
+      worker.join();
+    workers_.clear();
+    results_.clear();
+  }
+
+private:
+
+  bool IsDone() const // mutex_ held
+  {
+    return isCancelled_ || resultsTaken_ == files_.size();
+  }
+
+  void Worker()
+  {
+    FileDecoder fileDecoder; // once per thread, not per file
+    for( ;; )
+    {
+      auto fileIndex = nextFile_.fetch_add( 1, std::memory_order_relaxed );
+      if( fileIndex >= files_.size() )
+        return;
+      {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if( isCancelled_ )
+          return;
+      }
+
+      auto result = fileDecoder.Decode( files_[ fileIndex ] );
+      result.fileIndex = fileIndex;
+      {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        results_.push_back( std::move( result ) );
+      }
+      resultReady_.notify_one();
+    }
+  }
+
+private:
+  std::vector<std::filesystem::path>  files_;
+  std::vector<std::thread>            workers_;
+  std::mutex                          mutex_;
+  std::condition_variable             resultReady_;
+  std::deque<Result>                  results_;  // completed, not yet returned
+  std::atomic<size_t>                 nextFile_ = 0;
+  size_t                              resultsTaken_ = 0;
+  size_t                              workerCount_;
+  bool                                isCancelled_ = false;
+
+}; // class BatchDecoder
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
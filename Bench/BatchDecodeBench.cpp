@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  BatchDecodeBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BatchDecoder.h"
+#include "Benchmark.h"
+#include "BenchFiles.h"
+#include "PcmPipeline.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// BatchDecoder scaling with worker count, decoding WAV files with
+// WavFileSource, so it runs without Media Foundation. WinMediaBatchDecoder
+// schedules its workers the same way.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr size_t   kBatchFiles = 64;
+constexpr uint32_t kBatchFileFrames = 44100 * 2; // two seconds each
+constexpr size_t   kBatchRepetitions = 5;
+constexpr size_t   kReadFrames = 4096;
+
+struct WavDecodeResult
+{
+  size_t               fileIndex = 0;
+  std::vector<uint8_t> pcm;
+  bool                 isDecoded = false;
+};
+
+class WavFileDecoder
+{
+public:
+  using Result = WavDecodeResult;
+
+  WavDecodeResult Decode( const std::filesystem::path& file )
+  {
+    WavDecodeResult result;
+    WavFileSource source;
+    if( !source.Open( file ) )
+      return result;
+    auto blockAlign = source.GetFormat().GetBlockAlign();
+    for( ;; )
+    {
+      auto size = result.pcm.size();
+      result.pcm.resize( size + kReadFrames * blockAlign );
+      auto frameCount = source.Read( result.pcm.data() + size, kReadFrames );
+      result.pcm.resize( size + frameCount * blockAlign );
+      if( frameCount == 0 )
+        break;
+    }
+    result.isDecoded = true;
+    return result;
+  }
+};
+
+// Each sample is the throughput of one whole batch
+void BenchBatchDecode( BenchmarkReport& report )
+{
+  TempDirectory directory( "WinShimBench.batchDecode" );
+  auto files = WriteWavFiles( directory.GetPath(), kBatchFiles, kBatchFileFrames );
+
+  std::vector<size_t> workerCounts = { 1, 2, 4, 8 };
+  auto hardwareThreads = static_cast<size_t>( std::thread::hardware_concurrency() );
+  if( std::find( workerCounts.begin(), workerCounts.end(), hardwareThreads ) == workerCounts.end() )
+    workerCounts.push_back( hardwareThreads );
+
+  for( auto workerCount : workerCounts )
+  {
+    std::vector<double> filesPerSec;
+    BatchDecoder<WavFileDecoder> batchDecoder( workerCount );
+    for( size_t r = 0; r <= kBatchRepetitions; ++r ) // the first warms the file cache
+    {
+      auto start = Clock::now();
+      batchDecoder.Start( files );
+      WavDecodeResult result;
+      size_t decodedCount = 0;
+      while( batchDecoder.GetResult( result ) )
+        decodedCount += result.isDecoded ? 1 : 0;
+      auto elapsedNs = GetElapsedNs( start );
+      if( r != 0 && decodedCount == files.size() )
+        filesPerSec.push_back( static_cast<double>( decodedCount ) * 1e9 / elapsedNs );
+    }
+    auto name = "batchDecode.workers." + std::to_string( workerCount );
+    report.Add( name.c_str(), kBatchFiles, std::move( filesPerSec ), "files/s" );
+  }
+}
+
+const BenchmarkRegistration kRegistration( "batchDecode", BenchBatchDecode );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  BenchFiles.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace PKIsensee
+{
+
+namespace Bench
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Generated files for the benchmarks that read from disk. Files are written
+// once per group and read several times, so timings include the OS file
+// cache but not the disk.
+
+// Removes itself and everything in it
+class TempDirectory
+{
+public:
+  explicit TempDirectory( const char* name )
+    : path_( std::filesystem::temp_directory_path() / name )
+  {
+    std::error_code error;
+    std::filesystem::remove_all( path_, error );
+    std::filesystem::create_directories( path_ );
+  }
+
+  ~TempDirectory()
+  {
+    std::error_code error;
+    std::filesystem::remove_all( path_, error );
+  }
+
+  // Disable copy/move
+  TempDirectory( const TempDirectory& ) = delete;
+  TempDirectory& operator=( const TempDirectory& ) = delete;
+  TempDirectory( TempDirectory&& ) = delete;
+  TempDirectory& operator=( TempDirectory&& ) = delete;
+
+  const std::filesystem::path& GetPath() const
+  {
+    return path_;
+  }
+
+private:
+  std::filesystem::path path_;
+
+}; // class TempDirectory
+
+// 16-bit PCM WAV of a 440 Hz tone, the same in every channel
+inline bool WriteWavFile( const std::filesystem::path& file, uint32_t frameCount,
+                          uint32_t samplesPerSec = 44100, uint16_t channels = 2 )
+{
+  constexpr double kPi = 3.14159265358979323846;
+  auto blockAlign = static_cast<uint32_t>( channels ) * 2;
+  auto dataBytes = frameCount * blockAlign;
+  std::vector<uint8_t> wav( 44 + size_t( dataBytes ) );
+  auto put = [&]( size_t offset, uint32_t value, size_t bytes )
+  {
+    for( size_t i = 0; i < bytes; ++i )
+      wav[ offset + i ] = static_cast<uint8_t>( value >> ( 8 * i ) );
+  };
+  std::memcpy( &wav[ 0 ], "RIFF", 4 );
+  put( 4, 36 + dataBytes, 4 );
+  std::memcpy( &wav[ 8 ], "WAVEfmt ", 8 );
+  put( 16, 16, 4 );
+  put( 20, 1, 2 ); // PCM
+  put( 22, channels, 2 );
+  put( 24, samplesPerSec, 4 );
+  put( 28, samplesPerSec * blockAlign, 4 );
+  put( 32, blockAlign, 2 );
+  put( 34, 16, 2 );
+  std::memcpy( &wav[ 36 ], "data", 4 );
+  put( 40, dataBytes, 4 );
+  for( uint32_t frame = 0; frame < frameCount; ++frame )
+  {
+    auto sample = static_cast<int16_t>( 8000.0 * std::sin( 2.0 * kPi * 440.0 * frame / samplesPerSec ) );
+    for( uint16_t c = 0; c < channels; ++c )
+      put( 44 + size_t( frame ) * blockAlign + c * 2u, static_cast<uint16_t>( sample ), 2 );
+  }
+
+  std::ofstream out( file, std::ios::binary );
+  out.write( reinterpret_cast<const char*>( wav.data() ), static_cast<std::streamsize>( wav.size() ) );
+  return static_cast<bool>( out );
+}
+
+// count files named 0.wav, 1.wav, ... in directory
+inline std::vector<std::filesystem::path> WriteWavFiles( const std::filesystem::path& directory, size_t count,
+                                                         uint32_t frameCount )
+{
+  std::vector<std::filesystem::path> files;
+  for( size_t i = 0; i < count; ++i )
+  {
+    files.push_back( directory / ( std::to_string( i ) + ".wav" ) );
+    WriteWavFile( files.back(), frameCount );
+  }
+  return files;
+}
+
+} // namespace Bench
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Benchmark.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace PKIsensee
+{
+
+namespace Bench
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Shared by the WinShimBench groups. Call benchmarks time kRepetitions
+// batches of calls and report the spread of the per-call mean across
+// batches; latency benchmarks report the spread of individual operations.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kRepetitions = 15;
+constexpr size_t kCallIterations = 100000;
+
+// Stores results where the optimizer can't discard the calls that made them
+inline volatile uintptr_t gSink = 0;
+
+template<typename T>
+void Keep( T value )
+{
+  gSink = static_cast<uintptr_t>( value );
+}
+
+inline double GetElapsedNs( Clock::time_point start )
+{
+  return std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+}
+
+// One warm-up batch, then kRepetitions timed batches of op() called
+// iterations times; each sample is the mean ns per call of one batch
+template<typename Op>
+std::vector<double> TimeBatches( size_t iterations, Op&& op )
+{
+  for( size_t i = 0; i < iterations; ++i )
+    op();
+  std::vector<double> samples;
+  samples.reserve( kRepetitions );
+  for( size_t r = 0; r < kRepetitions; ++r )
+  {
+    auto start = Clock::now();
+    for( size_t i = 0; i < iterations; ++i )
+      op();
+    samples.push_back( GetElapsedNs( start ) / static_cast<double>( iterations ) );
+  }
+  return samples;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Results, written as JSON. The unit defaults to ns; throughput and size
+// benchmarks name their own.
+
+class BenchmarkReport
+{
+public:
+  void Add( const char* name, size_t iterations, std::vector<double> samples, const char* unit = "ns" )
+  {
+    if( samples.empty() )
+      return;
+    std::sort( samples.begin(), samples.end() );
+    auto getPercentile = [&]( double percentile )
+    {
+      auto rank = static_cast<size_t>( percentile / 100.0 * static_cast<double>( samples.size() - 1 ) + 0.5 );
+      return samples[ rank ];
+    };
+    double sum = 0.0;
+    for( auto sample : samples )
+      sum += sample;
+
+    Result result;
+    result.name = name;
+    result.unit = unit;
+    result.iterations = iterations;
+    result.sampleCount = samples.size();
+    result.min = samples.front();
+    result.median = getPercentile( 50.0 );
+    result.p90 = getPercentile( 90.0 );
+    result.p99 = getPercentile( 99.0 );
+    result.max = samples.back();
+    result.mean = sum / static_cast<double>( samples.size() );
+    results_.push_back( result );
+    std::fprintf( stderr, "%-36s median %14.1f %s\n", name, result.median, unit );
+  }
+
+  std::string ToJson() const
+  {
+    char buffer[ 512 ];
+    std::snprintf( buffer, sizeof( buffer ),
+                   "{\n  \"context\": { \"build\": \"%s\", \"pointerBits\": %zu, \"hardwareThreads\": %u },\n"
+                   "  \"benchmarks\": [",
+#if defined( NDEBUG )
+                   "release",
+#else
+                   "debug",
+#endif
+                   sizeof( void* ) * 8, std::thread::hardware_concurrency() );
+    std::string json = buffer;
+    for( size_t i = 0; i < results_.size(); ++i )
+    {
+      const auto& r = results_[ i ];
+      std::snprintf( buffer, sizeof( buffer ),
+                     "%s\n    { \"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %zu, \"samples\": %zu, "
+                     "\"min\": %.1f, \"median\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f, \"mean\": %.1f }",
+                     ( i == 0 ) ? "" : ",", r.name.c_str(), r.unit.c_str(), r.iterations, r.sampleCount,
+                     r.min, r.median, r.p90, r.p99, r.max, r.mean );
+      json += buffer;
+    }
+    json += "\n  ]\n}\n";
+    return json;
+  }
+
+private:
+  struct Result
+  {
+    std::string name;
+    std::string unit;
+    size_t      iterations = 0; // calls per sample
+    size_t      sampleCount = 0;
+    double      min = 0.0;
+    double      median = 0.0;
+    double      p90 = 0.0;
+    double      p99 = 0.0;
+    double      max = 0.0;
+    double      mean = 0.0;
+  };
+
+  std::vector<Result> results_;
+
+}; // class BenchmarkReport
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Each benchmark file registers its groups at startup, so a build includes
+// exactly the groups whose sources it compiles:
+//
+//    const BenchmarkRegistration kRegistration( "probe", BenchProbe );
+
+using BenchmarkFn = void ( * )( BenchmarkReport& );
+
+struct BenchmarkGroup
+{
+  const char* name;
+  BenchmarkFn run;
+};
+
+inline std::vector<BenchmarkGroup>& GetBenchmarkGroups()
+{
+  static std::vector<BenchmarkGroup> benchmarkGroups;
+  return benchmarkGroups;
+}
+
+struct BenchmarkRegistration
+{
+  BenchmarkRegistration( const char* name, BenchmarkFn run )
+  {
+    GetBenchmarkGroups().push_back( { name, run } );
+  }
+};
+
+} // namespace Bench
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  ComPtrBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdint>
+
+#include "Benchmark.h"
+#include "ComPtr.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// ComPtr reference counting
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+// Minimal COM object; the owning ComPtr takes the first reference
+class BenchUnknown : public IUnknown
+{
+public:
+  BenchUnknown() = default;
+
+  // Disable copy/move
+  BenchUnknown( const BenchUnknown& ) = delete;
+  BenchUnknown& operator=( const BenchUnknown& ) = delete;
+  BenchUnknown( BenchUnknown&& ) = delete;
+  BenchUnknown& operator=( BenchUnknown&& ) = delete;
+
+  HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv ) override
+  {
+    if( ppv == nullptr )
+      return E_POINTER;
+    if( iid == __uuidof( IUnknown ) )
+    {
+      *ppv = static_cast<IUnknown*>( this );
+      AddRef();
+      return S_OK;
+    }
+    *ppv = nullptr;
+    return E_NOINTERFACE;
+  }
+
+  ULONG STDMETHODCALLTYPE AddRef() override
+  {
+    return ++refCount_;
+  }
+
+  ULONG STDMETHODCALLTYPE Release() override
+  {
+    auto refCount = --refCount_;
+    if( refCount == 0 )
+      delete this;
+    return refCount;
+  }
+
+private:
+  virtual ~BenchUnknown() = default; // see Release()
+
+  std::atomic<ULONG> refCount_ = 0;
+};
+
+void BenchComPtr( BenchmarkReport& report )
+{
+  ComPtr<IUnknown> object( new BenchUnknown );
+
+  // A copy is an AddRef and a Release; a move is neither
+  report.Add( "comPtr.copy", kCallIterations, TimeBatches( kCallIterations, [&]
+  {
+    ComPtr<IUnknown> copy( object );
+    Keep( reinterpret_cast<uintptr_t>( copy.Get() ) );
+  } ) );
+  report.Add( "comPtr.move", kCallIterations, TimeBatches( kCallIterations, [&]
+  {
+    ComPtr<IUnknown> moved( std::move( object ) );
+    object = std::move( moved );
+    Keep( reinterpret_cast<uintptr_t>( object.Get() ) );
+  } ) );
+}
+
+const BenchmarkRegistration kRegistration( "comPtr", BenchComPtr );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
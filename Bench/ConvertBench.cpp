@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  ConvertBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "PcmConvert.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// ConvertSamples() throughput at every SimdLevel this CPU supports, in
+// millions of samples per second. Blocks are the size of a typical device
+// buffer, so they stay in L1.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr size_t kBlockSamples = 4096;
+constexpr size_t kConvertIterations = 2000;
+
+struct Conversion
+{
+  const char*  name;
+  SampleFormat srcFormat;
+  SampleFormat dstFormat;
+  bool         isDithered;
+};
+
+const Conversion kConversions[] =
+{
+  { "floatToInt16",         SampleFormat::Float32, SampleFormat::Int16,   false },
+  { "floatToInt16.dither",  SampleFormat::Float32, SampleFormat::Int16,   true  },
+  { "floatToInt24",         SampleFormat::Float32, SampleFormat::Int24,   false },
+  { "floatToInt32",         SampleFormat::Float32, SampleFormat::Int32,   false },
+  { "int16ToFloat",         SampleFormat::Int16,   SampleFormat::Float32, false },
+  { "int24ToFloat",         SampleFormat::Int24,   SampleFormat::Float32, false },
+  { "int32ToFloat",         SampleFormat::Int32,   SampleFormat::Float32, false },
+};
+
+void BenchConvert( BenchmarkReport& report )
+{
+  // A loud tone, so some samples clamp
+  std::vector<float> tone( kBlockSamples );
+  for( size_t i = 0; i < kBlockSamples; ++i )
+    tone[ i ] = 1.1f * std::sin( static_cast<float>( i ) * 0.0627f );
+  std::vector<uint8_t> src( kBlockSamples * 4 );
+  std::vector<uint8_t> dst( kBlockSamples * 4 );
+
+  const SimdLevel simdLevels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::NEON };
+  for( auto simdLevel : simdLevels )
+  {
+    if( !IsSimdLevelSupported( simdLevel ) )
+      continue;
+    for( const auto& conversion : kConversions )
+    {
+      ConvertSamples( tone.data(), SampleFormat::Float32, src.data(), conversion.srcFormat, kBlockSamples );
+      TpdfDither dither;
+      auto* ditherIn = conversion.isDithered ? &dither : nullptr;
+      auto samples = TimeBatches( kConvertIterations, [&]
+      {
+        ConvertSamples( src.data(), conversion.srcFormat, dst.data(), conversion.dstFormat, kBlockSamples,
+                        ditherIn, simdLevel );
+      } );
+      Keep( dst[ 0 ] );
+      for( auto& sample : samples )
+        sample = static_cast<double>( kBlockSamples ) * 1e3 / sample; // ns per block to Msamples/s
+      auto name = std::string( "convert." ) + GetSimdLevelName( simdLevel ) + "." + conversion.name;
+      report.Add( name.c_str(), kConvertIterations, std::move( samples ), "Msamples/s" );
+    }
+  }
+}
+
+const BenchmarkRegistration kRegistration( "convert", BenchConvert );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
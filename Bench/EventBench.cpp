@@ -0,0 +1,224 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  EventBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Util.h"
+#include "Benchmark.h"
+#include "EventSet.h"
+
+#if !defined( _WIN32 )
+#include <time.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Util::Event and Util::EventSet. Needs the Util repository.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr size_t   kEventRoundTrips = 10000;
+constexpr uint32_t kWaitMs = 1000;
+constexpr size_t   kBroadcastWaiters = 4;
+constexpr size_t   kBroadcasts = 500;
+constexpr size_t   kPlayerEvents = 3;    // refill, command, decoder-ready
+constexpr size_t   kPlayerWakes = 600;
+constexpr uint32_t kPollMs = 1;          // the polling loop's timeout per event
+constexpr auto     kPlayerIdle = std::chrono::milliseconds( 2 ); // between signals
+
+// CPU time of the calling thread
+double GetThreadCpuNs()
+{
+#if defined( _WIN32 )
+  FILETIME creation, exit, kernel, user;
+  ::GetThreadTimes( ::GetCurrentThread(), &creation, &exit, &kernel, &user );
+  auto ticks = ( static_cast<uint64_t>( kernel.dwHighDateTime ) << 32 ) + kernel.dwLowDateTime +
+               ( static_cast<uint64_t>( user.dwHighDateTime ) << 32 ) + user.dwLowDateTime;
+  return static_cast<double>( ticks ) * 100.0; // 100 ns ticks
+#else
+  timespec now = {};
+  clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+  return ( static_cast<double>( now.tv_sec ) * 1e9 ) + static_cast<double>( now.tv_nsec );
+#endif
+}
+
+// A player thread serving kPlayerEvents events, one signalled every
+// kPlayerIdle in turn. waitForAny() returns the index of an event that fired.
+// Reports wake-up latency and the player thread's CPU use over the run.
+template<typename WaitForAny>
+void BenchPlayerThread( BenchmarkReport& report, const char* name, Util::Event ( &events )[ kPlayerEvents ],
+                        WaitForAny waitForAny )
+{
+  Util::Event served;
+  std::atomic<Clock::rep> signalTime = 0;
+  std::vector<double> wakeNs;
+  wakeNs.reserve( kPlayerWakes );
+  double cpuPercent = 0.0;
+  std::thread player( [&]
+  {
+    auto wallStart = Clock::now();
+    auto cpuStart = GetThreadCpuNs();
+    for( size_t i = 0; i < kPlayerWakes; ++i )
+    {
+      waitForAny();
+      auto start = Clock::time_point( Clock::duration( signalTime.load( std::memory_order_acquire ) ) );
+      wakeNs.push_back( GetElapsedNs( start ) );
+      served.Signal();
+    }
+    cpuPercent = ( GetThreadCpuNs() - cpuStart ) * 100.0 / GetElapsedNs( wallStart );
+  } );
+  for( size_t i = 0; i < kPlayerWakes; ++i )
+  {
+    std::this_thread::sleep_for( kPlayerIdle );
+    signalTime.store( Clock::now().time_since_epoch().count(), std::memory_order_release );
+    events[ i % kPlayerEvents ].Signal();
+    while( !served.IsSignalled( kWaitMs ) )
+      ;
+  }
+  player.join();
+  auto latencyName = std::string( "event.player." ) + name + ".wakeLatency";
+  report.Add( latencyName.c_str(), 1, std::move( wakeNs ) );
+  auto cpuName = std::string( "event.player." ) + name + ".cpu";
+  report.Add( cpuName.c_str(), kPlayerWakes, { cpuPercent }, "% core" );
+}
+
+// From SignalAll() to the last of kBroadcastWaiters threads waking. Each
+// broadcast waits until every waiter is in IsSignalled(); one that arrives
+// late anyway is released by the next SignalAll().
+void BenchSignalAll( BenchmarkReport& report )
+{
+  Util::Event event;
+  std::atomic<size_t> waitingCount = 0;
+  std::atomic<size_t> wokenCount = 0;
+  Clock::rep wakeTimes[ kBroadcastWaiters ] = {};
+  std::vector<std::thread> waiters;
+  for( size_t w = 0; w < kBroadcastWaiters; ++w )
+  {
+    waiters.emplace_back( [&, w]
+    {
+      for( size_t i = 0; i < kBroadcasts; ++i )
+      {
+        waitingCount.fetch_add( 1 );
+        while( !event.IsSignalled( kWaitMs ) )
+          ;
+        wakeTimes[ w ] = Clock::now().time_since_epoch().count();
+        wokenCount.fetch_add( 1 );
+      }
+    } );
+  }
+
+  std::vector<double> wakeNs;
+  wakeNs.reserve( kBroadcasts );
+  for( size_t i = 0; i < kBroadcasts; ++i )
+  {
+    auto expectedCount = ( i + 1 ) * kBroadcastWaiters;
+    while( waitingCount.load() < expectedCount )
+      std::this_thread::yield();
+    std::this_thread::sleep_for( std::chrono::microseconds( 200 ) ); // into their waits
+    auto start = Clock::now();
+    event.SignalAll();
+    while( wokenCount.load() < expectedCount )
+    {
+      if( GetElapsedNs( start ) > 100e6 )
+        event.SignalAll();
+      std::this_thread::yield();
+    }
+    Clock::rep lastWake = 0;
+    for( auto wakeTime : wakeTimes )
+      lastWake = std::max( lastWake, wakeTime );
+    wakeNs.push_back( static_cast<double>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::duration( lastWake ) - start.time_since_epoch() ).count() ) );
+  }
+  for( auto& waiter : waiters )
+    waiter.join();
+  report.Add( "event.signalAll.wakeLatency", 1, std::move( wakeNs ) );
+}
+
+void BenchEvent( BenchmarkReport& report )
+{
+  // The calls themselves, with no other thread involved
+  Util::Event event;
+  report.Add( "event.signalAndPoll", kCallIterations, TimeBatches( kCallIterations, [&]
+  {
+    event.Signal();
+    Keep( event.IsSignalled( 0 ) );
+  } ) );
+
+  // From Signal() on this thread to IsSignalled() returning on another. The
+  // waiter answers each wake-up, so only one signal is ever outstanding.
+  Util::Event ping;
+  Util::Event pong;
+  std::atomic<Clock::rep> signalTime = 0;
+  std::vector<double> wakeNs;
+  wakeNs.reserve( kEventRoundTrips );
+  std::thread waiter( [&]
+  {
+    for( size_t i = 0; i < kEventRoundTrips; ++i )
+    {
+      while( !ping.IsSignalled( kWaitMs ) )
+        ;
+      auto start = Clock::time_point( Clock::duration( signalTime.load( std::memory_order_acquire ) ) );
+      wakeNs.push_back( GetElapsedNs( start ) );
+      pong.Signal();
+    }
+  } );
+  for( size_t i = 0; i < kEventRoundTrips; ++i )
+  {
+    signalTime.store( Clock::now().time_since_epoch().count(), std::memory_order_release );
+    ping.Signal();
+    while( !pong.IsSignalled( kWaitMs ) )
+      ;
+  }
+  waiter.join();
+  report.Add( "event.wakeLatency", 1, std::move( wakeNs ) );
+  BenchSignalAll( report );
+
+  // A player thread waiting on several events: one EventSet wait against
+  // polling each event in turn with a short timeout
+  Util::Event playerEvents[ kPlayerEvents ];
+  {
+    Util::EventSet eventSet;
+    for( auto& playerEvent : playerEvents )
+      eventSet.Add( playerEvent );
+    BenchPlayerThread( report, "waitAny", playerEvents, [&]
+    {
+      while( eventSet.WaitAny( kWaitMs ) == 0 )
+        ;
+    } );
+  }
+  BenchPlayerThread( report, "polling", playerEvents, [&]
+  {
+    for( size_t i = 0; ; i = ( i + 1 ) % kPlayerEvents )
+      if( playerEvents[ i ].IsSignalled( kPollMs ) )
+        return;
+  } );
+}
+
+const BenchmarkRegistration kRegistration( "event", BenchEvent );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  MappedWaveBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "Benchmark.h"
+#include "BenchFiles.h"
+#include "WinMappedWaveSource.h"
+
+#include "psapi.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// WinMappedWaveSource against the copy path, where the whole file is read
+// into memory before playback as WaveOut::Open() does with PcmData.
+// Time-to-first-audio is from opening the file to holding the first
+// device buffer; resident memory is the largest growth of the working set
+// while every buffer is read and released as the device would.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr uint32_t kFileFrames = 44100 * 60 * 5; // five minutes, about 53 MB
+constexpr size_t   kDeviceBufferBytes = 44100 * 4 / 10; // 100 ms
+constexpr size_t   kFirstAudioRepetitions = 15;
+constexpr size_t   kResidentRepetitions = 3;
+constexpr double   kBytesPerMB = 1024.0 * 1024.0;
+
+size_t GetWorkingSetBytes()
+{
+  PROCESS_MEMORY_COUNTERS counters = {};
+  counters.cb = sizeof( counters );
+  if( !::GetProcessMemoryInfo( ::GetCurrentProcess(), &counters, sizeof( counters ) ) )
+    return 0;
+  return counters.WorkingSetSize;
+}
+
+std::vector<uint8_t> ReadWholeFile( const std::filesystem::path& file )
+{
+  std::ifstream stream( file, std::ios::binary );
+  std::vector<uint8_t> bytes( static_cast<size_t>( std::filesystem::file_size( file ) ) );
+  stream.read( reinterpret_cast<char*>( bytes.data() ), static_cast<std::streamsize>( bytes.size() ) );
+  return bytes;
+}
+
+void BenchMappedWave( BenchmarkReport& report )
+{
+  TempDirectory directory( "WinShimBench.mappedWave" );
+  auto file = directory.GetPath() / "long.wav";
+  if( !WriteWavFile( file, kFileFrames ) )
+    return;
+  ReadWholeFile( file ); // warms the file cache for both paths
+
+  std::vector<double> copyMs;
+  std::vector<double> mappedMs;
+  for( size_t r = 0; r < kFirstAudioRepetitions; ++r )
+  {
+    auto start = Clock::now();
+    {
+      auto pcm = ReadWholeFile( file );
+      auto first = std::make_unique<VectorPcmBuffer>(
+        std::vector<uint8_t>( pcm.begin(), pcm.begin() + kDeviceBufferBytes ) );
+      Keep( first->GetSize() );
+      copyMs.push_back( GetElapsedNs( start ) / 1e6 );
+    }
+
+    start = Clock::now();
+    WinMappedWaveSource source;
+    if( !source.Open( file ) )
+      return;
+    auto first = source.Read( kDeviceBufferBytes );
+    Keep( first->GetData()[ 0 ] );
+    mappedMs.push_back( GetElapsedNs( start ) / 1e6 );
+  }
+  report.Add( "mappedWave.firstAudio.copy", 1, std::move( copyMs ), "ms" );
+  report.Add( "mappedWave.firstAudio.mapped", 1, std::move( mappedMs ), "ms" );
+
+  std::vector<double> copyMB;
+  std::vector<double> mappedMB;
+  for( size_t r = 0; r < kResidentRepetitions; ++r )
+  {
+    {
+      auto baseline = GetWorkingSetBytes();
+      auto pcm = ReadWholeFile( file );
+      size_t peak = GetWorkingSetBytes();
+      for( size_t offset = 0; offset < pcm.size(); offset += kDeviceBufferBytes )
+        Keep( pcm[ offset ] );
+      peak = std::max( peak, GetWorkingSetBytes() );
+      copyMB.push_back( static_cast<double>( peak - std::min( peak, baseline ) ) / kBytesPerMB );
+    }
+
+    auto baseline = GetWorkingSetBytes();
+    size_t peak = baseline;
+    WinMappedWaveSource source;
+    if( !source.Open( file ) )
+      return;
+    while( auto pcm = source.Read( kDeviceBufferBytes ) )
+    {
+      for( size_t offset = 0; offset < pcm->GetSize(); offset += 4096 ) // touch every page
+        Keep( pcm->GetData()[ offset ] );
+      peak = std::max( peak, GetWorkingSetBytes() );
+    }
+    mappedMB.push_back( static_cast<double>( peak - baseline ) / kBytesPerMB );
+  }
+  report.Add( "mappedWave.resident.copy", 1, std::move( copyMB ), "MB" );
+  report.Add( "mappedWave.resident.mapped", 1, std::move( mappedMB ), "MB" );
+}
+
+const BenchmarkRegistration kRegistration( "mappedWave", BenchMappedWave );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  MixerBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "PcmBufferChain.h"
+#include "PcmMixer.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// PcmMixer::Mix() throughput at several voice counts, in voices/ms: the
+// milliseconds of voice audio mixed per millisecond of CPU. Looping 16-bit
+// stereo voices at different gains and pans are mixed into dithered 16-bit
+// stereo device blocks, as a refill thread would.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr uint32_t kSamplesPerSec = 48000;
+constexpr size_t   kBlockFrames = 256;
+constexpr size_t   kMixIterations = 500;
+constexpr size_t   kVoiceCounts[] = { 1, 8, 32, 64 };
+
+std::shared_ptr<const PcmBuffer> MakeTone( size_t frameCount )
+{
+  std::vector<uint8_t> pcm( frameCount * 2 * sizeof( int16_t ) );
+  for( size_t i = 0; i < frameCount * 2; ++i )
+  {
+    auto sample = static_cast<int16_t>( 8000.0 * std::sin( static_cast<double>( i ) * 0.0313 ) );
+    std::memcpy( pcm.data() + i * sizeof( int16_t ), &sample, sizeof( int16_t ) );
+  }
+  return std::make_shared<VectorPcmBuffer>( std::move( pcm ) );
+}
+
+void BenchMix( BenchmarkReport& report )
+{
+  auto tone = MakeTone( kSamplesPerSec );
+  std::vector<int16_t> out( kBlockFrames * 2 );
+  const double audioMs = kBlockFrames * 1000.0 / kSamplesPerSec;
+
+  for( auto voiceCount : kVoiceCounts )
+  {
+    PcmMixer mixer( 2, kSamplesPerSec );
+    for( size_t i = 0; i < voiceCount; ++i )
+    {
+      auto pan = static_cast<float>( i % 5 ) * 0.5f - 1.0f;
+      mixer.AddVoice( tone, SampleFormat::Int16, 2, 1.0f / static_cast<float>( voiceCount ), pan, true );
+    }
+    TpdfDither dither;
+    mixer.Mix( out.data(), SampleFormat::Int16, kBlockFrames, &dither ); // applies the AddVoice()s
+
+    auto samples = TimeBatches( kMixIterations, [&]
+    {
+      mixer.Mix( out.data(), SampleFormat::Int16, kBlockFrames, &dither );
+    } );
+    Keep( out[ 0 ] );
+    for( auto& sample : samples )
+      sample = static_cast<double>( voiceCount ) * audioMs * 1e6 / sample; // ns per block to voices/ms
+    auto name = "mixer.voices" + std::to_string( voiceCount );
+    report.Add( name.c_str(), kMixIterations, std::move( samples ), "voices/ms" );
+  }
+}
+
+const BenchmarkRegistration kRegistration( "mixer", BenchMix );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PipelineBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Benchmark.h"
+#include "BenchFiles.h"
+#include "PcmPipeline.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// PcmPipeline end to end: WavFileSource -> float -> resample to 48 kHz ->
+// DSP gain -> 16-bit -> NullPcmSink, with each threading model and several
+// block sizes, plus the source straight into the sink. Each sample is one
+// whole run over a 30-second file, as a multiple of real time.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr uint32_t kPipelineFileFrames = 44100 * 30;
+constexpr size_t   kBlockSizes[] = { 256, 1024, 4096 };
+
+// Audio seconds over elapsed seconds for one run; zero if it failed
+double RunPipeline( const std::filesystem::path& file, const PcmPipeline::Options& options, bool hasStages )
+{
+  WavFileSource source;
+  if( !source.Open( file ) )
+    return 0.0;
+  PcmConvertStage toFloat( SampleFormat::Float32 );
+  PcmResampleStage resample( 48000 );
+  PcmDspStage gain( []( float* samples, size_t frameCount, uint32_t channelCount )
+  {
+    for( size_t i = 0; i < frameCount * channelCount; ++i )
+      samples[ i ] *= 0.5f;
+  } );
+  PcmConvertStage toInt16( SampleFormat::Int16, true );
+  NullPcmSink sink( true );
+
+  PcmPipeline pipeline( source, sink );
+  if( hasStages )
+  {
+    pipeline.AddStage( toFloat );
+    pipeline.AddStage( resample );
+    pipeline.AddStage( gain );
+    pipeline.AddStage( toInt16 );
+  }
+  auto start = Clock::now();
+  if( !pipeline.Start( options ) )
+    return 0.0;
+  pipeline.Wait();
+  auto elapsedNs = GetElapsedNs( start );
+  Keep( sink.GetChecksum() );
+  auto audioNs = static_cast<double>( pipeline.GetFramesWritten() ) * 1e9 / sink.GetFormat().samplesPerSec;
+  return audioNs / elapsedNs;
+}
+
+void BenchPipeline( BenchmarkReport& report )
+{
+  TempDirectory directory( "WinShimBench.pipeline" );
+  auto file = directory.GetPath() / "tone.wav";
+  if( !WriteWavFile( file, kPipelineFileFrames ) )
+    return;
+
+  const std::pair<PcmPipeline::Threading, const char*> threadings[] =
+  {
+    { PcmPipeline::Threading::ThreadPerPart, "threadPerPart" },
+    { PcmPipeline::Threading::SharedWorkers, "sharedWorkers" },
+  };
+  for( const auto& threading : threadings )
+  {
+    for( auto framesPerBlock : kBlockSizes )
+    {
+      PcmPipeline::Options options;
+      options.framesPerBlock = framesPerBlock;
+      options.threading = threading.first;
+      for( bool hasStages : { false, true } )
+      {
+        std::vector<double> samples;
+        RunPipeline( file, options, hasStages ); // warm the file cache
+        for( size_t r = 0; r < kRepetitions; ++r )
+          samples.push_back( RunPipeline( file, options, hasStages ) );
+        auto name = std::string( "pipeline." ) + threading.second + ".block" + std::to_string( framesPerBlock ) +
+                    ( hasStages ? ".stages4" : ".passthrough" );
+        report.Add( name.c_str(), 1, std::move( samples ), "x realtime" );
+      }
+    }
+  }
+}
+
+const BenchmarkRegistration kRegistration( "pipeline", BenchPipeline );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
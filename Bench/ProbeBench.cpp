@@ -0,0 +1,216 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  ProbeBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "BenchFiles.h"
+#include "Benchmark.h"
+#include "MediaInfoCache.h"
+#include "MediaProbe.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Media header parsing and MediaInfoCache lookups
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr size_t   kCacheEntries = 100000; // a large library
+constexpr size_t   kProbeFiles = 256;
+constexpr uint32_t kProbeFileFrames = 44100; // one second; only the header is read
+constexpr uint32_t kSamplesPerSec = 44100;
+
+void WriteLE16( uint8_t* p, uint32_t value )
+{
+  p[ 0 ] = static_cast<uint8_t>( value );
+  p[ 1 ] = static_cast<uint8_t>( value >> 8 );
+}
+
+void WriteLE32( uint8_t* p, uint32_t value )
+{
+  WriteLE16( p, value );
+  WriteLE16( p + 2, value >> 16 );
+}
+
+void WriteBE32( uint8_t* p, uint32_t value )
+{
+  p[ 0 ] = static_cast<uint8_t>( value >> 24 );
+  p[ 1 ] = static_cast<uint8_t>( value >> 16 );
+  p[ 2 ] = static_cast<uint8_t>( value >> 8 );
+  p[ 3 ] = static_cast<uint8_t>( value );
+}
+
+// WAV and FLAC headers of ten minutes of 44.1 kHz 16-bit stereo
+std::vector<uint8_t> MakeWavHeader()
+{
+  constexpr uint32_t kDataBytes = kSamplesPerSec * 4 * 600;
+  std::vector<uint8_t> header( 44 );
+  std::memcpy( &header[ 0 ], "RIFF", 4 );
+  WriteLE32( &header[ 4 ], 36 + kDataBytes );
+  std::memcpy( &header[ 8 ], "WAVEfmt ", 8 );
+  WriteLE32( &header[ 16 ], 16 );
+  WriteLE16( &header[ 20 ], 1 ); // PCM
+  WriteLE16( &header[ 22 ], 2 );
+  WriteLE32( &header[ 24 ], kSamplesPerSec );
+  WriteLE32( &header[ 28 ], kSamplesPerSec * 4 );
+  WriteLE16( &header[ 32 ], 4 );
+  WriteLE16( &header[ 34 ], 16 );
+  std::memcpy( &header[ 36 ], "data", 4 );
+  WriteLE32( &header[ 40 ], kDataBytes );
+  return header;
+}
+
+std::vector<uint8_t> MakeFlacHeader()
+{
+  std::vector<uint8_t> header( 8 + 34 );
+  std::memcpy( &header[ 0 ], "fLaC", 4 );
+  header[ 7 ] = 34; // STREAMINFO length
+  uint8_t* p = &header[ 8 + 10 ];
+  p[ 0 ] = static_cast<uint8_t>( kSamplesPerSec >> 12 );
+  p[ 1 ] = static_cast<uint8_t>( kSamplesPerSec >> 4 );
+  p[ 2 ] = static_cast<uint8_t>( ( ( kSamplesPerSec & 0x0F ) << 4 ) | ( ( 2 - 1 ) << 1 ) );
+  p[ 3 ] = ( 16 - 1 ) << 4;
+  WriteBE32( p + 4, kSamplesPerSec * 600 );
+  return header;
+}
+
+// Constant bitrate MPEG-1 layer III, 128 kbps joint stereo, 417 byte frames
+std::vector<uint8_t> MakeMp3Header()
+{
+  constexpr size_t kFrameBytes = 417;
+  std::vector<uint8_t> header( kFrameBytes * 4 );
+  for( size_t pos = 0; pos < header.size(); pos += kFrameBytes )
+  {
+    header[ pos ] = 0xFF;
+    header[ pos + 1 ] = 0xFB;
+    header[ pos + 2 ] = 0x90;
+    header[ pos + 3 ] = 0x64;
+  }
+  return header;
+}
+
+void BenchProbe( BenchmarkReport& report )
+{
+  // In the order ProbeMediaHeaders() tries them, so each format pays for the
+  // parsers that reject it first
+  auto probe = []( const std::vector<uint8_t>& header, MediaInfo& info )
+  {
+    return MediaProbe::ParseWav( header.data(), header.size(), header.size(), info ) ||
+           MediaProbe::ParseFlac( header.data(), header.size(), info ) ||
+           MediaProbe::ParseMp3( header.data(), header.size(), 10 * 1024 * 1024, info );
+  };
+  struct Header
+  {
+    const char*          name;
+    std::vector<uint8_t> bytes;
+  };
+  const Header headers[] =
+  {
+    { "probe.wav",  MakeWavHeader() },
+    { "probe.flac", MakeFlacHeader() },
+    { "probe.mp3",  MakeMp3Header() },
+  };
+  for( const auto& header : headers )
+  {
+    MediaInfo info;
+    report.Add( header.name, kCallIterations, TimeBatches( kCallIterations, [&]
+    {
+      Keep( probe( header.bytes, info ) );
+    } ) );
+  }
+
+  // An index of a large library; lookups cycle through every entry
+  std::vector<std::string> paths;
+  paths.reserve( kCacheEntries );
+  {
+    MediaInfoCache builder;
+    MediaInfo info;
+    info.samplesPerSec = kSamplesPerSec;
+    info.channels = 2;
+    info.bitsPerSample = 16;
+    for( size_t i = 0; i < kCacheEntries; ++i )
+    {
+      paths.push_back( "C:\\Music\\Artist " + std::to_string( i / 100 ) + "\\Album " + std::to_string( i / 10 % 10 ) +
+                       "\\Track " + std::to_string( i % 10 ) + ".flac" );
+      info.durationMs = 180000 + i;
+      builder.Insert( paths.back(), 30000000 + i, static_cast<int64_t>( i ), info );
+    }
+    auto serializeMs = TimeBatches( 1, [&]
+    {
+      Keep( builder.Serialize().size() );
+    } );
+    for( auto& sample : serializeMs )
+      sample /= 1e6;
+    report.Add( "mediaInfoCache.serialize", 1, serializeMs, "ms" );
+
+    // Lookups in a loaded image, as after startup
+    auto image = builder.Serialize();
+    MediaInfoCache cache;
+    cache.Load( image.data(), image.size() );
+    size_t next = 0;
+    report.Add( "mediaInfoCache.find", kCallIterations, TimeBatches( kCallIterations, [&]
+    {
+      MediaInfo found;
+      Keep( cache.Find( paths[ next ], 30000000 + next, static_cast<int64_t>( next ), found ) );
+      next = ( next + 1 ) % kCacheEntries;
+    } ) );
+
+    // Lookups of entries added since the load, as during the first scan
+    report.Add( "mediaInfoCache.find.added", kCallIterations, TimeBatches( kCallIterations, [&]
+    {
+      MediaInfo found;
+      Keep( builder.Find( paths[ next ], 30000000 + next, static_cast<int64_t>( next ), found ) );
+      next = ( next + 1 ) % kCacheEntries;
+    } ) );
+  }
+}
+
+// Whole-file probes, as when scanning a library: open, read the header, parse.
+// Samples are files per second over every file.
+void BenchProbeFiles( BenchmarkReport& report )
+{
+  TempDirectory directory( "WinShimBench.probe" );
+  auto files = WriteWavFiles( directory.GetPath(), kProbeFiles, kProbeFileFrames );
+  auto probeAll = [&]
+  {
+    MediaInfo info;
+    for( const auto& file : files )
+      Keep( ProbeMediaHeaders( file, info ) );
+  };
+  probeAll();
+  std::vector<double> samples;
+  samples.reserve( kRepetitions );
+  for( size_t r = 0; r < kRepetitions; ++r )
+  {
+    auto start = Clock::now();
+    probeAll();
+    samples.push_back( static_cast<double>( files.size() ) * 1e9 / GetElapsedNs( start ) );
+  }
+  report.Add( "probe.files", files.size(), samples, "files/s" );
+}
+
+const BenchmarkRegistration kRegistration( "probe", BenchProbe );
+const BenchmarkRegistration kFilesRegistration( "probe.files", BenchProbeFiles );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  RegistryBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+
+#include "Benchmark.h"
+#include "RegistryBackend.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Lookups through the installed RegistryBackend, answered by a MemoryRegistry,
+// so results don't depend on the machine or even the platform. This is what
+// Util::GetRegistryValue() does once a backend is set; WinRegistryBench.cpp
+// times the real registry.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr size_t kRegistryIterations = 1000;
+constexpr size_t kRegistryKeys = 100;
+constexpr size_t kEntriesPerKey = 10;
+
+std::string GetPath( size_t key )
+{
+  return "SOFTWARE\\PKIsensee\\Bench\\Key" + std::to_string( key );
+}
+
+std::string GetEntry( size_t entry )
+{
+  return "Entry" + std::to_string( entry );
+}
+
+void BenchRegistry( BenchmarkReport& report )
+{
+  MemoryRegistry memoryRegistry;
+  for( size_t key = 0; key < kRegistryKeys; ++key )
+    for( size_t entry = 0; entry < kEntriesPerKey; ++entry )
+      memoryRegistry.SetValue( GetPath( key ), GetEntry( entry ), "Value of " + GetEntry( entry ) );
+  SetRegistryBackend( [&]( const std::string& registryPath, const std::string& registryEntry )
+                      { return memoryRegistry.GetValue( registryPath, registryEntry ); } );
+
+  const std::string path = GetPath( kRegistryKeys / 2 );
+  const std::string entry = GetEntry( kEntriesPerKey / 2 );
+  const std::string missingEntry = GetEntry( kEntriesPerKey );
+  report.Add( "registry.getValue", kRegistryIterations, TimeBatches( kRegistryIterations, [&]
+  {
+    Keep( GetRegistryBackend()( path, entry ).size() );
+  } ) );
+  report.Add( "registry.getValue.missing", kRegistryIterations, TimeBatches( kRegistryIterations, [&]
+  {
+    Keep( GetRegistryBackend()( path, missingEntry ).size() );
+  } ) );
+
+  SetRegistryBackend( {} );
+}
+
+const BenchmarkRegistration kRegistration( "registry", BenchRegistry );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  ResamplerBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Benchmark.h"
+#include "PcmResampler.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// PcmResampler::Process() speed for stereo at every quality, as a multiple of
+// real time: a block's playing time over the CPU time to resample it.
+// PcmResampler.h promises well under 1% of a core, i.e. well over 100x, for
+// 44.1 -> 48 kHz.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr size_t kBlockFrames = 1024;
+constexpr size_t kResampleIterations = 200;
+
+struct Ratio
+{
+  const char* name;
+  uint32_t    inSamplesPerSec;
+  uint32_t    outSamplesPerSec;
+};
+
+const Ratio kRatios[] =
+{
+  { "44k1To48k", 44100,  48000 },
+  { "48kTo44k1", 48000,  44100 },
+  { "48kTo96k",  48000,  96000 },
+  { "192kTo8k",  192000, 8000  },
+};
+
+const std::pair<PcmResampler::Quality, const char*> kQualities[] =
+{
+  { PcmResampler::Quality::Fast,     "fast"     },
+  { PcmResampler::Quality::Balanced, "balanced" },
+  { PcmResampler::Quality::Best,     "best"     },
+};
+
+void BenchResample( BenchmarkReport& report )
+{
+  std::vector<float> in( kBlockFrames * 2 );
+  for( size_t i = 0; i < in.size(); ++i )
+    in[ i ] = 0.5f * std::sin( static_cast<float>( i ) * 0.0627f );
+
+  for( const auto& ratio : kRatios )
+  {
+    for( const auto& quality : kQualities )
+    {
+      PcmResampler resampler( 2, ratio.inSamplesPerSec, ratio.outSamplesPerSec, quality.first );
+      std::vector<float> out( resampler.GetMaxOutputFrames( kBlockFrames ) * 2 );
+      auto samples = TimeBatches( kResampleIterations, [&]
+      {
+        Keep( resampler.Process( in.data(), kBlockFrames, out.data() ) );
+      } );
+      const double blockNs = kBlockFrames * 1e9 / ratio.inSamplesPerSec;
+      for( auto& sample : samples )
+        sample = blockNs / sample; // ns per block to multiple of real time
+      auto name = std::string( "resampler." ) + ratio.name + "." + quality.second;
+      report.Add( name.c_str(), kResampleIterations, std::move( samples ), "x realtime" );
+    }
+  }
+}
+
+const BenchmarkRegistration kRegistration( "resampler", BenchResample );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,226 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WaveOutBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Util.h"
+#include "AudioMetrics.h"
+#include "Benchmark.h"
+#include "NullWaveSink.h"
+#include "PcmData.h"
+#include "WaveOut.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// WaveOut on a NullWaveSink. Needs the Util and Audio repositories.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr uint32_t kWaveOutCycles = 400;
+constexpr size_t   kWaveBufferCount = 4;
+constexpr uint32_t kToneSeconds = 60;
+constexpr uint32_t kSamplesPerSec = 44100;
+constexpr uint32_t kWaitMs = 1000;
+
+// Latency sweep: each setting plays kSweepSeconds on a real-time device
+// while the refill thread is stalled now and then, as a busy system would
+constexpr uint32_t kSweepLatencyMs[] = { 20, 40, 80, 160, 320 };
+constexpr size_t   kSweepWaveBufferCount = 2;
+constexpr uint32_t kSweepSeconds = 2;
+constexpr uint32_t kStallPercent = 10;
+constexpr uint32_t kMaxStallMs = 25;
+
+// kToneSeconds of a 440 Hz 16-bit stereo tone
+PcmData MakeTone()
+{
+  constexpr double kPi = 3.14159265358979323846;
+  std::vector<uint8_t> pcm( size_t( kSamplesPerSec ) * kToneSeconds * 4 );
+  for( size_t frame = 0; frame < pcm.size() / 4; ++frame )
+  {
+    auto sample = static_cast<int16_t>( 8000.0 * std::sin( 2.0 * kPi * 440.0 * static_cast<double>( frame ) / kSamplesPerSec ) );
+    std::memcpy( &pcm[ frame * 4 ], &sample, sizeof( sample ) );
+    std::memcpy( &pcm[ frame * 4 + 2 ], &sample, sizeof( sample ) );
+  }
+  return PcmData( 2, kSamplesPerSec, 16, std::move( pcm ) );
+}
+
+// Plays the tone kWaveOutCycles times on a device that consumes buffers as
+// fast as they arrive, timing every Prepare() and Update() and counting the
+// buffers each Update() refilled. AudioMetrics probes are enabled for a
+// random half of the calls, so calls with and without them see the same
+// conditions. An Update() that refills nothing takes a fraction of one that
+// refills every buffer, so the probes' cost is the difference in median time
+// between calls that refilled the same number of buffers, weighted by how
+// often each number came up. Their overhead is that cost for every Update()
+// as a share of the audio played: the share of a core the probes take during
+// real-time playback. Against Update() on this device, which does no work, a
+// single clock read is already a few percent.
+void RunWaveOutCycles( BenchmarkReport& report, const PcmData& pcmData )
+{
+  SetWaveSinkFactory( [] { return std::make_unique<NullWaveSink>( 0.0 ); } );
+
+  uint32_t random = 12345;
+  auto isRandomHalf = [&]
+  {
+    random = random * 1664525 + 1013904223; // LCG; see Numerical Recipes
+    return ( random >> 16 ) & 1;
+  };
+
+  std::vector<double> prepareNs[ 2 ]; // without, with metrics
+  std::vector<double> updateNs[ 2 ];
+  std::map<size_t, std::vector<double>> updateNsByRecycled[ 2 ];
+  std::vector<double> recycled;
+  {
+    Util::Event callbackEvent;
+    WaveOut waveOut;
+    waveOut.OpenBorrowed( pcmData, callbackEvent );
+    for( uint32_t cycle = 0; cycle < kWaveOutCycles; ++cycle )
+    {
+      auto isMetricsEnabled = isRandomHalf();
+      GetAudioMetrics().SetEnabled( isMetricsEnabled );
+      auto start = Clock::now();
+      waveOut.Prepare( 0, kWaveBufferCount );
+      prepareNs[ isMetricsEnabled ].push_back( GetElapsedNs( start ) );
+      waveOut.Start();
+      while( !waveOut.HasEnded() )
+      {
+        if( !callbackEvent.IsSignalled( kWaitMs ) )
+          continue;
+        isMetricsEnabled = isRandomHalf();
+        GetAudioMetrics().SetEnabled( isMetricsEnabled );
+        start = Clock::now();
+        waveOut.Update();
+        auto elapsedNs = GetElapsedNs( start );
+        updateNs[ isMetricsEnabled ].push_back( elapsedNs );
+        updateNsByRecycled[ isMetricsEnabled ][ waveOut.GetRecycledCount() ].push_back( elapsedNs );
+        recycled.push_back( double( waveOut.GetRecycledCount() ) );
+      }
+    }
+    waveOut.Close();
+  }
+
+  GetAudioMetrics().SetEnabled( false );
+  SetWaveSinkFactory( {} );
+  auto getMedian = []( std::vector<double> samples )
+  {
+    std::sort( samples.begin(), samples.end() );
+    return samples.empty() ? 0.0 : samples[ samples.size() / 2 ];
+  };
+  double probeNs = 0.0;
+  double weight = 0.0;
+  for( const auto& [ recycledCount, withoutNs ] : updateNsByRecycled[ 0 ] )
+  {
+    auto with = updateNsByRecycled[ 1 ].find( recycledCount );
+    if( with == updateNsByRecycled[ 1 ].end() )
+      continue;
+    auto count = double( withoutNs.size() + with->second.size() );
+    probeNs += ( getMedian( with->second ) - getMedian( withoutNs ) ) * count;
+    weight += count;
+  }
+  probeNs = ( weight > 0.0 ) ? std::max( probeNs / weight, 0.0 ) : 0.0;
+  auto updates = double( updateNs[ 0 ].size() + updateNs[ 1 ].size() );
+  auto playedNs = double( kWaveOutCycles ) * kToneSeconds * 1e9;
+  auto overheadPercent = probeNs * updates / playedNs * 100.0;
+  report.Add( "waveOut.prepare", 1, std::move( prepareNs[ 0 ] ) );
+  report.Add( "waveOut.prepare.metrics", 1, std::move( prepareNs[ 1 ] ) );
+  report.Add( "waveOut.update", 1, std::move( updateNs[ 0 ] ) );
+  report.Add( "waveOut.update.metrics", 1, std::move( updateNs[ 1 ] ) );
+  report.Add( "waveOut.update.metricsProbe", 1, { probeNs } );
+  report.Add( "waveOut.update.metricsOverhead", 1, { overheadPercent }, "% playback" );
+  report.Add( "waveOut.update.recycled", 1, std::move( recycled ), "buffers" );
+}
+
+// Polled while a real-time device plays, as a UI would
+void RunGetPositionMs( BenchmarkReport& report, const PcmData& pcmData )
+{
+  SetWaveSinkFactory( [] { return std::make_unique<NullWaveSink>( 1.0 ); } );
+  {
+    Util::Event callbackEvent;
+    WaveOut waveOut;
+    waveOut.OpenBorrowed( pcmData, callbackEvent );
+    waveOut.Prepare( 0, kWaveBufferCount );
+    waveOut.Start();
+    report.Add( "waveOut.getPositionMs", kCallIterations,
+                TimeBatches( kCallIterations, [&] { Keep( waveOut.GetPositionMs() ); } ) );
+    waveOut.Close();
+  }
+  SetWaveSinkFactory( {} );
+}
+
+// For each latency setting, reports how far behind the listener hears a
+// change (the audio queued once underruns have adapted the buffer count)
+// and how many underruns it took to get there. Stalls come from a fixed
+// seed, so every setting sees the same sequence.
+void RunLatencySweep( BenchmarkReport& report, const PcmData& pcmData )
+{
+  SetWaveSinkFactory( [] { return std::make_unique<NullWaveSink>( 1.0 ); } );
+  for( auto latencyMs : kSweepLatencyMs )
+  {
+    uint32_t random = 12345;
+    auto getRandom = [&]( uint32_t range )
+    {
+      random = random * 1664525 + 1013904223; // LCG; see Numerical Recipes
+      return ( random >> 8 ) % range;
+    };
+
+    Util::Event callbackEvent;
+    WaveOut waveOut;
+    waveOut.OpenBorrowed( pcmData, callbackEvent );
+    waveOut.SetLatencyMs( latencyMs );
+    waveOut.Prepare( 0, kSweepWaveBufferCount );
+    waveOut.Start();
+    auto start = Clock::now();
+    while( Clock::now() - start < std::chrono::seconds( kSweepSeconds ) )
+    {
+      if( !callbackEvent.IsSignalled( kWaitMs ) )
+        continue;
+      if( getRandom( 100 ) < kStallPercent )
+        std::this_thread::sleep_for( std::chrono::milliseconds( getRandom( kMaxStallMs ) + 1 ) );
+      waveOut.Update();
+    }
+    auto name = "waveOut.latency." + std::to_string( latencyMs );
+    report.Add( ( name + ".queued" ).c_str(), 1, { double( waveOut.GetLatencyMs() ) }, "ms" );
+    report.Add( ( name + ".underruns" ).c_str(), 1, { double( waveOut.GetUnderrunCount() ) }, "count" );
+    waveOut.Close();
+  }
+  SetWaveSinkFactory( {} );
+}
+
+void BenchWaveOut( BenchmarkReport& report )
+{
+  auto pcmData = MakeTone();
+  RunWaveOutCycles( report, pcmData ); // including the cost of AudioMetrics probes
+  RunGetPositionMs( report, pcmData );
+  RunLatencySweep( report, pcmData );
+}
+
+const BenchmarkRegistration kRegistration( "waveOut", BenchWaveOut );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
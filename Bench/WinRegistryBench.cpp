@@ -0,0 +1,59 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinRegistryBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+
+#include "Util.h"
+#include "Benchmark.h"
+#include "RegistryBackend.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Util::GetRegistryValue() on HKEY_LOCAL_MACHINE, with no backend installed.
+// Results vary with the machine; RegistryBench.cpp has the repeatable ones.
+// Windows only.
+
+using namespace PKIsensee;
+using namespace PKIsensee::Bench;
+
+namespace
+{
+
+constexpr size_t kRegistryIterations = 100;
+
+void BenchRegistryHklm( BenchmarkReport& report )
+{
+  // Present on every Windows installation
+  const std::string path = "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion";
+  const std::string entry = "ProductName";
+  const std::string missingEntry = "PKIsenseeBenchMissing";
+  SetRegistryBackend( {} );
+
+  report.Add( "registry.hklm.getValue", kRegistryIterations, TimeBatches( kRegistryIterations, [&]
+  {
+    Keep( Util::GetRegistryValue( path, entry ).size() );
+  } ) );
+  report.Add( "registry.hklm.getValue.missing", kRegistryIterations, TimeBatches( kRegistryIterations, [&]
+  {
+    Keep( Util::GetRegistryValue( path, missingEntry ).size() );
+  } ) );
+}
+
+const BenchmarkRegistration kRegistration( "registry.hklm", BenchRegistryHklm );
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
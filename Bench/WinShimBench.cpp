@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinShimBench.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include "Benchmark.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Benchmarks for the audio path and the calls around it. Every input is
+// generated, and devices are NullWaveSinks, so runs on different machines
+// differ only by the machine. Results are written as JSON, one entry per
+// benchmark, for comparing builds:
+//
+//    WinShimBench [--filter <group>] [--out <file>] [--list]
+//
+// Each *Bench.cpp file registers its groups; --list names those in this
+// build. Groups that need the Util and Audio repositories or Windows are
+// left out of builds without them (see CMakeLists.txt). A filter runs the
+// groups whose name starts with it.
+
+using namespace PKIsensee::Bench;
+
+int main( int argc, char** argv )
+{
+  std::string filter;
+  std::string outFile;
+  bool isListing = false;
+  for( int i = 1; i < argc; ++i )
+  {
+    if( std::strcmp( argv[ i ], "--list" ) == 0 )
+      isListing = true;
+    else if( std::strcmp( argv[ i ], "--filter" ) == 0 && i + 1 < argc )
+      filter = argv[ ++i ];
+    else if( std::strcmp( argv[ i ], "--out" ) == 0 && i + 1 < argc )
+      outFile = argv[ ++i ];
+  }
+
+  // Registration order depends on link order; run in name order instead
+  auto benchmarkGroups = GetBenchmarkGroups();
+  std::sort( benchmarkGroups.begin(), benchmarkGroups.end(), []( const auto& lhs, const auto& rhs )
+  {
+    return std::string_view( lhs.name ) < std::string_view( rhs.name );
+  } );
+  if( isListing )
+  {
+    for( const auto& benchmarkGroup : benchmarkGroups )
+      std::printf( "%s\n", benchmarkGroup.name );
+    return 0;
+  }
+
+  BenchmarkReport report;
+  for( const auto& benchmarkGroup : benchmarkGroups )
+  {
+    if( std::string_view( benchmarkGroup.name ).starts_with( filter ) )
+      benchmarkGroup.run( report );
+  }
+
+  auto json = report.ToJson();
+  if( outFile.empty() )
+  {
+    std::fputs( json.c_str(), stdout );
+    return 0;
+  }
+  std::ofstream out( outFile, std::ios::binary );
+  out << json;
+  return out ? 0 : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,296 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  BufferPool.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Recycles buffers that are expensive to allocate, such as IMFMediaBuffers
+// (see WinMediaBufferPool). Acquire() returns a Lease holding the smallest
+// idle buffer at least as large as requested, or a new one from the allocate
+// function; the buffer goes back to the pool when the Lease is destroyed,
+// which may happen on another thread and after the pool itself is gone.
+// Capacities are rounded up to a power of two so that packets whose sizes
+// vary slightly share buffers. At most maxIdleBuffers are kept; beyond that,
+// the smaller of the returned buffer and the smallest idle one is freed.
+//
+//    BufferPool<std::vector<uint8_t>> pool( []( size_t bytes ) { return std::vector<uint8_t>( bytes ); } );
+//    auto lease = pool.Acquire( bytes );
+//    memcpy( lease.Get().data(), pcm, bytes );
+//
+// GetStats() may be called from any thread.
+
+template<typename Buffer>
+class BufferPool
+{
+  struct Shared;
+
+public:
+  using Allocator = std::function<Buffer( size_t capacity )>;
+
+  static constexpr size_t kMinCapacity = 1024;
+  static constexpr size_t kDefaultMaxIdleBuffers = 16;
+
+  struct Stats
+  {
+    uint64_t acquireCount = 0;
+    uint64_t hitCount = 0;        // served by an idle buffer
+    uint64_t allocationCount = 0; // calls to the allocator
+    uint64_t discardCount = 0;    // returned to a full pool and freed
+    size_t   idleCount = 0;
+
+    double GetHitRate() const
+    {
+      return acquireCount ? static_cast<double>( hitCount ) / static_cast<double>( acquireCount ) : 0.0;
+    }
+  };
+
+  /////////////////////////////////////////////////////////////////////////////
+  //
+  // Exclusive use of one buffer; move-only
+
+  class Lease
+  {
+  public:
+    Lease() = default;
+
+    // Wraps a buffer that doesn't belong to any pool; it is simply destroyed
+    explicit Lease( Buffer buffer )
+      : buffer_( std::move( buffer ) )
+    {
+    }
+
+    Lease( Lease&& lease ) noexcept
+      : shared_( std::move( lease.shared_ ) ),
+        buffer_( std::move( lease.buffer_ ) ),
+        capacity_( lease.capacity_ )
+    {
+    }
+
+    Lease& operator=( Lease&& lease ) noexcept
+    {
+      if( this != &lease )
+      {
+        Return();
+        shared_ = std::move( lease.shared_ );
+        buffer_ = std::move( lease.buffer_ );
+        capacity_ = lease.capacity_;
+      }
+      return *this;
+    }
+
+    // Disable copy
+    Lease( const Lease& ) = delete;
+    Lease& operator=( const Lease& ) = delete;
+
+    ~Lease()
+    {
+      Return();
+    }
+
+    Buffer& Get()
+    {
+      return buffer_;
+    }
+
+    const Buffer& Get() const
+    {
+      return buffer_;
+    }
+
+    // Capacity the buffer was allocated with; zero if not pooled
+    size_t GetCapacity() const
+    {
+      return capacity_;
+    }
+
+    bool IsPooled() const
+    {
+      return shared_ != nullptr;
+    }
+
+  private:
+    friend class BufferPool;
+
+    Lease( std::shared_ptr<Shared> shared, Buffer buffer, size_t capacity )
+      : shared_( std::move( shared ) ),
+        buffer_( std::move( buffer ) ),
+        capacity_( capacity )
+    {
+    }
+
+    void Return()
+    {
+      if( shared_ )
+        shared_->Return( std::move( buffer_ ), capacity_ );
+      shared_.reset();
+    }
+
+  private:
+    std::shared_ptr<Shared> shared_; // null if not pooled
+    Buffer                  buffer_ = {};
+    size_t                  capacity_ = 0;
+  };
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  explicit BufferPool( Allocator allocator, size_t maxIdleBuffers = kDefaultMaxIdleBuffers )
+    : shared_( std::make_shared<Shared>( std::move( allocator ), maxIdleBuffers ) )
+  {
+  }
+
+  // Disable copy/move
+  BufferPool( const BufferPool& ) = delete;
+  BufferPool& operator=( const BufferPool& ) = delete;
+  BufferPool( BufferPool&& ) = delete;
+  BufferPool& operator=( BufferPool&& ) = delete;
+
+  Lease Acquire( size_t minCapacity )
+  {
+    auto& shared = *shared_;
+    shared.acquireCount.fetch_add( 1, std::memory_order_relaxed );
+    {
+      std::lock_guard<std::mutex> lock( shared.mutex );
+      auto best = shared.idle.end();
+      for( auto i = shared.idle.begin(); i != shared.idle.end(); ++i )
+        if( i->capacity >= minCapacity && ( best == shared.idle.end() || i->capacity < best->capacity ) )
+          best = i;
+      if( best != shared.idle.end() )
+      {
+        Lease lease( shared_, std::move( best->buffer ), best->capacity );
+        *best = std::move( shared.idle.back() );
+        shared.idle.pop_back();
+        shared.idleCount.store( shared.idle.size(), std::memory_order_relaxed );
+        shared.hitCount.fetch_add( 1, std::memory_order_relaxed );
+        return lease;
+      }
+    }
+
+    // Allocate outside the lock; it may be slow
+    auto capacity = RoundUpCapacity( minCapacity );
+    shared.allocationCount.fetch_add( 1, std::memory_order_relaxed );
+    return Lease( shared_, shared.allocator( capacity ), capacity );
+  }
+
+  // Frees every idle buffer
+  void Trim()
+  {
+    std::vector<Entry> idle;
+    {
+      std::lock_guard<std::mutex> lock( shared_->mutex );
+      idle.swap( shared_->idle );
+      shared_->idleCount.store( 0, std::memory_order_relaxed );
+    }
+  }
+
+  Stats GetStats() const
+  {
+    auto& shared = *shared_;
+    Stats stats;
+    stats.acquireCount = shared.acquireCount.load( std::memory_order_relaxed );
+    stats.hitCount = shared.hitCount.load( std::memory_order_relaxed );
+    stats.allocationCount = shared.allocationCount.load( std::memory_order_relaxed );
+    stats.discardCount = shared.discardCount.load( std::memory_order_relaxed );
+    stats.idleCount = shared.idleCount.load( std::memory_order_relaxed );
+    return stats;
+  }
+
+private:
+  static size_t RoundUpCapacity( size_t minCapacity )
+  {
+    size_t capacity = kMinCapacity;
+    while( capacity < minCapacity )
+      capacity <<= 1;
+    return capacity;
+  }
+
+  struct Entry
+  {
+    Buffer buffer;
+    size_t capacity;
+  };
+
+  // Outlives the pool while any Lease refers to it
+  struct Shared
+  {
+    Shared( Allocator allocatorFn, size_t maxIdle )
+      : allocator( std::move( allocatorFn ) ),
+        maxIdleBuffers( maxIdle )
+    {
+      assert( allocator );
+      idle.reserve( maxIdleBuffers );
+    }
+
+    // A full pool keeps the larger buffer, so it drifts toward buffers that
+    // fit every request rather than filling up with ones too small to reuse
+    void Return( Buffer&& buffer, size_t capacity )
+    {
+      Buffer discard;
+      {
+        std::lock_guard<std::mutex> lock( mutex );
+        if( idle.size() < maxIdleBuffers )
+        {
+          idle.push_back( Entry{ std::move( buffer ), capacity } );
+          idleCount.store( idle.size(), std::memory_order_relaxed );
+          return;
+        }
+        auto smallest = idle.begin();
+        for( auto i = idle.begin(); i != idle.end(); ++i )
+          if( i->capacity < smallest->capacity )
+            smallest = i;
+        if( smallest != idle.end() && smallest->capacity < capacity )
+        {
+          discard = std::move( smallest->buffer );
+          *smallest = Entry{ std::move( buffer ), capacity };
+        }
+        else
+        {
+          discard = std::move( buffer );
+        }
+      }
+      discardCount.fetch_add( 1, std::memory_order_relaxed );
+    } // discard freed outside the lock
+
+    Allocator             allocator;
+    size_t                maxIdleBuffers;
+    std::mutex            mutex;
+    std::vector<Entry>    idle; // unordered; searched for the best fit
+    std::atomic<uint64_t> acquireCount = 0;
+    std::atomic<uint64_t> hitCount = 0;
+    std::atomic<uint64_t> allocationCount = 0;
+    std::atomic<uint64_t> discardCount = 0;
+    std::atomic<size_t>   idleCount = 0;
+  };
+
+private:
+  std::shared_ptr<Shared> shared_;
+
+}; // class BufferPool
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -15,11 +15,75 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #pragma once
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if defined( _WIN32 )
 #include "unknwn.h"
+#endif
 
 namespace PKIsensee
 {
 
+#if !defined( _WIN32 )
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Linux stand-ins for the parts of unknwn.h that ComPtr uses, so ComPtr and
+// its tests build without Windows. An interface declares its IID as a static
+// kIid member, which __uuidof() reads in place of __declspec( uuid ).
+
+using HRESULT = int32_t;
+using ULONG = uint32_t;
+
+constexpr HRESULT S_OK = 0;
+constexpr HRESULT E_NOINTERFACE = static_cast<HRESULT>( 0x80004002 );
+constexpr HRESULT E_POINTER = static_cast<HRESULT>( 0x80004003 );
+
+struct IID
+{
+  uint32_t Data1;
+  uint16_t Data2;
+  uint16_t Data3;
+  uint8_t  Data4[ 8 ];
+};
+
+using REFIID = const IID&;
+
+inline bool operator==( REFIID a, REFIID b )
+{
+  return std::memcmp( &a, &b, sizeof( IID ) ) == 0;
+}
+
+#define STDMETHODCALLTYPE
+#define __uuidof( I ) ( I::kIid )
+
+struct IUnknown
+{
+  static constexpr IID kIid = { 0x00000000, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+
+  virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv ) = 0;
+  virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+  virtual ULONG STDMETHODCALLTYPE Release() = 0;
+
+protected:
+  ~IUnknown() = default;
+};
+
+#endif // !_WIN32
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Owns one reference to a COM interface. Copies AddRef; moves, Attach() and
+// Detach() transfer the reference without touching the count, so passing
+// objects through return values and containers costs no interlocked
+// operations. Raw pointers given to the constructor or operator= are
+// borrowed and AddRef'd; pointers that already carry a reference, such as
+// the output of a COM call, go through Attach() or ReleaseAndGetAddressOf().
+
 template<typename I>
 class ComPtr
 {
@@ -43,23 +107,31 @@ public:
       p_->AddRef();
   }
 
-  ComPtr( ComPtr&& cp ) = delete; // not currently needed, but could be replaced with code below
-  /*{
-    p_ = cp.p_;
+  // noexcept so std::vector and std::deque move rather than copy on growth
+  ComPtr( ComPtr&& cp ) noexcept : p_( cp.p_ )
+  {
     cp.p_ = nullptr;
-  }*/
+  }
 
-  // not currently needed
-  ComPtr& operator=( const ComPtr& ) = delete; 
-  ComPtr& operator=( ComPtr&& ) = delete;
+  ComPtr& operator=( const ComPtr& cp )
+  {
+    ComPtr( cp ).Swap( *this );
+    return *this;
+  }
+
+  ComPtr& operator=( ComPtr&& cp ) noexcept
+  {
+    ComPtr( std::move( cp ) ).Swap( *this );
+    return *this;
+  }
 
   I* operator=( I* p )
   {
+    if( p ) // before Release(), in case p is p_
+      p->AddRef();
     if( p_ )
       p_->Release();
     p_ = p;
-    if( p_ )
-      p_->AddRef();
     return p_;
   }
 
@@ -81,12 +153,21 @@ public:
     return p_;
   }
 
+  // For COM calls that create the object; see ReleaseAndGetAddressOf() to reuse
   I** operator&()
   {
     assert( p_ == nullptr );
     return &p_;
   }
 
+  // Out parameter for a ComPtr that may already hold an object, e.g. one
+  // reused on every pass of a read loop
+  I** ReleaseAndGetAddressOf()
+  {
+    Reset();
+    return &p_;
+  }
+
   I* Get()
   {
     return p_;
@@ -97,6 +178,44 @@ public:
     return p_;
   }
 
+  // Takes ownership of a reference the caller already holds
+  void Attach( I* p )
+  {
+    if( p_ )
+      p_->Release();
+    p_ = p;
+  }
+
+  // Gives up ownership; the caller must Release() the result
+  I* Detach()
+  {
+    I* p = p_;
+    p_ = nullptr;
+    return p;
+  }
+
+  void Reset()
+  {
+    if( p_ )
+      p_->Release();
+    p_ = nullptr;
+  }
+
+  void Swap( ComPtr& cp )
+  {
+    std::swap( p_, cp.p_ );
+  }
+
+  // QueryInterface for Q; null if the object doesn't implement it
+  template<typename Q>
+  ComPtr<Q> As() const
+  {
+    ComPtr<Q> q;
+    if( p_ )
+      p_->QueryInterface( __uuidof( Q ), reinterpret_cast<void**>( &q ) );
+    return q;
+  }
+
 private:
   I* p_;
 
@@ -14,13 +14,16 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-#pragma once
 #include "Util.h"
 #include <cassert>
+#include <mutex>
 
-// Windows-specific
+#if defined( _WIN32 )
 #define NOMINMAX 1
 #include "Windows.h"
+#else
+#include "FutexEvent.h"
+#endif
 
 namespace PKIsensee
 {
@@ -28,25 +31,44 @@ namespace PKIsensee
 namespace Util
 {
 
+#if defined( _WIN32 )
+
 class Event::Impl
 {
 public:
-  HANDLE event = NULL;
+  // Releases the threads that were waiting when SignalAll() was called. Each
+  // wait joins the current broadcast; SignalAll() sets it and retires it, and
+  // the last waiter to leave a retired broadcast closes it.
+  struct Broadcast
+  {
+    HANDLE released = NULL; // manual-reset
+    size_t waiterCount = 0;
+  };
+
+  HANDLE     event = NULL;
+  std::mutex mutex;               // guards broadcast and every waiterCount
+  Broadcast* broadcast = nullptr; // the one new waits join; created on demand
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// The deleter must handle both closing the handle (ha) and freeing the pimpl
+// The deleter must handle both closing the handles (ha) and freeing the pimpl
 
-Event::Event()
+Event::Event( Mode mode )
   : impl_( new Impl, []( Impl* e ) 
     { 
       if( e->event != NULL )
         ::CloseHandle( e->event ); 
+      if( e->broadcast != nullptr )
+      {
+        ::CloseHandle( e->broadcast->released );
+        delete e->broadcast;
+      }
       delete e; 
     } )
 {
-  impl_->event = ::CreateEvent( NULL, FALSE, FALSE, NULL ); // auto reset event
+  BOOL isManualReset = ( mode == Mode::ManualReset ) ? TRUE : FALSE;
+  impl_->event = ::CreateEvent( NULL, isManualReset, FALSE, NULL );
   assert( impl_->event != NULL );
 }
 
@@ -60,14 +82,115 @@ void Event::Reset()
   ::ResetEvent( impl_->event );
 }
 
+void Event::Signal()
+{
+  ::SetEvent( impl_->event );
+}
+
+// Not PulseEvent(), which misses a thread that's momentarily out of its
+// wait, e.g. running a kernel APC. Waiters join a manual-reset broadcast
+// event before they wait, so setting it releases every one of them however
+// late it gets to WaitForMultipleObjects(). EventSet waits on the event
+// alone, so this doesn't release it, here or on Linux.
+
+void Event::SignalAll()
+{
+  ::ResetEvent( impl_->event );
+  std::lock_guard<std::mutex> lock( impl_->mutex );
+  auto* broadcast = impl_->broadcast;
+  if( broadcast == nullptr || broadcast->waiterCount == 0 )
+    return;
+  ::SetEvent( broadcast->released );
+  impl_->broadcast = nullptr; // retired
+}
+
 bool Event::IsSignalled( uint32_t timeoutMs ) const // true if signalled, false if timeout
 {
-  DWORD result = ::WaitForSingleObject( impl_->event, timeoutMs );
-  assert( result != WAIT_ABANDONED );
+  // Polling can't be waiting during a SignalAll(), so needn't join a broadcast
+  if( timeoutMs == 0 )
+  {
+    DWORD result = ::WaitForSingleObject( impl_->event, 0 );
+    assert( result != WAIT_ABANDONED );
+    assert( result != WAIT_FAILED );
+    return ( result == WAIT_OBJECT_0 );
+  }
+
+  Impl::Broadcast* broadcast = nullptr;
+  {
+    std::lock_guard<std::mutex> lock( impl_->mutex );
+    if( impl_->broadcast == nullptr )
+    {
+      impl_->broadcast = new Impl::Broadcast;
+      impl_->broadcast->released = ::CreateEvent( NULL, TRUE, FALSE, NULL );
+      assert( impl_->broadcast->released != NULL );
+    }
+    broadcast = impl_->broadcast;
+    ++broadcast->waiterCount;
+  }
+
+  const HANDLE handles[ 2 ] = { impl_->event, broadcast->released };
+  DWORD result = ::WaitForMultipleObjects( 2, handles, FALSE, timeoutMs );
+  assert( result != WAIT_ABANDONED && result != WAIT_ABANDONED + 1 );
   assert( result != WAIT_FAILED );
-  return ( result == WAIT_OBJECT_0 );
+
+  std::lock_guard<std::mutex> lock( impl_->mutex );
+  if( --broadcast->waiterCount == 0 && broadcast != impl_->broadcast )
+  {
+    ::CloseHandle( broadcast->released );
+    delete broadcast;
+  }
+  return ( result == WAIT_OBJECT_0 ) || ( result == WAIT_OBJECT_0 + 1 );
 }
 
+#else // Linux
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// GetHandle() returns the FutexEvent, which EventSet waits on
+
+class Event::Impl
+{
+public:
+  explicit Impl( Event::Mode mode )
+    : event( mode == Event::Mode::ManualReset )
+  {
+  }
+
+  FutexEvent event;
+};
+
+Event::Event( Mode mode )
+  : impl_( new Impl( mode ), []( Impl* e ) { delete e; } )
+{
+}
+
+void* Event::GetHandle()
+{
+  return &impl_->event;
+}
+
+void Event::Reset()
+{
+  impl_->event.Reset();
+}
+
+void Event::Signal()
+{
+  impl_->event.Signal();
+}
+
+void Event::SignalAll()
+{
+  impl_->event.SignalAll();
+}
+
+bool Event::IsSignalled( uint32_t timeoutMs ) const // true if signalled, false if timeout
+{
+  return impl_->event.Wait( timeoutMs );
+}
+
+#endif // _WIN32
+
 }; // end namespace Util
 
 }; // end namespace PKIsensee
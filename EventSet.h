@@ -0,0 +1,243 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  EventSet.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "Util.h"
+
+#if defined( _WIN32 )
+#define NOMINMAX 1
+#include "Windows.h"
+#else
+#include "FutexEvent.h"
+#endif
+
+namespace PKIsensee
+{
+
+namespace Util
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Waits on several Events at once, so a thread serving audio refills, control
+// commands and decoder output sleeps until one of them fires instead of
+// polling each with a short timeout. WaitAny() reports every event that fired
+// as a bit mask, not just the first, so a busy low-index event can't starve
+// the others and one wake-up serves them all. As with Event::IsSignalled(),
+// reporting an auto-reset event resets it. Event::SignalAll() releases only
+// threads in IsSignalled(), not a set waiting on the event.
+//
+// On Windows this is WaitForMultipleObjects(). On Linux each event notifies
+// the set's FutexWatcher while the set is waiting, so the waiting thread
+// sleeps on one futex; an event may belong to one set at a time.
+//
+//    EventSet events;
+//    auto refill = events.Add( refillEvent );
+//    auto command = events.Add( commandEvent );
+//    for( ;; )
+//    {
+//      auto fired = events.WaitAny();
+//      if( EventSet::IsSet( fired, refill ) ) ...
+//      if( EventSet::IsSet( fired, command ) ) ...
+//    }
+
+class EventSet
+{
+public:
+  static constexpr size_t   kMaxEvents = 64; // MAXIMUM_WAIT_OBJECTS; one bit each
+  static constexpr uint32_t kInfinite = UINT32_MAX;
+
+  EventSet() = default;
+
+#if !defined( _WIN32 )
+  ~EventSet()
+  {
+    for( size_t i = 0; i < count_; ++i )
+      events_[ i ]->SetWatcher( nullptr );
+  }
+#endif
+
+  // Disable copy/move
+  EventSet( const EventSet& ) = delete;
+  EventSet& operator=( const EventSet& ) = delete;
+  EventSet( EventSet&& ) = delete;
+  EventSet& operator=( EventSet&& ) = delete;
+
+#if defined( _WIN32 )
+
+  // The event must outlive the set. Returns the event's index
+  size_t Add( Event& event )
+  {
+    assert( count_ < kMaxEvents );
+    handles_[ count_ ] = event.GetHandle();
+    return count_++;
+  }
+
+  size_t GetSize() const
+  {
+    return count_;
+  }
+
+  static bool IsSet( uint64_t fired, size_t index )
+  {
+    assert( index < kMaxEvents );
+    return ( fired & ( uint64_t( 1 ) << index ) ) != 0;
+  }
+
+  // Waits up to timeoutMs for at least one event; returns a mask with bit i
+  // set if event i fired, or zero on timeout
+  uint64_t WaitAny( uint32_t timeoutMs = kInfinite )
+  {
+    assert( count_ > 0 );
+    auto result = ::WaitForMultipleObjects( static_cast<DWORD>( count_ ), handles_.data(), FALSE,
+                                            ToWaitMs( timeoutMs ) );
+    assert( result != WAIT_FAILED );
+    auto first = static_cast<size_t>( result - WAIT_OBJECT_0 ); // wraps for WAIT_TIMEOUT etc.
+    if( first >= count_ )
+      return 0;
+
+    // Windows reports only the lowest signalled index; collect the rest
+    uint64_t fired = uint64_t( 1 ) << first;
+    for( auto i = first + 1; i < count_; ++i )
+      if( ::WaitForSingleObject( handles_[ i ], 0 ) == WAIT_OBJECT_0 )
+        fired |= uint64_t( 1 ) << i;
+    return fired;
+  }
+
+  // Waits up to timeoutMs for every event to be signalled at once; true if
+  // they were, false on timeout
+  bool WaitAll( uint32_t timeoutMs = kInfinite )
+  {
+    assert( count_ > 0 );
+    auto result = ::WaitForMultipleObjects( static_cast<DWORD>( count_ ), handles_.data(), TRUE,
+                                            ToWaitMs( timeoutMs ) );
+    assert( result != WAIT_FAILED );
+    return static_cast<size_t>( result - WAIT_OBJECT_0 ) < count_;
+  }
+
+private:
+  static DWORD ToWaitMs( uint32_t timeoutMs )
+  {
+    return ( timeoutMs == kInfinite ) ? INFINITE : static_cast<DWORD>( timeoutMs );
+  }
+
+private:
+  std::array<HANDLE, kMaxEvents> handles_ = {};
+  size_t                         count_ = 0;
+
+#else // Linux
+
+  // The event must outlive the set. Returns the event's index
+  size_t Add( Event& event )
+  {
+    assert( count_ < kMaxEvents );
+    events_[ count_ ] = static_cast<FutexEvent*>( event.GetHandle() );
+    events_[ count_ ]->SetWatcher( &watcher_ );
+    return count_++;
+  }
+
+  size_t GetSize() const
+  {
+    return count_;
+  }
+
+  static bool IsSet( uint64_t fired, size_t index )
+  {
+    assert( index < kMaxEvents );
+    return ( fired & ( uint64_t( 1 ) << index ) ) != 0;
+  }
+
+  // Waits up to timeoutMs for at least one event; returns a mask with bit i
+  // set if event i fired, or zero on timeout
+  uint64_t WaitAny( uint32_t timeoutMs = kInfinite )
+  {
+    assert( count_ > 0 );
+    uint64_t fired = 0;
+    Wait( timeoutMs, [&]
+    {
+      for( size_t i = 0; i < count_; ++i )
+        if( events_[ i ]->TryWait() )
+          fired |= uint64_t( 1 ) << i;
+      return fired != 0;
+    } );
+    return fired;
+  }
+
+  // Waits up to timeoutMs for every event to be signalled at once; true if
+  // they were, false on timeout. Auto-reset events are taken one by one; if
+  // another thread takes one first, those already taken are signalled again
+  // and the wait continues.
+  bool WaitAll( uint32_t timeoutMs = kInfinite )
+  {
+    assert( count_ > 0 );
+    return Wait( timeoutMs, [&]
+    {
+      for( size_t i = 0; i < count_; ++i )
+        if( !events_[ i ]->IsSet() )
+          return false;
+      for( size_t i = 0; i < count_; ++i )
+      {
+        if( events_[ i ]->TryWait() )
+          continue;
+        while( i-- > 0 )
+          events_[ i ]->Signal();
+        return false;
+      }
+      return true;
+    } );
+  }
+
+private:
+  // Sleeps on the watcher until isReady() returns true or the time is up.
+  // The sequence is read before checking, so a notify in between isn't lost.
+  template<typename IsReady>
+  bool Wait( uint32_t timeoutMs, IsReady isReady )
+  {
+    bool isInfinite = ( timeoutMs == kInfinite );
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( isInfinite ? 0 : timeoutMs );
+    watcher_.waiters.fetch_add( 1 );
+    bool isDone = false;
+    for( ;; )
+    {
+      auto sequence = watcher_.sequence.load();
+      isDone = isReady();
+      if( isDone || timeoutMs == 0 || !FutexWatcher::Wait( watcher_.sequence, sequence, deadline, isInfinite ) )
+        break;
+    }
+    watcher_.waiters.fetch_sub( 1 );
+    return isDone;
+  }
+
+private:
+  std::array<FutexEvent*, kMaxEvents> events_ = {};
+  FutexWatcher                        watcher_;
+  size_t                              count_ = 0;
+
+#endif // _WIN32
+
+}; // class EventSet
+
+} // namespace Util
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
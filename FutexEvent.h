@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  FutexEvent.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+// Linux-specific
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Wakes the thread in EventSet::WaitAny()/WaitAll() when any event it watches
+// changes. Events notify it only while someone is waiting.
+
+class FutexWatcher
+{
+public:
+  std::atomic<uint32_t> sequence = 0; // futex word; bumped by every notify
+  std::atomic<uint32_t> waiters = 0;
+
+  void Notify()
+  {
+    if( waiters.load() == 0 )
+      return;
+    sequence.fetch_add( 1 );
+    Wake( sequence, INT_MAX );
+  }
+
+  // Futex helpers shared with FutexEvent. Wait() returns false on timeout;
+  // early and spurious returns are true, so callers re-check their condition.
+  static bool Wait( std::atomic<uint32_t>& word, uint32_t expected,
+                    std::chrono::steady_clock::time_point deadline, bool isInfinite )
+  {
+    static_assert( sizeof( std::atomic<uint32_t> ) == sizeof( uint32_t ) );
+    timespec timeout = {};
+    if( !isInfinite )
+    {
+      auto remaining = deadline - std::chrono::steady_clock::now();
+      if( remaining <= std::chrono::steady_clock::duration::zero() )
+        return false;
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>( remaining ).count();
+      timeout.tv_sec = static_cast<time_t>( ns / 1000000000 );
+      timeout.tv_nsec = static_cast<long>( ns % 1000000000 );
+    }
+    // CLOCK_MONOTONIC relative timeout, the clock steady_clock uses
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>( &word ), FUTEX_WAIT_PRIVATE, expected,
+             isInfinite ? nullptr : &timeout, nullptr, 0 );
+    return true;
+  }
+
+  static void Wake( std::atomic<uint32_t>& word, int count )
+  {
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>( &word ), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0 );
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Linux backend of Util::Event, with the semantics of a Win32 event. One
+// 32-bit futex word holds the signalled bit and a generation count that
+// SignalAll() advances. Signalling an event nobody waits on and polling an
+// event with a zero timeout are plain atomic operations; the kernel is
+// entered only to sleep or to wake a sleeper.
+//
+// Auto-reset: Signal() releases one waiting thread, or the next to wait, and
+// the release resets the event. Manual-reset: Signal() releases every waiter
+// and the event stays signalled until Reset(). Either way, SignalAll()
+// releases every thread waiting at that moment and leaves the event reset,
+// which is what PulseEvent() was meant to do.
+
+class FutexEvent
+{
+public:
+  static constexpr uint32_t kInfinite = UINT32_MAX; // same value as INFINITE
+
+  explicit FutexEvent( bool isManualReset = false )
+    : isManualReset_( isManualReset )
+  {
+  }
+
+  // Disable copy/move
+  FutexEvent( const FutexEvent& ) = delete;
+  FutexEvent& operator=( const FutexEvent& ) = delete;
+  FutexEvent( FutexEvent&& ) = delete;
+  FutexEvent& operator=( FutexEvent&& ) = delete;
+
+  void Signal()
+  {
+    word_.fetch_or( kSignalled );
+    WakeWaiters( isManualReset_ ? INT_MAX : 1 );
+  }
+
+  void SignalAll()
+  {
+    auto word = word_.load();
+    while( !word_.compare_exchange_weak( word, ( word + kGenerationStep ) & ~kSignalled ) )
+    {
+    }
+    WakeWaiters( INT_MAX );
+  }
+
+  void Reset()
+  {
+    word_.fetch_and( ~kSignalled );
+  }
+
+  // Takes the signal without waiting; true if it was set
+  bool TryWait()
+  {
+    auto word = word_.load();
+    while( word & kSignalled )
+    {
+      if( isManualReset_ || word_.compare_exchange_weak( word, word & ~kSignalled ) )
+        return true;
+    }
+    return false;
+  }
+
+  // True if signalled within timeoutMs, false on timeout
+  bool Wait( uint32_t timeoutMs )
+  {
+    if( TryWait() )
+      return true;
+    return ( timeoutMs != 0 ) && WaitSlow( timeoutMs );
+  }
+
+  // For EventSet; see FutexWatcher
+  bool IsSet() const
+  {
+    return ( word_.load() & kSignalled ) != 0;
+  }
+
+  void SetWatcher( FutexWatcher* watcher )
+  {
+    assert( watcher == nullptr || watcher_.load() == nullptr ); // one EventSet per event
+    watcher_.store( watcher );
+  }
+
+private:
+  static constexpr uint32_t kSignalled = 1;
+  static constexpr uint32_t kGenerationStep = 2;
+
+  // Sequentially consistent on both sides: a waiter increments waiters_ then
+  // reads word_, a signaller writes word_ then reads waiters_, so one of them
+  // always sees the other and no wake-up is lost
+  void WakeWaiters( int count )
+  {
+    if( waiters_.load() != 0 )
+      FutexWatcher::Wake( word_, count );
+    if( auto* watcher = watcher_.load() )
+      watcher->Notify();
+  }
+
+  bool WaitSlow( uint32_t timeoutMs )
+  {
+    bool isInfinite = ( timeoutMs == kInfinite );
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( isInfinite ? 0 : timeoutMs );
+    waiters_.fetch_add( 1 );
+    auto word = word_.load();
+    auto generation = word & ~kSignalled;
+    bool isReleased = false;
+    for( ;; )
+    {
+      if( word & kSignalled )
+      {
+        if( isManualReset_ || word_.compare_exchange_weak( word, word & ~kSignalled ) )
+        {
+          isReleased = true;
+          break;
+        }
+        continue; // word reloaded by the failed exchange
+      }
+      if( ( word & ~kSignalled ) != generation ) // SignalAll()
+      {
+        isReleased = true;
+        break;
+      }
+      if( !FutexWatcher::Wait( word_, word, deadline, isInfinite ) )
+        break;
+      word = word_.load();
+    }
+    waiters_.fetch_sub( 1 );
+    return isReleased;
+  }
+
+private:
+  std::atomic<uint32_t>      word_ = 0;    // generation | kSignalled
+  std::atomic<uint32_t>      waiters_ = 0; // threads in WaitSlow()
+  std::atomic<FutexWatcher*> watcher_ = nullptr;
+  bool                       isManualReset_;
+
+}; // class FutexEvent
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
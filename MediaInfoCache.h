@@ -0,0 +1,372 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  MediaInfoCache.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "MediaProbe.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Persistent cache of MediaInfo keyed by file path, valid only while the
+// file's size and modification time are unchanged. The index is a compact
+// binary image meant to be memory-mapped: Load() just points at it, and each
+// lookup is a hash probe into the image, so startup costs one mapping no
+// matter how large the library. Entries added since the load are kept in
+// memory until Serialize() produces a new image; a changed file's new entry
+// replaces the old one, so the index is rebuilt incrementally. Remove()
+// drops the entry of a deleted file; GetPaths() lists the candidates.
+//
+// Any number of threads may call Find() while another calls Insert().
+// The image is little-endian, as on every platform Windows runs on.
+// WinMediaInfoCache (WinMediaInfoCache.h) maps and saves the index file.
+//
+// Image layout:
+//    Header
+//    Entry[ entryCount ]
+//    uint32_t slot[ slotCount ] // open-addressed hash table; entry index + 1, or 0 if empty
+//    char paths[ pathBytes ]    // UTF-8, not terminated
+
+class MediaInfoCache
+{
+public:
+
+  MediaInfoCache() = default;
+
+  // Disable copy/move
+  MediaInfoCache( const MediaInfoCache& ) = delete;
+  MediaInfoCache& operator=( const MediaInfoCache& ) = delete;
+  MediaInfoCache( MediaInfoCache&& ) = delete;
+  MediaInfoCache& operator=( MediaInfoCache&& ) = delete;
+
+  // The image must remain valid until the next Load() or Clear(). Entries
+  // added with Insert() or dropped with Remove() stay so. Returns false, leaving no image loaded, if
+  // the image is damaged or from another version.
+  bool Load( const uint8_t* image, size_t imageBytes )
+  {
+    std::unique_lock<std::shared_mutex> lock( mutex_ );
+    image_ = {};
+    if( image == nullptr || imageBytes < sizeof( Header ) )
+      return false;
+    Header header;
+    std::memcpy( &header, image, sizeof( header ) );
+    if( std::memcmp( header.magic, kMagic, sizeof( header.magic ) ) != 0 || header.version != kVersion )
+      return false;
+    if( header.slotCount == 0 || ( header.slotCount & ( header.slotCount - 1 ) ) != 0 ||
+        header.slotCount < header.entryCount )
+      return false;
+    uint64_t expectedBytes = sizeof( Header ) + uint64_t( header.entryCount ) * sizeof( Entry ) +
+                             uint64_t( header.slotCount ) * sizeof( uint32_t ) + header.pathBytes;
+    if( expectedBytes != imageBytes )
+      return false;
+
+    image_.entries = reinterpret_cast<const Entry*>( image + sizeof( Header ) );
+    image_.slots = reinterpret_cast<const uint32_t*>( image_.entries + header.entryCount );
+    image_.paths = reinterpret_cast<const char*>( image_.slots + header.slotCount );
+    image_.entryCount = header.entryCount;
+    image_.slotMask = header.slotCount - 1;
+    image_.pathBytes = header.pathBytes;
+    return true;
+  }
+
+  void Clear()
+  {
+    std::unique_lock<std::shared_mutex> lock( mutex_ );
+    image_ = {};
+    added_.clear();
+    removed_.clear();
+  }
+
+  // False if the file isn't cached or has changed since it was
+  bool Find( std::string_view path, uint64_t fileSize, int64_t modifiedTime, MediaInfo& info ) const
+  {
+    std::shared_lock<std::shared_mutex> lock( mutex_ );
+    if( !added_.empty() )
+    {
+      if( auto i = added_.find( path ); i != added_.end() )
+      {
+        if( i->second.fileSize != fileSize || i->second.modifiedTime != modifiedTime )
+          return false;
+        info = i->second.info;
+        return true;
+      }
+    }
+    if( !removed_.empty() && removed_.find( path ) != removed_.end() )
+      return false;
+    const Entry* entry = FindEntry( path );
+    if( entry == nullptr || entry->fileSize != fileSize || entry->modifiedTime != modifiedTime )
+      return false;
+    info = GetInfo( *entry );
+    return true;
+  }
+
+  void Insert( std::string_view path, uint64_t fileSize, int64_t modifiedTime, const MediaInfo& info )
+  {
+    std::unique_lock<std::shared_mutex> lock( mutex_ );
+    Record record = { info, fileSize, modifiedTime };
+    if( auto i = added_.find( path ); i != added_.end() )
+      i->second = record;
+    else
+      added_.emplace( std::string( path ), record );
+  }
+
+  // Drops the file's entry, as when the file has been deleted
+  void Remove( std::string_view path )
+  {
+    std::unique_lock<std::shared_mutex> lock( mutex_ );
+    if( auto i = added_.find( path ); i != added_.end() )
+      added_.erase( i );
+    if( FindEntry( path ) != nullptr )
+      removed_.emplace( path );
+  }
+
+  // Every cached path, for finding the files that no longer exist. Copies,
+  // so the caller may check the files without holding up lookups.
+  std::vector<std::string> GetPaths() const
+  {
+    std::shared_lock<std::shared_mutex> lock( mutex_ );
+    std::vector<std::string> paths;
+    paths.reserve( image_.entryCount + added_.size() );
+    ForEachImageEntry( [&paths]( std::string_view path, const Entry& )
+    {
+      paths.emplace_back( path );
+    } );
+    for( const auto& added : added_ )
+      paths.push_back( added.first );
+    return paths;
+  }
+
+  // True if entries were added or removed since the last Load()
+  bool IsModified() const
+  {
+    std::shared_lock<std::shared_mutex> lock( mutex_ );
+    return !added_.empty() || !removed_.empty();
+  }
+
+  // Image of every current entry, for writing to disk and loading later
+  std::vector<uint8_t> Serialize() const
+  {
+    std::shared_lock<std::shared_mutex> lock( mutex_ );
+
+    // Entries from the loaded image that weren't replaced, then the additions
+    std::vector<std::pair<std::string_view, Record>> records;
+    records.reserve( image_.entryCount + added_.size() );
+    ForEachImageEntry( [&records]( std::string_view path, const Entry& entry )
+    {
+      records.emplace_back( path, Record{ GetInfo( entry ), entry.fileSize, entry.modifiedTime } );
+    } );
+    for( const auto& [ path, record ] : added_ )
+      records.emplace_back( path, record );
+
+    Header header;
+    std::memcpy( header.magic, kMagic, sizeof( header.magic ) );
+    header.version = kVersion;
+    header.entryCount = static_cast<uint32_t>( records.size() );
+    header.slotCount = 1;
+    while( header.slotCount < header.entryCount * 2 ) // load factor at most 1/2
+      header.slotCount <<= 1;
+    header.pathBytes = 0;
+    for( const auto& record : records )
+      header.pathBytes += record.first.size();
+
+    std::vector<Entry> entries( records.size() );
+    std::vector<uint32_t> slots( header.slotCount );
+    std::string paths;
+    paths.reserve( static_cast<size_t>( header.pathBytes ) );
+    auto slotMask = header.slotCount - 1;
+    for( size_t i = 0; i < records.size(); ++i )
+    {
+      const auto& [ path, record ] = records[ i ];
+      Entry& entry = entries[ i ];
+      entry.pathHash = Hash( path );
+      entry.fileSize = record.fileSize;
+      entry.modifiedTime = record.modifiedTime;
+      entry.durationMs = record.info.durationMs;
+      entry.pathOffset = paths.size();
+      entry.pathBytes = static_cast<uint32_t>( path.size() );
+      entry.samplesPerSec = record.info.samplesPerSec;
+      entry.channels = record.info.channels;
+      entry.bitsPerSample = record.info.bitsPerSample;
+      paths.append( path );
+
+      auto slot = entry.pathHash & slotMask;
+      while( slots[ slot ] != 0 )
+        slot = ( slot + 1 ) & slotMask;
+      slots[ slot ] = static_cast<uint32_t>( i + 1 );
+    }
+
+    std::vector<uint8_t> image( sizeof( header ) + entries.size() * sizeof( Entry ) +
+                                slots.size() * sizeof( uint32_t ) + paths.size() );
+    size_t imageBytes = 0;
+    auto append = [&image, &imageBytes]( const void* data, size_t bytes )
+    {
+      if( bytes == 0 )
+        return;
+      std::memcpy( image.data() + imageBytes, data, bytes );
+      imageBytes += bytes;
+    };
+    append( &header, sizeof( header ) );
+    append( entries.data(), entries.size() * sizeof( Entry ) );
+    append( slots.data(), slots.size() * sizeof( uint32_t ) );
+    append( paths.data(), paths.size() );
+    return image;
+  }
+
+private:
+
+  static constexpr char kMagic[ 4 ] = { 'P', 'K', 'M', 'C' };
+  static constexpr uint32_t kVersion = 1;
+
+  struct Header
+  {
+    char     magic[ 4 ];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t slotCount; // power of two
+    uint64_t pathBytes;
+  };
+
+  struct Entry
+  {
+    uint64_t pathHash;
+    uint64_t fileSize;
+    int64_t  modifiedTime;
+    uint64_t durationMs;
+    uint64_t pathOffset;
+    uint32_t pathBytes;
+    uint32_t samplesPerSec;
+    uint32_t channels;
+    uint32_t bitsPerSample;
+  };
+  static_assert( std::is_trivially_copyable<Entry>::value && sizeof( Entry ) == 56, "Entry is stored on disk" );
+  static_assert( sizeof( Header ) == 24, "Header is stored on disk" );
+
+  struct Record
+  {
+    MediaInfo info;
+    uint64_t  fileSize;
+    int64_t   modifiedTime;
+  };
+
+  struct Image // views into the loaded image
+  {
+    const Entry*    entries = nullptr;
+    const uint32_t* slots = nullptr;
+    const char*     paths = nullptr;
+    uint32_t        entryCount = 0;
+    uint32_t        slotMask = 0;
+    uint64_t        pathBytes = 0;
+  };
+
+  static uint64_t Hash( std::string_view path ) // FNV-1a
+  {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for( auto c : path )
+    {
+      hash ^= static_cast<uint8_t>( c );
+      hash *= 0x100000001B3ull;
+    }
+    return hash;
+  }
+
+  std::string_view GetPath( const Entry& entry ) const
+  {
+    if( entry.pathOffset + entry.pathBytes > image_.pathBytes ) // damaged
+      return {};
+    return std::string_view( image_.paths + entry.pathOffset, entry.pathBytes );
+  }
+
+  static MediaInfo GetInfo( const Entry& entry )
+  {
+    MediaInfo info;
+    info.durationMs = entry.durationMs;
+    info.samplesPerSec = entry.samplesPerSec;
+    info.channels = entry.channels;
+    info.bitsPerSample = entry.bitsPerSample;
+    return info;
+  }
+
+  // Loaded entries not since replaced or removed; mutex_ held
+  template<typename Fn>
+  void ForEachImageEntry( Fn&& fn ) const
+  {
+    for( uint32_t i = 0; i < image_.entryCount; ++i )
+    {
+      const Entry& entry = image_.entries[ i ];
+      std::string_view path = GetPath( entry );
+      if( !added_.empty() && added_.find( path ) != added_.end() )
+        continue;
+      if( !removed_.empty() && removed_.find( path ) != removed_.end() )
+        continue;
+      fn( path, entry );
+    }
+  }
+
+  const Entry* FindEntry( std::string_view path ) const // mutex_ held
+  {
+    if( image_.entryCount == 0 )
+      return nullptr;
+    auto hash = Hash( path );
+    auto slot = hash & image_.slotMask;
+    for( uint64_t probes = 0; probes <= image_.slotMask && image_.slots[ slot ] != 0; ++probes )
+    {
+      auto index = image_.slots[ slot ] - 1;
+      if( index >= image_.entryCount )
+        return nullptr; // damaged
+      const Entry& entry = image_.entries[ index ];
+      if( entry.pathHash == hash && GetPath( entry ) == path )
+        return &entry;
+      slot = ( slot + 1 ) & image_.slotMask;
+    }
+    return nullptr;
+  }
+
+  // Lets the containers below be searched by string_view without building a
+  // std::string per lookup
+  struct PathHash
+  {
+    using is_transparent = void;
+    size_t operator()( std::string_view path ) const
+    {
+      return std::hash<std::string_view>{}( path );
+    }
+  };
+
+private:
+  mutable std::shared_mutex                                          mutex_;
+  Image                                                              image_;
+  std::unordered_map<std::string, Record, PathHash, std::equal_to<>> added_;   // since Load(); replaces image entries
+  std::unordered_set<std::string, PathHash, std::equal_to<>>         removed_; // image entries dropped since Load()
+
+}; // class MediaInfoCache
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,359 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  MediaProbe.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Duration and format of an audio file, read straight from the container
+// headers without decoding or instantiating a media source. Handles WAV/RIFF,
+// FLAC (STREAMINFO) and MP3 (Xing/Info or VBRI frame, else constant bitrate).
+// ProbeMedia() in WinMediaProbe.h falls back to Media Foundation for anything
+// these parsers reject. Portable; uses only the standard library.
+
+struct MediaInfo
+{
+  uint64_t durationMs = 0;
+  uint32_t samplesPerSec = 0;
+  uint32_t channels = 0;
+  uint32_t bitsPerSample = 0; // 0 for lossy formats, which have no native bit depth
+};
+
+namespace MediaProbe
+{
+
+constexpr size_t kHeaderBytes = 64 * 1024;      // enough for the headers of all supported formats
+constexpr size_t kMp3SyncSearchBytes = 4 * 1024; // padding allowed before the first MP3 frame
+
+inline uint32_t ReadLE16( const uint8_t* p )
+{
+  return uint32_t( p[ 0 ] ) | ( uint32_t( p[ 1 ] ) << 8 );
+}
+
+inline uint32_t ReadLE32( const uint8_t* p )
+{
+  return ReadLE16( p ) | ( ReadLE16( p + 2 ) << 16 );
+}
+
+inline uint32_t ReadBE16( const uint8_t* p )
+{
+  return ( uint32_t( p[ 0 ] ) << 8 ) | uint32_t( p[ 1 ] );
+}
+
+inline uint32_t ReadBE24( const uint8_t* p )
+{
+  return ( uint32_t( p[ 0 ] ) << 16 ) | ReadBE16( p + 1 );
+}
+
+inline uint32_t ReadBE32( const uint8_t* p )
+{
+  return ( ReadBE16( p ) << 16 ) | ReadBE16( p + 2 );
+}
+
+inline uint64_t FramesToMs( uint64_t frames, uint32_t samplesPerSec )
+{
+  return samplesPerSec ? ( frames * 1000 ) / samplesPerSec : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// WAV: walk the RIFF chunks for "fmt " and "data". WAVE_FORMAT_EXTENSIBLE is
+// reported as the format tag of its subformat. dataBytes is as recorded in the
+// header; callers reading the samples must clamp it to the file size.
+
+struct WavLayout
+{
+  uint32_t formatTag = 0;
+  uint32_t channels = 0;
+  uint32_t samplesPerSec = 0;
+  uint32_t blockAlign = 0;
+  uint32_t bitsPerSample = 0;
+  uint64_t dataOffset = 0; // from the start of the RIFF header
+  uint64_t dataBytes = 0;
+};
+
+inline bool ParseWavLayout( const uint8_t* data, size_t size, WavLayout& layout )
+{
+  constexpr uint32_t kFormatExtensible = 0xFFFE;
+  if( size < 12 || std::memcmp( data, "RIFF", 4 ) != 0 || std::memcmp( data + 8, "WAVE", 4 ) != 0 )
+    return false;
+
+  layout = {};
+  for( size_t pos = 12; pos + 8 <= size; )
+  {
+    const uint8_t* chunk = data + pos;
+    uint64_t chunkBytes = ReadLE32( chunk + 4 );
+    if( std::memcmp( chunk, "fmt ", 4 ) == 0 )
+    {
+      if( chunkBytes < 16 || pos + 8 + 16 > size )
+        return false;
+      layout.formatTag = ReadLE16( chunk + 8 );
+      layout.channels = ReadLE16( chunk + 10 );
+      layout.samplesPerSec = ReadLE32( chunk + 12 );
+      layout.blockAlign = ReadLE16( chunk + 20 );
+      layout.bitsPerSample = ReadLE16( chunk + 22 );
+
+      // The first two bytes of the subformat GUID are the equivalent format tag
+      if( layout.formatTag == kFormatExtensible && chunkBytes >= 40 && pos + 8 + 40 <= size )
+        layout.formatTag = ReadLE16( chunk + 8 + 24 );
+    }
+    else if( std::memcmp( chunk, "data", 4 ) == 0 )
+    {
+      if( layout.blockAlign == 0 ) // fmt must precede data
+        return false;
+      layout.dataOffset = pos + 8;
+      layout.dataBytes = chunkBytes;
+      return layout.samplesPerSec != 0;
+    }
+    pos += 8 + chunkBytes + ( chunkBytes & 1 ); // chunks are word aligned
+  }
+  return false;
+}
+
+// fileBytes is the size of the file from the RIFF header on. Truncated files,
+// and files from writers that never patched the header (which often record
+// 0 or 0xFFFFFFFF), are timed by the data actually present.
+inline bool ParseWav( const uint8_t* data, size_t size, uint64_t fileBytes, MediaInfo& info )
+{
+  WavLayout layout;
+  if( !ParseWavLayout( data, size, layout ) || layout.dataOffset > fileBytes )
+    return false;
+  auto dataBytes = std::min( layout.dataBytes, fileBytes - layout.dataOffset );
+  info.channels = layout.channels;
+  info.samplesPerSec = layout.samplesPerSec;
+  info.bitsPerSample = layout.bitsPerSample;
+  info.durationMs = FramesToMs( dataBytes / layout.blockAlign, layout.samplesPerSec );
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// FLAC: STREAMINFO is always the first metadata block
+
+inline bool ParseFlac( const uint8_t* data, size_t size, MediaInfo& info )
+{
+  constexpr size_t kStreamInfoBytes = 34;
+  if( size < 8 + kStreamInfoBytes || std::memcmp( data, "fLaC", 4 ) != 0 )
+    return false;
+  const uint8_t* blockHeader = data + 4;
+  if( ( blockHeader[ 0 ] & 0x7F ) != 0 || ReadBE24( blockHeader + 1 ) < kStreamInfoBytes )
+    return false;
+
+  // min/max block size (16+16), min/max frame size (24+24), then
+  // sample rate (20), channels - 1 (3), bits per sample - 1 (5), total samples (36)
+  const uint8_t* streamInfo = blockHeader + 4;
+  const uint8_t* p = streamInfo + 10;
+  info.samplesPerSec = ( uint32_t( p[ 0 ] ) << 12 ) | ( uint32_t( p[ 1 ] ) << 4 ) | ( p[ 2 ] >> 4 );
+  info.channels = ( ( p[ 2 ] >> 1 ) & 0x07 ) + 1;
+  info.bitsPerSample = ( ( ( p[ 2 ] & 0x01 ) << 4 ) | ( p[ 3 ] >> 4 ) ) + 1;
+  uint64_t totalSamples = ( uint64_t( p[ 3 ] & 0x0F ) << 32 ) | ReadBE32( p + 4 );
+  info.durationMs = FramesToMs( totalSamples, info.samplesPerSec );
+  return info.samplesPerSec != 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// MP3: the first frame header gives the format; a Xing/Info or VBRI frame
+// gives the frame count, otherwise the bitrate is assumed constant
+
+struct Mp3FrameHeader
+{
+  uint32_t samplesPerSec = 0;
+  uint32_t bitrate = 0;       // bits per second
+  uint32_t samplesPerFrame = 0;
+  uint32_t frameBytes = 0;
+  uint32_t channels = 0;
+  bool     isMpeg1 = false;
+};
+
+inline bool ParseMp3FrameHeader( const uint8_t* p, Mp3FrameHeader& frame )
+{
+  static constexpr uint16_t kBitrates[ 2 ][ 3 ][ 16 ] = // kbps by [isMpeg1][layer - 1][index]
+  {
+    { { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 } },
+    { { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+      { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+      { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 } },
+  };
+  static constexpr uint32_t kSampleRates[ 3 ] = { 44100, 48000, 32000 }; // MPEG-1
+
+  if( p[ 0 ] != 0xFF || ( p[ 1 ] & 0xE0 ) != 0xE0 )
+    return false;
+  uint32_t version = ( p[ 1 ] >> 3 ) & 0x03; // 0 = 2.5, 2 = 2, 3 = 1
+  uint32_t layer = 4 - ( ( p[ 1 ] >> 1 ) & 0x03 );
+  uint32_t bitrateIndex = p[ 2 ] >> 4;
+  uint32_t sampleRateIndex = ( p[ 2 ] >> 2 ) & 0x03;
+  if( version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3 )
+    return false; // reserved, or free format, which has no fixed frame size
+
+  frame.isMpeg1 = ( version == 3 );
+  frame.samplesPerSec = kSampleRates[ sampleRateIndex ] >> ( frame.isMpeg1 ? 0 : ( version == 2 ? 1 : 2 ) );
+  frame.bitrate = kBitrates[ frame.isMpeg1 ][ layer - 1 ][ bitrateIndex ] * 1000u;
+  frame.channels = ( ( p[ 3 ] >> 6 ) == 3 ) ? 1 : 2;
+  uint32_t padding = ( p[ 2 ] >> 1 ) & 0x01;
+  if( layer == 1 )
+  {
+    frame.samplesPerFrame = 384;
+    frame.frameBytes = ( 12 * frame.bitrate / frame.samplesPerSec + padding ) * 4;
+  }
+  else
+  {
+    frame.samplesPerFrame = ( layer == 3 && !frame.isMpeg1 ) ? 576 : 1152;
+    frame.frameBytes = ( frame.samplesPerFrame / 8 ) * frame.bitrate / frame.samplesPerSec + padding;
+  }
+  return true;
+}
+
+// audioBytes is the size of the MPEG stream, excluding ID3 tags
+inline bool ParseMp3( const uint8_t* data, size_t size, uint64_t audioBytes, MediaInfo& info )
+{
+  // Find a frame header near the start that is followed by two more of the
+  // same format, so other formats and stray sync bits aren't taken for MP3
+  auto isFrameAt = [&]( size_t pos, Mp3FrameHeader& frame, uint32_t framesToCheck )
+  {
+    for( ; framesToCheck; --framesToCheck )
+    {
+      Mp3FrameHeader next;
+      if( pos + 4 > size )
+        return frame.samplesPerSec != 0; // ran out of header data
+      if( !ParseMp3FrameHeader( data + pos, next ) )
+        return false;
+      if( frame.samplesPerSec != 0 && ( next.samplesPerSec != frame.samplesPerSec || next.isMpeg1 != frame.isMpeg1 ) )
+        return false;
+      if( frame.samplesPerSec == 0 )
+        frame = next;
+      pos += next.frameBytes;
+    }
+    return true;
+  };
+  Mp3FrameHeader frame;
+  size_t pos = 0;
+  auto searchEnd = std::min( size, kMp3SyncSearchBytes );
+  for( ; pos + 4 <= searchEnd; ++pos )
+  {
+    frame = {};
+    if( isFrameAt( pos, frame, 3 ) )
+      break;
+  }
+  if( pos + 4 > searchEnd )
+    return false;
+  info.samplesPerSec = frame.samplesPerSec;
+  info.channels = frame.channels;
+  info.bitsPerSample = 0;
+
+  // The Xing/Info tag follows the side information; VBRI is at a fixed offset
+  const uint8_t* header = data + pos;
+  size_t sideInfoBytes = frame.isMpeg1 ? ( frame.channels == 1 ? 17 : 32 ) : ( frame.channels == 1 ? 9 : 17 );
+  const uint8_t* xing = header + 4 + sideInfoBytes;
+  const uint8_t* vbri = header + 4 + 32;
+  if( xing + 12 <= data + size && ( std::memcmp( xing, "Xing", 4 ) == 0 || std::memcmp( xing, "Info", 4 ) == 0 ) &&
+      ( ReadBE32( xing + 4 ) & 0x01 ) )
+  {
+    info.durationMs = FramesToMs( uint64_t( ReadBE32( xing + 8 ) ) * frame.samplesPerFrame, frame.samplesPerSec );
+    return true;
+  }
+  if( vbri + 18 <= data + size && std::memcmp( vbri, "VBRI", 4 ) == 0 )
+  {
+    info.durationMs = FramesToMs( uint64_t( ReadBE32( vbri + 14 ) ) * frame.samplesPerFrame, frame.samplesPerSec );
+    return true;
+  }
+
+  // Constant bitrate
+  if( audioBytes < pos )
+    return false;
+  info.durationMs = ( ( audioBytes - pos ) * 8 * 1000 ) / frame.bitrate;
+  return true;
+}
+
+// ID3v2 tags precede the audio in MP3 (and occasionally FLAC) files
+inline uint64_t GetId3v2Bytes( const uint8_t* data, size_t size )
+{
+  if( size < 10 || std::memcmp( data, "ID3", 3 ) != 0 )
+    return 0;
+  uint64_t tagBytes = ( uint32_t( data[ 6 ] & 0x7F ) << 21 ) | ( uint32_t( data[ 7 ] & 0x7F ) << 14 ) |
+                      ( uint32_t( data[ 8 ] & 0x7F ) << 7 ) | ( data[ 9 ] & 0x7F ); // syncsafe
+  bool hasFooter = ( data[ 5 ] & 0x10 ) != 0;
+  return 10 + tagBytes + ( hasFooter ? 10 : 0 );
+}
+
+} // namespace MediaProbe
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Reads at most two small blocks of the file: the start, and if an ID3 tag is
+// present, the start of the audio that follows it. False if the format isn't
+// recognized or the headers are damaged.
+
+inline bool ProbeMediaHeaders( const std::filesystem::path& file, MediaInfo& info )
+{
+  using namespace MediaProbe;
+  std::error_code error;
+  auto fileBytes = std::filesystem::file_size( file, error );
+  if( error )
+    return false;
+  std::ifstream stream( file, std::ios::binary );
+  if( !stream )
+    return false;
+
+  std::vector<uint8_t> header( static_cast<size_t>( std::min<uint64_t>( fileBytes, kHeaderBytes ) ) );
+  auto readAt = [&]( uint64_t offset )
+  {
+    header.resize( static_cast<size_t>( std::min<uint64_t>( fileBytes - offset, kHeaderBytes ) ) );
+    stream.seekg( static_cast<std::streamoff>( offset ) );
+    stream.read( reinterpret_cast<char*>( header.data() ), static_cast<std::streamsize>( header.size() ) );
+    return stream.gcount() == static_cast<std::streamsize>( header.size() );
+  };
+  if( !readAt( 0 ) )
+    return false;
+
+  auto tagBytes = GetId3v2Bytes( header.data(), header.size() );
+  if( tagBytes >= fileBytes )
+    return false;
+  if( tagBytes > 0 && !readAt( tagBytes ) )
+    return false;
+
+  info = {};
+  if( ParseWav( header.data(), header.size(), fileBytes - tagBytes, info ) )
+    return true;
+  if( ParseFlac( header.data(), header.size(), info ) )
+    return true;
+
+  // An ID3v1 tag occupies the last 128 bytes
+  auto audioBytes = fileBytes - tagBytes;
+  if( audioBytes >= 128 )
+  {
+    char tag[ 3 ] = {};
+    stream.seekg( static_cast<std::streamoff>( fileBytes - 128 ) );
+    if( stream.read( tag, 3 ) && std::memcmp( tag, "TAG", 3 ) == 0 )
+      audioBytes -= 128;
+  }
+  return ParseMp3( header.data(), header.size(), audioBytes, info );
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,274 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  NullWaveSink.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "WaveSink.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Device that discards audio. A worker thread consumes queued WAVEHDRs in
+// order at speed times real time (0.0 means as fast as possible), then marks
+// each WHDR_DONE and signals the event, as winmm does with CALLBACK_EVENT.
+// Buffers are consumed in small chunks so GetPositionBytes() advances
+// smoothly, as it would on real hardware.
+
+class NullWaveSink : public WaveSink
+{
+  static constexpr uint32_t kChunkMs = 5;
+
+public:
+  explicit NullWaveSink( double speed = 1.0 )
+    : speed_( speed )
+  {
+    assert( speed_ >= 0.0 );
+  }
+
+  ~NullWaveSink() override
+  {
+    NullWaveSink::Close();
+  }
+
+  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent ) override
+  {
+    assert( !worker_.joinable() );
+    assert( wfx.nAvgBytesPerSec > 0 );
+    assert( wfx.nBlockAlign > 0 );
+    wfx_ = wfx;
+    hEvent_ = hEvent;
+    position_ = 0;
+    isPaused_ = false;
+    isClosing_ = false;
+    worker_ = std::thread( [this] { Consumer(); } );
+    return true;
+  }
+
+  void Prepare( WAVEHDR& wh ) override
+  {
+    wh.dwFlags |= WHDR_PREPARED;
+  }
+
+  void Unprepare( WAVEHDR& wh ) override
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    assert( !( wh.dwFlags & WHDR_INQUEUE ) );
+    wh.dwFlags &= ~static_cast<DWORD>( WHDR_PREPARED );
+  }
+
+  void Write( WAVEHDR& wh ) override
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      assert( wh.dwFlags & WHDR_PREPARED );
+      wh.dwFlags &= ~static_cast<DWORD>( WHDR_DONE );
+      wh.dwFlags |= WHDR_INQUEUE;
+      wh.reserved = 0; // bytes consumed so far
+      queue_.push_back( &wh );
+    }
+    wakeup_.notify_one();
+  }
+
+  uint32_t GetPositionBytes() const override
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return static_cast<uint32_t>( position_ ); // wraps like winmm
+  }
+
+  WaveVolume GetVolume() const override
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return volume_;
+  }
+
+  void SetVolume( const WaveVolume& volume ) override
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    volume_ = volume;
+  }
+
+  void Reset() override
+  {
+    // Return all pending buffers and reset position; pause state is unchanged
+    std::lock_guard<std::mutex> lock( mutex_ );
+    ReturnAll();
+    position_ = 0;
+    ++generation_;
+    wakeup_.notify_one();
+  }
+
+  void Close() override
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      ReturnAll();
+      isClosing_ = true;
+    }
+    wakeup_.notify_one();
+    if( worker_.joinable() )
+      worker_.join();
+  }
+
+  void Restart() override
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      isPaused_ = false;
+      ++generation_; // restart the real-time clock
+    }
+    wakeup_.notify_one();
+  }
+
+  void Pause() override
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    isPaused_ = true;
+    ++generation_;
+    wakeup_.notify_one();
+  }
+
+protected:
+
+  // Invoked with the sink lock held for each consumed chunk of audio
+  virtual void Consume( const uint8_t*, size_t )
+  {
+  }
+
+private:
+
+  void ReturnAll()
+  {
+    for( auto* wh : queue_ )
+      SetWaveHdrDone( *wh );
+    if( !queue_.empty() && hEvent_ != NULL )
+      SignalWaveEvent( hEvent_ );
+    queue_.clear();
+  }
+
+  void Consumer()
+  {
+    using Clock = std::chrono::steady_clock;
+    size_t blockAlign = wfx_.nBlockAlign;
+    auto chunkBytes = ( wfx_.nAvgBytesPerSec * kChunkMs / 1000 ) + blockAlign - 1;
+    chunkBytes -= chunkBytes % blockAlign;
+    auto deadline = Clock::now();
+    auto generation = generation_;
+
+    std::unique_lock<std::mutex> lock( mutex_ );
+    for( ;; )
+    {
+      // A device that ran dry doesn't make up the idle time later
+      bool isIdle = isPaused_ || queue_.empty();
+      wakeup_.wait( lock, [this] { return isClosing_ || ( !isPaused_ && !queue_.empty() ); } );
+      if( isClosing_ )
+        return;
+
+      // Pause, restart or reset since the last chunk resynchronizes the clock
+      if( isIdle || generation != generation_ )
+      {
+        generation = generation_;
+        deadline = Clock::now();
+      }
+
+      auto* wh = queue_.front();
+      auto offset = static_cast<size_t>( wh->reserved );
+      auto bytes = std::min<size_t>( chunkBytes, wh->dwBufferLength - offset );
+
+      if( speed_ > 0.0 )
+      {
+        auto seconds = static_cast<double>( bytes ) / ( wfx_.nAvgBytesPerSec * speed_ );
+        deadline += std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( seconds ) );
+        wakeup_.wait_until( lock, deadline, [&] { return isClosing_ || generation != generation_; } );
+        if( isClosing_ )
+          return;
+        if( generation != generation_ ) // buffers returned or paused; chunk doesn't count
+          continue;
+      }
+
+      Consume( reinterpret_cast<const uint8_t*>( wh->lpData ) + offset, bytes );
+      position_ += bytes;
+      wh->reserved += bytes;
+      if( wh->reserved >= wh->dwBufferLength )
+      {
+        queue_.pop_front();
+        SetWaveHdrDone( *wh );
+        SignalWaveEvent( hEvent_ );
+      }
+    }
+  }
+
+private:
+  mutable std::mutex      mutex_;
+  std::condition_variable wakeup_;
+  std::deque<WAVEHDR*>    queue_;
+  std::thread             worker_;
+  WAVEFORMATEX            wfx_ = { 0 };
+  HANDLE                  hEvent_ = NULL;
+  WaveVolume              volume_ = { 0xFFFF, 0xFFFF };
+  uint64_t                position_ = 0;
+  uint64_t                generation_ = 0;
+  double                  speed_ = 1.0;
+  bool                    isPaused_ = false;
+  bool                    isClosing_ = false;
+
+}; // class NullWaveSink
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Device that appends the raw PCM stream to a file; useful for verifying the
+// exact bytes WaveOut delivered. Defaults to faster than real time.
+
+class FileWaveSink : public NullWaveSink
+{
+public:
+  explicit FileWaveSink( const std::filesystem::path& rawPcmFile, double speed = 0.0 )
+    : NullWaveSink( speed ),
+      file_( rawPcmFile, std::ios::binary | std::ios::trunc )
+  {
+    assert( file_.is_open() );
+  }
+
+  ~FileWaveSink() override
+  {
+    Close(); // stop the consumer before file_ is destroyed
+  }
+
+protected:
+
+  void Consume( const uint8_t* pcm, size_t bytes ) override
+  {
+    file_.write( reinterpret_cast<const char*>( pcm ), static_cast<std::streamsize>( bytes ) );
+  }
+
+private:
+  std::ofstream file_;
+
+}; // class FileWaveSink
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
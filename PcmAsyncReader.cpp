@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmAsyncReader.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "AudioMetrics.h"
+#include "PcmAsyncReader.h"
+
+namespace PKIsensee
+{
+
+PcmAsyncReader::PcmAsyncReader( PcmSource& source, size_t framesPerBuffer, size_t buffersInFlight )
+  : source_( source ),
+    framesPerBuffer_( framesPerBuffer ),
+    buffersInFlight_( buffersInFlight )
+{
+  assert( framesPerBuffer_ > 0 );
+  assert( buffersInFlight_ > 0 );
+}
+
+PcmAsyncReader::~PcmAsyncReader()
+{
+  Stop();
+}
+
+void PcmAsyncReader::Start()
+{
+  assert( !worker_.joinable() );
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    isStopping_ = false;
+  }
+  worker_ = std::thread( [this] { Run(); } );
+}
+
+void PcmAsyncReader::Stop()
+{
+  if( !worker_.joinable() )
+    return;
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    isStopping_ = true;
+  }
+  wake_.notify_all();
+  worker_.join();
+  ready_.clear();
+  promises_.clear();
+}
+
+AsyncReadStatus PcmAsyncReader::TryRead( std::unique_ptr<PcmBuffer>& pcmBuffer )
+{
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    assert( promises_.empty() ); // ReadAsync() results would arrive out of order
+    if( ready_.empty() )
+      return isEnded_ ? AsyncReadStatus::EndOfStream : AsyncReadStatus::Pending;
+    pcmBuffer = std::move( ready_.front() );
+    ready_.pop_front();
+  }
+  wake_.notify_all();
+  return AsyncReadStatus::Ready;
+}
+
+std::future<std::unique_ptr<PcmBuffer>> PcmAsyncReader::ReadAsync()
+{
+  std::promise<std::unique_ptr<PcmBuffer>> promise;
+  auto result = promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    if( ready_.empty() && !isEnded_ )
+    {
+      promises_.push_back( std::move( promise ) );
+      return result;
+    }
+    if( ready_.empty() )
+    {
+      promise.set_value( nullptr );
+      return result;
+    }
+    promise.set_value( std::move( ready_.front() ) );
+    ready_.pop_front();
+  }
+  wake_.notify_all();
+  return result;
+}
+
+// Reads whenever fewer than buffersInFlight are waiting. The source is read
+// without the lock held, so callers never wait on it.
+void PcmAsyncReader::Run()
+{
+  auto blockAlign = source_.GetFormat().GetBlockAlign();
+  assert( blockAlign > 0 );
+  for( ;; )
+  {
+    {
+      std::unique_lock<std::mutex> lock( mutex_ );
+      wake_.wait( lock, [this] { return isStopping_ || isEnded_ || ready_.size() < buffersInFlight_; } );
+      if( isStopping_ || isEnded_ )
+        return;
+    }
+
+    std::vector<uint8_t> pcm( framesPerBuffer_ * blockAlign );
+    size_t frameCount = 0;
+    {
+      AudioMetricTimer decodeTimer( AudioMetric::DecodeTime );
+      frameCount = source_.Read( pcm.data(), framesPerBuffer_ );
+    }
+
+    std::lock_guard<std::mutex> lock( mutex_ );
+    if( isStopping_ )
+      return;
+    if( frameCount == 0 )
+    {
+      isEnded_ = true;
+      while( !promises_.empty() )
+        Fulfill( nullptr );
+      return;
+    }
+    GetAudioMetrics().Add( AudioCounter::SamplesDecoded );
+    pcm.resize( frameCount * blockAlign );
+    auto pcmBuffer = std::make_unique<VectorPcmBuffer>( std::move( pcm ) );
+    if( promises_.empty() )
+      ready_.push_back( std::move( pcmBuffer ) );
+    else
+      Fulfill( std::move( pcmBuffer ) );
+  }
+}
+
+void PcmAsyncReader::Fulfill( std::unique_ptr<PcmBuffer> pcmBuffer )
+{
+  promises_.front().set_value( std::move( pcmBuffer ) );
+  promises_.pop_front();
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmAsyncReader.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "PcmBufferChain.h"
+#include "PcmPipeline.h"
+
+namespace PKIsensee
+{
+
+enum class AsyncReadStatus
+{
+  Ready,
+  Pending,
+  EndOfStream
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Reads a PcmSource ahead on a thread of its own, so decoding overlaps
+// whatever the caller does with each buffer. Up to buffersInFlight buffers of
+// framesPerBuffer frames are being decoded or waiting to be read. This is the
+// portable counterpart of WinMediaAsyncSourceReader (WinMediaFoundation.h),
+// with the same calls: Start(), then the non-blocking TryRead() or ReadAsync(),
+// whose future can be waited on or polled. Don't mix the two while a
+// ReadAsync() is outstanding.
+//
+// Typical use:
+//
+//    WavFileSource source;
+//    source.Open( file );
+//    PcmAsyncReader reader( source );
+//    reader.Start();
+//    while( auto pcmBuffer = reader.ReadAsync().get() ) // null at end of stream
+//      Process( pcmBuffer->GetData(), pcmBuffer->GetSize() );
+
+class PcmAsyncReader
+{
+public:
+  // The source must outlive the reader
+  explicit PcmAsyncReader( PcmSource& source, size_t framesPerBuffer = 4096, size_t buffersInFlight = 4 );
+
+  // Disable copy/move
+  PcmAsyncReader( const PcmAsyncReader& ) = delete;
+  PcmAsyncReader& operator=( const PcmAsyncReader& ) = delete;
+  PcmAsyncReader( PcmAsyncReader&& ) = delete;
+  PcmAsyncReader& operator=( PcmAsyncReader&& ) = delete;
+
+  ~PcmAsyncReader();
+
+  PcmStreamFormat GetFormat() const
+  {
+    return source_.GetFormat();
+  }
+
+  // Begins reading ahead
+  void Start();
+
+  // Waits for a read in progress, then discards what was read ahead; waiting
+  // futures see broken_promise
+  void Stop();
+
+  AsyncReadStatus TryRead( std::unique_ptr<PcmBuffer>& pcmBuffer );
+
+  // The buffer is null at end of stream
+  std::future<std::unique_ptr<PcmBuffer>> ReadAsync();
+
+private:
+  void Run();
+  void Fulfill( std::unique_ptr<PcmBuffer> pcmBuffer );
+
+private:
+  PcmSource&                                            source_;
+  size_t                                                framesPerBuffer_;
+  size_t                                                buffersInFlight_;
+  std::thread                                           worker_;
+  std::mutex                                            mutex_;
+  std::condition_variable                               wake_;     // a buffer was read, or Stop()
+  std::deque<std::unique_ptr<PcmBuffer>>                ready_;    // in stream order
+  std::deque<std::promise<std::unique_ptr<PcmBuffer>>>  promises_; // from ReadAsync(), oldest first
+  bool                                                  isEnded_ = false;
+  bool                                                  isStopping_ = false;
+
+}; // class PcmAsyncReader
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,256 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmBufferChain.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// A block of PCM that stays put until its last owner lets go. Decoders hand
+// these to WinWaveStream, which points WAVEHDRs straight at the data and
+// releases each block only once the device has returned every buffer that
+// referenced it. WinMediaPcmBuffer (WinMediaFoundation.h) wraps a locked
+// IMFMediaBuffer; VectorPcmBuffer owns its memory.
+
+class PcmBuffer
+{
+public:
+  PcmBuffer() = default;
+  virtual ~PcmBuffer() = default;
+
+  // Disable copy/move
+  PcmBuffer( const PcmBuffer& ) = delete;
+  PcmBuffer& operator=( const PcmBuffer& ) = delete;
+  PcmBuffer( PcmBuffer&& ) = delete;
+  PcmBuffer& operator=( PcmBuffer&& ) = delete;
+
+  virtual const uint8_t* GetData() const = 0;
+  virtual size_t GetSize() const = 0;
+};
+
+class VectorPcmBuffer : public PcmBuffer
+{
+public:
+  explicit VectorPcmBuffer( std::vector<uint8_t> pcm )
+    : pcm_( std::move( pcm ) )
+  {
+  }
+
+  const uint8_t* GetData() const override
+  {
+    return pcm_.data();
+  }
+
+  size_t GetSize() const override
+  {
+    return pcm_.size();
+  }
+
+private:
+  std::vector<uint8_t> pcm_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// FIFO of PcmBuffers read as one continuous stream. GetFront() returns the
+// contiguous bytes remaining in the oldest buffer along with a reference that
+// keeps them alive after Skip() moves past them; Read() copies across buffers.
+// The chain doesn't own the buffers: once neither the chain nor a reference
+// holds one, GetReleased() hands it back to be destroyed, which the caller may
+// leave to another thread. Buffers are counted in a pool sized by Reserve(),
+// so nothing allocates afterwards. Not thread-safe.
+
+class PcmBufferChain
+{
+public:
+  // A reference from GetFront(); give it back with Release()
+  using BufferRef = uint32_t;
+  static constexpr BufferRef kNoBuffer = UINT32_MAX;
+
+  // Room for maxBuffers pushed and not yet released; clears the chain
+  void Reserve( size_t maxBuffers )
+  {
+    assert( maxBuffers < kNoBuffer );
+    nodes_.assign( maxBuffers, Node() );
+    freeNodes_.clear();
+    freeNodes_.reserve( maxBuffers );
+    for( auto i = maxBuffers; i > 0; --i )
+      freeNodes_.push_back( static_cast<BufferRef>( i - 1 ) );
+    chain_.assign( maxBuffers, kNoBuffer );
+    chainHead_ = 0;
+    chainCount_ = 0;
+    released_.clear();
+    released_.reserve( maxBuffers );
+    offset_ = 0;
+    size_ = 0;
+  }
+
+  size_t GetCapacity() const
+  {
+    return nodes_.size();
+  }
+
+  // Fails if Reserve() didn't make room
+  bool Push( PcmBuffer* pcmBuffer )
+  {
+    assert( pcmBuffer != nullptr );
+    if( freeNodes_.empty() )
+      return false;
+    auto node = freeNodes_.back();
+    freeNodes_.pop_back();
+    nodes_[ node ] = { pcmBuffer, 1 };
+    if( pcmBuffer->GetSize() == 0 )
+    {
+      Release( node );
+      return true;
+    }
+    chain_[ ( chainHead_ + chainCount_ ) % chain_.size() ] = node;
+    ++chainCount_;
+    size_ += pcmBuffer->GetSize();
+    return true;
+  }
+
+  bool IsEmpty() const
+  {
+    return size_ == 0;
+  }
+
+  // Total bytes not yet skipped
+  size_t GetSize() const
+  {
+    return size_;
+  }
+
+  // Bytes that can be read from the front buffer without crossing into the next
+  size_t GetFrontSize() const
+  {
+    return ( chainCount_ == 0 ) ? 0 : GetFrontBuffer().GetSize() - offset_;
+  }
+
+  // Replaces any buffer bufferRef held
+  const uint8_t* GetFront( BufferRef& bufferRef )
+  {
+    assert( !IsEmpty() );
+    auto node = chain_[ chainHead_ ];
+    ++nodes_[ node ].refCount;
+    Release( bufferRef );
+    bufferRef = node;
+    return GetFrontBuffer().GetData() + offset_;
+  }
+
+  // Drops the reference, if any; bufferRef is then kNoBuffer
+  void Release( BufferRef& bufferRef )
+  {
+    if( bufferRef == kNoBuffer )
+      return;
+    auto& node = nodes_[ bufferRef ];
+    assert( node.refCount > 0 );
+    if( --node.refCount == 0 )
+    {
+      released_.push_back( node.pcmBuffer );
+      node.pcmBuffer = nullptr;
+      freeNodes_.push_back( bufferRef );
+    }
+    bufferRef = kNoBuffer;
+  }
+
+  void Skip( size_t bytes )
+  {
+    assert( bytes <= GetFrontSize() );
+    offset_ += bytes;
+    size_ -= bytes;
+    if( offset_ == GetFrontBuffer().GetSize() )
+      PopFront();
+  }
+
+  // Copies up to bytes, releasing buffers as they're emptied; returns bytes copied
+  size_t Read( uint8_t* pcm, size_t bytes )
+  {
+    size_t bytesRead = 0;
+    while( bytesRead < bytes && !IsEmpty() )
+    {
+      auto chunk = std::min( bytes - bytesRead, GetFrontSize() );
+      std::memcpy( pcm + bytesRead, GetFrontBuffer().GetData() + offset_, chunk );
+      bytesRead += chunk;
+      Skip( chunk );
+    }
+    return bytesRead;
+  }
+
+  // Retrieves a buffer no longer referenced, which the caller now owns
+  bool GetReleased( PcmBuffer*& pcmBuffer )
+  {
+    if( released_.empty() )
+      return false;
+    pcmBuffer = released_.back();
+    released_.pop_back();
+    return true;
+  }
+
+  // Lets go of every buffer in the chain; references from GetFront() still hold theirs
+  void Clear()
+  {
+    while( chainCount_ != 0 )
+      PopFront();
+    offset_ = 0;
+    size_ = 0;
+  }
+
+private:
+  struct Node
+  {
+    PcmBuffer* pcmBuffer = nullptr;
+    uint32_t   refCount = 0; // the chain's, plus one per BufferRef
+  };
+
+  const PcmBuffer& GetFrontBuffer() const
+  {
+    return *nodes_[ chain_[ chainHead_ ] ].pcmBuffer;
+  }
+
+  void PopFront()
+  {
+    auto node = chain_[ chainHead_ ];
+    chainHead_ = ( chainHead_ + 1 ) % chain_.size();
+    --chainCount_;
+    offset_ = 0;
+    Release( node );
+  }
+
+private:
+  std::vector<Node>       nodes_;
+  std::vector<BufferRef>  freeNodes_;
+  std::vector<BufferRef>  chain_;      // ring of nodes, oldest first
+  size_t                  chainHead_ = 0;
+  size_t                  chainCount_ = 0;
+  std::vector<PcmBuffer*> released_;
+  size_t                  offset_ = 0; // into the front buffer
+  size_t                  size_ = 0;
+
+};
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
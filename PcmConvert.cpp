@@ -0,0 +1,471 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmConvert.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "PcmConvert.h"
+
+namespace PKIsensee
+{
+
+namespace
+{
+
+constexpr size_t kBlockSamples = 1024; // intermediate floats and noise stay in L1
+
+constexpr float kScale16 = 32768.0f;
+constexpr float kScale24 = 8388608.0f;
+constexpr float kScale32 = 2147483648.0f;
+constexpr float kMin16 = -32768.0f;
+constexpr float kMax16 = 32767.0f;
+constexpr float kMin24 = -8388608.0f;
+constexpr float kMax24 = 8388607.0f;
+constexpr float kMin32 = -2147483648.0f;
+constexpr float kMax32 = 2147483520.0f; // largest float below 2^31
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Scalar reference kernels
+
+int32_t ToInt( float sample, float scale, float lo, float hi, float noise )
+{
+  return static_cast<int32_t>( std::lrint( std::clamp( sample * scale + noise, lo, hi ) ) );
+}
+
+void StoreInt24( uint8_t* out, int32_t sample )
+{
+  out[ 0 ] = static_cast<uint8_t>( sample );
+  out[ 1 ] = static_cast<uint8_t>( sample >> 8 );
+  out[ 2 ] = static_cast<uint8_t>( sample >> 16 );
+}
+
+int32_t LoadInt24( const uint8_t* in )
+{
+  auto bits = ( uint32_t( in[ 0 ] ) << 8 ) | ( uint32_t( in[ 1 ] ) << 16 ) | ( uint32_t( in[ 2 ] ) << 24 );
+  return static_cast<int32_t>( bits ) >> 8; // sign extends
+}
+
+void FloatToInt16Scalar( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int16_t*>( dst );
+  for( size_t i = 0; i < sampleCount; ++i )
+    out[ i ] = static_cast<int16_t>( ToInt( src[ i ], kScale16, kMin16, kMax16, noise ? noise[ i ] : 0.0f ) );
+}
+
+void FloatToInt24Scalar( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<uint8_t*>( dst );
+  for( size_t i = 0; i < sampleCount; ++i )
+    StoreInt24( out + ( i * 3 ), ToInt( src[ i ], kScale24, kMin24, kMax24, noise ? noise[ i ] : 0.0f ) );
+}
+
+void FloatToInt32Scalar( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int32_t*>( dst );
+  for( size_t i = 0; i < sampleCount; ++i )
+    out[ i ] = ToInt( src[ i ], kScale32, kMin32, kMax32, noise ? noise[ i ] : 0.0f );
+}
+
+void FloatToFloat( const float* src, void* dst, size_t sampleCount, const float* )
+{
+  std::memcpy( dst, src, sampleCount * sizeof( float ) );
+}
+
+void Int16ToFloatScalar( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int16_t*>( src );
+  for( size_t i = 0; i < sampleCount; ++i )
+    dst[ i ] = static_cast<float>( in[ i ] ) * ( 1.0f / kScale16 );
+}
+
+void Int24ToFloatScalar( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const uint8_t*>( src );
+  for( size_t i = 0; i < sampleCount; ++i )
+    dst[ i ] = static_cast<float>( LoadInt24( in + ( i * 3 ) ) ) * ( 1.0f / kScale24 );
+}
+
+void Int32ToFloatScalar( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int32_t*>( src );
+  for( size_t i = 0; i < sampleCount; ++i )
+    dst[ i ] = static_cast<float>( in[ i ] ) * ( 1.0f / kScale32 );
+}
+
+void FloatToFloatCopy( const void* src, float* dst, size_t sampleCount )
+{
+  std::memcpy( dst, src, sampleCount * sizeof( float ) );
+}
+
+const PcmConvertKernels kScalarKernels =
+{
+  { FloatToInt16Scalar, FloatToInt24Scalar, FloatToInt32Scalar, FloatToFloat },
+  { Int16ToFloatScalar, Int24ToFloatScalar, Int32ToFloatScalar, FloatToFloatCopy }
+};
+
+#if defined( PKI_SIMD_X64 )
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// SSE2. Rounding comes from MXCSR, which defaults to nearest even like
+// lrint(). Int24 needs byte shuffles, so it's left to the scalar kernels.
+
+__m128 ScaleClampSse2( const float* src, const float* noise, __m128 scale, __m128 lo, __m128 hi )
+{
+  __m128 v = _mm_mul_ps( _mm_loadu_ps( src ), scale );
+  if( noise != nullptr )
+    v = _mm_add_ps( v, _mm_loadu_ps( noise ) );
+  return _mm_min_ps( _mm_max_ps( v, lo ), hi );
+}
+
+void FloatToInt16Sse2( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int16_t*>( dst );
+  const __m128 scale = _mm_set1_ps( kScale16 );
+  const __m128 lo = _mm_set1_ps( kMin16 );
+  const __m128 hi = _mm_set1_ps( kMax16 );
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    __m128i a = _mm_cvtps_epi32( ScaleClampSse2( src + i, noise ? noise + i : nullptr, scale, lo, hi ) );
+    __m128i b = _mm_cvtps_epi32( ScaleClampSse2( src + i + 4, noise ? noise + i + 4 : nullptr, scale, lo, hi ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), _mm_packs_epi32( a, b ) );
+  }
+  FloatToInt16Scalar( src + i, out + i, sampleCount - i, noise ? noise + i : nullptr );
+}
+
+void FloatToInt32Sse2( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int32_t*>( dst );
+  const __m128 scale = _mm_set1_ps( kScale32 );
+  const __m128 lo = _mm_set1_ps( kMin32 );
+  const __m128 hi = _mm_set1_ps( kMax32 );
+  size_t i = 0;
+  for( ; i + 4 <= sampleCount; i += 4 )
+  {
+    __m128i v = _mm_cvtps_epi32( ScaleClampSse2( src + i, noise ? noise + i : nullptr, scale, lo, hi ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), v );
+  }
+  FloatToInt32Scalar( src + i, out + i, sampleCount - i, noise ? noise + i : nullptr );
+}
+
+void Int16ToFloatSse2( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int16_t*>( src );
+  const __m128 scale = _mm_set1_ps( 1.0f / kScale16 );
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    // Unpacking a value with itself and shifting right sign extends it
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i ) );
+    __m128i a = _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 );
+    __m128i b = _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 );
+    _mm_storeu_ps( dst + i, _mm_mul_ps( _mm_cvtepi32_ps( a ), scale ) );
+    _mm_storeu_ps( dst + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( b ), scale ) );
+  }
+  Int16ToFloatScalar( in + i, dst + i, sampleCount - i );
+}
+
+void Int32ToFloatSse2( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int32_t*>( src );
+  const __m128 scale = _mm_set1_ps( 1.0f / kScale32 );
+  size_t i = 0;
+  for( ; i + 4 <= sampleCount; i += 4 )
+  {
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i ) );
+    _mm_storeu_ps( dst + i, _mm_mul_ps( _mm_cvtepi32_ps( v ), scale ) );
+  }
+  Int32ToFloatScalar( in + i, dst + i, sampleCount - i );
+}
+
+const PcmConvertKernels kSse2Kernels =
+{
+  { FloatToInt16Sse2, FloatToInt24Scalar, FloatToInt32Sse2, FloatToFloat },
+  { Int16ToFloatSse2, Int24ToFloatScalar, Int32ToFloatSse2, FloatToFloatCopy }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// AVX2. Int24 is packed and unpacked with byte shuffles within each 128-bit
+// lane. The 16-byte loads and stores run 4 bytes past the 8 samples they
+// handle, so those loops stop 2 samples early and leave the rest to scalar.
+
+PKI_TARGET_AVX2 __m256 ScaleClampAvx2( const float* src, const float* noise, __m256 scale, __m256 lo, __m256 hi )
+{
+  __m256 v = _mm256_mul_ps( _mm256_loadu_ps( src ), scale );
+  if( noise != nullptr )
+    v = _mm256_add_ps( v, _mm256_loadu_ps( noise ) );
+  return _mm256_min_ps( _mm256_max_ps( v, lo ), hi );
+}
+
+PKI_TARGET_AVX2 void FloatToInt16Avx2( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int16_t*>( dst );
+  const __m256 scale = _mm256_set1_ps( kScale16 );
+  const __m256 lo = _mm256_set1_ps( kMin16 );
+  const __m256 hi = _mm256_set1_ps( kMax16 );
+  size_t i = 0;
+  for( ; i + 16 <= sampleCount; i += 16 )
+  {
+    __m256i a = _mm256_cvtps_epi32( ScaleClampAvx2( src + i, noise ? noise + i : nullptr, scale, lo, hi ) );
+    __m256i b = _mm256_cvtps_epi32( ScaleClampAvx2( src + i + 8, noise ? noise + i + 8 : nullptr, scale, lo, hi ) );
+
+    // Packing works within lanes, leaving a0-3 b0-3 a4-7 b4-7; put them in order
+    __m256i packed = _mm256_permute4x64_epi64( _mm256_packs_epi32( a, b ), 0xD8 );
+    _mm256_storeu_si256( reinterpret_cast<__m256i*>( out + i ), packed );
+  }
+  FloatToInt16Sse2( src + i, out + i, sampleCount - i, noise ? noise + i : nullptr );
+}
+
+PKI_TARGET_AVX2 void FloatToInt24Avx2( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<uint8_t*>( dst );
+  const __m256 scale = _mm256_set1_ps( kScale24 );
+  const __m256 lo = _mm256_set1_ps( kMin24 );
+  const __m256 hi = _mm256_set1_ps( kMax24 );
+  const __m256i pack = _mm256_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+  size_t i = 0;
+  for( ; i + 10 <= sampleCount; i += 8 )
+  {
+    __m256i v = _mm256_cvtps_epi32( ScaleClampAvx2( src + i, noise ? noise + i : nullptr, scale, lo, hi ) );
+    v = _mm256_shuffle_epi8( v, pack );
+
+    // The second store overwrites the first one's 4 bytes of padding
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( out + ( i * 3 ) ), _mm256_castsi256_si128( v ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( out + ( i * 3 ) + 12 ), _mm256_extracti128_si256( v, 1 ) );
+  }
+  FloatToInt24Scalar( src + i, out + ( i * 3 ), sampleCount - i, noise ? noise + i : nullptr );
+}
+
+PKI_TARGET_AVX2 void FloatToInt32Avx2( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int32_t*>( dst );
+  const __m256 scale = _mm256_set1_ps( kScale32 );
+  const __m256 lo = _mm256_set1_ps( kMin32 );
+  const __m256 hi = _mm256_set1_ps( kMax32 );
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    __m256i v = _mm256_cvtps_epi32( ScaleClampAvx2( src + i, noise ? noise + i : nullptr, scale, lo, hi ) );
+    _mm256_storeu_si256( reinterpret_cast<__m256i*>( out + i ), v );
+  }
+  FloatToInt32Sse2( src + i, out + i, sampleCount - i, noise ? noise + i : nullptr );
+}
+
+PKI_TARGET_AVX2 void Int16ToFloatAvx2( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int16_t*>( src );
+  const __m256 scale = _mm256_set1_ps( 1.0f / kScale16 );
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    __m256i v = _mm256_cvtepi16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i ) ) );
+    _mm256_storeu_ps( dst + i, _mm256_mul_ps( _mm256_cvtepi32_ps( v ), scale ) );
+  }
+  Int16ToFloatScalar( in + i, dst + i, sampleCount - i );
+}
+
+PKI_TARGET_AVX2 void Int24ToFloatAvx2( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const uint8_t*>( src );
+  const __m256 scale = _mm256_set1_ps( 1.0f / kScale24 );
+
+  // Each sample goes to the top three bytes of its int32, then shifts down with sign
+  const __m256i unpack = _mm256_setr_epi8( -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                           -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11 );
+  size_t i = 0;
+  for( ; i + 10 <= sampleCount; i += 8 )
+  {
+    __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + ( i * 3 ) ) );
+    __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + ( i * 3 ) + 12 ) );
+    __m256i v = _mm256_inserti128_si256( _mm256_castsi128_si256( a ), b, 1 );
+    v = _mm256_srai_epi32( _mm256_shuffle_epi8( v, unpack ), 8 );
+    _mm256_storeu_ps( dst + i, _mm256_mul_ps( _mm256_cvtepi32_ps( v ), scale ) );
+  }
+  Int24ToFloatScalar( in + ( i * 3 ), dst + i, sampleCount - i );
+}
+
+PKI_TARGET_AVX2 void Int32ToFloatAvx2( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int32_t*>( src );
+  const __m256 scale = _mm256_set1_ps( 1.0f / kScale32 );
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + i ) );
+    _mm256_storeu_ps( dst + i, _mm256_mul_ps( _mm256_cvtepi32_ps( v ), scale ) );
+  }
+  Int32ToFloatScalar( in + i, dst + i, sampleCount - i );
+}
+
+const PcmConvertKernels kAvx2Kernels =
+{
+  { FloatToInt16Avx2, FloatToInt24Avx2, FloatToInt32Avx2, FloatToFloat },
+  { Int16ToFloatAvx2, Int24ToFloatAvx2, Int32ToFloatAvx2, FloatToFloatCopy }
+};
+
+#endif // PKI_SIMD_X64
+
+#if defined( PKI_SIMD_NEON )
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// NEON. vcvtnq rounds to nearest even regardless of FPCR. Int24 is left to
+// the scalar kernels.
+
+float32x4_t ScaleClampNeon( const float* src, const float* noise, float32x4_t scale, float32x4_t lo, float32x4_t hi )
+{
+  float32x4_t v = vmulq_f32( vld1q_f32( src ), scale );
+  if( noise != nullptr )
+    v = vaddq_f32( v, vld1q_f32( noise ) );
+  return vminq_f32( vmaxq_f32( v, lo ), hi );
+}
+
+void FloatToInt16Neon( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int16_t*>( dst );
+  const float32x4_t scale = vdupq_n_f32( kScale16 );
+  const float32x4_t lo = vdupq_n_f32( kMin16 );
+  const float32x4_t hi = vdupq_n_f32( kMax16 );
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    int32x4_t a = vcvtnq_s32_f32( ScaleClampNeon( src + i, noise ? noise + i : nullptr, scale, lo, hi ) );
+    int32x4_t b = vcvtnq_s32_f32( ScaleClampNeon( src + i + 4, noise ? noise + i + 4 : nullptr, scale, lo, hi ) );
+    vst1q_s16( out + i, vcombine_s16( vqmovn_s32( a ), vqmovn_s32( b ) ) );
+  }
+  FloatToInt16Scalar( src + i, out + i, sampleCount - i, noise ? noise + i : nullptr );
+}
+
+void FloatToInt32Neon( const float* src, void* dst, size_t sampleCount, const float* noise )
+{
+  auto* out = static_cast<int32_t*>( dst );
+  const float32x4_t scale = vdupq_n_f32( kScale32 );
+  const float32x4_t lo = vdupq_n_f32( kMin32 );
+  const float32x4_t hi = vdupq_n_f32( kMax32 );
+  size_t i = 0;
+  for( ; i + 4 <= sampleCount; i += 4 )
+    vst1q_s32( out + i, vcvtnq_s32_f32( ScaleClampNeon( src + i, noise ? noise + i : nullptr, scale, lo, hi ) ) );
+  FloatToInt32Scalar( src + i, out + i, sampleCount - i, noise ? noise + i : nullptr );
+}
+
+void Int16ToFloatNeon( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int16_t*>( src );
+  const float32x4_t scale = vdupq_n_f32( 1.0f / kScale16 );
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    int16x8_t v = vld1q_s16( in + i );
+    vst1q_f32( dst + i, vmulq_f32( vcvtq_f32_s32( vmovl_s16( vget_low_s16( v ) ) ), scale ) );
+    vst1q_f32( dst + i + 4, vmulq_f32( vcvtq_f32_s32( vmovl_high_s16( v ) ), scale ) );
+  }
+  Int16ToFloatScalar( in + i, dst + i, sampleCount - i );
+}
+
+void Int32ToFloatNeon( const void* src, float* dst, size_t sampleCount )
+{
+  auto* in = static_cast<const int32_t*>( src );
+  const float32x4_t scale = vdupq_n_f32( 1.0f / kScale32 );
+  size_t i = 0;
+  for( ; i + 4 <= sampleCount; i += 4 )
+    vst1q_f32( dst + i, vmulq_f32( vcvtq_f32_s32( vld1q_s32( in + i ) ), scale ) );
+  Int32ToFloatScalar( in + i, dst + i, sampleCount - i );
+}
+
+const PcmConvertKernels kNeonKernels =
+{
+  { FloatToInt16Neon, FloatToInt24Scalar, FloatToInt32Neon, FloatToFloat },
+  { Int16ToFloatNeon, Int24ToFloatScalar, Int32ToFloatNeon, FloatToFloatCopy }
+};
+
+#endif // PKI_SIMD_NEON
+
+} // anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+const PcmConvertKernels& GetPcmConvertKernels( SimdLevel simdLevel )
+{
+  assert( IsSimdLevelSupported( simdLevel ) );
+  switch( simdLevel )
+  {
+#if defined( PKI_SIMD_X64 )
+  case SimdLevel::SSE2: return kSse2Kernels;
+  case SimdLevel::AVX2: return kAvx2Kernels;
+#endif
+#if defined( PKI_SIMD_NEON )
+  case SimdLevel::NEON: return kNeonKernels;
+#endif
+  default: return kScalarKernels;
+  }
+}
+
+void ConvertSamples( const void* src, SampleFormat srcFormat, void* dst, SampleFormat dstFormat,
+                     size_t sampleCount, TpdfDither* dither, SimdLevel simdLevel )
+{
+  if( srcFormat == dstFormat )
+  {
+    std::memmove( dst, src, sampleCount * GetBytesPerSample( srcFormat ) );
+    return;
+  }
+
+  const auto& kernels = GetPcmConvertKernels( simdLevel );
+  auto toFloat = kernels.toFloat[ static_cast<size_t>( srcFormat ) ];
+  auto fromFloat = kernels.fromFloat[ static_cast<size_t>( dstFormat ) ];
+  bool isDithered = ( dither != nullptr ) &&
+                    ( dstFormat == SampleFormat::Int16 || dstFormat == SampleFormat::Int24 );
+  if( dstFormat == SampleFormat::Float32 )
+  {
+    toFloat( src, static_cast<float*>( dst ), sampleCount );
+    return;
+  }
+  if( srcFormat == SampleFormat::Float32 && !isDithered )
+  {
+    fromFloat( static_cast<const float*>( src ), dst, sampleCount, nullptr );
+    return;
+  }
+
+  // Integer sources are widened to float a block at a time
+  float samples[ kBlockSamples ];
+  float noise[ kBlockSamples ];
+  auto* in = static_cast<const uint8_t*>( src );
+  auto* out = static_cast<uint8_t*>( dst );
+  auto srcBytes = GetBytesPerSample( srcFormat );
+  auto dstBytes = GetBytesPerSample( dstFormat );
+  for( size_t i = 0; i < sampleCount; i += kBlockSamples )
+  {
+    auto count = std::min( kBlockSamples, sampleCount - i );
+    const float* floats = reinterpret_cast<const float*>( in + ( i * srcBytes ) );
+    if( srcFormat != SampleFormat::Float32 )
+    {
+      toFloat( in + ( i * srcBytes ), samples, count );
+      floats = samples;
+    }
+    if( isDithered )
+      dither->Generate( noise, count );
+    fromFloat( floats, out + ( i * dstBytes ), count, isDithered ? noise : nullptr );
+  }
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmConvert.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "Simd.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Interleaved sample formats. Float32 full scale is [-1, 1); integer formats
+// are signed, little-endian, and Int24 is packed into three bytes.
+
+enum class SampleFormat
+{
+  Int16,
+  Int24,
+  Int32,
+  Float32
+};
+
+constexpr uint32_t GetBytesPerSample( SampleFormat sampleFormat )
+{
+  switch( sampleFormat )
+  {
+  case SampleFormat::Int16:   return 2;
+  case SampleFormat::Int24:   return 3;
+  case SampleFormat::Int32:   return 4;
+  case SampleFormat::Float32: return 4;
+  default: return 0;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Triangular (TPDF) dither noise in units of the output LSB: the difference of
+// two uniform values, so it spans (-1, 1) and peaks at zero. Adding it before
+// rounding turns the truncation distortion of quiet signals into a constant,
+// signal-independent noise floor. Not thread-safe; use one per stream.
+
+class TpdfDither
+{
+public:
+  explicit TpdfDither( uint32_t seed = 0x9E3779B9 )
+  {
+    // Lanes must start far apart; splitmix spreads one seed across them
+    uint64_t mix = seed;
+    for( auto& state : state_ )
+    {
+      mix += 0x9E3779B97F4A7C15;
+      auto z = mix;
+      z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9;
+      z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EB;
+      state = static_cast<uint32_t>( z ^ ( z >> 31 ) ) | 1; // never zero
+    }
+  }
+
+  void Generate( float* noise, size_t count )
+  {
+    for( size_t i = 0; i < count; i += kLanes )
+    {
+      float a[ kLanes ];
+      float b[ kLanes ];
+      for( size_t lane = 0; lane < kLanes; ++lane )
+        a[ lane ] = GetUniform( state_[ lane ] );
+      for( size_t lane = 0; lane < kLanes; ++lane )
+        b[ lane ] = GetUniform( state_[ lane ] );
+      for( size_t lane = 0; lane < kLanes && i + lane < count; ++lane )
+        noise[ i + lane ] = a[ lane ] - b[ lane ];
+    }
+  }
+
+private:
+  // Independent generators stepped in lockstep, so compilers vectorize them
+  static constexpr size_t kLanes = 8;
+
+  // xorshift32; the top 24 bits give every float in [0, 1) with 2^-24 spacing
+  static float GetUniform( uint32_t& state )
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<float>( state >> 8 ) * ( 1.0f / 16777216.0f );
+  }
+
+private:
+  uint32_t state_[ kLanes ];
+
+}; // class TpdfDither
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Conversion kernels, one set per SimdLevel. Float to integer scales by
+// 2^(bits-1), adds the optional noise (in LSBs), clamps to the integer range
+// and rounds to nearest even. Integer to float scales by 2^-(bits-1), which
+// is exact. Every SimdLevel produces bit-identical output, so the scalar
+// kernels are the reference. Where a vector form doesn't pay off for a
+// format, that level uses the scalar kernel.
+
+struct PcmConvertKernels
+{
+  using FromFloat = void (*)( const float* src, void* dst, size_t sampleCount, const float* noise );
+  using ToFloat = void (*)( const void* src, float* dst, size_t sampleCount );
+
+  FromFloat fromFloat[ 4 ]; // indexed by destination SampleFormat
+  ToFloat   toFloat[ 4 ];   // indexed by source SampleFormat
+};
+
+// Requires IsSimdLevelSupported( simdLevel )
+const PcmConvertKernels& GetPcmConvertKernels( SimdLevel simdLevel = GetSimdLevel() );
+
+// Converts sampleCount samples (not frames). Integer to integer conversions go
+// through float, which is exact for Int16 and Int24 sources; Int32 sources keep
+// 24 significant bits. If dither is given it's applied when the destination is
+// Int16 or Int24. src and dst must not overlap unless the formats match.
+void ConvertSamples( const void* src, SampleFormat srcFormat, void* dst, SampleFormat dstFormat,
+                     size_t sampleCount, TpdfDither* dither = nullptr, SimdLevel simdLevel = GetSimdLevel() );
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,622 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmMixer.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "PcmMixer.h"
+
+namespace PKIsensee
+{
+
+namespace
+{
+
+constexpr float kMinExponentialGain = 0.0001f; // -80 dB; exponential ramps can't reach zero
+constexpr float kPi = 3.14159265358979f;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Kernels. Gain for sample j of a block is gain[ c ] + step[ c ] * f, where
+// f = j / channelCount and c = j % channelCount, computed the same way at
+// every SimdLevel so all levels agree bit for bit.
+
+struct MixKernels
+{
+  // dst = ( isAccumulating ? dst : 0 ) + src * gain
+  void (*mixRamp)( const float* src, float* dst, size_t frameCount, uint32_t channelCount,
+                   const float* gain, const float* step, bool isAccumulating );
+
+  // Clamps to [-1, 1]; returns the number of samples that were outside
+  size_t (*clamp)( float* buffer, size_t sampleCount );
+};
+
+void MixRampScalar( const float* src, float* dst, size_t begin, size_t end, uint32_t channelCount,
+                    const float* gain, const float* step, bool isAccumulating )
+{
+  for( size_t j = begin; j < end; ++j )
+  {
+    auto c = j % channelCount;
+    auto g = gain[ c ] + step[ c ] * static_cast<float>( j / channelCount );
+    dst[ j ] = isAccumulating ? dst[ j ] + src[ j ] * g : src[ j ] * g;
+  }
+}
+
+void MixRampScalar( const float* src, float* dst, size_t frameCount, uint32_t channelCount,
+                    const float* gain, const float* step, bool isAccumulating )
+{
+  MixRampScalar( src, dst, 0, frameCount * channelCount, channelCount, gain, step, isAccumulating );
+}
+
+size_t ClampScalar( float* buffer, size_t begin, size_t end )
+{
+  size_t clipped = 0;
+  for( size_t i = begin; i < end; ++i )
+  {
+    if( buffer[ i ] > 1.0f || buffer[ i ] < -1.0f )
+      ++clipped;
+    buffer[ i ] = std::min( std::max( buffer[ i ], -1.0f ), 1.0f );
+  }
+  return clipped;
+}
+
+size_t ClampScalar( float* buffer, size_t sampleCount )
+{
+  return ClampScalar( buffer, 0, sampleCount );
+}
+
+const MixKernels kScalarKernels = { MixRampScalar, ClampScalar };
+
+#if defined( PKI_SIMD_X64 )
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// SSE2: 4 samples per vector, so 4 mono or 2 stereo frames
+
+void MixRampSse2( const float* src, float* dst, size_t frameCount, uint32_t channelCount,
+                  const float* gain, const float* step, bool isAccumulating )
+{
+  assert( channelCount == 1 || channelCount == 2 );
+  bool isStereo = ( channelCount == 2 );
+  const __m128 gainV = isStereo ? _mm_setr_ps( gain[ 0 ], gain[ 1 ], gain[ 0 ], gain[ 1 ] ) : _mm_set1_ps( gain[ 0 ] );
+  const __m128 stepV = isStereo ? _mm_setr_ps( step[ 0 ], step[ 1 ], step[ 0 ], step[ 1 ] ) : _mm_set1_ps( step[ 0 ] );
+  const __m128 frameStep = _mm_set1_ps( isStereo ? 2.0f : 4.0f );
+  __m128 frame = isStereo ? _mm_setr_ps( 0.0f, 0.0f, 1.0f, 1.0f ) : _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+
+  auto sampleCount = frameCount * channelCount;
+  size_t j = 0;
+  for( ; j + 4 <= sampleCount; j += 4 )
+  {
+    __m128 g = _mm_add_ps( gainV, _mm_mul_ps( stepV, frame ) );
+    __m128 v = _mm_mul_ps( _mm_loadu_ps( src + j ), g );
+    if( isAccumulating )
+      v = _mm_add_ps( _mm_loadu_ps( dst + j ), v );
+    _mm_storeu_ps( dst + j, v );
+    frame = _mm_add_ps( frame, frameStep ); // exact; frame counts are far below 2^24
+  }
+  MixRampScalar( src, dst, j, sampleCount, channelCount, gain, step, isAccumulating );
+}
+
+size_t ClampSse2( float* buffer, size_t sampleCount )
+{
+  const __m128 lo = _mm_set1_ps( -1.0f );
+  const __m128 hi = _mm_set1_ps( 1.0f );
+  size_t clipped = 0;
+  size_t i = 0;
+  for( ; i + 4 <= sampleCount; i += 4 )
+  {
+    __m128 v = _mm_loadu_ps( buffer + i );
+    __m128 isOutside = _mm_or_ps( _mm_cmpgt_ps( v, hi ), _mm_cmplt_ps( v, lo ) );
+    clipped += static_cast<size_t>( std::popcount( static_cast<uint32_t>( _mm_movemask_ps( isOutside ) ) ) );
+    _mm_storeu_ps( buffer + i, _mm_min_ps( _mm_max_ps( v, lo ), hi ) );
+  }
+  return clipped + ClampScalar( buffer, i, sampleCount );
+}
+
+const MixKernels kSse2Kernels = { MixRampSse2, ClampSse2 };
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// AVX2: 8 samples per vector, so 8 mono or 4 stereo frames
+
+PKI_TARGET_AVX2 void MixRampAvx2( const float* src, float* dst, size_t frameCount, uint32_t channelCount,
+                                  const float* gain, const float* step, bool isAccumulating )
+{
+  assert( channelCount == 1 || channelCount == 2 );
+  bool isStereo = ( channelCount == 2 );
+  const __m256 gainV = isStereo ? _mm256_setr_ps( gain[ 0 ], gain[ 1 ], gain[ 0 ], gain[ 1 ],
+                                                  gain[ 0 ], gain[ 1 ], gain[ 0 ], gain[ 1 ] )
+                                : _mm256_set1_ps( gain[ 0 ] );
+  const __m256 stepV = isStereo ? _mm256_setr_ps( step[ 0 ], step[ 1 ], step[ 0 ], step[ 1 ],
+                                                  step[ 0 ], step[ 1 ], step[ 0 ], step[ 1 ] )
+                                : _mm256_set1_ps( step[ 0 ] );
+  const __m256 frameStep = _mm256_set1_ps( isStereo ? 4.0f : 8.0f );
+  __m256 frame = isStereo ? _mm256_setr_ps( 0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f )
+                          : _mm256_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f );
+
+  auto sampleCount = frameCount * channelCount;
+  size_t j = 0;
+  for( ; j + 8 <= sampleCount; j += 8 )
+  {
+    __m256 g = _mm256_add_ps( gainV, _mm256_mul_ps( stepV, frame ) );
+    __m256 v = _mm256_mul_ps( _mm256_loadu_ps( src + j ), g );
+    if( isAccumulating )
+      v = _mm256_add_ps( _mm256_loadu_ps( dst + j ), v );
+    _mm256_storeu_ps( dst + j, v );
+    frame = _mm256_add_ps( frame, frameStep );
+  }
+  MixRampScalar( src, dst, j, sampleCount, channelCount, gain, step, isAccumulating );
+}
+
+PKI_TARGET_AVX2 size_t ClampAvx2( float* buffer, size_t sampleCount )
+{
+  const __m256 lo = _mm256_set1_ps( -1.0f );
+  const __m256 hi = _mm256_set1_ps( 1.0f );
+  size_t clipped = 0;
+  size_t i = 0;
+  for( ; i + 8 <= sampleCount; i += 8 )
+  {
+    __m256 v = _mm256_loadu_ps( buffer + i );
+    __m256 isOutside = _mm256_or_ps( _mm256_cmp_ps( v, hi, _CMP_GT_OQ ), _mm256_cmp_ps( v, lo, _CMP_LT_OQ ) );
+    clipped += static_cast<size_t>( std::popcount( static_cast<uint32_t>( _mm256_movemask_ps( isOutside ) ) ) );
+    _mm256_storeu_ps( buffer + i, _mm256_min_ps( _mm256_max_ps( v, lo ), hi ) );
+  }
+  return clipped + ClampScalar( buffer, i, sampleCount );
+}
+
+const MixKernels kAvx2Kernels = { MixRampAvx2, ClampAvx2 };
+
+#endif // PKI_SIMD_X64
+
+#if defined( PKI_SIMD_NEON )
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// NEON: 4 samples per vector. Separate multiply and add, not vfmaq, so the
+// results match the other levels.
+
+void MixRampNeon( const float* src, float* dst, size_t frameCount, uint32_t channelCount,
+                  const float* gain, const float* step, bool isAccumulating )
+{
+  assert( channelCount == 1 || channelCount == 2 );
+  bool isStereo = ( channelCount == 2 );
+  const float gains[ 4 ] = { gain[ 0 ], gain[ isStereo ? 1 : 0 ], gain[ 0 ], gain[ isStereo ? 1 : 0 ] };
+  const float steps[ 4 ] = { step[ 0 ], step[ isStereo ? 1 : 0 ], step[ 0 ], step[ isStereo ? 1 : 0 ] };
+  const float frames[ 4 ] = { 0.0f, isStereo ? 0.0f : 1.0f, isStereo ? 1.0f : 2.0f, isStereo ? 1.0f : 3.0f };
+  const float32x4_t gainV = vld1q_f32( gains );
+  const float32x4_t stepV = vld1q_f32( steps );
+  const float32x4_t frameStep = vdupq_n_f32( isStereo ? 2.0f : 4.0f );
+  float32x4_t frame = vld1q_f32( frames );
+
+  auto sampleCount = frameCount * channelCount;
+  size_t j = 0;
+  for( ; j + 4 <= sampleCount; j += 4 )
+  {
+    float32x4_t g = vaddq_f32( gainV, vmulq_f32( stepV, frame ) );
+    float32x4_t v = vmulq_f32( vld1q_f32( src + j ), g );
+    if( isAccumulating )
+      v = vaddq_f32( vld1q_f32( dst + j ), v );
+    vst1q_f32( dst + j, v );
+    frame = vaddq_f32( frame, frameStep );
+  }
+  MixRampScalar( src, dst, j, sampleCount, channelCount, gain, step, isAccumulating );
+}
+
+size_t ClampNeon( float* buffer, size_t sampleCount )
+{
+  const float32x4_t lo = vdupq_n_f32( -1.0f );
+  const float32x4_t hi = vdupq_n_f32( 1.0f );
+  uint32x4_t clippedV = vdupq_n_u32( 0 );
+  size_t i = 0;
+  for( ; i + 4 <= sampleCount; i += 4 )
+  {
+    float32x4_t v = vld1q_f32( buffer + i );
+    uint32x4_t isOutside = vorrq_u32( vcgtq_f32( v, hi ), vcltq_f32( v, lo ) );
+    clippedV = vsubq_u32( clippedV, isOutside ); // true is all ones, i.e. -1
+    vst1q_f32( buffer + i, vminq_f32( vmaxq_f32( v, lo ), hi ) );
+  }
+  return vaddvq_u32( clippedV ) + ClampScalar( buffer, i, sampleCount );
+}
+
+const MixKernels kNeonKernels = { MixRampNeon, ClampNeon };
+
+#endif // PKI_SIMD_NEON
+
+const MixKernels& GetMixKernels( SimdLevel simdLevel )
+{
+  assert( IsSimdLevelSupported( simdLevel ) );
+  switch( simdLevel )
+  {
+#if defined( PKI_SIMD_X64 )
+  case SimdLevel::SSE2: return kSse2Kernels;
+  case SimdLevel::AVX2: return kAvx2Kernels;
+#endif
+#if defined( PKI_SIMD_NEON )
+  case SimdLevel::NEON: return kNeonKernels;
+#endif
+  default: return kScalarKernels;
+  }
+}
+
+} // anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct PcmMixer::Voice
+{
+  std::shared_ptr<const PcmBuffer> pcm;
+  SampleFormat                     sampleFormat = SampleFormat::Float32;
+  uint32_t                         channelCount = 0;
+  size_t                           frameCount = 0;
+  size_t                           position = 0; // next frame to mix
+  VoiceId                          voiceId = kInvalidVoice;
+  float                            gain = 1.0f;
+  float                            pan = 0.0f;
+  bool                             isLooping = false;
+  bool                             isStopping = false;
+  Ramp                             channelGains[ 2 ]; // gain and pan combined, per output channel
+};
+
+void PcmMixer::Ramp::Set( float newTarget, uint32_t frames, RampShape rampShape )
+{
+  start = GetValue();
+  target = newTarget;
+  totalFrames = frames;
+  elapsedFrames = 0;
+  shape = rampShape;
+}
+
+float PcmMixer::Ramp::GetValue() const
+{
+  return GetValueAfter( 0 );
+}
+
+float PcmMixer::Ramp::GetValueAfter( uint32_t frames ) const
+{
+  auto elapsed = elapsedFrames + frames;
+  if( elapsed >= totalFrames )
+    return target;
+  auto t = static_cast<float>( elapsed ) / static_cast<float>( totalFrames );
+  if( shape == RampShape::Linear )
+    return start + ( target - start ) * t;
+
+  // Equal steps in decibels. Ramps to or from silence run between -80 dB and
+  // the other end, then jump the last step, which is inaudible.
+  auto from = std::max( start, kMinExponentialGain );
+  auto to = std::max( target, kMinExponentialGain );
+  return from * std::pow( to / from, t );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+PcmMixer::PcmMixer( uint32_t channelCount, uint32_t samplesPerSec, SimdLevel simdLevel )
+  : channelCount_( channelCount ),
+    samplesPerSec_( samplesPerSec ),
+    simdLevel_( simdLevel ),
+    commands_( kMaxQueuedCommands ),
+    endedVoices_( kMaxQueuedCommands )
+{
+  assert( channelCount == 1 || channelCount == 2 );
+  assert( samplesPerSec > 0 );
+  voices_.reserve( kMaxVoices );
+  retiredVoices_.reserve( kMaxVoices );
+  voiceBlock_.resize( kBlockFrames * 2 );
+  mixBlock_.resize( kBlockFrames * channelCount );
+  for( auto& ramp : masterGain_ )
+    ramp.Set( 1.0f, 0, RampShape::Linear );
+}
+
+PcmMixer::~PcmMixer()
+{
+  // Voices still queued belong to their commands or the ended queue
+  Command command;
+  while( commands_.Read( &command, 1 ) )
+    delete command.voice;
+  Voice* voice = nullptr;
+  while( endedVoices_.Read( &voice, 1 ) )
+    delete voice;
+}
+
+PcmMixer::VoiceId PcmMixer::AddVoice( std::shared_ptr<const PcmBuffer> pcm, SampleFormat sampleFormat,
+                                      uint32_t channelCount, float gain, float pan, bool isLooping )
+{
+  assert( pcm );
+  assert( channelCount == 1 || channelCount == 2 );
+  auto frameBytes = GetBytesPerSample( sampleFormat ) * channelCount;
+  assert( pcm->GetSize() % frameBytes == 0 );
+
+  auto voice = std::make_unique<Voice>();
+  voice->frameCount = pcm->GetSize() / frameBytes;
+  voice->pcm = std::move( pcm );
+  voice->sampleFormat = sampleFormat;
+  voice->channelCount = channelCount;
+  voice->voiceId = nextVoiceId_;
+  voice->gain = gain;
+  voice->pan = pan;
+  voice->isLooping = isLooping;
+
+  Command command = { Command::Type::Add, voice->voiceId, 0.0f, 0, RampShape::Linear, voice.get() };
+  if( !PushCommand( command ) )
+    return kInvalidVoice;
+  voice.release(); // now owned by the command
+  if( ++nextVoiceId_ == kInvalidVoice )
+    ++nextVoiceId_;
+  return command.voiceId;
+}
+
+bool PcmMixer::SetGain( VoiceId voiceId, float gain, uint32_t rampMs, RampShape rampShape )
+{
+  return PushCommand( { Command::Type::Gain, voiceId, gain, MsToFrames( rampMs ), rampShape, nullptr } );
+}
+
+bool PcmMixer::SetPan( VoiceId voiceId, float pan, uint32_t rampMs )
+{
+  pan = std::min( std::max( pan, -1.0f ), 1.0f );
+  return PushCommand( { Command::Type::Pan, voiceId, pan, MsToFrames( rampMs ), RampShape::Linear, nullptr } );
+}
+
+bool PcmMixer::SetMasterGain( float gain, uint32_t rampMs, RampShape rampShape )
+{
+  return PushCommand( { Command::Type::MasterGain, kInvalidVoice, gain, MsToFrames( rampMs ), rampShape, nullptr } );
+}
+
+bool PcmMixer::Stop( VoiceId voiceId, uint32_t rampMs )
+{
+  return PushCommand( { Command::Type::Stop, voiceId, 0.0f, MsToFrames( rampMs ), RampShape::Linear, nullptr } );
+}
+
+bool PcmMixer::GetEndedVoice( VoiceId& voiceId )
+{
+  Voice* voice = nullptr;
+  if( endedVoices_.Read( &voice, 1 ) != 1 )
+    return false;
+  voiceId = voice->voiceId;
+  delete voice;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void PcmMixer::Mix( float* out, size_t frameCount )
+{
+  assert( out != nullptr || frameCount == 0 );
+  FlushRetiredVoices();
+  ApplyCommands();
+  std::fill( out, out + ( frameCount * channelCount_ ), 0.0f );
+  for( auto& voice : voices_ )
+    MixVoice( *voice, out, frameCount );
+  ApplyRamps( masterGain_, out, out, frameCount, false );
+
+  auto clipped = GetMixKernels( simdLevel_ ).clamp( out, frameCount * channelCount_ );
+  if( clipped != 0 )
+    clipCount_.fetch_add( clipped, std::memory_order_relaxed );
+
+  // Retire voices that played out or finished fading after Stop()
+  auto isEnded = []( const std::unique_ptr<Voice>& voice )
+  {
+    return voice->isStopping ? !voice->channelGains[ 0 ].IsRamping() : voice->position == voice->frameCount;
+  };
+  for( size_t i = 0; i < voices_.size(); )
+  {
+    if( !isEnded( voices_[ i ] ) )
+    {
+      ++i;
+      continue;
+    }
+    std::swap( voices_[ i ], voices_.back() );
+    RetireVoice( std::move( voices_.back() ) );
+    voices_.pop_back();
+  }
+}
+
+void PcmMixer::Mix( void* out, SampleFormat sampleFormat, size_t frameCount, TpdfDither* dither )
+{
+  if( sampleFormat == SampleFormat::Float32 )
+  {
+    Mix( static_cast<float*>( out ), frameCount );
+    return;
+  }
+  auto* pcm = static_cast<uint8_t*>( out );
+  auto frameBytes = GetBytesPerSample( sampleFormat ) * channelCount_;
+  for( size_t frame = 0; frame < frameCount; frame += kBlockFrames )
+  {
+    auto frames = std::min( kBlockFrames, frameCount - frame );
+    Mix( mixBlock_.data(), frames );
+    ConvertSamples( mixBlock_.data(), SampleFormat::Float32, pcm + ( frame * frameBytes ), sampleFormat,
+                    frames * channelCount_, dither, simdLevel_ );
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PcmMixer::PushCommand( const Command& command )
+{
+  return commands_.Write( &command, 1 ) == 1;
+}
+
+void PcmMixer::ApplyCommands()
+{
+  Command command;
+  while( commands_.Read( &command, 1 ) )
+  {
+    if( command.type == Command::Type::Add )
+    {
+      std::unique_ptr<Voice> voice( command.voice );
+      if( voices_.size() == kMaxVoices )
+      {
+        RetireVoice( std::move( voice ) );
+        continue;
+      }
+      SetChannelGains( *voice, 0, RampShape::Linear );
+      voices_.push_back( std::move( voice ) ); // capacity is reserved
+      continue;
+    }
+    if( command.type == Command::Type::MasterGain )
+    {
+      for( auto& ramp : masterGain_ )
+        ramp.Set( command.value, command.rampFrames, command.rampShape );
+      continue;
+    }
+
+    auto* voice = FindVoice( command.voiceId );
+    if( voice == nullptr || voice->isStopping )
+      continue;
+    switch( command.type )
+    {
+    case Command::Type::Gain: voice->gain = command.value; break;
+    case Command::Type::Pan:  voice->pan = command.value; break;
+    case Command::Type::Stop: voice->gain = 0.0f; voice->isStopping = true; break;
+    default: assert( false ); break;
+    }
+    SetChannelGains( *voice, command.rampFrames, command.rampShape );
+  }
+}
+
+// Hands the voice to the control thread. If it's behind on GetEndedVoice(),
+// the voice waits for the next Mix(); only if that backlog is full too is it
+// destroyed here.
+void PcmMixer::RetireVoice( std::unique_ptr<Voice> voice )
+{
+  Voice* ended = voice.get();
+  if( retiredVoices_.empty() && endedVoices_.Write( &ended, 1 ) == 1 )
+  {
+    voice.release(); // now owned by the queue
+    return;
+  }
+  if( retiredVoices_.size() < retiredVoices_.capacity() )
+    retiredVoices_.push_back( std::move( voice ) );
+}
+
+void PcmMixer::FlushRetiredVoices()
+{
+  size_t flushed = 0;
+  for( ; flushed < retiredVoices_.size(); ++flushed )
+  {
+    Voice* ended = retiredVoices_[ flushed ].get();
+    if( endedVoices_.Write( &ended, 1 ) != 1 )
+      break;
+    retiredVoices_[ flushed ].release();
+  }
+  retiredVoices_.erase( retiredVoices_.begin(), retiredVoices_.begin() + static_cast<ptrdiff_t>( flushed ) );
+}
+
+PcmMixer::Voice* PcmMixer::FindVoice( VoiceId voiceId )
+{
+  auto it = std::find_if( voices_.begin(), voices_.end(),
+                          [voiceId]( const std::unique_ptr<Voice>& voice ) { return voice->voiceId == voiceId; } );
+  return ( it == voices_.end() ) ? nullptr : it->get();
+}
+
+// Mono voices use a constant-power pan law, so they sound equally loud
+// anywhere in the field; stereo voices attenuate the opposite side only
+void PcmMixer::SetChannelGains( Voice& voice, uint32_t rampFrames, RampShape rampShape )
+{
+  float left = voice.gain;
+  float right = voice.gain;
+  if( channelCount_ == 2 && voice.channelCount == 1 )
+  {
+    auto angle = ( voice.pan + 1.0f ) * ( kPi / 4.0f );
+    left *= std::cos( angle );
+    right *= std::sin( angle );
+  }
+  else if( channelCount_ == 2 )
+  {
+    left *= std::min( 1.0f, 1.0f - voice.pan );
+    right *= std::min( 1.0f, 1.0f + voice.pan );
+  }
+  voice.channelGains[ 0 ].Set( left, rampFrames, rampShape );
+  voice.channelGains[ 1 ].Set( right, rampFrames, rampShape );
+}
+
+void PcmMixer::MixVoice( Voice& voice, float* out, size_t frameCount )
+{
+  auto frameBytes = GetBytesPerSample( voice.sampleFormat ) * voice.channelCount;
+  auto* block = voiceBlock_.data();
+  size_t mixed = 0;
+  while( mixed < frameCount && voice.position < voice.frameCount )
+  {
+    auto frames = std::min( { kBlockFrames, frameCount - mixed, voice.frameCount - voice.position } );
+    const uint8_t* pcm = voice.pcm->GetData() + ( voice.position * frameBytes );
+    ConvertSamples( pcm, voice.sampleFormat, block, SampleFormat::Float32, frames * voice.channelCount,
+                    nullptr, simdLevel_ );
+
+    // Match the output channels: copy mono to both sides, or average stereo
+    if( voice.channelCount == 1 && channelCount_ == 2 )
+    {
+      for( auto i = frames; i-- > 0; )
+        block[ ( i * 2 ) + 1 ] = block[ i * 2 ] = block[ i ];
+    }
+    else if( voice.channelCount == 2 && channelCount_ == 1 )
+    {
+      for( size_t i = 0; i < frames; ++i )
+        block[ i ] = ( block[ i * 2 ] + block[ ( i * 2 ) + 1 ] ) * 0.5f;
+    }
+
+    ApplyRamps( voice.channelGains, block, out + ( mixed * channelCount_ ), frames, true );
+    mixed += frames;
+    voice.position += frames;
+    if( voice.position == voice.frameCount && voice.isLooping )
+      voice.position = 0;
+  }
+
+  // A stopping voice that ran out of samples still has to finish its ramp
+  if( mixed < frameCount && voice.isStopping )
+    for( auto& ramp : voice.channelGains )
+      ramp.elapsedFrames = ramp.totalFrames;
+}
+
+// Ramps advance in segments that are each mixed with a linear gain; a steady
+// gain is a single segment with zero step
+void PcmMixer::ApplyRamps( Ramp* ramps, const float* src, float* dst, size_t frameCount, bool isAccumulating )
+{
+  const auto& kernels = GetMixKernels( simdLevel_ );
+  size_t done = 0;
+  while( done < frameCount )
+  {
+    auto frames = static_cast<uint32_t>( frameCount - done );
+    bool isRamping = ramps[ 0 ].IsRamping() || ( channelCount_ == 2 && ramps[ 1 ].IsRamping() );
+    if( isRamping )
+    {
+      auto rampLeft = std::max( ramps[ 0 ].totalFrames - std::min( ramps[ 0 ].elapsedFrames, ramps[ 0 ].totalFrames ),
+                                ramps[ 1 ].totalFrames - std::min( ramps[ 1 ].elapsedFrames, ramps[ 1 ].totalFrames ) );
+      frames = std::min( { frames, rampLeft, kRampSegmentFrames } );
+    }
+
+    float gain[ 2 ];
+    float step[ 2 ];
+    for( uint32_t c = 0; c < channelCount_; ++c )
+    {
+      gain[ c ] = ramps[ c ].GetValue();
+      step[ c ] = ( ramps[ c ].GetValueAfter( frames ) - gain[ c ] ) / static_cast<float>( frames );
+      ramps[ c ].elapsedFrames = std::min( ramps[ c ].elapsedFrames + frames, ramps[ c ].totalFrames );
+    }
+    kernels.mixRamp( src + ( done * channelCount_ ), dst + ( done * channelCount_ ), frames, channelCount_,
+                     gain, step, isAccumulating );
+    done += frames;
+  }
+}
+
+uint32_t PcmMixer::MsToFrames( uint32_t ms ) const
+{
+  return static_cast<uint32_t>( ( static_cast<uint64_t>( ms ) * samplesPerSec_ ) / 1000 );
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,215 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmMixer.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "PcmBufferChain.h"
+#include "PcmConvert.h"
+#include "Simd.h"
+#include "SpscRingBuffer.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Software mixer. Any number of voices, each a PcmBuffer in any SampleFormat,
+// are summed into one mono or stereo float stream that's converted to the
+// device format and written to a WinWaveStream. One device can then carry
+// music and UI sounds, each with its own volume, unlike waveOutSetVolume(),
+// which sets the whole device in coarse steps.
+//
+// Gain and pan changes ramp over a few milliseconds so they never click.
+// Linear ramps suit short changes; exponential ramps move evenly in decibels
+// and suit fades. Mono voices pan with a constant-power law; stereo voices
+// pan as a balance control. The mixed signal is clamped to full scale and
+// the clipped samples are counted, so the app can lower the master gain.
+//
+// The control thread calls AddVoice(), SetGain() etc., which queue commands;
+// the refill thread calls Mix(), which applies them and never blocks or
+// allocates. Nor does it free: ended voices go back to the control thread,
+// which destroys them, and with them perhaps the last reference to their
+// PCM, in GetEndedVoice(). Call it regularly. Voices must already be at the
+// mixer's sample rate. PcmMixerSource (PcmPipeline.h) plays a mixer through
+// a pipeline, e.g. to a WinWaveStream.
+//
+// Typical use:
+//
+//    PcmMixer mixer( 2, 48000 );
+//    auto music = mixer.AddVoice( musicPcm, SampleFormat::Int16, 2, 0.8f );
+//    mixer.AddVoice( clickPcm, SampleFormat::Float32, 1, 1.0f, -0.5f );
+//    // refill thread: mixer.Mix( pcm, SampleFormat::Int16, frames, &dither ); stream.Write( pcm, bytes );
+//    mixer.SetGain( music, 0.0f, 2000, PcmMixer::RampShape::Exponential ); // fade out
+
+class PcmMixer
+{
+public:
+  using VoiceId = uint32_t;
+
+  enum class RampShape
+  {
+    Linear,
+    Exponential
+  };
+
+  static constexpr VoiceId  kInvalidVoice = 0;
+  static constexpr uint32_t kDefaultRampMs = 10;
+  static constexpr size_t   kMaxVoices = 64;
+
+  PcmMixer( uint32_t channelCount, uint32_t samplesPerSec, SimdLevel simdLevel = GetSimdLevel() );
+  ~PcmMixer();
+
+  // Disable copy/move
+  PcmMixer( const PcmMixer& ) = delete;
+  PcmMixer& operator=( const PcmMixer& ) = delete;
+  PcmMixer( PcmMixer&& ) = delete;
+  PcmMixer& operator=( PcmMixer&& ) = delete;
+
+  /////////////////////////////////////////////////////////////////////////////
+  //
+  // Control side; may be called from any single thread other than Mix()
+
+  // Starts playing pcm, which holds whole frames of channelCount (1 or 2)
+  // interleaved channels. Returns kInvalidVoice if too many commands are
+  // queued; a voice that arrives when kMaxVoices are playing ends at once.
+  VoiceId AddVoice( std::shared_ptr<const PcmBuffer> pcm, SampleFormat sampleFormat, uint32_t channelCount,
+                    float gain = 1.0f, float pan = 0.0f, bool isLooping = false );
+
+  // gain is linear; pan runs from -1 (left) to 1 (right). Return false if
+  // too many commands are queued. Unknown or ended voices are ignored.
+  bool SetGain( VoiceId voiceId, float gain, uint32_t rampMs = kDefaultRampMs,
+                RampShape rampShape = RampShape::Linear );
+  bool SetPan( VoiceId voiceId, float pan, uint32_t rampMs = kDefaultRampMs );
+  bool SetMasterGain( float gain, uint32_t rampMs = kDefaultRampMs, RampShape rampShape = RampShape::Linear );
+
+  // Fades the voice out, then ends it
+  bool Stop( VoiceId voiceId, uint32_t rampMs = kDefaultRampMs );
+
+  // Retrieves the ids of voices that have ended, in the order they ended, and
+  // destroys the voices
+  bool GetEndedVoice( VoiceId& voiceId );
+
+  /////////////////////////////////////////////////////////////////////////////
+  //
+  // Mix side; call from the refill thread
+
+  // Overwrites frameCount frames of out with the mix
+  void Mix( float* out, size_t frameCount );
+
+  // Mixes in blocks and converts to sampleFormat; see ConvertSamples()
+  void Mix( void* out, SampleFormat sampleFormat, size_t frameCount, TpdfDither* dither = nullptr );
+
+  size_t GetVoiceCount() const
+  {
+    return voices_.size();
+  }
+
+  uint32_t GetChannelCount() const
+  {
+    return channelCount_;
+  }
+
+  uint32_t GetSamplesPerSec() const
+  {
+    return samplesPerSec_;
+  }
+
+  // Samples clamped to full scale since the mixer was created; any thread
+  uint64_t GetClipCount() const
+  {
+    return clipCount_.load( std::memory_order_relaxed );
+  }
+
+private:
+  static constexpr size_t   kBlockFrames = 256;
+  static constexpr size_t   kMaxQueuedCommands = 256;
+  static constexpr uint32_t kRampSegmentFrames = 64; // exponential ramps are linear in between
+
+  // A gain moving from start to target over totalFrames
+  struct Ramp
+  {
+    float     start = 0.0f;
+    float     target = 0.0f;
+    uint32_t  totalFrames = 0;
+    uint32_t  elapsedFrames = 0;
+    RampShape shape = RampShape::Linear;
+
+    void Set( float newTarget, uint32_t frames, RampShape rampShape );
+    float GetValue() const;
+    float GetValueAfter( uint32_t frames ) const;
+    bool IsRamping() const
+    {
+      return elapsedFrames < totalFrames;
+    }
+  };
+
+  struct Voice;
+
+  struct Command
+  {
+    enum class Type
+    {
+      Add,
+      Gain,
+      Pan,
+      MasterGain,
+      Stop
+    };
+
+    Type      type;
+    VoiceId   voiceId;
+    float     value;
+    uint32_t  rampFrames;
+    RampShape rampShape;
+    Voice*    voice; // Add only; owned by the command until applied
+  };
+
+  bool PushCommand( const Command& command );
+  void ApplyCommands();
+  void RetireVoice( std::unique_ptr<Voice> voice );
+  void FlushRetiredVoices();
+  Voice* FindVoice( VoiceId voiceId );
+  void SetChannelGains( Voice& voice, uint32_t rampFrames, RampShape rampShape );
+  void MixVoice( Voice& voice, float* out, size_t frameCount );
+  void ApplyRamps( Ramp* ramps, const float* src, float* dst, size_t frameCount, bool isAccumulating );
+  uint32_t MsToFrames( uint32_t ms ) const;
+
+private:
+  uint32_t                            channelCount_;
+  uint32_t                            samplesPerSec_;
+  SimdLevel                           simdLevel_;
+  SpscRingBuffer<Command>             commands_;
+  SpscRingBuffer<Voice*>              endedVoices_; // owned by the queue until GetEndedVoice()
+  VoiceId                             nextVoiceId_ = kInvalidVoice + 1; // control side
+
+  // Mix side
+  std::vector<std::unique_ptr<Voice>> voices_;
+  std::vector<std::unique_ptr<Voice>> retiredVoices_; // ended while endedVoices_ was full
+  std::vector<float>                  voiceBlock_;  // one voice converted to float
+  std::vector<float>                  mixBlock_;    // for Mix() to other formats
+  Ramp                                masterGain_[ 2 ];
+  std::atomic<uint64_t>               clipCount_ = 0;
+
+}; // class PcmMixer
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
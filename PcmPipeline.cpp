@@ -0,0 +1,628 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmPipeline.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#include "MediaProbe.h"
+#include "PcmPipeline.h"
+#include "SpscRingBuffer.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Pipeline internals. Each node is one part; node i hands blocks to node i+1
+// through node i+1's input queue. A block belongs to the node that writes
+// into it, and goes back to that node's free queue from the first node that
+// doesn't pass it on. Which node that is never changes, so every queue has
+// one producer and one consumer, as SpscRingBuffer requires; the isRunning
+// flag makes each side of a queue one thread at a time.
+
+struct PcmPipeline::Block
+{
+  std::unique_ptr<uint8_t[]> data;
+  size_t                     frameCount = 0;
+  size_t                     owner = 0;         // index of the node it belongs to
+  bool                       isEndOfStream = false; // last block; may hold frames
+};
+
+struct PcmPipeline::Node
+{
+  size_t                                  index = 0;
+  PcmStage*                               stage = nullptr; // null for source and sink
+  bool                                    isInPlace = false;
+  PcmStreamFormat                         inFormat;
+  PcmStreamFormat                         outFormat;
+  size_t                                  blockFrames = 0; // capacity of the blocks it outputs
+  std::vector<Block>                      blocks;          // owned; none for in-place stages and sink
+  std::unique_ptr<SpscRingBuffer<Block*>> freeBlocks;
+  std::unique_ptr<SpscRingBuffer<Block*>> input;           // null for the source
+  std::atomic<bool>                       isRunning = false;
+
+  // Only touched while running
+  Block*                                  spare = nullptr;   // free block taken before input arrived
+  Block*                                  pending = nullptr; // sink: block partly written
+  size_t                                  pendingFrames = 0; // sink: frames of pending written
+  bool                                    isEnded = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+PcmPipeline::PcmPipeline( PcmSource& source, PcmSink& sink )
+  : source_( source ),
+    sink_( sink )
+{
+}
+
+PcmPipeline::~PcmPipeline()
+{
+  Stop();
+}
+
+void PcmPipeline::AddStage( PcmStage& stage )
+{
+  assert( workers_.empty() );
+  stages_.push_back( &stage );
+}
+
+bool PcmPipeline::Start( const Options& options )
+{
+  assert( workers_.empty() );
+  assert( options.framesPerBlock > 0 );
+  assert( options.blocksPerStage > 0 );
+  nodes_.clear();
+  framesWritten_.store( 0 );
+  isSinkBlocked_.store( false );
+  isEnded_.store( false );
+  isStopping_.store( false );
+
+  auto format = source_.GetFormat();
+  if( format.channelCount == 0 || format.samplesPerSec == 0 )
+    return false;
+
+  auto addNode = [&]( PcmStage* stage, size_t blockFrames )
+  {
+    auto node = std::make_unique<Node>();
+    node->index = nodes_.size();
+    node->stage = stage;
+    node->inFormat = format;
+    node->outFormat = format;
+    node->blockFrames = blockFrames;
+    nodes_.push_back( std::move( node ) );
+    return nodes_.back().get();
+  };
+  auto addBlocks = [&]( Node& node )
+  {
+    node.blocks.resize( options.blocksPerStage );
+    for( auto& block : node.blocks )
+    {
+      block.data.reset( new uint8_t[ node.blockFrames * node.outFormat.GetBlockAlign() ] );
+      block.owner = node.index;
+    }
+  };
+
+  // Formats and block sizes flow downstream from the source
+  auto blockFrames = options.framesPerBlock;
+  addBlocks( *addNode( nullptr, blockFrames ) );
+  for( auto* stage : stages_ )
+  {
+    PcmStreamFormat outFormat;
+    if( !stage->Configure( format, outFormat ) )
+      return false;
+    if( stage->IsInPlace() )
+    {
+      assert( outFormat.GetBlockAlign() == format.GetBlockAlign() );
+      assert( stage->GetMaxFlushFrames() == 0 );
+      auto* node = addNode( stage, blockFrames );
+      node->isInPlace = true;
+      node->outFormat = outFormat;
+    }
+    else
+    {
+      blockFrames = stage->GetMaxOutputFrames( blockFrames ) + stage->GetMaxFlushFrames();
+      auto* node = addNode( stage, blockFrames );
+      node->outFormat = outFormat;
+      addBlocks( *node );
+    }
+    format = outFormat;
+  }
+  if( !sink_.Open( format ) )
+    return false;
+  addNode( nullptr, blockFrames );
+
+  // Every queue can hold every block, so writes never fail; the blocks
+  // themselves bound how far ahead each part runs
+  size_t blockCount = 0;
+  for( const auto& node : nodes_ )
+    blockCount += node->blocks.size();
+  for( auto& node : nodes_ )
+  {
+    if( node->index > 0 )
+      node->input = std::make_unique<SpscRingBuffer<Block*>>( blockCount );
+    if( !node->blocks.empty() )
+    {
+      node->freeBlocks = std::make_unique<SpscRingBuffer<Block*>>( node->blocks.size() );
+      for( auto& block : node->blocks )
+      {
+        auto* free = &block;
+        node->freeBlocks->Write( &free, 1 );
+      }
+    }
+  }
+
+  auto nodeCount = nodes_.size();
+  if( options.threading == Threading::ThreadPerPart )
+  {
+    for( size_t i = 0; i < nodeCount; ++i )
+      workers_.emplace_back( [this, i] { RunWorker( i, 1 ); } );
+  }
+  else
+  {
+    size_t workerCount = options.workerCount ? options.workerCount : std::thread::hardware_concurrency();
+    workerCount = std::clamp<size_t>( workerCount, 1, nodeCount );
+    for( size_t i = 0; i < workerCount; ++i )
+      workers_.emplace_back( [this, i, workerCount, nodeCount] { RunWorker( i * nodeCount / workerCount, nodeCount ); } );
+  }
+  return true;
+}
+
+void PcmPipeline::Wait()
+{
+  JoinWorkers();
+}
+
+void PcmPipeline::Stop()
+{
+  isStopping_.store( true );
+  Notify();
+  JoinWorkers();
+}
+
+void PcmPipeline::JoinWorkers()
+{
+  for( auto& worker : workers_ )
+    worker.join();
+  workers_.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Workers
+
+void PcmPipeline::RunWorker( size_t homeNode, size_t nodeCount )
+{
+  for( ;; )
+  {
+    auto sequence = workSequence_.load();
+    if( isStopping_.load() || isEnded_.load() )
+      return;
+    bool didWork = false;
+    for( size_t i = 0; i < nodeCount; ++i )
+      didWork |= RunNode( *nodes_[ ( homeNode + i ) % nodes_.size() ] );
+    if( !didWork )
+      Sleep( sequence );
+  }
+}
+
+// Runs the node unless another worker already is; true if anything moved
+bool PcmPipeline::RunNode( Node& node )
+{
+  if( node.isRunning.exchange( true, std::memory_order_acquire ) )
+    return false;
+
+  bool didWork = false;
+  if( node.index == 0 )
+    didWork = RunSource( node );
+  else if( node.stage != nullptr )
+    didWork = RunStage( node );
+  else
+    didWork = RunSink( node );
+
+  node.isRunning.store( false, std::memory_order_release );
+  if( didWork )
+    Notify();
+  return didWork;
+}
+
+// A worker that finds nothing to do sleeps until the sequence moves on. It
+// counts itself as a sleeper before checking the sequence, and Notify()
+// advances the sequence before checking for sleepers, so one of them always
+// sees the other. While the sink is full nothing upstream will wake the
+// pipeline, so sleepers time out to retry it.
+void PcmPipeline::Notify()
+{
+  workSequence_.fetch_add( 1 );
+  if( sleeperCount_.load() != 0 )
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    wake_.notify_all();
+  }
+}
+
+void PcmPipeline::Sleep( uint64_t sequence )
+{
+  std::unique_lock<std::mutex> lock( mutex_ );
+  sleeperCount_.fetch_add( 1 );
+  auto isWoken = [&]
+  {
+    return workSequence_.load() != sequence || isStopping_.load() || isEnded_.load();
+  };
+  if( isSinkBlocked_.load() )
+    wake_.wait_for( lock, std::chrono::milliseconds( kSinkRetryMs ), isWoken );
+  else
+    wake_.wait( lock, isWoken );
+  sleeperCount_.fetch_sub( 1 );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Parts. Each run moves at most kMaxBlocksPerRun blocks and hands them on in
+// one queue write.
+
+bool PcmPipeline::RunSource( Node& node )
+{
+  Block* ready[ kMaxBlocksPerRun ];
+  size_t readyCount = 0;
+  while( readyCount < kMaxBlocksPerRun && !node.isEnded )
+  {
+    Block* block = nullptr;
+    if( node.freeBlocks->Read( &block, 1 ) == 0 )
+      break;
+    block->frameCount = source_.Read( block->data.get(), node.blockFrames );
+    assert( block->frameCount <= node.blockFrames );
+    block->isEndOfStream = ( block->frameCount == 0 );
+    node.isEnded = block->isEndOfStream;
+    ready[ readyCount++ ] = block;
+  }
+  Forward( node, ready, readyCount );
+  return readyCount > 0;
+}
+
+bool PcmPipeline::RunStage( Node& node )
+{
+  Block* ready[ kMaxBlocksPerRun ];
+  size_t readyCount = 0;
+  while( readyCount < kMaxBlocksPerRun )
+  {
+    if( node.isInPlace )
+    {
+      Block* block = nullptr;
+      if( node.input->Read( &block, 1 ) == 0 )
+        break;
+      if( block->frameCount != 0 )
+      {
+        [[maybe_unused]] auto frameCount = node.stage->Process( block->data.get(), block->frameCount, block->data.get() );
+        assert( frameCount == block->frameCount );
+      }
+      ready[ readyCount++ ] = block;
+      continue;
+    }
+
+    // Take an output block first, so input isn't consumed with nowhere to put it
+    if( node.spare == nullptr && node.freeBlocks->Read( &node.spare, 1 ) == 0 )
+      break;
+    Block* in = nullptr;
+    if( node.input->Read( &in, 1 ) == 0 )
+      break;
+
+    Block* out = node.spare;
+    node.spare = nullptr;
+    out->frameCount = ( in->frameCount != 0 ) ? node.stage->Process( in->data.get(), in->frameCount, out->data.get() ) : 0;
+    out->isEndOfStream = in->isEndOfStream;
+    if( out->isEndOfStream )
+      out->frameCount += node.stage->Flush( out->data.get() + out->frameCount * node.outFormat.GetBlockAlign() );
+    assert( out->frameCount <= node.blockFrames );
+    Release( in );
+    ready[ readyCount++ ] = out;
+  }
+  Forward( node, ready, readyCount );
+  return readyCount > 0;
+}
+
+bool PcmPipeline::RunSink( Node& node )
+{
+  bool didWork = false;
+  for( size_t i = 0; i < kMaxBlocksPerRun && !node.isEnded; ++i )
+  {
+    if( node.pending == nullptr )
+    {
+      if( node.input->Read( &node.pending, 1 ) == 0 )
+        break;
+      node.pendingFrames = 0;
+    }
+
+    auto* block = node.pending;
+    auto blockAlign = node.inFormat.GetBlockAlign();
+    while( node.pendingFrames < block->frameCount )
+    {
+      auto frameCount = sink_.Write( block->data.get() + node.pendingFrames * blockAlign,
+                                     block->frameCount - node.pendingFrames );
+      if( frameCount == 0 )
+      {
+        isSinkBlocked_.store( true );
+        return didWork;
+      }
+      node.pendingFrames += frameCount;
+      framesWritten_.fetch_add( frameCount, std::memory_order_relaxed );
+      isSinkBlocked_.store( false );
+      didWork = true;
+    }
+
+    node.pending = nullptr;
+    didWork = true;
+    if( block->isEndOfStream )
+    {
+      sink_.SetEndOfStream();
+      node.isEnded = true;
+      isEnded_.store( true, std::memory_order_release );
+    }
+    Release( block );
+  }
+  return didWork;
+}
+
+void PcmPipeline::Forward( Node& node, Block* const* blocks, size_t blockCount )
+{
+  if( blockCount == 0 )
+    return;
+  [[maybe_unused]] auto written = nodes_[ node.index + 1 ]->input->Write( blocks, blockCount );
+  assert( written == blockCount );
+}
+
+void PcmPipeline::Release( Block* block )
+{
+  [[maybe_unused]] auto written = nodes_[ block->owner ]->freeBlocks->Write( &block, 1 );
+  assert( written == 1 );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Stages
+
+PcmConvertStage::PcmConvertStage( SampleFormat outFormat, bool isDithered )
+  : outFormat_( outFormat ),
+    dither_( isDithered ? std::make_unique<TpdfDither>() : nullptr )
+{
+}
+
+bool PcmConvertStage::Configure( const PcmStreamFormat& inFormat, PcmStreamFormat& outFormat )
+{
+  inFormat_ = inFormat.sampleFormat;
+  channelCount_ = inFormat.channelCount;
+  outFormat = inFormat;
+  outFormat.sampleFormat = outFormat_;
+  return true;
+}
+
+bool PcmConvertStage::IsInPlace() const
+{
+  return inFormat_ == outFormat_; // nothing to do
+}
+
+size_t PcmConvertStage::Process( const void* in, size_t inFrames, void* out )
+{
+  if( inFormat_ != outFormat_ )
+    ConvertSamples( in, inFormat_, out, outFormat_, inFrames * channelCount_, dither_.get() );
+  return inFrames;
+}
+
+PcmResampleStage::PcmResampleStage( uint32_t outSamplesPerSec, PcmResampler::Quality quality )
+  : outSamplesPerSec_( outSamplesPerSec ),
+    quality_( quality )
+{
+  assert( outSamplesPerSec_ > 0 );
+}
+
+bool PcmResampleStage::Configure( const PcmStreamFormat& inFormat, PcmStreamFormat& outFormat )
+{
+  if( inFormat.sampleFormat != SampleFormat::Float32 )
+    return false;
+  resampler_ = std::make_unique<PcmResampler>( inFormat.channelCount, inFormat.samplesPerSec,
+                                               outSamplesPerSec_, quality_ );
+  outFormat = inFormat;
+  outFormat.samplesPerSec = outSamplesPerSec_;
+  return true;
+}
+
+bool PcmResampleStage::IsInPlace() const
+{
+  return false;
+}
+
+size_t PcmResampleStage::GetMaxOutputFrames( size_t inFrames ) const
+{
+  return resampler_->GetMaxOutputFrames( inFrames );
+}
+
+size_t PcmResampleStage::Process( const void* in, size_t inFrames, void* out )
+{
+  return resampler_->Process( static_cast<const float*>( in ), inFrames, static_cast<float*>( out ) );
+}
+
+size_t PcmResampleStage::GetMaxFlushFrames() const
+{
+  return resampler_->GetMaxOutputFrames( resampler_->GetLatencyFrames() );
+}
+
+size_t PcmResampleStage::Flush( void* out )
+{
+  return resampler_->Flush( static_cast<float*>( out ) );
+}
+
+PcmDspStage::PcmDspStage( Function function )
+  : function_( std::move( function ) )
+{
+  assert( function_ );
+}
+
+bool PcmDspStage::Configure( const PcmStreamFormat& inFormat, PcmStreamFormat& outFormat )
+{
+  channelCount_ = inFormat.channelCount;
+  outFormat = inFormat;
+  return inFormat.sampleFormat == SampleFormat::Float32;
+}
+
+bool PcmDspStage::IsInPlace() const
+{
+  return true;
+}
+
+size_t PcmDspStage::Process( const void*, size_t inFrames, void* out )
+{
+  function_( static_cast<float*>( out ), inFrames, channelCount_ );
+  return inFrames;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// WavFileSource
+
+bool WavFileSource::Open( const std::filesystem::path& file )
+{
+  constexpr uint32_t kFormatPcm = 1;
+  constexpr uint32_t kFormatFloat = 3;
+
+  file_.close();
+  file_.clear();
+  format_ = {};
+  remainingBytes_ = 0;
+  file_.open( file, std::ios::binary );
+  if( !file_ )
+    return false;
+
+  std::vector<uint8_t> header( MediaProbe::kHeaderBytes );
+  file_.read( reinterpret_cast<char*>( header.data() ), static_cast<std::streamsize>( header.size() ) );
+  MediaProbe::WavLayout layout;
+  if( !MediaProbe::ParseWavLayout( header.data(), static_cast<size_t>( file_.gcount() ), layout ) )
+    return false;
+
+  PcmStreamFormat format;
+  if( layout.formatTag == kFormatPcm && layout.bitsPerSample == 16 )
+    format.sampleFormat = SampleFormat::Int16;
+  else if( layout.formatTag == kFormatPcm && layout.bitsPerSample == 24 )
+    format.sampleFormat = SampleFormat::Int24;
+  else if( layout.formatTag == kFormatPcm && layout.bitsPerSample == 32 )
+    format.sampleFormat = SampleFormat::Int32;
+  else if( layout.formatTag == kFormatFloat && layout.bitsPerSample == 32 )
+    format.sampleFormat = SampleFormat::Float32;
+  else
+    return false;
+  format.channelCount = layout.channels;
+  format.samplesPerSec = layout.samplesPerSec;
+  if( format.channelCount == 0 || format.GetBlockAlign() != layout.blockAlign )
+    return false;
+
+  // The header's data size may overstate a truncated file
+  file_.clear();
+  file_.seekg( 0, std::ios::end );
+  auto fileBytes = static_cast<uint64_t>( file_.tellg() );
+  if( layout.dataOffset > fileBytes )
+    return false;
+  file_.seekg( static_cast<std::streamoff>( layout.dataOffset ) );
+  auto dataBytes = std::min( layout.dataBytes, fileBytes - layout.dataOffset );
+  remainingBytes_ = dataBytes - ( dataBytes % layout.blockAlign );
+  format_ = format;
+  return true;
+}
+
+PcmStreamFormat WavFileSource::GetFormat() const
+{
+  return format_;
+}
+
+size_t WavFileSource::Read( void* out, size_t maxFrames )
+{
+  auto blockAlign = format_.GetBlockAlign();
+  auto bytes = std::min<uint64_t>( remainingBytes_, uint64_t( maxFrames ) * blockAlign );
+  if( bytes == 0 )
+    return 0;
+  file_.read( static_cast<char*>( out ), static_cast<std::streamsize>( bytes ) );
+  auto frameCount = static_cast<size_t>( file_.gcount() ) / blockAlign;
+  remainingBytes_ = ( frameCount != 0 ) ? remainingBytes_ - frameCount * blockAlign : 0; // stop on read errors
+  return frameCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// PcmMixerSource
+
+PcmMixerSource::PcmMixerSource( PcmMixer& mixer, SampleFormat sampleFormat )
+  : mixer_( mixer )
+{
+  format_.sampleFormat = sampleFormat;
+  format_.channelCount = mixer.GetChannelCount();
+  format_.samplesPerSec = mixer.GetSamplesPerSec();
+}
+
+PcmStreamFormat PcmMixerSource::GetFormat() const
+{
+  return format_;
+}
+
+size_t PcmMixerSource::Read( void* out, size_t maxFrames )
+{
+  mixer_.Mix( out, format_.sampleFormat, maxFrames, &dither_ );
+  return maxFrames;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// NullPcmSink
+
+NullPcmSink::NullPcmSink( bool isChecksummed, size_t maxFramesPerWrite )
+  : maxFramesPerWrite_( maxFramesPerWrite ),
+    isChecksummed_( isChecksummed )
+{
+  assert( maxFramesPerWrite_ > 0 );
+}
+
+bool NullPcmSink::Open( const PcmStreamFormat& format )
+{
+  format_ = format;
+  sum_ = 0;
+  sumOfSums_ = 0;
+  isEnded_ = false;
+  return true;
+}
+
+size_t NullPcmSink::Write( const void* pcm, size_t frameCount )
+{
+  frameCount = std::min( frameCount, maxFramesPerWrite_ );
+  if( isChecksummed_ )
+  {
+    auto* bytes = static_cast<const uint8_t*>( pcm );
+    auto byteCount = frameCount * format_.GetBlockAlign();
+    for( size_t i = 0; i < byteCount; ++i )
+    {
+      sum_ += bytes[ i ];
+      sumOfSums_ += sum_;
+    }
+  }
+  return frameCount;
+}
+
+void NullPcmSink::SetEndOfStream()
+{
+  isEnded_ = true;
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,412 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmPipeline.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PcmConvert.h"
+#include "PcmMixer.h"
+#include "PcmResampler.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Format of the PCM on one link of a pipeline
+
+struct PcmStreamFormat
+{
+  SampleFormat sampleFormat = SampleFormat::Int16;
+  uint32_t     channelCount = 0;
+  uint32_t     samplesPerSec = 0;
+
+  uint32_t GetBlockAlign() const
+  {
+    return GetBytesPerSample( sampleFormat ) * channelCount;
+  }
+
+  bool operator==( const PcmStreamFormat& ) const = default;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Pluggable parts of a pipeline. A source produces PCM, each stage transforms
+// it and the sink consumes it. Every call on one part comes from one thread
+// at a time, though not always the same thread, so parts need no locking of
+// their own. PCM is interleaved whole frames in the link's format.
+
+class PcmSource
+{
+public:
+  PcmSource() = default;
+  virtual ~PcmSource() = default;
+
+  // Disable copy/move
+  PcmSource( const PcmSource& ) = delete;
+  PcmSource& operator=( const PcmSource& ) = delete;
+  PcmSource( PcmSource&& ) = delete;
+  PcmSource& operator=( PcmSource&& ) = delete;
+
+  virtual PcmStreamFormat GetFormat() const = 0;
+
+  // Writes up to maxFrames frames to out; returns zero only at end of stream
+  virtual size_t Read( void* out, size_t maxFrames ) = 0;
+};
+
+class PcmStage
+{
+public:
+  PcmStage() = default;
+  virtual ~PcmStage() = default;
+
+  // Disable copy/move
+  PcmStage( const PcmStage& ) = delete;
+  PcmStage& operator=( const PcmStage& ) = delete;
+  PcmStage( PcmStage&& ) = delete;
+  PcmStage& operator=( PcmStage&& ) = delete;
+
+  // Called by PcmPipeline::Start() with the format arriving at this stage.
+  // Sets the format it outputs; false if it can't take inFormat
+  virtual bool Configure( const PcmStreamFormat& inFormat, PcmStreamFormat& outFormat ) = 0;
+
+  // In-place stages are given out == in and must write exactly inFrames.
+  // Asked after Configure()
+  virtual bool IsInPlace() const = 0;
+
+  // Most frames Process() can write for inFrames input frames
+  virtual size_t GetMaxOutputFrames( size_t inFrames ) const
+  {
+    return inFrames;
+  }
+
+  // Returns the number of frames written to out
+  virtual size_t Process( const void* in, size_t inFrames, void* out ) = 0;
+
+  // Most frames Flush() can write; zero for stages that hold nothing back
+  virtual size_t GetMaxFlushFrames() const
+  {
+    return 0;
+  }
+
+  // Writes what the stage still holds at end of stream; not called for
+  // in-place stages
+  virtual size_t Flush( void* )
+  {
+    return 0;
+  }
+};
+
+class PcmSink
+{
+public:
+  PcmSink() = default;
+  virtual ~PcmSink() = default;
+
+  // Disable copy/move
+  PcmSink( const PcmSink& ) = delete;
+  PcmSink& operator=( const PcmSink& ) = delete;
+  PcmSink( PcmSink&& ) = delete;
+  PcmSink& operator=( PcmSink&& ) = delete;
+
+  // False if the sink can't take format
+  virtual bool Open( const PcmStreamFormat& format ) = 0;
+
+  // Returns the number of frames accepted, which may be fewer than frameCount.
+  // Zero means the device is full; the frames are offered again a few
+  // milliseconds later.
+  virtual size_t Write( const void* pcm, size_t frameCount ) = 0;
+
+  virtual void SetEndOfStream()
+  {
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Streams PCM from a source through any number of stages to a sink, each
+// part running concurrently with the others. Parts exchange blocks of
+// framesPerBlock frames through bounded lock-free queues, so per-call costs
+// are paid once per block rather than per sample, and no PCM is copied
+// between parts except by stages that change its size. Each part writes into
+// a fixed set of blocksPerStage blocks it owns; when all of them are
+// downstream it stops until one comes back, so a slow sink holds the whole
+// pipeline back instead of letting memory grow. In-place stages, such as
+// DSP, use the blocks they are given and own none.
+//
+// Parts run either on a thread each, or on a shared set of workers. Each
+// worker favours a home part and takes whichever other part has work when
+// its own has none; a part only ever runs on one worker at a time. Idle
+// threads sleep until a block moves.
+//
+// Typical use:
+//
+//    WavFileSource source;                         // or WinMediaPcmSource
+//    source.Open( file );
+//    PcmConvertStage toFloat( SampleFormat::Float32 );
+//    PcmResampleStage resample( 48000 );
+//    PcmConvertStage toDevice( SampleFormat::Int16 );
+//    WinWaveStreamPcmSink sink( stream, hEvent, ringBytes ); // or NullPcmSink
+//    PcmPipeline pipeline( source, sink );
+//    pipeline.AddStage( toFloat );
+//    pipeline.AddStage( resample );
+//    pipeline.AddStage( toDevice );
+//    pipeline.Start();
+//    pipeline.Wait();
+
+class PcmPipeline
+{
+public:
+  enum class Threading
+  {
+    ThreadPerPart,
+    SharedWorkers
+  };
+
+  struct Options
+  {
+    size_t    framesPerBlock = 1024;
+    size_t    blocksPerStage = 4;
+    Threading threading = Threading::SharedWorkers;
+    uint32_t  workerCount = 0; // SharedWorkers only; 0 means one per core, at most one per part
+  };
+
+  static constexpr size_t   kMaxBlocksPerRun = 4; // before a worker looks at other parts
+  static constexpr uint32_t kSinkRetryMs = 2;
+
+  // The source, stages and sink must outlive the pipeline
+  PcmPipeline( PcmSource& source, PcmSink& sink );
+  ~PcmPipeline();
+
+  // Disable copy/move
+  PcmPipeline( const PcmPipeline& ) = delete;
+  PcmPipeline& operator=( const PcmPipeline& ) = delete;
+  PcmPipeline( PcmPipeline&& ) = delete;
+  PcmPipeline& operator=( PcmPipeline&& ) = delete;
+
+  // Stages run in the order added; call before Start()
+  void AddStage( PcmStage& stage );
+
+  // False if a stage or the sink rejects its input format
+  bool Start( const Options& options );
+  bool Start()
+  {
+    return Start( Options{} );
+  }
+
+  // Blocks until the sink has taken the end of the stream
+  void Wait();
+
+  // Abandons the stream; the sink doesn't get SetEndOfStream()
+  void Stop();
+
+  bool IsEnded() const
+  {
+    return isEnded_.load( std::memory_order_acquire );
+  }
+
+  // Frames the sink has accepted; any thread
+  uint64_t GetFramesWritten() const
+  {
+    return framesWritten_.load( std::memory_order_relaxed );
+  }
+
+private:
+  struct Block;
+  struct Node;
+
+  bool RunNode( Node& node );
+  bool RunSource( Node& node );
+  bool RunStage( Node& node );
+  bool RunSink( Node& node );
+  void Forward( Node& node, Block* const* blocks, size_t blockCount );
+  void Release( Block* block );
+  void RunWorker( size_t homeNode, size_t nodeCount );
+  void Notify();
+  void Sleep( uint64_t sequence );
+  void JoinWorkers();
+
+private:
+  PcmSource&                         source_;
+  PcmSink&                           sink_;
+  std::vector<PcmStage*>             stages_;
+  std::vector<std::unique_ptr<Node>> nodes_; // source, stages, sink
+  std::vector<std::thread>           workers_;
+
+  // Sleeping workers wake when the sequence changes
+  std::mutex                         mutex_;
+  std::condition_variable            wake_;
+  std::atomic<uint64_t>              workSequence_ = 0;
+  std::atomic<uint32_t>              sleeperCount_ = 0;
+
+  std::atomic<uint64_t>              framesWritten_ = 0;
+  std::atomic<bool>                  isSinkBlocked_ = false;
+  std::atomic<bool>                  isEnded_ = false;
+  std::atomic<bool>                  isStopping_ = false;
+
+}; // class PcmPipeline
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Stages
+
+// Changes sample format with ConvertSamples(); optionally dithered
+class PcmConvertStage : public PcmStage
+{
+public:
+  explicit PcmConvertStage( SampleFormat outFormat, bool isDithered = false );
+
+  bool Configure( const PcmStreamFormat& inFormat, PcmStreamFormat& outFormat ) override;
+  bool IsInPlace() const override;
+  size_t Process( const void* in, size_t inFrames, void* out ) override;
+
+private:
+  SampleFormat                inFormat_ = SampleFormat::Int16;
+  SampleFormat                outFormat_;
+  uint32_t                    channelCount_ = 0;
+  std::unique_ptr<TpdfDither> dither_;
+};
+
+// Changes sample rate with PcmResampler; Float32 only
+class PcmResampleStage : public PcmStage
+{
+public:
+  explicit PcmResampleStage( uint32_t outSamplesPerSec,
+                             PcmResampler::Quality quality = PcmResampler::Quality::Balanced );
+
+  bool Configure( const PcmStreamFormat& inFormat, PcmStreamFormat& outFormat ) override;
+  bool IsInPlace() const override;
+  size_t GetMaxOutputFrames( size_t inFrames ) const override;
+  size_t Process( const void* in, size_t inFrames, void* out ) override;
+  size_t GetMaxFlushFrames() const override;
+  size_t Flush( void* out ) override;
+
+private:
+  uint32_t                      outSamplesPerSec_;
+  PcmResampler::Quality         quality_;
+  std::unique_ptr<PcmResampler> resampler_;
+};
+
+// Applies a function to Float32 frames in place; for effects, meters etc.
+class PcmDspStage : public PcmStage
+{
+public:
+  using Function = std::function<void( float* samples, size_t frameCount, uint32_t channelCount )>;
+
+  explicit PcmDspStage( Function function );
+
+  bool Configure( const PcmStreamFormat& inFormat, PcmStreamFormat& outFormat ) override;
+  bool IsInPlace() const override;
+  size_t Process( const void* in, size_t inFrames, void* out ) override;
+
+private:
+  Function function_;
+  uint32_t channelCount_ = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Portable source and sink, for running a pipeline without Media Foundation
+// or a sound card. See WinPcmPipeline.h for the Windows ones.
+
+// Integer or float PCM WAV, read with buffered file I/O
+class WavFileSource : public PcmSource
+{
+public:
+  WavFileSource() = default;
+
+  // False if the file can't be opened or isn't 16/24/32-bit integer or
+  // 32-bit float PCM WAV
+  bool Open( const std::filesystem::path& file );
+
+  PcmStreamFormat GetFormat() const override;
+  size_t Read( void* out, size_t maxFrames ) override;
+
+private:
+  std::ifstream   file_;
+  PcmStreamFormat format_;
+  uint64_t        remainingBytes_ = 0;
+};
+
+// Plays a PcmMixer, e.g. into a WinWaveStreamPcmSink; the pipeline thread is
+// the mixer's refill thread. The mix never ends, so Stop() the pipeline.
+// Mixer commands are heard once the blocks already queued have played, so
+// keep the pipeline's blocks and the sink's ring short.
+class PcmMixerSource : public PcmSource
+{
+public:
+  // Integer formats are dithered
+  explicit PcmMixerSource( PcmMixer& mixer, SampleFormat sampleFormat = SampleFormat::Float32 );
+
+  PcmStreamFormat GetFormat() const override;
+  size_t Read( void* out, size_t maxFrames ) override;
+
+private:
+  PcmMixer&       mixer_;
+  PcmStreamFormat format_;
+  TpdfDither      dither_;
+};
+
+// Accepts any format and discards it, at most maxFramesPerWrite at a time.
+// Fewer frames per write stand in for a device that fills up.
+class NullPcmSink : public PcmSink
+{
+public:
+  explicit NullPcmSink( bool isChecksummed = false, size_t maxFramesPerWrite = SIZE_MAX );
+
+  bool Open( const PcmStreamFormat& format ) override;
+  size_t Write( const void* pcm, size_t frameCount ) override;
+  void SetEndOfStream() override;
+
+  const PcmStreamFormat& GetFormat() const
+  {
+    return format_;
+  }
+
+  // Fletcher-style sum of every byte written, for checking a run end to end;
+  // zero unless isChecksummed
+  uint64_t GetChecksum() const
+  {
+    return ( uint64_t( sumOfSums_ ) << 32 ) | sum_;
+  }
+
+  bool IsEnded() const
+  {
+    return isEnded_;
+  }
+
+private:
+  PcmStreamFormat format_;
+  size_t          maxFramesPerWrite_;
+  uint32_t        sum_ = 0;
+  uint32_t        sumOfSums_ = 0;
+  bool            isChecksummed_;
+  bool            isEnded_ = false;
+};
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
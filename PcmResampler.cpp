@@ -0,0 +1,351 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmResampler.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+
+#include "PcmResampler.h"
+
+namespace PKIsensee
+{
+
+struct PcmResampler::FilterBank
+{
+  uint32_t           phases = 0;
+  uint32_t           taps = 0;   // per phase; a multiple of 8
+  std::vector<float> coefs;      // rows of taps; see DesignFilterBank()
+};
+
+namespace
+{
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Kaiser beta sets the stopband, the zero crossings on each side set the
+// transition width, and the cutoff puts the stopband edge at Nyquist
+struct QualitySpec
+{
+  uint32_t zeroCrossings;
+  double   beta;
+  double   cutoff; // fraction of the lower Nyquist rate
+};
+
+constexpr QualitySpec kQualitySpecs[] =
+{
+  {  8,  5.0, 0.800 }, // Fast
+  { 24,  8.0, 0.890 }, // Balanced
+  { 64, 11.0, 0.945 }, // Best
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Dot products of n floats, n a multiple of 8. Every level keeps eight partial
+// sums and adds them in the same order, so all levels agree bit for bit.
+
+float DotProductScalar( const float* a, const float* b, size_t n )
+{
+  assert( n % 8 == 0 );
+  float sum[ 8 ] = {};
+  for( size_t i = 0; i < n; i += 8 )
+    for( size_t lane = 0; lane < 8; ++lane )
+      sum[ lane ] += a[ i + lane ] * b[ i + lane ];
+  for( size_t lane = 0; lane < 4; ++lane )
+    sum[ lane ] += sum[ lane + 4 ];
+  sum[ 0 ] += sum[ 2 ];
+  sum[ 1 ] += sum[ 3 ];
+  return sum[ 0 ] + sum[ 1 ];
+}
+
+#if defined( PKI_SIMD_X64 )
+
+float DotProductSse2( const float* a, const float* b, size_t n )
+{
+  assert( n % 8 == 0 );
+  __m128 lo = _mm_setzero_ps();
+  __m128 hi = _mm_setzero_ps();
+  for( size_t i = 0; i < n; i += 8 )
+  {
+    lo = _mm_add_ps( lo, _mm_mul_ps( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i ) ) );
+    hi = _mm_add_ps( hi, _mm_mul_ps( _mm_loadu_ps( a + i + 4 ), _mm_loadu_ps( b + i + 4 ) ) );
+  }
+  __m128 sum = _mm_add_ps( lo, hi );
+  sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+  sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 1 ) );
+  return _mm_cvtss_f32( sum );
+}
+
+PKI_TARGET_AVX2 float DotProductAvx2( const float* a, const float* b, size_t n )
+{
+  assert( n % 8 == 0 );
+  __m256 acc = _mm256_setzero_ps();
+  for( size_t i = 0; i < n; i += 8 )
+    acc = _mm256_add_ps( acc, _mm256_mul_ps( _mm256_loadu_ps( a + i ), _mm256_loadu_ps( b + i ) ) );
+  __m128 sum = _mm_add_ps( _mm256_castps256_ps128( acc ), _mm256_extractf128_ps( acc, 1 ) );
+  sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+  sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 1 ) );
+  return _mm_cvtss_f32( sum );
+}
+
+#endif // PKI_SIMD_X64
+
+#if defined( PKI_SIMD_NEON )
+
+float DotProductNeon( const float* a, const float* b, size_t n )
+{
+  assert( n % 8 == 0 );
+  float32x4_t lo = vdupq_n_f32( 0.0f );
+  float32x4_t hi = vdupq_n_f32( 0.0f );
+  for( size_t i = 0; i < n; i += 8 )
+  {
+    lo = vaddq_f32( lo, vmulq_f32( vld1q_f32( a + i ), vld1q_f32( b + i ) ) );
+    hi = vaddq_f32( hi, vmulq_f32( vld1q_f32( a + i + 4 ), vld1q_f32( b + i + 4 ) ) );
+  }
+  float32x4_t sum = vaddq_f32( lo, hi );
+  float32x2_t pair = vadd_f32( vget_low_f32( sum ), vget_high_f32( sum ) );
+  return vget_lane_f32( pair, 0 ) + vget_lane_f32( pair, 1 );
+}
+
+#endif // PKI_SIMD_NEON
+
+auto GetDotProduct( SimdLevel simdLevel ) -> float (*)( const float*, const float*, size_t )
+{
+  assert( IsSimdLevelSupported( simdLevel ) );
+  switch( simdLevel )
+  {
+#if defined( PKI_SIMD_X64 )
+  case SimdLevel::SSE2: return DotProductSse2;
+  case SimdLevel::AVX2: return DotProductAvx2;
+#endif
+#if defined( PKI_SIMD_NEON )
+  case SimdLevel::NEON: return DotProductNeon;
+#endif
+  default: return DotProductScalar;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Filter design
+
+// Zeroth-order modified Bessel function of the first kind
+double BesselI0( double x )
+{
+  double sum = 1.0;
+  double term = 1.0;
+  for( int k = 1; term > sum * 1e-12; ++k )
+  {
+    auto half = x / ( 2.0 * k );
+    term *= half * half;
+    sum += term;
+  }
+  return sum;
+}
+
+// Phase p of L holds the weights of the taps around output time i + p/L,
+// where i is the input sample under the middle tap. Each phase is normalized
+// to unity gain at DC. When L is above kMaxPhases, a row for p = phases
+// (one input sample on) follows the others, so rounding to the nearest phase
+// never needs to wrap.
+std::shared_ptr<const PcmResampler::FilterBank> DesignFilterBank( uint32_t upFactor, uint32_t downFactor,
+                                                                   PcmResampler::Quality quality )
+{
+  const auto& spec = kQualitySpecs[ static_cast<size_t>( quality ) ];
+
+  // Downsampling widens the filter in input samples to cut off lower
+  double scale = std::min( 1.0, static_cast<double>( upFactor ) / downFactor );
+  auto halfTaps = static_cast<uint32_t>( std::ceil( spec.zeroCrossings / scale ) );
+  halfTaps = ( halfTaps + 3u ) & ~3u;
+
+  auto bank = std::make_shared<PcmResampler::FilterBank>();
+  bank->phases = std::min( upFactor, PcmResampler::kMaxPhases );
+  bank->taps = halfTaps * 2;
+  auto rows = bank->phases + ( ( bank->phases < upFactor ) ? 1u : 0u );
+  bank->coefs.resize( static_cast<size_t>( rows ) * bank->taps );
+
+  auto cutoff = spec.cutoff * scale;
+  auto windowNorm = 1.0 / BesselI0( spec.beta );
+  std::vector<double> row( bank->taps );
+  for( uint32_t p = 0; p < rows; ++p )
+  {
+    auto offset = static_cast<double>( p ) / bank->phases;
+    for( uint32_t j = 0; j < bank->taps; ++j )
+    {
+      auto d = offset + ( static_cast<double>( halfTaps ) - 1.0 - j ); // distance from the output time, in input samples
+      auto x = d / halfTaps;
+      auto window = ( std::fabs( x ) < 1.0 ) ? BesselI0( spec.beta * std::sqrt( 1.0 - x * x ) ) * windowNorm : 0.0;
+      auto sinc = ( d == 0.0 ) ? 1.0 : std::sin( kPi * cutoff * d ) / ( kPi * cutoff * d );
+      row[ j ] = cutoff * sinc * window;
+    }
+    auto gain = std::accumulate( row.begin(), row.end(), 0.0 );
+    auto* coefs = bank->coefs.data() + ( static_cast<size_t>( p ) * bank->taps );
+    for( uint32_t j = 0; j < bank->taps; ++j )
+      coefs[ j ] = static_cast<float>( row[ j ] / gain );
+  }
+  return bank;
+}
+
+std::shared_ptr<const PcmResampler::FilterBank> GetFilterBank( uint32_t upFactor, uint32_t downFactor,
+                                                                PcmResampler::Quality quality )
+{
+  static std::mutex mutex;
+  static std::map<std::tuple<uint32_t, uint32_t, PcmResampler::Quality>,
+                  std::shared_ptr<const PcmResampler::FilterBank>> filterBanks;
+
+  auto key = std::make_tuple( upFactor, downFactor, quality );
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    auto it = filterBanks.find( key );
+    if( it != filterBanks.end() )
+      return it->second;
+  }
+
+  // Design outside the lock; if two threads race, the first one stored wins
+  auto bank = DesignFilterBank( upFactor, downFactor, quality );
+  std::lock_guard<std::mutex> lock( mutex );
+  return filterBanks.emplace( key, std::move( bank ) ).first->second;
+}
+
+} // anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+PcmResampler::PcmResampler( uint32_t channelCount, uint32_t inSamplesPerSec, uint32_t outSamplesPerSec,
+                            Quality quality, SimdLevel simdLevel )
+  : channelCount_( channelCount )
+{
+  assert( channelCount > 0 );
+  assert( inSamplesPerSec > 0 && outSamplesPerSec > 0 );
+  auto divisor = std::gcd( inSamplesPerSec, outSamplesPerSec );
+  upFactor_ = outSamplesPerSec / divisor;
+  downFactor_ = inSamplesPerSec / divisor;
+  filterBank_ = GetFilterBank( upFactor_, downFactor_, quality );
+  taps_ = filterBank_->taps;
+  halfTaps_ = taps_ / 2;
+  dotProduct_ = GetDotProduct( simdLevel );
+
+  historyStride_ = taps_ + kBlockFrames;
+  history_.resize( historyStride_ * channelCount_ );
+  Reset();
+}
+
+PcmResampler::~PcmResampler() = default;
+
+void PcmResampler::PrecomputeCommonRatios()
+{
+  constexpr uint32_t kRatios[][ 2 ] = { { 160, 147 }, { 147, 160 }, { 2, 1 }, { 1, 2 } };
+  for( const auto& ratio : kRatios )
+    for( auto quality : { Quality::Fast, Quality::Balanced, Quality::Best } )
+      GetFilterBank( ratio[ 0 ], ratio[ 1 ], quality );
+}
+
+size_t PcmResampler::GetMaxOutputFrames( size_t inFrames ) const
+{
+  // Each output advances M/L input frames; the input held over from the last
+  // call can complete at most one more
+  return static_cast<size_t>( ( static_cast<uint64_t>( inFrames ) * upFactor_ ) / downFactor_ ) + 2;
+}
+
+size_t PcmResampler::Process( const float* in, size_t inFrames, float* out )
+{
+  assert( in != nullptr || inFrames == 0 );
+  size_t outFrames = 0;
+  for( size_t done = 0; done < inFrames; done += kBlockFrames )
+  {
+    auto frames = std::min( kBlockFrames, inFrames - done );
+    outFrames += ProcessBlock( in + ( done * channelCount_ ), frames, out + ( outFrames * channelCount_ ) );
+  }
+  return outFrames;
+}
+
+size_t PcmResampler::Flush( float* out )
+{
+  // Silence after the last input lets the filter reach it. Steep downsampling
+  // filters look ahead further than one block
+  size_t outFrames = 0;
+  for( size_t done = 0; done < halfTaps_; done += kBlockFrames )
+  {
+    auto frames = std::min( kBlockFrames, halfTaps_ - done );
+    outFrames += ProcessBlock( nullptr, frames, out + ( outFrames * channelCount_ ) );
+  }
+  return outFrames;
+}
+
+void PcmResampler::Reset()
+{
+  // Silence before the first input, so the first output is centered on it
+  std::fill( history_.begin(), history_.end(), 0.0f );
+  historyFrames_ = halfTaps_ - 1;
+  inputPos_ = 0;
+  phase_ = 0;
+}
+
+// Appends up to kBlockFrames frames of input (silence if in is null) to the
+// history and computes every output the history now covers
+size_t PcmResampler::ProcessBlock( const float* in, size_t frameCount, float* out )
+{
+  assert( frameCount <= kBlockFrames );
+  assert( historyFrames_ + frameCount <= historyStride_ );
+  for( uint32_t c = 0; c < channelCount_; ++c )
+  {
+    auto* history = history_.data() + ( c * historyStride_ ) + historyFrames_;
+    if( in == nullptr )
+      std::fill( history, history + frameCount, 0.0f );
+    else
+      for( size_t i = 0; i < frameCount; ++i )
+        history[ i ] = in[ ( i * channelCount_ ) + c ];
+  }
+  historyFrames_ += frameCount;
+
+  const auto& bank = *filterBank_;
+  size_t outFrames = 0;
+  while( inputPos_ + taps_ <= historyFrames_ )
+  {
+    // The nearest phase; may be the extra row at bank.phases
+    auto row = ( bank.phases == upFactor_ ) ? phase_
+                                            : static_cast<uint32_t>( ( ( static_cast<uint64_t>( phase_ ) * bank.phases ) +
+                                                                       ( upFactor_ / 2 ) ) / upFactor_ );
+    const auto* coefs = bank.coefs.data() + ( static_cast<size_t>( row ) * taps_ );
+    for( uint32_t c = 0; c < channelCount_; ++c )
+      out[ ( outFrames * channelCount_ ) + c ] = dotProduct_( history_.data() + ( c * historyStride_ ) + inputPos_,
+                                                              coefs, taps_ );
+    ++outFrames;
+    phase_ += downFactor_;
+    inputPos_ += phase_ / upFactor_;
+    phase_ %= upFactor_;
+  }
+
+  // Keep the frames later outputs still need. When downsampling, the next
+  // output can start past the end of the history
+  auto consumed = std::min( inputPos_, historyFrames_ );
+  for( uint32_t c = 0; c < channelCount_; ++c )
+  {
+    auto* history = history_.data() + ( c * historyStride_ );
+    std::memmove( history, history + consumed, ( historyFrames_ - consumed ) * sizeof( float ) );
+  }
+  historyFrames_ -= consumed;
+  inputPos_ -= consumed;
+  return outFrames;
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PlaybackClock.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Sample-accurate playback position. The refill thread occasionally feeds the
+// clock the device byte position via Sync(); readers on any thread get a
+// position interpolated from the last sync using the high-resolution timer,
+// so polling the position costs a few atomic loads and never a device call.
+//
+// Positions are 64-bit sample frames, so the 32-bit device byte counter may
+// wrap freely. Readings never go backwards between Reset() calls: if the
+// device reports less than was already interpolated, the clock holds until
+// the device catches up. Readings never exceed the frames written to the
+// device (see SetLimit), so a stalled refill thread can't run the clock away.
+//
+// All time points are parameters so the clock can be driven by a simulated
+// device in tests.
+
+class PlaybackClock
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  PlaybackClock() = default;
+
+  // Disable copy/move
+  PlaybackClock( const PlaybackClock& ) = delete;
+  PlaybackClock& operator=( const PlaybackClock& ) = delete;
+  PlaybackClock( PlaybackClock&& ) = delete;
+  PlaybackClock& operator=( PlaybackClock&& ) = delete;
+
+  void Open( uint32_t samplesPerSec, uint32_t blockAlign )
+  {
+    assert( samplesPerSec > 0 );
+    assert( blockAlign > 0 );
+    samplesPerSec_ = samplesPerSec;
+    blockAlign_ = blockAlign;
+    Reset( 0 );
+  }
+
+  // Device position restarts at zero and playback is stopped at startFrame
+  void Reset( uint64_t startFrame )
+  {
+    startFrame_ = startFrame;
+    lastDeviceBytes_ = 0;
+    deviceBytes_ = 0;
+    Publish( startFrame, 0, startFrame, false );
+  }
+
+  // Frames written to the device so far, including startFrame
+  void SetLimit( uint64_t limitFrames )
+  {
+    auto state = Load();
+    Publish( state.frames, state.ticks, limitFrames, state.isRunning );
+  }
+
+  void Start( Clock::time_point now = Clock::now() )
+  {
+    auto state = Load();
+    if( !state.isRunning )
+      Publish( state.frames, ToTicks( now ), state.limit, true );
+  }
+
+  void Stop( Clock::time_point now = Clock::now() )
+  {
+    auto state = Load();
+    Publish( Interpolate( state, ToTicks( now ) ), 0, state.limit, false );
+  }
+
+  // Call from the refill thread with the device's (wrapping) byte position
+  void Sync( uint32_t devicePositionBytes, Clock::time_point now = Clock::now() )
+  {
+    deviceBytes_ += static_cast<uint32_t>( devicePositionBytes - lastDeviceBytes_ );
+    lastDeviceBytes_ = devicePositionBytes;
+    auto deviceFrames = startFrame_ + ( deviceBytes_ / blockAlign_ );
+
+    auto state = Load();
+    auto ticks = ToTicks( now );
+    auto current = Interpolate( state, ticks );
+    if( !state.isRunning || deviceFrames >= current )
+    {
+      Publish( std::max( deviceFrames, current ), ticks, state.limit, state.isRunning );
+      return;
+    }
+
+    // Device is behind what readers have seen; hold until it catches up
+    auto holdTicks = ( ( current - deviceFrames ) * kTicksPerSecond ) / samplesPerSec_;
+    Publish( current, ticks + static_cast<int64_t>( holdTicks ), state.limit, true );
+  }
+
+  uint64_t GetFrames( Clock::time_point now = Clock::now() ) const
+  {
+    return Interpolate( Load(), ToTicks( now ) );
+  }
+
+  uint64_t GetNanoseconds( Clock::time_point now = Clock::now() ) const
+  {
+    auto frames = GetFrames( now );
+    return ( ( frames / samplesPerSec_ ) * kTicksPerSecond ) +
+           ( ( frames % samplesPerSec_ ) * kTicksPerSecond ) / samplesPerSec_;
+  }
+
+  uint64_t GetMilliseconds( Clock::time_point now = Clock::now() ) const
+  {
+    return GetNanoseconds( now ) / 1000000;
+  }
+
+private:
+  static constexpr uint64_t kTicksPerSecond = 1000000000; // nanoseconds
+
+  struct State
+  {
+    uint64_t frames = 0; // position at ticks
+    int64_t  ticks = 0;  // anchor time
+    uint64_t limit = 0;  // position may not pass this
+    bool     isRunning = false;
+  };
+
+  static int64_t ToTicks( Clock::time_point t )
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( t.time_since_epoch() ).count();
+  }
+
+  uint64_t Interpolate( const State& state, int64_t ticks ) const
+  {
+    if( !state.isRunning || ticks <= state.ticks )
+      return state.frames;
+    auto elapsed = static_cast<uint64_t>( ticks - state.ticks );
+    auto frames = state.frames + ( elapsed * samplesPerSec_ ) / kTicksPerSecond;
+    return std::max( std::min( frames, state.limit ), state.frames );
+  }
+
+  // Seqlock: one writer (the refill/control thread) and any number of readers.
+  // Readers retry if the sequence was odd or changed during the read.
+  State Load() const
+  {
+    State state;
+    for( ;; )
+    {
+      auto seq = seq_.load( std::memory_order_acquire );
+      if( seq & 1 )
+        continue;
+      state.frames = frames_.load( std::memory_order_relaxed );
+      state.ticks = ticks_.load( std::memory_order_relaxed );
+      state.limit = limit_.load( std::memory_order_relaxed );
+      state.isRunning = isRunning_.load( std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if( seq_.load( std::memory_order_relaxed ) == seq )
+        return state;
+    }
+  }
+
+  void Publish( uint64_t frames, int64_t ticks, uint64_t limit, bool isRunning )
+  {
+    auto seq = seq_.load( std::memory_order_relaxed );
+    seq_.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    frames_.store( frames, std::memory_order_relaxed );
+    ticks_.store( ticks, std::memory_order_relaxed );
+    limit_.store( limit, std::memory_order_relaxed );
+    isRunning_.store( isRunning, std::memory_order_relaxed );
+    seq_.store( seq + 2, std::memory_order_release );
+  }
+
+private:
+  std::atomic<uint32_t> seq_ = 0;
+  std::atomic<uint64_t> frames_ = 0;
+  std::atomic<int64_t>  ticks_ = 0;
+  std::atomic<uint64_t> limit_ = 0;
+  std::atomic<bool>     isRunning_ = false;
+
+  // Writer-only state
+  uint64_t startFrame_ = 0;
+  uint64_t deviceBytes_ = 0;     // unwrapped device position
+  uint32_t lastDeviceBytes_ = 0; // as last reported
+  uint32_t samplesPerSec_ = 1;
+  uint32_t blockAlign_ = 1;
+
+}; // class PlaybackClock
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  RegistryBackend.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Util::GetRegistryValue() reads HKEY_LOCAL_MACHINE (see WinUtil.cpp).
+// Install a backend to answer from somewhere else, e.g.
+//
+//    MemoryRegistry memoryRegistry;
+//    memoryRegistry.SetValue( "SOFTWARE\\Vendor\\App", "Version", "1.0" );
+//    SetRegistryBackend( [&]( const std::string& path, const std::string& entry )
+//                        { return memoryRegistry.GetValue( path, entry ); } );
+//
+// The backend is one unsynchronized global, read by every lookup. Set it
+// before any thread starts looking values up, and restore it only once they
+// have all finished; the backend and whatever it captures must outlive them.
+
+using RegistryBackend = std::function<std::string( const std::string& registryPath,
+                                                   const std::string& registryEntry )>;
+
+inline RegistryBackend& GetRegistryBackend()
+{
+  static RegistryBackend registryBackend;
+  return registryBackend;
+}
+
+inline void SetRegistryBackend( RegistryBackend registryBackend ) // empty to restore default
+{
+  GetRegistryBackend() = std::move( registryBackend );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// String values held in memory. Unlike the registry, names are case sensitive.
+// Missing values are empty, as GetRegistryValue() returns them.
+
+class MemoryRegistry
+{
+public:
+  void SetValue( const std::string& registryPath, const std::string& registryEntry, std::string value )
+  {
+    values_[ { registryPath, registryEntry } ] = std::move( value );
+  }
+
+  std::string GetValue( const std::string& registryPath, const std::string& registryEntry ) const
+  {
+    auto it = values_.find( { registryPath, registryEntry } );
+    return ( it == values_.end() ) ? std::string() : it->second;
+  }
+
+private:
+  std::map<std::pair<std::string, std::string>, std::string> values_;
+
+}; // class MemoryRegistry
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
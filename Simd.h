@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Simd.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+
+#if defined( _M_X64 ) || defined( __x86_64__ )
+#define PKI_SIMD_X64 1
+#include <immintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#elif ( defined( _M_ARM64 ) || defined( __aarch64__ ) ) && defined( PKI_SIMD_ENABLE_NEON )
+#define PKI_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only emit AVX2 instructions in functions marked for it; MSVC
+// emits whatever intrinsics it's given. FMA is left out so GCC can't fuse a
+// multiply and add, which would round differently from the other levels.
+#if defined( PKI_SIMD_X64 ) && defined( __GNUC__ )
+#define PKI_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define PKI_TARGET_AVX2
+#endif
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Instruction sets that DSP kernels are written for. Every x64 CPU has SSE2
+// and every ARM64 CPU has NEON, so only AVX2 needs to be checked at runtime.
+// The kernels use neither FMA nor anything else beyond AVX2 itself.
+//
+// The NEON kernels have not yet been compiled or run on an ARM64 machine, so
+// they are opt-in: define PKI_SIMD_ENABLE_NEON (WINSHIM_ENABLE_NEON in
+// CMakeLists.txt) and run the tests there before relying on them. Without it,
+// ARM64 builds use the scalar kernels.
+// Kernels take a SimdLevel so benchmarks and tests can compare each level
+// against the scalar reference on the same machine.
+
+enum class SimdLevel
+{
+  Scalar,
+  SSE2,
+  AVX2,
+  NEON
+};
+
+inline SimdLevel DetectSimdLevel()
+{
+#if defined( PKI_SIMD_X64 ) && defined( _MSC_VER )
+  int cpuInfo[ 4 ] = {};
+  __cpuid( cpuInfo, 0 );
+  if( cpuInfo[ 0 ] < 7 )
+    return SimdLevel::SSE2;
+
+  // The OS must save the YMM registers on context switches
+  __cpuid( cpuInfo, 1 );
+  bool hasOsxsave = ( cpuInfo[ 2 ] & ( 1 << 27 ) ) != 0;
+  bool hasAvx = ( cpuInfo[ 2 ] & ( 1 << 28 ) ) != 0;
+  if( !hasOsxsave || !hasAvx || ( _xgetbv( 0 ) & 6 ) != 6 )
+    return SimdLevel::SSE2;
+
+  __cpuidex( cpuInfo, 7, 0 );
+  bool hasAvx2 = ( cpuInfo[ 1 ] & ( 1 << 5 ) ) != 0;
+  return hasAvx2 ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#elif defined( PKI_SIMD_X64 )
+  return __builtin_cpu_supports( "avx2" ) ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#elif defined( PKI_SIMD_NEON )
+  return SimdLevel::NEON;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+// Best level this CPU supports; detected once
+inline SimdLevel GetSimdLevel()
+{
+  static const SimdLevel simdLevel = DetectSimdLevel();
+  return simdLevel;
+}
+
+inline bool IsSimdLevelSupported( SimdLevel simdLevel )
+{
+  switch( simdLevel )
+  {
+  case SimdLevel::Scalar: return true;
+  case SimdLevel::SSE2:   return GetSimdLevel() == SimdLevel::SSE2 || GetSimdLevel() == SimdLevel::AVX2;
+  case SimdLevel::AVX2:   return GetSimdLevel() == SimdLevel::AVX2;
+  case SimdLevel::NEON:   return GetSimdLevel() == SimdLevel::NEON;
+  default: return false;
+  }
+}
+
+inline const char* GetSimdLevelName( SimdLevel simdLevel )
+{
+  switch( simdLevel )
+  {
+  case SimdLevel::Scalar: return "Scalar";
+  case SimdLevel::SSE2:   return "SSE2";
+  case SimdLevel::AVX2:   return "AVX2";
+  case SimdLevel::NEON:   return "NEON";
+  default: return "Unknown";
+  }
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,144 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  SpscRingBuffer.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Lock-free single-producer/single-consumer ring buffer. One thread may call
+// Write(); one (other) thread may call Read()/Skip(). Capacity is rounded up
+// to a power of two so indices can wrap with a mask. Head and tail are free-
+// running counters, so full vs. empty never needs a wasted slot.
+
+#pragma warning(push)
+#pragma warning(disable: 4324) // structure was padded due to alignment specifier
+template<typename T>
+class SpscRingBuffer
+{
+  static_assert( std::is_trivially_copyable<T>::value, "T must be trivially copyable" );
+  static constexpr size_t kCacheLine = 64;
+
+public:
+  explicit SpscRingBuffer( size_t minCapacity )
+  {
+    assert( minCapacity > 0 );
+    capacity_ = 1;
+    while( capacity_ < minCapacity )
+      capacity_ <<= 1;
+    mask_ = capacity_ - 1;
+    buffer_.reset( new T[ capacity_ ] );
+  }
+
+  // Disable copy/move
+  SpscRingBuffer( const SpscRingBuffer& ) = delete;
+  SpscRingBuffer& operator=( const SpscRingBuffer& ) = delete;
+  SpscRingBuffer( SpscRingBuffer&& ) = delete;
+  SpscRingBuffer& operator=( SpscRingBuffer&& ) = delete;
+
+  size_t GetCapacity() const
+  {
+    return capacity_;
+  }
+
+  // Approximate when called from a thread other than producer/consumer
+  size_t GetReadAvailable() const
+  {
+    return tail_.load( std::memory_order_acquire ) - head_.load( std::memory_order_acquire );
+  }
+
+  size_t GetWriteAvailable() const
+  {
+    return capacity_ - GetReadAvailable();
+  }
+
+  bool IsEmpty() const
+  {
+    return GetReadAvailable() == 0;
+  }
+
+  // Producer only; returns number of elements written, which may be less than count
+  size_t Write( const T* src, size_t count )
+  {
+    assert( src != nullptr || count == 0 );
+    auto tail = tail_.load( std::memory_order_relaxed );
+    auto head = head_.load( std::memory_order_acquire );
+    auto toWrite = std::min( count, capacity_ - ( tail - head ) );
+    if( toWrite == 0 )
+      return 0;
+
+    // Copy in at most two pieces: up to the physical end, then from the start
+    auto start = tail & mask_;
+    auto first = std::min( toWrite, capacity_ - start );
+    std::memcpy( buffer_.get() + start, src, first * sizeof( T ) );
+    std::memcpy( buffer_.get(), src + first, ( toWrite - first ) * sizeof( T ) );
+
+    tail_.store( tail + toWrite, std::memory_order_release );
+    return toWrite;
+  }
+
+  // Consumer only; returns number of elements read, which may be less than count
+  size_t Read( T* dest, size_t count )
+  {
+    assert( dest != nullptr || count == 0 );
+    auto head = head_.load( std::memory_order_relaxed );
+    auto tail = tail_.load( std::memory_order_acquire );
+    auto toRead = std::min( count, tail - head );
+    if( toRead == 0 )
+      return 0;
+
+    auto start = head & mask_;
+    auto first = std::min( toRead, capacity_ - start );
+    std::memcpy( dest, buffer_.get() + start, first * sizeof( T ) );
+    std::memcpy( dest + first, buffer_.get(), ( toRead - first ) * sizeof( T ) );
+
+    head_.store( head + toRead, std::memory_order_release );
+    return toRead;
+  }
+
+  // Consumer only; discard up to count elements
+  size_t Skip( size_t count )
+  {
+    auto head = head_.load( std::memory_order_relaxed );
+    auto tail = tail_.load( std::memory_order_acquire );
+    auto toSkip = std::min( count, tail - head );
+    head_.store( head + toSkip, std::memory_order_release );
+    return toSkip;
+  }
+
+private:
+  std::unique_ptr<T[]> buffer_;
+  size_t capacity_ = 0;
+  size_t mask_ = 0;
+
+  // Keep producer and consumer indices on separate cache lines to avoid false sharing
+  alignas( kCacheLine ) std::atomic<size_t> head_ = 0; // written by consumer
+  alignas( kCacheLine ) std::atomic<size_t> tail_ = 0; // written by producer
+
+}; // class SpscRingBuffer
+#pragma warning(pop)
+
+}; // end namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  AllocationCount.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Counts calls to the global operator new on every thread. This header
+// replaces the global allocation functions, so include it in only one file
+// of a test executable.
+//
+//    auto allocations = Test::GetAllocationCount();
+//    ...
+//    CHECK( Test::GetAllocationCount() == allocations );
+
+namespace PKIsensee
+{
+
+namespace Test
+{
+
+inline std::atomic<size_t> gAllocationCount = 0;
+
+inline size_t GetAllocationCount()
+{
+  return gAllocationCount.load( std::memory_order_relaxed );
+}
+
+} // namespace Test
+
+} // namespace PKIsensee
+
+// Out of line, so GCC doesn't pair the inlined malloc() and free() with the
+// new and delete expressions and warn that they're mismatched
+#if defined( __GNUC__ )
+#define WINSHIM_TEST_NOINLINE __attribute__( ( noinline ) )
+#else
+#define WINSHIM_TEST_NOINLINE
+#endif
+
+WINSHIM_TEST_NOINLINE void* operator new( size_t bytes )
+{
+  PKIsensee::Test::gAllocationCount.fetch_add( 1, std::memory_order_relaxed );
+  if( void* p = std::malloc( ( bytes != 0 ) ? bytes : 1 ) )
+    return p;
+  throw std::bad_alloc();
+}
+
+WINSHIM_TEST_NOINLINE void operator delete( void* p ) noexcept
+{
+  std::free( p );
+}
+
+WINSHIM_TEST_NOINLINE void operator delete( void* p, size_t ) noexcept
+{
+  std::free( p );
+}
+
+///////////////////////////////////////////////////////////////////////////////
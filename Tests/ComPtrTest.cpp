@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  ComPtrTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <utility>
+#include <vector>
+
+#include "ComPtr.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+
+namespace
+{
+
+// An interface MockUnknown implements, and one it doesn't
+#if defined( _WIN32 )
+struct __declspec( uuid( "5d0c3a52-9a0e-4b43-a1f2-6c2e7f1d8b01" ) ) IMockValue : public IUnknown
+#else
+struct IMockValue : public IUnknown
+#endif
+{
+#if !defined( _WIN32 )
+  static constexpr IID kIid = { 0x5d0c3a52, 0x9a0e, 0x4b43, { 0xa1, 0xf2, 0x6c, 0x2e, 0x7f, 0x1d, 0x8b, 0x01 } };
+#endif
+  virtual int STDMETHODCALLTYPE GetValue() = 0;
+};
+
+#if defined( _WIN32 )
+struct __declspec( uuid( "5d0c3a52-9a0e-4b43-a1f2-6c2e7f1d8b02" ) ) IMockMissing : public IUnknown
+#else
+struct IMockMissing : public IUnknown
+#endif
+{
+#if !defined( _WIN32 )
+  static constexpr IID kIid = { 0x5d0c3a52, 0x9a0e, 0x4b43, { 0xa1, 0xf2, 0x6c, 0x2e, 0x7f, 0x1d, 0x8b, 0x02 } };
+#endif
+};
+
+// Counts references instead of deleting itself, so every test can check the
+// count ComPtr leaves behind
+class MockUnknown : public IMockValue
+{
+public:
+  MockUnknown() = default;
+
+  // Disable copy/move
+  MockUnknown( const MockUnknown& ) = delete;
+  MockUnknown& operator=( const MockUnknown& ) = delete;
+  MockUnknown( MockUnknown&& ) = delete;
+  MockUnknown& operator=( MockUnknown&& ) = delete;
+
+  HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv ) override
+  {
+    if( ppv == nullptr )
+      return E_POINTER;
+    if( iid == __uuidof( IUnknown ) || iid == __uuidof( IMockValue ) )
+    {
+      *ppv = static_cast<IMockValue*>( this );
+      AddRef();
+      return S_OK;
+    }
+    *ppv = nullptr;
+    return E_NOINTERFACE;
+  }
+
+  ULONG STDMETHODCALLTYPE AddRef() override
+  {
+    ++addRefCount_;
+    return ++refCount_;
+  }
+
+  ULONG STDMETHODCALLTYPE Release() override
+  {
+    return --refCount_;
+  }
+
+  int STDMETHODCALLTYPE GetValue() override
+  {
+    return 42;
+  }
+
+  ULONG GetRefCount() const
+  {
+    return refCount_;
+  }
+
+  ULONG GetAddRefCount() const
+  {
+    return addRefCount_;
+  }
+
+private:
+  ULONG refCount_ = 0;
+  ULONG addRefCount_ = 0;
+};
+
+void TestConstructAndDestroy()
+{
+  MockUnknown mock;
+  {
+    ComPtr<IMockValue> p( &mock ); // borrowed, so AddRef'd
+    CHECK( mock.GetRefCount() == 1 );
+    CHECK( p->GetValue() == 42 );
+  }
+  CHECK( mock.GetRefCount() == 0 );
+}
+
+void TestCopyAndMove()
+{
+  MockUnknown mock;
+  ComPtr<IMockValue> p( &mock );
+  {
+    ComPtr<IMockValue> copy( p );
+    CHECK( mock.GetRefCount() == 2 );
+  }
+  CHECK( mock.GetRefCount() == 1 );
+
+  auto addRefCount = mock.GetAddRefCount();
+  ComPtr<IMockValue> moved( std::move( p ) );
+  CHECK( p.Get() == nullptr );
+  p = std::move( moved );
+  CHECK( mock.GetRefCount() == 1 );
+  CHECK( mock.GetAddRefCount() == addRefCount );
+
+  // Growing a vector moves its elements
+  std::vector<ComPtr<IMockValue>> ptrs;
+  for( int i = 0; i < 16; ++i )
+    ptrs.push_back( p );
+  CHECK( mock.GetAddRefCount() == addRefCount + 16 );
+  ptrs.clear();
+  CHECK( mock.GetRefCount() == 1 );
+}
+
+void TestAssign()
+{
+  MockUnknown first;
+  MockUnknown second;
+  ComPtr<IMockValue> p( &first );
+  p = &second;
+  CHECK( first.GetRefCount() == 0 );
+  CHECK( second.GetRefCount() == 1 );
+  p = p.Get(); // self-assignment keeps the reference
+  CHECK( second.GetRefCount() == 1 );
+
+  ComPtr<IMockValue> other( &first );
+  p = other;
+  CHECK( first.GetRefCount() == 2 );
+  CHECK( second.GetRefCount() == 0 );
+}
+
+// Attach() and Detach() move a reference the caller already holds
+void TestAttachAndDetach()
+{
+  MockUnknown mock;
+  mock.AddRef(); // e.g. the output of a COM call
+  ComPtr<IMockValue> p;
+  p.Attach( &mock );
+  CHECK( mock.GetRefCount() == 1 );
+  auto* raw = p.Detach();
+  CHECK( raw == &mock );
+  CHECK( p.Get() == nullptr );
+  CHECK( mock.GetRefCount() == 1 );
+  raw->Release();
+}
+
+void TestOutParameters()
+{
+  MockUnknown first;
+  MockUnknown second;
+  ComPtr<IMockValue> p;
+  *&p = &first; // as a COM creation call would
+  first.AddRef();
+  CHECK( p.Get() == &first );
+
+  *p.ReleaseAndGetAddressOf() = &second;
+  second.AddRef();
+  CHECK( first.GetRefCount() == 0 );
+  CHECK( second.GetRefCount() == 1 );
+  p.Reset();
+  CHECK( second.GetRefCount() == 0 );
+}
+
+void TestAs()
+{
+  MockUnknown mock;
+  ComPtr<IMockValue> p( &mock );
+  {
+    auto unknown = p.As<IUnknown>();
+    CHECK( unknown.Get() != nullptr );
+    CHECK( mock.GetRefCount() == 2 );
+  }
+  CHECK( mock.GetRefCount() == 1 );
+
+  auto missing = p.As<IMockMissing>();
+  CHECK( missing.Get() == nullptr );
+  CHECK( mock.GetRefCount() == 1 );
+
+  ComPtr<IMockValue> empty;
+  CHECK( empty.As<IUnknown>().Get() == nullptr );
+}
+
+} // namespace
+
+int main()
+{
+  TestConstructAndDestroy();
+  TestCopyAndMove();
+  TestAssign();
+  TestAttachAndDetach();
+  TestOutParameters();
+  TestAs();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
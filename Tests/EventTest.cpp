@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  EventTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "EventSet.h"
+#include "Test.h"
+#include "Util.h"
+
+using namespace PKIsensee;
+
+namespace
+{
+
+constexpr uint32_t kWaitMs = 5000; // long enough that only a lost wake-up times out
+
+void TestAutoReset()
+{
+  Util::Event event;
+  CHECK( !event.IsSignalled() );
+  event.Signal();
+  event.Signal();
+  CHECK( event.IsSignalled() );
+  CHECK( !event.IsSignalled() ); // one release however many signals
+  CHECK( !event.IsSignalled( 1 ) );
+}
+
+void TestManualReset()
+{
+  Util::Event event( Util::Event::Mode::ManualReset );
+  event.Signal();
+  CHECK( event.IsSignalled() );
+  CHECK( event.IsSignalled( 1 ) );
+  event.Reset();
+  CHECK( !event.IsSignalled() );
+}
+
+// Releases every thread waiting at the time, and leaves the event reset
+void TestSignalAll()
+{
+  constexpr size_t kWaiters = 8;
+  for( auto mode : { Util::Event::Mode::AutoReset, Util::Event::Mode::ManualReset } )
+  {
+    Util::Event event( mode );
+    std::atomic<size_t> startedCount = 0;
+    std::atomic<size_t> releasedCount = 0;
+    std::vector<std::thread> waiters;
+    for( size_t i = 0; i < kWaiters; ++i )
+    {
+      waiters.emplace_back( [&]
+      {
+        ++startedCount;
+        if( event.IsSignalled( kWaitMs ) )
+          ++releasedCount;
+      } );
+    }
+    while( startedCount < kWaiters )
+      std::this_thread::yield();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) ); // into their waits
+    event.SignalAll();
+    for( auto& waiter : waiters )
+      waiter.join();
+    CHECK( releasedCount == kWaiters );
+    CHECK( !event.IsSignalled() );
+  }
+}
+
+// A set waiting on the event isn't released, on either platform; a Signal()
+// afterwards still reaches it
+void TestSignalAllSkipsEventSet()
+{
+  Util::Event event;
+  Util::EventSet events;
+  events.Add( event );
+  std::atomic<bool> isWaiting = false;
+  uint64_t fired = 0;
+  std::thread waiter( [&]
+  {
+    isWaiting = true;
+    fired = events.WaitAny( 200 );
+  } );
+  while( !isWaiting )
+    std::this_thread::yield();
+  std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) ); // into its wait
+  event.SignalAll();
+  waiter.join();
+  CHECK( fired == 0 );
+
+  event.Signal();
+  CHECK( events.WaitAny( kWaitMs ) == 1 );
+}
+
+// Many producers signal one waiter after each change; however the signals
+// coalesce, the waiter must see the final count without timing out
+void TestManyProducers()
+{
+  constexpr size_t   kProducers = 16;
+  constexpr uint32_t kSignalsEach = 20000;
+  Util::Event event;
+  std::atomic<uint32_t> producedCount = 0;
+  std::vector<std::thread> producers;
+  for( size_t i = 0; i < kProducers; ++i )
+  {
+    producers.emplace_back( [&]
+    {
+      for( uint32_t j = 0; j < kSignalsEach; ++j )
+      {
+        producedCount.fetch_add( 1 );
+        event.Signal();
+      }
+    } );
+  }
+
+  uint32_t seenCount = 0;
+  bool isLost = false;
+  while( seenCount < kProducers * kSignalsEach && !isLost )
+  {
+    isLost = !event.IsSignalled( kWaitMs );
+    seenCount = producedCount.load();
+  }
+  for( auto& producer : producers )
+    producer.join();
+  CHECK( !isLost );
+  CHECK( seenCount == kProducers * kSignalsEach );
+}
+
+} // namespace
+
+int main()
+{
+  TestAutoReset();
+  TestManualReset();
+  TestSignalAll();
+  TestSignalAllSkipsEventSet();
+  TestManyProducers();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,308 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  FakeWaveSink.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "NullWaveSink.h"
+#include "WaveSink.h"
+
+namespace PKIsensee
+{
+
+namespace Test
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Auto-reset callback event without the Util repository; the handle is what
+// Util::Event::GetHandle() would return
+
+class TestEvent
+{
+public:
+  TestEvent()
+  {
+#if defined( _WIN32 )
+    event_ = ::CreateEventW( nullptr, FALSE, FALSE, nullptr );
+#endif
+  }
+
+  ~TestEvent()
+  {
+#if defined( _WIN32 )
+    ::CloseHandle( event_ );
+#endif
+  }
+
+  // Disable copy/move
+  TestEvent( const TestEvent& ) = delete;
+  TestEvent& operator=( const TestEvent& ) = delete;
+  TestEvent( TestEvent&& ) = delete;
+  TestEvent& operator=( TestEvent&& ) = delete;
+
+  HANDLE GetHandle()
+  {
+#if defined( _WIN32 )
+    return event_;
+#else
+    return &event_;
+#endif
+  }
+
+  bool Wait( uint32_t timeoutMs )
+  {
+    return WaitWaveEvent( GetHandle(), timeoutMs );
+  }
+
+private:
+#if defined( _WIN32 )
+  HANDLE     event_ = NULL;
+#else
+  FutexEvent event_;
+#endif
+
+}; // class TestEvent
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Device driven by the test. Written buffers wait until Play() finishes
+// them, in order, the way a sound card would; nothing happens on another
+// thread, so every refill decision can be checked step by step. Played
+// bytes are kept for comparison with what was written. Write() never
+// allocates, so it doesn't show up in a caller's allocation count.
+
+class FakeWaveSink : public WaveSink
+{
+public:
+  FakeWaveSink()
+  {
+    queue_.reserve( kMaxWaveBuffers );
+  }
+
+  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent ) override
+  {
+    wfx_ = wfx;
+    hEvent_ = hEvent;
+    isOpen_ = true;
+    return true;
+  }
+
+  void Prepare( WAVEHDR& wh ) override
+  {
+    wh.dwFlags |= WHDR_PREPARED;
+    ++prepareCount_;
+  }
+
+  void Unprepare( WAVEHDR& wh ) override
+  {
+    assert( !( wh.dwFlags & WHDR_INQUEUE ) );
+    wh.dwFlags &= ~static_cast<DWORD>( WHDR_PREPARED );
+  }
+
+  void Write( WAVEHDR& wh ) override
+  {
+    assert( isOpen_ );
+    assert( wh.dwFlags & WHDR_PREPARED );
+    wh.dwFlags &= ~static_cast<DWORD>( WHDR_DONE );
+    wh.dwFlags |= WHDR_INQUEUE;
+    queue_.push_back( &wh );
+    ++writeCount_;
+  }
+
+  uint32_t GetPositionBytes() const override
+  {
+    return static_cast<uint32_t>( position_ );
+  }
+
+  WaveVolume GetVolume() const override
+  {
+    return volume_;
+  }
+
+  void SetVolume( const WaveVolume& volume ) override
+  {
+    volume_ = volume;
+  }
+
+  void Reset() override
+  {
+    for( auto* wh : queue_ )
+      SetWaveHdrDone( *wh );
+    queue_.clear();
+    position_ = 0;
+  }
+
+  void Close() override
+  {
+    Reset();
+    isOpen_ = false;
+  }
+
+  void Restart() override
+  {
+    isPaused_ = false;
+  }
+
+  void Pause() override
+  {
+    isPaused_ = true;
+  }
+
+  // Finishes up to count buffers in the order written, then signals the
+  // event; returns the number finished
+  size_t Play( size_t count = SIZE_MAX )
+  {
+    size_t played = 0;
+    for( ; played < count && !queue_.empty(); ++played )
+    {
+      auto* wh = queue_.front();
+      queue_.erase( queue_.begin() );
+      const auto* pcm = reinterpret_cast<const uint8_t*>( wh->lpData );
+      played_.insert( played_.end(), pcm, pcm + wh->dwBufferLength );
+      position_ += wh->dwBufferLength;
+      SetWaveHdrDone( *wh );
+    }
+    if( played != 0 && hEvent_ != NULL )
+      SignalWaveEvent( hEvent_ );
+    return played;
+  }
+
+  size_t GetQueuedCount() const
+  {
+    return queue_.size();
+  }
+
+  const WAVEHDR& GetQueued( size_t i ) const
+  {
+    return *queue_[ i ];
+  }
+
+  const std::vector<uint8_t>& GetPlayed() const
+  {
+    return played_;
+  }
+
+  const WAVEFORMATEX& GetFormat() const
+  {
+    return wfx_;
+  }
+
+  size_t GetWriteCount() const
+  {
+    return writeCount_;
+  }
+
+  size_t GetPrepareCount() const
+  {
+    return prepareCount_;
+  }
+
+  bool IsOpen() const
+  {
+    return isOpen_;
+  }
+
+  bool IsPaused() const
+  {
+    return isPaused_;
+  }
+
+private:
+  std::vector<WAVEHDR*> queue_; // oldest first
+  std::vector<uint8_t>  played_;
+  WAVEFORMATEX          wfx_ = { 0 };
+  HANDLE                hEvent_ = NULL;
+  WaveVolume            volume_ = { 0xFFFF, 0xFFFF };
+  uint64_t              position_ = 0;
+  size_t                writeCount_ = 0;
+  size_t                prepareCount_ = 0;
+  bool                  isOpen_ = false;
+  bool                  isPaused_ = true;
+
+}; // class FakeWaveSink
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// NullWaveSink that keeps what it consumed. Read GetConsumed() once closed.
+
+class CaptureWaveSink : public NullWaveSink
+{
+public:
+  explicit CaptureWaveSink( double speed = 0.0 )
+    : NullWaveSink( speed )
+  {
+  }
+
+  ~CaptureWaveSink() override
+  {
+    Close(); // stop the consumer before consumed_ is destroyed
+  }
+
+  const std::vector<uint8_t>& GetConsumed() const
+  {
+    return consumed_;
+  }
+
+protected:
+
+  void Consume( const uint8_t* pcm, size_t bytes ) override
+  {
+    consumed_.insert( consumed_.end(), pcm, pcm + bytes );
+  }
+
+private:
+  std::vector<uint8_t> consumed_;
+
+}; // class CaptureWaveSink
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 16-bit stereo whose every byte is predictable from its stream offset, so a
+// dropped, repeated or reordered byte shows up in a comparison
+
+inline WAVEFORMATEX MakeWaveFormat( uint32_t samplesPerSec = 48000, uint16_t channels = 2, uint16_t bitsPerSample = 16 )
+{
+  WAVEFORMATEX wfx = { 0 };
+  wfx.wFormatTag      = WAVE_FORMAT_PCM;
+  wfx.nChannels       = channels;
+  wfx.wBitsPerSample  = bitsPerSample;
+  wfx.nSamplesPerSec  = samplesPerSec;
+  wfx.nBlockAlign     = static_cast<WORD>( channels * bitsPerSample / 8 );
+  wfx.nAvgBytesPerSec = samplesPerSec * wfx.nBlockAlign;
+  return wfx;
+}
+
+inline uint8_t GetPatternByte( uint64_t offset )
+{
+  return static_cast<uint8_t>( ( offset * 7 ) ^ ( offset >> 8 ) );
+}
+
+inline std::vector<uint8_t> MakePattern( uint64_t offset, size_t bytes )
+{
+  std::vector<uint8_t> pcm( bytes );
+  for( size_t i = 0; i < bytes; ++i )
+    pcm[ i ] = GetPatternByte( offset + i );
+  return pcm;
+}
+
+} // namespace Test
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  MediaInfoCacheTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MediaInfoCache.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+
+namespace
+{
+
+MediaInfo MakeInfo( uint64_t durationMs )
+{
+  MediaInfo info;
+  info.durationMs = durationMs;
+  info.samplesPerSec = 44100;
+  info.channels = 2;
+  info.bitsPerSample = 16;
+  return info;
+}
+
+// Entries survive a Serialize()/Load() round trip, and a changed file misses
+void TestRoundTrip()
+{
+  MediaInfoCache builder;
+  builder.Insert( "a.flac", 100, 1, MakeInfo( 1000 ) );
+  builder.Insert( "b.flac", 200, 2, MakeInfo( 2000 ) );
+  auto image = builder.Serialize();
+
+  MediaInfoCache cache;
+  CHECK( cache.Load( image.data(), image.size() ) );
+  CHECK( !cache.IsModified() );
+  MediaInfo info;
+  CHECK( cache.Find( "a.flac", 100, 1, info ) && info.durationMs == 1000 );
+  CHECK( cache.Find( "b.flac", 200, 2, info ) && info.durationMs == 2000 );
+  CHECK( !cache.Find( "b.flac", 200, 3, info ) );
+  CHECK( !cache.Find( "c.flac", 100, 1, info ) );
+}
+
+// Additions replace loaded entries until the next image
+void TestReplace()
+{
+  MediaInfoCache builder;
+  builder.Insert( "a.flac", 100, 1, MakeInfo( 1000 ) );
+  auto image = builder.Serialize();
+
+  MediaInfoCache cache;
+  cache.Load( image.data(), image.size() );
+  cache.Insert( "a.flac", 150, 5, MakeInfo( 1500 ) );
+  CHECK( cache.IsModified() );
+  MediaInfo info;
+  CHECK( !cache.Find( "a.flac", 100, 1, info ) );
+  CHECK( cache.Find( "a.flac", 150, 5, info ) && info.durationMs == 1500 );
+
+  auto newImage = cache.Serialize();
+  MediaInfoCache reloaded;
+  reloaded.Load( newImage.data(), newImage.size() );
+  CHECK( reloaded.GetPaths().size() == 1 );
+  CHECK( reloaded.Find( "a.flac", 150, 5, info ) && info.durationMs == 1500 );
+}
+
+// Removed entries, loaded or added, are gone from lookups and the next image
+void TestRemove()
+{
+  MediaInfoCache builder;
+  builder.Insert( "a.flac", 100, 1, MakeInfo( 1000 ) );
+  builder.Insert( "b.flac", 200, 2, MakeInfo( 2000 ) );
+  auto image = builder.Serialize();
+
+  MediaInfoCache cache;
+  cache.Load( image.data(), image.size() );
+  cache.Insert( "c.flac", 300, 3, MakeInfo( 3000 ) );
+  cache.Remove( "a.flac" );
+  cache.Remove( "c.flac" );
+  cache.Remove( "missing.flac" );
+  CHECK( cache.IsModified() );
+  MediaInfo info;
+  CHECK( !cache.Find( "a.flac", 100, 1, info ) );
+  CHECK( !cache.Find( "c.flac", 300, 3, info ) );
+  CHECK( cache.Find( "b.flac", 200, 2, info ) );
+  CHECK( cache.GetPaths() == std::vector<std::string>{ "b.flac" } );
+
+  auto newImage = cache.Serialize();
+  MediaInfoCache reloaded;
+  reloaded.Load( newImage.data(), newImage.size() );
+  CHECK( reloaded.GetPaths() == std::vector<std::string>{ "b.flac" } );
+  CHECK( !reloaded.Find( "a.flac", 100, 1, info ) );
+
+  // A file that comes back is cached again
+  cache.Insert( "a.flac", 100, 4, MakeInfo( 1000 ) );
+  CHECK( cache.Find( "a.flac", 100, 4, info ) );
+  auto paths = cache.GetPaths();
+  std::sort( paths.begin(), paths.end() );
+  CHECK( paths == ( std::vector<std::string>{ "a.flac", "b.flac" } ) );
+}
+
+void TestDamagedImage()
+{
+  MediaInfoCache builder;
+  builder.Insert( "a.flac", 100, 1, MakeInfo( 1000 ) );
+  auto image = builder.Serialize();
+
+  MediaInfoCache cache;
+  CHECK( !cache.Load( image.data(), image.size() - 1 ) );
+  image[ 0 ] = 'X';
+  CHECK( !cache.Load( image.data(), image.size() ) );
+  MediaInfo info;
+  CHECK( !cache.Find( "a.flac", 100, 1, info ) );
+}
+
+} // namespace
+
+int main()
+{
+  TestRoundTrip();
+  TestReplace();
+  TestRemove();
+  TestDamagedImage();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
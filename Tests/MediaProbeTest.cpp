@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  MediaProbeTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "MediaProbe.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+
+namespace
+{
+
+constexpr uint32_t kSamplesPerSec = 44100;
+constexpr uint32_t kBlockAlign = 4; // 16-bit stereo
+constexpr uint64_t kHeaderBytes = 44;
+constexpr uint64_t kOneSecondBytes = kSamplesPerSec * kBlockAlign;
+
+// Canonical 44-byte header of 16-bit stereo PCM recording dataBytes
+std::vector<uint8_t> MakeWavHeader( uint32_t dataBytes )
+{
+  std::vector<uint8_t> wav( kHeaderBytes );
+  auto put = [&]( size_t offset, uint32_t value, size_t bytes )
+  {
+    for( size_t i = 0; i < bytes; ++i )
+      wav[ offset + i ] = static_cast<uint8_t>( value >> ( 8 * i ) );
+  };
+  std::memcpy( &wav[ 0 ], "RIFF", 4 );
+  put( 4, 36 + dataBytes, 4 );
+  std::memcpy( &wav[ 8 ], "WAVEfmt ", 8 );
+  put( 16, 16, 4 );
+  put( 20, 1, 2 ); // PCM
+  put( 22, 2, 2 );
+  put( 24, kSamplesPerSec, 4 );
+  put( 28, kSamplesPerSec * kBlockAlign, 4 );
+  put( 32, kBlockAlign, 2 );
+  put( 34, 16, 2 );
+  std::memcpy( &wav[ 36 ], "data", 4 );
+  put( 40, dataBytes, 4 );
+  return wav;
+}
+
+void TestWholeFile()
+{
+  auto header = MakeWavHeader( 2 * kOneSecondBytes );
+  MediaInfo info;
+  CHECK( MediaProbe::ParseWav( header.data(), header.size(), kHeaderBytes + 2 * kOneSecondBytes, info ) );
+  CHECK( info.samplesPerSec == kSamplesPerSec );
+  CHECK( info.channels == 2 );
+  CHECK( info.bitsPerSample == 16 );
+  CHECK( info.durationMs == 2000 );
+}
+
+// A header claiming ten seconds in a file holding one, as from an interrupted copy
+void TestTruncatedFile()
+{
+  auto header = MakeWavHeader( 10 * kOneSecondBytes );
+  MediaInfo info;
+  CHECK( MediaProbe::ParseWav( header.data(), header.size(), kHeaderBytes + kOneSecondBytes, info ) );
+  CHECK( info.durationMs == 1000 );
+}
+
+// Streaming writers that never patch the header leave 0xFFFFFFFF
+void TestUnpatchedHeader()
+{
+  auto header = MakeWavHeader( 0xFFFFFFFF );
+  MediaInfo info;
+  CHECK( MediaProbe::ParseWav( header.data(), header.size(), kHeaderBytes + 3 * kOneSecondBytes, info ) );
+  CHECK( info.durationMs == 3000 );
+}
+
+void TestNoData()
+{
+  auto header = MakeWavHeader( kOneSecondBytes );
+  MediaInfo info;
+  CHECK( MediaProbe::ParseWav( header.data(), header.size(), kHeaderBytes, info ) );
+  CHECK( info.durationMs == 0 );
+  CHECK( !MediaProbe::ParseWav( header.data(), header.size(), kHeaderBytes - 4, info ) );
+}
+
+} // namespace
+
+int main()
+{
+  TestWholeFile();
+  TestTruncatedFile();
+  TestUnpatchedHeader();
+  TestNoData();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
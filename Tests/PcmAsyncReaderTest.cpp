@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmAsyncReaderTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PcmAsyncReader.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+
+namespace
+{
+
+constexpr size_t kFramesPerBuffer = 16;
+
+// Mono 16-bit frames whose value is the frame's position in the stream, so
+// order can be checked. With isGated set, each Read() waits for Open().
+class CountingSource : public PcmSource
+{
+public:
+  explicit CountingSource( size_t frameCount, bool isGated = false )
+    : frameCount_( frameCount ),
+      isGated_( isGated )
+  {
+  }
+
+  PcmStreamFormat GetFormat() const override
+  {
+    return { SampleFormat::Int16, 1, 8000 };
+  }
+
+  size_t Read( void* out, size_t maxFrames ) override
+  {
+    ++readCount_;
+    if( isGated_ )
+    {
+      std::unique_lock<std::mutex> lock( mutex_ );
+      isReading_ = true;
+      changed_.notify_all();
+      changed_.wait( lock, [this] { return isOpen_; } );
+    }
+    auto frames = std::min( maxFrames, frameCount_ - position_ );
+    auto* pcm = static_cast<int16_t*>( out );
+    for( size_t i = 0; i < frames; ++i )
+      pcm[ i ] = static_cast<int16_t>( position_ + i );
+    position_ += frames;
+    return frames;
+  }
+
+  size_t GetReadCount() const
+  {
+    return readCount_;
+  }
+
+  void WaitUntilReading()
+  {
+    std::unique_lock<std::mutex> lock( mutex_ );
+    changed_.wait( lock, [this] { return isReading_; } );
+  }
+
+  void Open()
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      isOpen_ = true;
+    }
+    changed_.notify_all();
+  }
+
+private:
+  size_t                   frameCount_;
+  size_t                   position_ = 0;
+  bool                     isGated_;
+  std::atomic<size_t>      readCount_ = 0;
+  std::mutex               mutex_;
+  std::condition_variable  changed_;
+  bool                     isReading_ = false;
+  bool                     isOpen_ = false;
+};
+
+// Polls, since the reader signals nothing while it waits for room
+bool WaitForReadCount( const CountingSource& source, size_t readCount )
+{
+  for( int i = 0; i < 1000; ++i )
+  {
+    if( source.GetReadCount() >= readCount )
+      return true;
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  }
+  return false;
+}
+
+std::vector<int16_t> GetFrames( const PcmBuffer& pcmBuffer )
+{
+  std::vector<int16_t> frames( pcmBuffer.GetSize() / sizeof( int16_t ) );
+  std::copy_n( pcmBuffer.GetData(), pcmBuffer.GetSize(), reinterpret_cast<uint8_t*>( frames.data() ) );
+  return frames;
+}
+
+// No more than buffersInFlight are read ahead, and each read makes room for one more
+void TestPrefetchDepth()
+{
+  constexpr size_t kBuffersInFlight = 3;
+  CountingSource source( kFramesPerBuffer * 100 );
+  PcmAsyncReader reader( source, kFramesPerBuffer, kBuffersInFlight );
+  reader.Start();
+  CHECK( WaitForReadCount( source, kBuffersInFlight ) );
+  std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+  CHECK( source.GetReadCount() == kBuffersInFlight );
+
+  std::unique_ptr<PcmBuffer> pcmBuffer;
+  CHECK( reader.TryRead( pcmBuffer ) == AsyncReadStatus::Ready );
+  CHECK( pcmBuffer && GetFrames( *pcmBuffer ).size() == kFramesPerBuffer );
+  CHECK( pcmBuffer && GetFrames( *pcmBuffer )[ 0 ] == 0 );
+  CHECK( WaitForReadCount( source, kBuffersInFlight + 1 ) );
+  std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+  CHECK( source.GetReadCount() == kBuffersInFlight + 1 );
+  reader.Stop();
+}
+
+// Every frame arrives in order, the last buffer short; then both calls report the end
+void TestEndOfStream()
+{
+  constexpr size_t kFrameCount = kFramesPerBuffer * 5 / 2;
+  CountingSource source( kFrameCount );
+  PcmAsyncReader reader( source, kFramesPerBuffer, 2 );
+  reader.Start();
+  size_t position = 0;
+  bool isInOrder = true;
+  while( auto pcmBuffer = reader.ReadAsync().get() )
+  {
+    for( auto frame : GetFrames( *pcmBuffer ) )
+      isInOrder = isInOrder && frame == static_cast<int16_t>( position++ );
+  }
+  CHECK( position == kFrameCount );
+  CHECK( isInOrder );
+
+  std::unique_ptr<PcmBuffer> pcmBuffer;
+  CHECK( reader.TryRead( pcmBuffer ) == AsyncReadStatus::EndOfStream );
+  CHECK( !pcmBuffer );
+  CHECK( reader.ReadAsync().get() == nullptr );
+  CHECK( source.GetReadCount() == 4 ); // three buffers and the empty read
+}
+
+// Stop() waits out the read in progress, answers the waiting future and reads no more
+void TestStopMidFlight()
+{
+  CountingSource source( kFramesPerBuffer * 100, true );
+  PcmAsyncReader reader( source, kFramesPerBuffer, 2 );
+  reader.Start();
+  source.WaitUntilReading();
+  auto future = reader.ReadAsync();
+  CHECK( future.wait_for( std::chrono::milliseconds( 0 ) ) == std::future_status::timeout );
+
+  std::thread stopper( [&reader] { reader.Stop(); } );
+  std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+  source.Open();
+  stopper.join();
+  CHECK( future.wait_for( std::chrono::milliseconds( 0 ) ) == std::future_status::ready );
+  try
+  {
+    CHECK( future.get() != nullptr ); // the read finished before Stop() was seen
+  }
+  catch( const std::future_error& e )
+  {
+    CHECK( e.code() == std::future_errc::broken_promise );
+  }
+
+  auto readCount = source.GetReadCount();
+  std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+  CHECK( source.GetReadCount() == readCount );
+  std::unique_ptr<PcmBuffer> pcmBuffer;
+  CHECK( reader.TryRead( pcmBuffer ) == AsyncReadStatus::Pending );
+}
+
+} // namespace
+
+int main()
+{
+  TestPrefetchDepth();
+  TestEndOfStream();
+  TestStopMidFlight();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmMixerTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "AllocationCount.h"
+#include "PcmMixer.h"
+#include "PcmPipeline.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+using namespace PKIsensee::Test;
+
+namespace
+{
+
+constexpr uint32_t kSamplesPerSec = 48000;
+constexpr size_t   kFrames = 64;
+
+// Float PCM of a constant value; remembers the thread that destroyed it
+class TestPcmBuffer : public PcmBuffer
+{
+public:
+  TestPcmBuffer( size_t sampleCount, float value, std::atomic<std::thread::id>* destroyedOn = nullptr )
+    : pcm_( sampleCount * sizeof( float ) ),
+      destroyedOn_( destroyedOn )
+  {
+    for( size_t i = 0; i < sampleCount; ++i )
+      std::memcpy( pcm_.data() + i * sizeof( float ), &value, sizeof( float ) );
+  }
+
+  ~TestPcmBuffer() override
+  {
+    if( destroyedOn_ != nullptr )
+      destroyedOn_->store( std::this_thread::get_id() );
+  }
+
+  const uint8_t* GetData() const override
+  {
+    return pcm_.data();
+  }
+
+  size_t GetSize() const override
+  {
+    return pcm_.size();
+  }
+
+private:
+  std::vector<uint8_t>          pcm_;
+  std::atomic<std::thread::id>* destroyedOn_;
+};
+
+void TestMixSums()
+{
+  PcmMixer mixer( 2, kSamplesPerSec );
+  mixer.AddVoice( std::make_shared<TestPcmBuffer>( kFrames * 2, 0.25f ), SampleFormat::Float32, 2, 1.0f );
+  mixer.AddVoice( std::make_shared<TestPcmBuffer>( kFrames * 2, 0.5f ), SampleFormat::Float32, 2, 0.5f );
+  std::vector<float> out( kFrames * 2 );
+  mixer.Mix( out.data(), kFrames );
+  for( auto sample : out )
+    CHECK( sample == 0.5f );
+  CHECK( mixer.GetClipCount() == 0 );
+}
+
+// Voices end on the refill thread but are destroyed, with their PCM, on the
+// control thread
+void TestVoicesDestroyedOnControlThread()
+{
+  PcmMixer mixer( 2, kSamplesPerSec );
+  std::atomic<std::thread::id> destroyedOn;
+  auto voiceId = mixer.AddVoice( std::make_shared<TestPcmBuffer>( kFrames * 2, 0.25f, &destroyedOn ),
+                                 SampleFormat::Float32, 2 );
+  CHECK( voiceId != PcmMixer::kInvalidVoice );
+
+  std::thread refill( [&mixer]
+  {
+    std::vector<float> out( kFrames * 2 );
+    mixer.Mix( out.data(), kFrames );
+    mixer.Mix( out.data(), kFrames );
+  } );
+  refill.join();
+  CHECK( mixer.GetVoiceCount() == 0 );
+  CHECK( destroyedOn.load() == std::thread::id() );
+
+  PcmMixer::VoiceId endedId = PcmMixer::kInvalidVoice;
+  CHECK( mixer.GetEndedVoice( endedId ) );
+  CHECK( endedId == voiceId );
+  CHECK( destroyedOn.load() == std::this_thread::get_id() );
+  CHECK( !mixer.GetEndedVoice( endedId ) );
+}
+
+// Voices beyond kMaxVoices end at once, and come back like any other
+void TestTooManyVoices()
+{
+  PcmMixer mixer( 2, kSamplesPerSec );
+  auto pcm = std::make_shared<TestPcmBuffer>( kFrames * 2, 0.0f );
+  for( size_t i = 0; i < PcmMixer::kMaxVoices + 1; ++i )
+    mixer.AddVoice( pcm, SampleFormat::Float32, 2, 1.0f, 0.0f, true );
+  std::vector<float> out( kFrames * 2 );
+  mixer.Mix( out.data(), kFrames );
+  CHECK( mixer.GetVoiceCount() == PcmMixer::kMaxVoices );
+  PcmMixer::VoiceId endedId = PcmMixer::kInvalidVoice;
+  CHECK( mixer.GetEndedVoice( endedId ) );
+  CHECK( endedId == PcmMixer::kMaxVoices + 1 );
+}
+
+void TestMixDoesNotAllocate()
+{
+  PcmMixer mixer( 2, kSamplesPerSec );
+  auto pcm = std::make_shared<TestPcmBuffer>( kFrames * 2, 0.25f );
+  for( int i = 0; i < 8; ++i )
+    mixer.AddVoice( pcm, SampleFormat::Float32, 2, 0.1f );
+  std::vector<int16_t> out( kFrames * 2 );
+  TpdfDither dither;
+
+  auto allocations = GetAllocationCount();
+  mixer.Mix( out.data(), SampleFormat::Int16, kFrames, &dither );
+  mixer.Mix( out.data(), SampleFormat::Int16, kFrames, &dither ); // every voice ends
+  CHECK( GetAllocationCount() == allocations );
+  CHECK( mixer.GetVoiceCount() == 0 );
+}
+
+// A mixer plays through a pipeline like any other source
+void TestMixerSource()
+{
+  PcmMixer mixer( 2, kSamplesPerSec );
+  mixer.AddVoice( std::make_shared<TestPcmBuffer>( kFrames * 2, 0.25f ), SampleFormat::Float32, 2, 1.0f,
+                  0.0f, true );
+  PcmMixerSource source( mixer, SampleFormat::Int16 );
+  CHECK( source.GetFormat().channelCount == 2 );
+  CHECK( source.GetFormat().samplesPerSec == kSamplesPerSec );
+
+  NullPcmSink sink( true );
+  PcmPipeline pipeline( source, sink );
+  CHECK( pipeline.Start() );
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 5 );
+  while( pipeline.GetFramesWritten() < kSamplesPerSec && std::chrono::steady_clock::now() < deadline )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  pipeline.Stop();
+  CHECK( pipeline.GetFramesWritten() >= kSamplesPerSec );
+  CHECK( sink.GetFormat().sampleFormat == SampleFormat::Int16 );
+  CHECK( sink.GetChecksum() != 0 );
+}
+
+} // namespace
+
+int main()
+{
+  TestMixSums();
+  TestVoicesDestroyedOnControlThread();
+  TestTooManyVoices();
+  TestMixDoesNotAllocate();
+  TestMixerSource();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,179 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PcmResamplerTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "PcmResampler.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+
+namespace
+{
+
+constexpr double kPi = 3.14159265358979323846;
+
+struct ToneResult
+{
+  double gainDb = 0.0; // output amplitude relative to input
+  double thdnDb = 0.0; // everything but the tone, relative to the tone
+};
+
+// Resamples one second of a mono tone and fits a sine of the same frequency,
+// plus DC, to the settled output by least squares
+ToneResult MeasureTone( PcmResampler::Quality quality, uint32_t inSamplesPerSec, uint32_t outSamplesPerSec,
+                        double frequency )
+{
+  constexpr double kAmplitude = 0.5;
+  std::vector<float> in( inSamplesPerSec );
+  for( size_t i = 0; i < in.size(); ++i )
+    in[ i ] = static_cast<float>( kAmplitude * std::sin( 2.0 * kPi * frequency * i / inSamplesPerSec ) );
+
+  PcmResampler resampler( 1, inSamplesPerSec, outSamplesPerSec, quality );
+  std::vector<float> out( resampler.GetMaxOutputFrames( in.size() ) );
+  out.resize( resampler.Process( in.data(), in.size(), out.data() ) );
+
+  // Skip the filter settling in at the start
+  auto settle = static_cast<size_t>( 2.0 * resampler.GetLatencyFrames() * outSamplesPerSec / inSamplesPerSec ) + 1;
+  double basis[ 3 ][ 3 ] = {};
+  double rhs[ 3 ] = {};
+  auto omega = 2.0 * kPi * frequency / outSamplesPerSec;
+  for( size_t n = settle; n < out.size(); ++n )
+  {
+    const double f[ 3 ] = { std::sin( omega * n ), std::cos( omega * n ), 1.0 };
+    for( int r = 0; r < 3; ++r )
+    {
+      rhs[ r ] += f[ r ] * out[ n ];
+      for( int c = 0; c < 3; ++c )
+        basis[ r ][ c ] += f[ r ] * f[ c ];
+    }
+  }
+
+  // Cramer's rule
+  auto det = []( const double m[ 3 ][ 3 ] )
+  {
+    return m[ 0 ][ 0 ] * ( m[ 1 ][ 1 ] * m[ 2 ][ 2 ] - m[ 1 ][ 2 ] * m[ 2 ][ 1 ] ) -
+           m[ 0 ][ 1 ] * ( m[ 1 ][ 0 ] * m[ 2 ][ 2 ] - m[ 1 ][ 2 ] * m[ 2 ][ 0 ] ) +
+           m[ 0 ][ 2 ] * ( m[ 1 ][ 0 ] * m[ 2 ][ 1 ] - m[ 1 ][ 1 ] * m[ 2 ][ 0 ] );
+  };
+  double weights[ 3 ] = {};
+  for( int k = 0; k < 3; ++k )
+  {
+    double m[ 3 ][ 3 ];
+    for( int r = 0; r < 3; ++r )
+      for( int c = 0; c < 3; ++c )
+        m[ r ][ c ] = ( c == k ) ? rhs[ r ] : basis[ r ][ c ];
+    weights[ k ] = det( m ) / det( basis );
+  }
+
+  double signal = 0.0;
+  double residual = 0.0;
+  for( size_t n = settle; n < out.size(); ++n )
+  {
+    auto fit = weights[ 0 ] * std::sin( omega * n ) + weights[ 1 ] * std::cos( omega * n ) + weights[ 2 ];
+    signal += fit * fit;
+    residual += ( out[ n ] - fit ) * ( out[ n ] - fit );
+  }
+  ToneResult result;
+  auto amplitude = std::sqrt( weights[ 0 ] * weights[ 0 ] + weights[ 1 ] * weights[ 1 ] );
+  result.gainDb = 20.0 * std::log10( amplitude / kAmplitude );
+  result.thdnDb = 10.0 * std::log10( residual / signal );
+  return result;
+}
+
+struct QualityLimits
+{
+  PcmResampler::Quality quality;
+  const char*           name;
+  double                thdnDb;     // at 1 kHz, 44.1 -> 48 kHz
+  double                passband;   // fraction of the lower Nyquist rate within +/-0.1 dB
+};
+
+// The figures documented in PcmResampler.h
+const QualityLimits kQualityLimits[] =
+{
+  { PcmResampler::Quality::Fast,     "Fast",     -61.0,  0.62 },
+  { PcmResampler::Quality::Balanced, "Balanced", -89.0,  0.81 },
+  { PcmResampler::Quality::Best,     "Best",     -123.0, 0.90 },
+};
+
+void TestThdN()
+{
+  for( const auto& limits : kQualityLimits )
+  {
+    auto result = MeasureTone( limits.quality, 44100, 48000, 1000.0 );
+    std::printf( "%-8s THD+N %7.1f dB\n", limits.name, result.thdnDb );
+    CHECK( result.thdnDb < limits.thdnDb );
+    CHECK( std::fabs( result.gainDb ) < 0.1 );
+  }
+}
+
+// Up and down, at the edge of the documented passband
+void TestPassband()
+{
+  for( const auto& limits : kQualityLimits )
+  {
+    auto frequency = limits.passband * 44100 / 2;
+    for( auto ratio : { std::make_pair( 44100u, 48000u ), std::make_pair( 48000u, 44100u ) } )
+    {
+      auto result = MeasureTone( limits.quality, ratio.first, ratio.second, frequency );
+      std::printf( "%-8s %u -> %u gain at %.0f Hz %+.3f dB\n", limits.name, ratio.first, ratio.second, frequency,
+                   result.gainDb );
+      CHECK( std::fabs( result.gainDb ) < 0.1 );
+    }
+  }
+}
+
+// Ratios with more than kMaxPhases phases round to the nearest phase
+void TestNearestPhase()
+{
+  auto result = MeasureTone( PcmResampler::Quality::Best, 44100, 48001, 1000.0 );
+  std::printf( "Best     44100 -> 48001 THD+N %7.1f dB\n", result.thdnDb );
+  CHECK( result.thdnDb < -87.0 ); // "about -88 dB"
+}
+
+// Steep downsampling looks ahead more than one block; Flush() must still
+// return every remaining output, and a DC input must come out at DC
+void TestFlushLongFilter()
+{
+  PcmResampler resampler( 2, 192000, 8000, PcmResampler::Quality::Best );
+  CHECK( resampler.GetLatencyFrames() > 1024 );
+  constexpr size_t kInFrames = 192000;
+  std::vector<float> in( kInFrames * 2, 0.25f );
+  std::vector<float> out( resampler.GetMaxOutputFrames( kInFrames ) * 2 );
+  auto outFrames = resampler.Process( in.data(), kInFrames, out.data() );
+  std::vector<float> tail( resampler.GetMaxOutputFrames( resampler.GetLatencyFrames() ) * 2 );
+  auto tailFrames = resampler.Flush( tail.data() );
+  CHECK( outFrames + tailFrames == 8000 );
+  CHECK( std::fabs( out[ 4000 * 2 ] - 0.25f ) < 1e-4f );
+  CHECK( std::fabs( out[ 4000 * 2 + 1 ] - 0.25f ) < 1e-4f );
+}
+
+} // namespace
+
+int main()
+{
+  TestThdN();
+  TestPassband();
+  TestNearestPhase();
+  TestFlushLongFilter();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
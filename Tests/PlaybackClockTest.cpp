@@ -0,0 +1,169 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  PlaybackClockTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstdint>
+
+#include "PlaybackClock.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+constexpr uint32_t kSamplesPerSec = 48000;
+constexpr uint32_t kBlockAlign = 4;
+constexpr uint64_t kNoLimit = UINT64_MAX;
+
+// Simulated time; the steady clock itself is never read
+const PlaybackClock::Clock::time_point kStart = PlaybackClock::Clock::time_point() + 1h;
+
+uint32_t ToDeviceBytes( uint64_t frames )
+{
+  return static_cast<uint32_t>( frames * kBlockAlign ); // wraps like the device counter
+}
+
+void TestInterpolation()
+{
+  PlaybackClock clock;
+  clock.Open( kSamplesPerSec, kBlockAlign );
+  clock.SetLimit( kNoLimit );
+  CHECK( clock.GetFrames( kStart + 1s ) == 0 ); // stopped
+
+  clock.Start( kStart );
+  CHECK( clock.GetFrames( kStart ) == 0 );
+  CHECK( clock.GetFrames( kStart + 10ms ) == 480 );
+  CHECK( clock.GetMilliseconds( kStart + 1s ) == 1000 );
+  CHECK( clock.GetNanoseconds( kStart + 1500us ) == 1500000 );
+
+  clock.Stop( kStart + 10ms );
+  CHECK( clock.GetFrames( kStart + 1s ) == 480 );
+  clock.Start( kStart + 2s );
+  CHECK( clock.GetFrames( kStart + 2s + 10ms ) == 960 );
+}
+
+// A stalled refill thread can't run the clock past the frames written
+void TestLimit()
+{
+  PlaybackClock clock;
+  clock.Open( kSamplesPerSec, kBlockAlign );
+  clock.SetLimit( 1000 );
+  clock.Start( kStart );
+  CHECK( clock.GetFrames( kStart + 10ms ) == 480 );
+  CHECK( clock.GetFrames( kStart + 1s ) == 1000 );
+  clock.SetLimit( 2000 );
+  CHECK( clock.GetFrames( kStart + 1s ) == 2000 );
+}
+
+// The 32-bit device byte counter wraps every 6 hours at 48 kHz stereo 16-bit
+void TestDeviceWrap()
+{
+  PlaybackClock clock;
+  clock.Open( kSamplesPerSec, kBlockAlign );
+  clock.Reset( 100 );
+  clock.SetLimit( kNoLimit );
+  uint64_t frames = 0;
+  for( int i = 0; i < 12; ++i ) // three wraps
+  {
+    frames += ( 1u << 30 ) / kBlockAlign;
+    clock.Sync( ToDeviceBytes( frames ), kStart );
+    CHECK( clock.GetFrames( kStart ) == 100 + frames );
+  }
+  CHECK( clock.GetFrames( kStart ) * kBlockAlign > uint64_t( UINT32_MAX ) * 2 );
+}
+
+// If the device reports less than readers have already seen, the clock holds
+// until the device catches up rather than going backwards
+void TestHoldsWhenDeviceIsBehind()
+{
+  PlaybackClock clock;
+  clock.Open( kSamplesPerSec, kBlockAlign );
+  clock.SetLimit( kNoLimit );
+  clock.Start( kStart );
+  CHECK( clock.GetFrames( kStart + 100ms ) == 4800 );
+
+  clock.Sync( ToDeviceBytes( 4320 ), kStart + 100ms ); // 10 ms behind
+  CHECK( clock.GetFrames( kStart + 100ms ) == 4800 );
+  CHECK( clock.GetFrames( kStart + 109ms ) == 4800 );
+  CHECK( clock.GetFrames( kStart + 120ms ) == 5280 );
+
+  // A device ahead of the clock moves it forward at once
+  clock.Sync( ToDeviceBytes( 6000 ), kStart + 120ms );
+  CHECK( clock.GetFrames( kStart + 120ms ) == 6000 );
+}
+
+void TestReset()
+{
+  PlaybackClock clock;
+  clock.Open( kSamplesPerSec, kBlockAlign );
+  clock.SetLimit( kNoLimit );
+  clock.Start( kStart );
+  clock.Sync( ToDeviceBytes( 9600 ), kStart + 200ms );
+
+  // A seek: the device restarts at zero from frame 48000
+  clock.Reset( 48000 );
+  clock.SetLimit( kNoLimit );
+  CHECK( clock.GetFrames( kStart + 1s ) == 48000 );
+  clock.Start( kStart + 1s );
+  clock.Sync( ToDeviceBytes( 480 ), kStart + 1s + 10ms );
+  CHECK( clock.GetFrames( kStart + 1s + 10ms ) == 48480 );
+}
+
+// A device whose position updates in 10 ms steps, sampled at jittery times,
+// as the refill thread sees a real one: readings never go backwards and
+// never stray from the true position by more than one device step
+void TestSimulatedDevice()
+{
+  PlaybackClock clock;
+  clock.Open( kSamplesPerSec, kBlockAlign );
+  clock.SetLimit( kNoLimit );
+  clock.Start( kStart );
+
+  constexpr uint64_t kStepFrames = 480;
+  uint32_t random = 1;
+  uint64_t lastFrames = 0;
+  auto now = kStart;
+  for( int i = 0; i < 10000; ++i )
+  {
+    random = random * 1664525 + 1013904223;
+    now += std::chrono::microseconds( 500 + ( random >> 8 ) % 3000 );
+    auto trueFrames = static_cast<uint64_t>( ( now - kStart ) / 1us ) * kSamplesPerSec / 1000000;
+    if( ( random >> 4 ) % 4 == 0 )
+      clock.Sync( ToDeviceBytes( trueFrames - ( trueFrames % kStepFrames ) ), now );
+
+    auto frames = clock.GetFrames( now );
+    CHECK( frames >= lastFrames );
+    CHECK( frames + kStepFrames >= trueFrames && frames <= trueFrames + kStepFrames );
+    lastFrames = frames;
+  }
+}
+
+} // namespace
+
+int main()
+{
+  TestInterpolation();
+  TestLimit();
+  TestDeviceWrap();
+  TestHoldsWhenDeviceIsBehind();
+  TestReset();
+  TestSimulatedDevice();
+  return PKIsensee::Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
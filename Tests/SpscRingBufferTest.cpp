@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  SpscRingBufferTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "SpscRingBuffer.h"
+#include "Test.h"
+
+using namespace PKIsensee;
+
+namespace
+{
+
+void TestCapacity()
+{
+  SpscRingBuffer<uint8_t> ring( 5 );
+  CHECK( ring.GetCapacity() == 8 );
+  CHECK( ring.IsEmpty() );
+  CHECK( ring.GetWriteAvailable() == 8 );
+}
+
+// Writes and reads that straddle the physical end come back in order
+void TestWrapAround()
+{
+  SpscRingBuffer<uint8_t> ring( 8 );
+  const uint8_t first[] = { 1, 2, 3, 4, 5, 6 };
+  CHECK( ring.Write( first, 6 ) == 6 );
+  uint8_t out[ 8 ] = {};
+  CHECK( ring.Read( out, 4 ) == 4 );
+  CHECK( out[ 0 ] == 1 && out[ 3 ] == 4 );
+
+  const uint8_t second[] = { 7, 8, 9, 10, 11, 12, 13 };
+  CHECK( ring.Write( second, 7 ) == 6 ); // full after 6
+  CHECK( ring.GetWriteAvailable() == 0 );
+  CHECK( ring.Read( out, 8 ) == 8 );
+  const uint8_t expected[] = { 5, 6, 7, 8, 9, 10, 11, 12 };
+  for( size_t i = 0; i < 8; ++i )
+    CHECK( out[ i ] == expected[ i ] );
+  CHECK( ring.Read( out, 1 ) == 0 );
+}
+
+void TestSkip()
+{
+  SpscRingBuffer<uint32_t> ring( 4 );
+  const uint32_t values[] = { 10, 20, 30 };
+  ring.Write( values, 3 );
+  CHECK( ring.Skip( 2 ) == 2 );
+  uint32_t value = 0;
+  CHECK( ring.Read( &value, 1 ) == 1 );
+  CHECK( value == 30 );
+  CHECK( ring.Skip( 1 ) == 0 );
+}
+
+// Producer and consumer on their own threads, in chunk sizes that keep
+// landing on different offsets; every value must arrive once and in order
+void TestThreaded()
+{
+  constexpr uint32_t kCount = 1 << 20;
+  SpscRingBuffer<uint32_t> ring( 1000 );
+  std::thread producer( [&]
+  {
+    std::vector<uint32_t> chunk( 97 );
+    uint32_t next = 0;
+    size_t chunkSize = 1;
+    while( next < kCount )
+    {
+      chunkSize = ( chunkSize % chunk.size() ) + 1;
+      auto count = std::min<size_t>( chunkSize, kCount - next );
+      for( size_t i = 0; i < count; ++i )
+        chunk[ i ] = next + static_cast<uint32_t>( i );
+      auto written = ring.Write( chunk.data(), count );
+      next += static_cast<uint32_t>( written );
+      if( written == 0 )
+        std::this_thread::yield();
+    }
+  } );
+
+  std::vector<uint32_t> chunk( 61 );
+  uint32_t expected = 0;
+  bool isInOrder = true;
+  while( expected < kCount )
+  {
+    auto read = ring.Read( chunk.data(), ( expected % chunk.size() ) + 1 );
+    for( size_t i = 0; i < read; ++i )
+      isInOrder = isInOrder && ( chunk[ i ] == expected++ );
+    if( read == 0 )
+      std::this_thread::yield();
+  }
+  producer.join();
+  CHECK( isInOrder );
+  CHECK( ring.IsEmpty() );
+}
+
+} // namespace
+
+int main()
+{
+  TestCapacity();
+  TestWrapAround();
+  TestSkip();
+  TestThreaded();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Test.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdio>
+
+namespace PKIsensee
+{
+
+namespace Test
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Minimal checking for the tests in this directory. Each *Test.cpp is its
+// own executable: main() runs the cases and returns GetExitCode(), which
+// ctest reports. A failed CHECK prints the expression and carries on, so one
+// run shows every failure.
+
+inline int& GetFailureCount()
+{
+  static int failureCount = 0;
+  return failureCount;
+}
+
+inline void Check( bool isTrue, const char* expression, const char* file, int line )
+{
+  if( isTrue )
+    return;
+  ++GetFailureCount();
+  std::fprintf( stderr, "%s(%d): CHECK( %s ) failed\n", file, line, expression );
+}
+
+inline int GetExitCode()
+{
+  if( GetFailureCount() == 0 )
+    return 0;
+  std::fprintf( stderr, "%d check(s) failed\n", GetFailureCount() );
+  return 1;
+}
+
+} // namespace Test
+
+} // namespace PKIsensee
+
+#define CHECK( condition ) ::PKIsensee::Test::Check( static_cast<bool>( condition ), #condition, __FILE__, __LINE__ )
+
+///////////////////////////////////////////////////////////////////////////////
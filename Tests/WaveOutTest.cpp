@@ -0,0 +1,336 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WaveOutTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AllocationCount.h"
+#include "FakeWaveSink.h"
+#include "PcmData.h"
+#include "Test.h"
+#include "Util.h"
+#include "WaveOut.h"
+
+using namespace PKIsensee;
+using namespace PKIsensee::Test;
+
+namespace
+{
+
+constexpr uint32_t kSamplesPerSec = 44100;
+constexpr size_t   kPcmBytes = kSamplesPerSec * 4 * 10; // ten seconds of 16-bit stereo
+constexpr size_t   kWaveBufferCount = 4;
+
+PcmData MakePcmData()
+{
+  return PcmData( 2, kSamplesPerSec, 16, std::vector<uint8_t>( kPcmBytes ) );
+}
+
+// FakeWaveSink shared between the test and the audio thread. Counts every
+// Restart() and Pause(), one per Start() or Pause() command applied.
+class LockedWaveSink : public FakeWaveSink
+{
+public:
+  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent ) override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    return FakeWaveSink::Open( wfx, hEvent );
+  }
+
+  void Prepare( WAVEHDR& wh ) override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::Prepare( wh );
+  }
+
+  void Unprepare( WAVEHDR& wh ) override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::Unprepare( wh );
+  }
+
+  void Write( WAVEHDR& wh ) override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::Write( wh );
+  }
+
+  uint32_t GetPositionBytes() const override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    return FakeWaveSink::GetPositionBytes();
+  }
+
+  WaveVolume GetVolume() const override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    return FakeWaveSink::GetVolume();
+  }
+
+  void SetVolume( const WaveVolume& volume ) override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::SetVolume( volume );
+  }
+
+  void Reset() override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::Reset();
+  }
+
+  void Close() override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::Close();
+  }
+
+  void Restart() override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::Restart();
+    ++restartCount_;
+  }
+
+  void Pause() override
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    FakeWaveSink::Pause();
+    ++pauseCount_;
+  }
+
+  size_t Play( size_t count )
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    return FakeWaveSink::Play( count );
+  }
+
+  size_t GetWriteCount() const
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    return FakeWaveSink::GetWriteCount();
+  }
+
+  size_t GetRestartCount() const
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    return restartCount_;
+  }
+
+  size_t GetPauseCount() const
+  {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    return pauseCount_;
+  }
+
+private:
+  mutable std::recursive_mutex mutex_; // FakeWaveSink::Close() calls Reset()
+  size_t                       restartCount_ = 0;
+  size_t                       pauseCount_ = 0;
+};
+
+LockedWaveSink* gLockedWaveSink = nullptr; // the last one created
+
+// Polls, since the audio thread signals nothing back
+bool WaitUntil( const std::function<bool()>& isDone )
+{
+  for( int i = 0; i < 2000; ++i )
+  {
+    if( isDone() )
+      return true;
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  }
+  return false;
+}
+
+// Sharing never copies the PCM; after the first Open() has sized the seek
+// crossfade buffers, opening again allocates nothing at all
+void TestSharedOpenDoesNotCopy()
+{
+  auto pcmData = std::make_shared<const PcmData>( MakePcmData() );
+  Util::Event event;
+  WaveOut waveOut;
+  CHECK( waveOut.Open( pcmData, event ) );
+
+  auto allocations = GetAllocationCount();
+  CHECK( waveOut.Open( pcmData, event ) );
+  CHECK( GetAllocationCount() == allocations );
+  CHECK( pcmData.use_count() == 2 );
+  waveOut.Close();
+  CHECK( pcmData.use_count() == 1 );
+}
+
+void TestBorrowedOpenDoesNotCopy()
+{
+  auto pcmData = MakePcmData();
+  Util::Event event;
+  WaveOut waveOut;
+  CHECK( waveOut.OpenBorrowed( pcmData, event ) );
+
+  auto allocations = GetAllocationCount();
+  CHECK( waveOut.OpenBorrowed( pcmData, event ) );
+  CHECK( GetAllocationCount() == allocations );
+}
+
+// The copying Open() reuses the previous copy's memory
+void TestCopyingOpenReusesMemory()
+{
+  auto pcmData = MakePcmData();
+  Util::Event event;
+  WaveOut waveOut;
+  auto allocations = GetAllocationCount();
+  CHECK( waveOut.Open( pcmData, event ) );
+  CHECK( GetAllocationCount() > allocations );
+
+  allocations = GetAllocationCount();
+  CHECK( waveOut.Open( pcmData, event ) );
+  CHECK( GetAllocationCount() == allocations );
+}
+
+// Preparing and playing a shared track again is as cheap as the first time
+void TestReopenAndPrepareDoNotAllocate()
+{
+  auto pcmData = std::make_shared<const PcmData>( MakePcmData() );
+  Util::Event event;
+  WaveOut waveOut;
+  CHECK( waveOut.Open( pcmData, event ) );
+  waveOut.Prepare( 0, kWaveBufferCount );
+
+  auto allocations = GetAllocationCount();
+  CHECK( waveOut.Open( pcmData, event ) );
+  waveOut.Prepare( 0, kWaveBufferCount );
+  waveOut.Start();
+  waveOut.Update();
+  CHECK( GetAllocationCount() == allocations );
+  waveOut.Close();
+}
+
+// While playing, a seek waits for the previous seek's crossfade to be heard;
+// FakeWaveSink never finishes a buffer, so requests made meanwhile coalesce
+// until a pause lets the latest through
+void TestSeekCounts()
+{
+  auto pcmData = std::make_shared<const PcmData>( MakePcmData() );
+  Util::Event event;
+  WaveOut waveOut;
+  CHECK( waveOut.Open( pcmData, event ) );
+  waveOut.Prepare( 0, kWaveBufferCount );
+  waveOut.Start();
+
+  waveOut.Seek( 1000 );
+  waveOut.Update();
+  CHECK( waveOut.GetSeekCount() == 1 );
+  CHECK( waveOut.GetCoalescedSeekCount() == 0 );
+
+  waveOut.Seek( 2000 );
+  waveOut.Update();
+  waveOut.Seek( 3000 );
+  waveOut.Seek( 4000 );
+  waveOut.Update();
+  CHECK( waveOut.GetSeekCount() == 1 );
+  CHECK( waveOut.GetCoalescedSeekCount() == 2 );
+
+  waveOut.Pause();
+  waveOut.Update();
+  CHECK( waveOut.GetSeekCount() == 2 );
+  CHECK( waveOut.GetPositionMs() == 4000 );
+
+  CHECK( waveOut.Open( pcmData, event ) );
+  CHECK( waveOut.GetSeekCount() == 0 );
+  CHECK( waveOut.GetCoalescedSeekCount() == 0 );
+  waveOut.Close();
+}
+
+// With the audio thread running, commands from other threads are applied in
+// order and none is lost, even when two threads overrun the queue at once,
+// and played buffers are refilled without anyone calling Update()
+void TestAudioThread()
+{
+  SetWaveSinkFactory( []
+  {
+    auto waveSink = std::make_unique<LockedWaveSink>();
+    gLockedWaveSink = waveSink.get();
+    return waveSink;
+  } );
+  auto pcmData = std::make_shared<const PcmData>( MakePcmData() );
+  Util::Event event;
+  WaveOut waveOut;
+  CHECK( waveOut.Open( pcmData, event ) );
+  auto& sink = *gLockedWaveSink;
+  waveOut.Prepare( 0, kWaveBufferCount );
+  auto writeCount = sink.GetWriteCount();
+  waveOut.StartAudioThread();
+
+  std::thread control( [&waveOut]
+  {
+    waveOut.SetVolume( { 0x1234, 0x5678 } );
+    waveOut.Start();
+  } );
+  control.join();
+  CHECK( WaitUntil( [&] { return waveOut.IsPlaying(); } ) );
+  CHECK( WaitUntil( [&] { return sink.GetVolume() == WaveVolume( 0x1234, 0x5678 ); } ) );
+
+  CHECK( sink.Play( 2 ) == 2 );
+  CHECK( WaitUntil( [&] { return sink.GetWriteCount() == writeCount + 2; } ) );
+
+  constexpr size_t kCommandsPerThread = 1000; // far more than the queue holds
+  auto restartCount = sink.GetRestartCount();
+  auto pauseCount = sink.GetPauseCount();
+  auto toggle = [&waveOut]
+  {
+    for( size_t i = 0; i < kCommandsPerThread; ++i )
+    {
+      waveOut.Pause();
+      waveOut.Start();
+    }
+  };
+  std::thread first( toggle );
+  std::thread second( toggle );
+  first.join();
+  second.join();
+  waveOut.StopAudioThread(); // applies whatever is still queued
+  CHECK( sink.GetRestartCount() == restartCount + 2 * kCommandsPerThread );
+  CHECK( sink.GetPauseCount() == pauseCount + 2 * kCommandsPerThread );
+  CHECK( waveOut.IsPlaying() );
+
+  waveOut.Pause(); // applied directly once the thread is gone
+  CHECK( !waveOut.IsPlaying() );
+  waveOut.Close();
+  SetWaveSinkFactory( [] { return std::make_unique<FakeWaveSink>(); } );
+}
+
+} // namespace
+
+int main()
+{
+  // FakeWaveSink doesn't allocate, so every count is WaveOut's own
+  SetWaveSinkFactory( [] { return std::make_unique<FakeWaveSink>(); } );
+  TestSharedOpenDoesNotCopy();
+  TestBorrowedOpenDoesNotCopy();
+  TestCopyingOpenReusesMemory();
+  TestReopenAndPrepareDoNotAllocate();
+  TestSeekCounts();
+  TestAudioThread();
+  SetWaveSinkFactory( {} );
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,539 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinWaveStreamTest.cpp
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AllocationCount.h"
+#include "FakeWaveSink.h"
+#include "Test.h"
+#include "WinWaveStream.h"
+
+using namespace PKIsensee;
+using namespace PKIsensee::Test;
+
+namespace
+{
+
+constexpr size_t   kRingBytes = 64 * 1024;
+constexpr uint32_t kWaitMs = 1000;
+
+// 20 ms buffers of 48 kHz 16-bit stereo
+constexpr size_t   kWaveBufferCount = 4;
+constexpr uint32_t kLatencyMs = 80;
+constexpr size_t   kWaveBufferBytes = 3840;
+
+// Creates FakeWaveSinks and remembers the latest, which the stream owns
+struct FakeWaveSinkFactory
+{
+  FakeWaveSink* sink = nullptr;
+
+  WaveSinkFactory Get()
+  {
+    return [this]
+    {
+      auto waveSink = std::make_unique<FakeWaveSink>();
+      sink = waveSink.get();
+      return std::unique_ptr<WaveSink>( std::move( waveSink ) );
+    };
+  }
+};
+
+// Writes as much of the pattern as the ring takes
+void Produce( WinWaveStream& stream, uint64_t& written, uint64_t totalBytes )
+{
+  while( written < totalBytes )
+  {
+    auto pcm = MakePattern( written, static_cast<size_t>( std::min<uint64_t>( 5000, totalBytes - written ) ) );
+    auto accepted = stream.Write( pcm.data(), pcm.size() );
+    written += accepted;
+    if( accepted < pcm.size() )
+      return;
+  }
+}
+
+// The device returns one buffer per wake-up and the producer keeps the ring
+// topped up, so every byte plays in order and nothing underruns
+void TestRingRefill()
+{
+  constexpr uint64_t kTotalBytes = 1000000;
+  TestEvent event;
+  FakeWaveSinkFactory factory;
+  WinWaveStream stream( factory.Get() );
+  CHECK( stream.Open( MakeWaveFormat(), event.GetHandle(), kRingBytes ) );
+
+  uint64_t written = 0;
+  Produce( stream, written, kTotalBytes );
+  stream.Prepare( kWaveBufferCount, kLatencyMs );
+  CHECK( factory.sink->GetQueuedCount() == kWaveBufferCount );
+  CHECK( factory.sink->GetQueued( 0 ).dwBufferLength == kWaveBufferBytes );
+  stream.Start();
+  CHECK( !factory.sink->IsPaused() );
+
+  size_t allocations = 0;
+  for( size_t i = 0; i < 10000 && !stream.HasEnded(); ++i )
+  {
+    factory.sink->Play( 1 );
+    Produce( stream, written, kTotalBytes );
+    if( written == kTotalBytes )
+      stream.SetEndOfStream();
+    auto allocationCount = GetAllocationCount();
+    CHECK( stream.Update() <= 1 );
+    allocations += GetAllocationCount() - allocationCount;
+  }
+  CHECK( stream.HasEnded() );
+  CHECK( stream.GetUnderrunCount() == 0 );
+  CHECK( allocations == 0 ); // the copy path runs on preallocated memory
+  CHECK( factory.sink->GetPlayed() == MakePattern( 0, kTotalBytes ) );
+}
+
+// Every buffer came back while data was waiting: the refill thread was late,
+// so the queue deepens by one buffer
+void TestLateRefillAddsBuffer()
+{
+  TestEvent event;
+  FakeWaveSinkFactory factory;
+  WinWaveStream stream( factory.Get() );
+  stream.Open( MakeWaveFormat(), event.GetHandle(), kRingBytes );
+  uint64_t written = 0;
+  Produce( stream, written, kRingBytes );
+  stream.Prepare( 2, 40 );
+  stream.Start();
+  CHECK( stream.GetLatencyMs() == 40 );
+
+  CHECK( factory.sink->Play() == 2 );
+  CHECK( stream.Update() == 3 );
+  CHECK( stream.GetUnderrunCount() == 1 );
+  CHECK( stream.GetLatencyMs() == 60 );
+  CHECK( factory.sink->GetQueuedCount() == 3 );
+}
+
+// The producer fell behind: the device runs dry, and the next Write() wakes
+// the consumer, since no buffer is queued to fire the event
+void TestStarvationWakesConsumer()
+{
+  TestEvent event;
+  FakeWaveSinkFactory factory;
+  WinWaveStream stream( factory.Get() );
+  stream.Open( MakeWaveFormat(), event.GetHandle(), kRingBytes );
+  uint64_t written = 0;
+  Produce( stream, written, 2 * kWaveBufferBytes );
+  stream.Prepare( 2, 40 );
+  stream.Start();
+
+  factory.sink->Play();
+  CHECK( stream.Update() == 0 );
+  CHECK( stream.GetUnderrunCount() == 1 );
+  CHECK( factory.sink->GetQueuedCount() == 0 );
+  CHECK( !stream.HasEnded() );
+
+  while( event.Wait( 0 ) )
+  {
+  }
+  Produce( stream, written, written + kWaveBufferBytes );
+  CHECK( event.Wait( 0 ) );
+  CHECK( stream.Update() == 1 );
+  CHECK( stream.GetUnderrunCount() == 1 ); // one dry spell, counted once
+  CHECK( factory.sink->GetQueuedCount() == 1 );
+}
+
+// Counts live buffers so the test can tell when the stream lets go
+class TrackedPcmBuffer : public VectorPcmBuffer
+{
+public:
+  explicit TrackedPcmBuffer( std::vector<uint8_t> pcm )
+    : VectorPcmBuffer( std::move( pcm ) )
+  {
+    ++liveCount;
+  }
+
+  ~TrackedPcmBuffer() override
+  {
+    --liveCount;
+  }
+
+  static inline int liveCount = 0;
+};
+
+// PcmBuffers are played in place and released once the device is done
+void TestZeroCopyRefill()
+{
+  constexpr uint64_t kTotalBytes = 64 * kWaveBufferBytes;
+  TestEvent event;
+  FakeWaveSinkFactory factory;
+  WinWaveStream stream( factory.Get() );
+  CHECK( stream.Open( MakeWaveFormat(), event.GetHandle() ) );
+
+  uint64_t written = 0;
+  auto produce = [&]
+  {
+    for( ; written < kTotalBytes; written += kWaveBufferBytes )
+    {
+      std::unique_ptr<PcmBuffer> pcmBuffer = std::make_unique<TrackedPcmBuffer>( MakePattern( written, kWaveBufferBytes ) );
+      if( !stream.Write( std::move( pcmBuffer ) ) )
+        return;
+    }
+    stream.SetEndOfStream();
+  };
+  produce();
+  stream.Prepare( kWaveBufferCount, kLatencyMs );
+  stream.Start();
+
+  CHECK( factory.sink->GetQueued( 0 ).dwBufferLength == kWaveBufferBytes );
+
+  for( size_t i = 0; i < 10000 && !stream.HasEnded(); ++i )
+  {
+    factory.sink->Play( 1 );
+    stream.Update();
+    CHECK( TrackedPcmBuffer::liveCount <= static_cast<int>( kTotalBytes / kWaveBufferBytes ) );
+  }
+  CHECK( stream.HasEnded() );
+  CHECK( stream.GetUnderrunCount() == 0 );
+  CHECK( factory.sink->GetPlayed() == MakePattern( 0, kTotalBytes ) );
+
+  // The last buffers wait for the producer to destroy them
+  CHECK( TrackedPcmBuffer::liveCount > 0 );
+  stream.FreePlayedBuffers();
+  CHECK( TrackedPcmBuffer::liveCount == 0 );
+}
+
+struct ZeroCopyRun
+{
+  std::vector<uint8_t> played;
+  size_t               bufferCount = 0;  // PcmBuffers written
+  size_t               waveHdrCount = 0; // WAVEHDRs played
+  size_t               inPlaceCount = 0; // of those, pointing into a PcmBuffer
+  size_t               allocations = 0;  // by Update()
+  size_t               updateFrees = 0;  // PcmBuffers destroyed by Update()
+  int                  liveCount = 0;    // PcmBuffers not yet released
+};
+
+// Writes PcmBuffers of each of bufferSizes in turn until totalBytes, then
+// plays them out one WAVEHDR at a time
+ZeroCopyRun RunZeroCopy( const std::vector<size_t>& bufferSizes, uint64_t totalBytes )
+{
+  TestEvent event;
+  FakeWaveSinkFactory factory;
+  ZeroCopyRun result;
+  std::vector<std::pair<const uint8_t*, size_t>> pcmRanges;
+  {
+    WinWaveStream stream( factory.Get() );
+    stream.Open( MakeWaveFormat(), event.GetHandle() );
+    uint64_t written = 0;
+    auto produce = [&]
+    {
+      while( written < totalBytes )
+      {
+        auto bytes = static_cast<size_t>( std::min<uint64_t>( bufferSizes[ result.bufferCount % bufferSizes.size() ],
+                                                              totalBytes - written ) );
+        std::unique_ptr<PcmBuffer> pcmBuffer = std::make_unique<TrackedPcmBuffer>( MakePattern( written, bytes ) );
+        const auto* pcm = pcmBuffer->GetData();
+        if( !stream.Write( std::move( pcmBuffer ) ) )
+          return;
+        pcmRanges.emplace_back( pcm, bytes );
+        written += bytes;
+        ++result.bufferCount;
+      }
+      stream.SetEndOfStream();
+    };
+    produce();
+    stream.Prepare( kWaveBufferCount, kLatencyMs );
+    stream.Start();
+
+    for( size_t i = 0; i < 100000 && !stream.HasEnded(); ++i )
+    {
+      if( factory.sink->GetQueuedCount() != 0 )
+      {
+        const auto& wh = factory.sink->GetQueued( 0 );
+        const auto* pcm = reinterpret_cast<const uint8_t*>( wh.lpData );
+        for( const auto& pcmRange : pcmRanges )
+          if( pcm >= pcmRange.first && pcm < pcmRange.first + pcmRange.second )
+            ++result.inPlaceCount;
+        ++result.waveHdrCount;
+        factory.sink->Play( 1 );
+      }
+      produce();
+      auto allocationCount = GetAllocationCount();
+      auto liveCount = TrackedPcmBuffer::liveCount;
+      stream.Update();
+      result.allocations += GetAllocationCount() - allocationCount;
+      result.updateFrees += static_cast<size_t>( liveCount - TrackedPcmBuffer::liveCount );
+    }
+    result.played = factory.sink->GetPlayed();
+    stream.Close();
+  }
+  result.liveCount = TrackedPcmBuffer::liveCount;
+  return result;
+}
+
+// Buffers as large as a WAVEHDR are played in place; no byte is copied
+void TestZeroCopyPlaysInPlace()
+{
+  constexpr uint64_t kTotalBytes = 64 * kWaveBufferBytes;
+  auto result = RunZeroCopy( { kWaveBufferBytes, 2 * kWaveBufferBytes }, kTotalBytes );
+  CHECK( result.played == MakePattern( 0, kTotalBytes ) );
+  CHECK( result.waveHdrCount == 64 );
+  CHECK( result.inPlaceCount == result.waveHdrCount );
+  CHECK( result.liveCount == 0 );
+  CHECK( result.allocations == 0 );
+  CHECK( result.updateFrees == 0 ); // the producer destroys them
+}
+
+// Tiny buffers are copied together, so each WAVEHDR is still full. A large
+// buffer after them is played in place again.
+void TestZeroCopyCoalescesSmallBuffers()
+{
+  constexpr size_t kSmallBytes = 240; // 1.25 ms
+  constexpr uint64_t kTotalBytes = 32 * kWaveBufferBytes;
+  auto result = RunZeroCopy( { kSmallBytes }, kTotalBytes );
+  CHECK( result.played == MakePattern( 0, kTotalBytes ) );
+  CHECK( result.bufferCount == kTotalBytes / kSmallBytes );
+  CHECK( result.waveHdrCount == 32 );
+  CHECK( result.inPlaceCount == 0 );
+  CHECK( result.liveCount == 0 );
+  CHECK( result.allocations == 0 );
+  CHECK( result.updateFrees == 0 );
+
+  // 16 small buffers fill a WAVEHDR; the large one that follows isn't copied
+  result = RunZeroCopy( { kSmallBytes, kSmallBytes, kSmallBytes, kSmallBytes, 4 * kWaveBufferBytes }, kTotalBytes );
+  CHECK( result.played == MakePattern( 0, kTotalBytes ) );
+  CHECK( result.inPlaceCount > 0 );
+  CHECK( result.inPlaceCount < result.waveHdrCount );
+  CHECK( result.liveCount == 0 );
+
+  // A buffer over half a WAVEHDR is sent alone rather than copied
+  result = RunZeroCopy( { kWaveBufferBytes / 2 + 4 }, kTotalBytes );
+  CHECK( result.played == MakePattern( 0, kTotalBytes ) );
+  CHECK( result.inPlaceCount == result.waveHdrCount );
+}
+
+// Producer, consumer and device each on their own thread
+void TestThreadedRefill()
+{
+  constexpr uint64_t kTotalBytes = 2 * 1024 * 1024;
+  TestEvent event;
+  CaptureWaveSink* sink = nullptr;
+  WinWaveStream stream( [&]
+  {
+    auto waveSink = std::make_unique<CaptureWaveSink>( 0.0 );
+    sink = waveSink.get();
+    return std::unique_ptr<WaveSink>( std::move( waveSink ) );
+  } );
+  stream.Open( MakeWaveFormat(), event.GetHandle(), 16 * 1024 );
+
+  std::thread producer( [&]
+  {
+    uint64_t written = 0;
+    size_t chunkBytes = 0;
+    while( written < kTotalBytes )
+    {
+      chunkBytes = ( chunkBytes % 3001 ) + 1; // odd sizes split frames between writes
+      auto pcm = MakePattern( written, static_cast<size_t>( std::min<uint64_t>( chunkBytes, kTotalBytes - written ) ) );
+      auto accepted = stream.Write( pcm.data(), pcm.size() );
+      written += accepted;
+      if( accepted == 0 )
+        std::this_thread::yield();
+    }
+    stream.SetEndOfStream();
+  } );
+
+  while( stream.GetBufferedBytes() < 8192 )
+    std::this_thread::yield();
+  stream.Prepare( kWaveBufferCount, 40 );
+  stream.Start();
+  size_t timeouts = 0;
+  while( !stream.HasEnded() && timeouts < 10 )
+  {
+    if( event.Wait( kWaitMs ) )
+      stream.Update();
+    else
+      ++timeouts;
+  }
+  producer.join();
+  CHECK( stream.HasEnded() );
+  CHECK( timeouts == 0 );
+  stream.Close();
+  CHECK( sink->GetConsumed() == MakePattern( 0, kTotalBytes ) );
+}
+
+// FakeWaveSink whose Open() and Close() take as long as a slow driver's
+class SlowWaveSink : public FakeWaveSink
+{
+public:
+  explicit SlowWaveSink( std::chrono::milliseconds delay )
+    : delay_( delay )
+  {
+  }
+
+  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent ) override
+  {
+    std::this_thread::sleep_for( delay_ );
+    return FakeWaveSink::Open( wfx, hEvent );
+  }
+
+  void Close() override
+  {
+    std::this_thread::sleep_for( delay_ );
+    FakeWaveSink::Close();
+  }
+
+private:
+  std::chrono::milliseconds delay_;
+};
+
+// Remembers every sink in creation order; later ones are created on the
+// stream's helper thread
+struct SlowWaveSinkFactory
+{
+  std::mutex                 mutex;
+  std::vector<SlowWaveSink*> sinks; // owned by the stream
+  std::chrono::milliseconds  delay;
+
+  WaveSinkFactory Get()
+  {
+    return [this]
+    {
+      auto waveSink = std::make_unique<SlowWaveSink>( delay );
+      std::lock_guard<std::mutex> lock( mutex );
+      sinks.push_back( waveSink.get() );
+      return std::unique_ptr<WaveSink>( std::move( waveSink ) );
+    };
+  }
+
+  SlowWaveSink* GetSink( size_t i )
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    return ( i < sinks.size() ) ? sinks[ i ] : nullptr;
+  }
+};
+
+struct FormatSwitch
+{
+  std::vector<uint8_t> played;
+  double               maxUpdateMs = 0.0;
+  size_t               waitCount = 0; // Update() calls that found the new device not yet open
+  size_t               sinkCount = 0;
+  bool                 hasEnded = false;
+};
+
+// Plays a 48 kHz track, then a 44.1 kHz track, on devices that take delay
+// to open and close. Each buffer takes bufferPeriod to play.
+FormatSwitch RunFormatSwitch( std::chrono::milliseconds delay, std::chrono::milliseconds bufferPeriod )
+{
+  constexpr size_t kTrackBytes = 8 * kWaveBufferBytes;
+  auto formatA = MakeWaveFormat( 48000 );
+  auto formatB = MakeWaveFormat( 44100 );
+  TestEvent event;
+  SlowWaveSinkFactory factory;
+  factory.delay = delay;
+  FormatSwitch result;
+  {
+    WinWaveStream stream( factory.Get() );
+    stream.Open( formatA, event.GetHandle(), kRingBytes );
+    auto pcm = MakePattern( 0, 2 * kTrackBytes );
+    stream.Write( pcm.data(), kTrackBytes );
+    stream.EndTrack( 1, &formatB );
+    stream.Write( pcm.data() + kTrackBytes, kTrackBytes );
+    stream.EndTrack( 2 );
+    stream.SetEndOfStream();
+    stream.Prepare( kWaveBufferCount, kLatencyMs );
+    stream.Start();
+
+    size_t current = 0;
+    for( size_t i = 0; i < 1000 && !stream.HasEnded(); ++i )
+    {
+      std::this_thread::sleep_for( bufferPeriod );
+      auto* sink = factory.GetSink( current );
+      if( sink->GetQueuedCount() != 0 )
+      {
+        const auto& wh = sink->GetQueued( 0 );
+        result.played.insert( result.played.end(), wh.lpData, wh.lpData + wh.dwBufferLength );
+        sink->Play( 1 );
+      }
+      else if( !event.Wait( kWaitMs ) ) // only the helper thread can wake us
+        break;
+
+      auto start = std::chrono::steady_clock::now();
+      stream.Update();
+      auto updateMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+      result.maxUpdateMs = std::max( result.maxUpdateMs, updateMs );
+
+      // Once the next sink has buffers, the stream has switched and handed the
+      // old one to a helper thread to close and destroy; it's never touched again
+      auto* next = factory.GetSink( current + 1 );
+      if( next != nullptr && next->GetQueuedCount() != 0 )
+        ++current;
+      else if( current == 0 && sink->GetQueuedCount() == 0 )
+        ++result.waitCount;
+    }
+    result.hasEnded = stream.HasEnded();
+    uint32_t trackId = 0;
+    CHECK( stream.GetEndedTrack( trackId ) && trackId == 1 );
+    CHECK( stream.GetEndedTrack( trackId ) && trackId == 2 );
+  }
+  result.sinkCount = factory.sinks.size();
+  return result;
+}
+
+// The next device opens while the old one plays out its last buffers, so the
+// new format starts in the same Update() that finds the old device empty
+void TestFormatSwitchWithoutGap()
+{
+  constexpr auto kDelay = std::chrono::milliseconds( 30 );
+  auto result = RunFormatSwitch( kDelay, std::chrono::milliseconds( 20 ) );
+  CHECK( result.hasEnded );
+  CHECK( result.sinkCount == 2 );
+  CHECK( result.waitCount == 0 );
+  CHECK( result.played == MakePattern( 0, result.played.size() ) );
+  CHECK( result.played.size() == 16 * kWaveBufferBytes );
+  CHECK( result.maxUpdateMs < 15.0 ); // neither the open nor the close
+}
+
+// The old device plays out before the next one opens. Update() returns rather
+// than waiting, and the helper thread wakes the consumer once it's open.
+void TestSlowOpenDoesNotBlockUpdate()
+{
+  constexpr auto kDelay = std::chrono::milliseconds( 200 );
+  auto result = RunFormatSwitch( kDelay, std::chrono::milliseconds( 0 ) );
+  CHECK( result.hasEnded );
+  CHECK( result.sinkCount == 2 );
+  CHECK( result.waitCount > 0 );
+  CHECK( result.played == MakePattern( 0, 16 * kWaveBufferBytes ) );
+  CHECK( result.maxUpdateMs < 100.0 );
+}
+
+} // namespace
+
+int main()
+{
+  TestRingRefill();
+  TestLateRefillAddsBuffer();
+  TestStarvationWakesConsumer();
+  TestZeroCopyRefill();
+  TestZeroCopyPlaysInPlace();
+  TestZeroCopyCoalescesSmallBuffers();
+  TestThreadedRefill();
+  TestFormatSwitchWithoutGap();
+  TestSlowOpenDoesNotBlockUpdate();
+  return Test::GetExitCode();
+}
+
+///////////////////////////////////////////////////////////////////////////////
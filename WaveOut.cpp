@@ -14,56 +14,197 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-#pragma once
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <climits>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "Util.h"
+#include "AudioMetrics.h"
+#include "AudioThreadPriority.h"
+#include "PcmConvert.h"
 #include "PcmData.h"
+#include "PlaybackClock.h"
+#include "SpscRingBuffer.h"
 #include "WaveOut.h"
 #include "WinWaveOut.h"
 
+#if defined( _WIN32 )
 #define NOMINMAX 1
 #include "Windows.h"
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// Windows-specific implementation of PCM playback
+// Windows-specific implementation of PCM playback. The output device is
+// created by CreateWaveSink(), so a NullWaveSink can stand in for winmm, and
+// the same code runs on Linux against the stand-ins in WaveSink.h.
 //
 // https://chromium.googlesource.com/chromium/src/media/+/master/audio/win/waveout_output_win.cc
 
 namespace PKIsensee
 {
 
-constexpr size_t kWaveBufferBytes = sizeof( uint16_t ) * 2 * 44100; // 1 second for 16-bit stereo 44.1 KHz
-[[maybe_unused]] constexpr size_t kMaxWaveBuffers = 16;
+// Audio queued on the device unless SetLatencyMs() says otherwise; with four
+// buffers, each holds 250 ms regardless of format
+constexpr uint32_t kDefaultLatencyMs = 1000;
+
+// Seek() blends this much of the old position into the new one
+constexpr uint32_t kSeekCrossfadeMs = 5;
+constexpr uint32_t kNoSeek = UINT32_MAX;
+
+// Start(), Pause() and SetVolume() calls queued for the audio thread
+constexpr size_t kMaxAudioCommands = 64;
 
 class WaveOut::Impl
 {
 public:
-  std::vector<WAVEHDR> waveHdr;
-  WinWaveOut           waveOut;
-  PcmData              pcmData;
-  const uint8_t*       nextPcm = nullptr;
-  uint32_t             lastStartOffsetBytes = 0;
-  bool                 isPlaying = false;
-  bool                 hasEnded = false;
-
-  WaveOut::Impl() = default;
-  WaveOut::Impl( const WaveOut::Impl& ) = delete;
-  WaveOut::Impl( WaveOut::Impl&& ) = delete;
-  WaveOut::Impl& operator=( const WaveOut::Impl& ) = delete;
-  WaveOut::Impl& operator=( WaveOut::Impl&& ) = delete;
+  std::vector<WAVEHDR>           waveHdr;
+  WaveHdrQueue                   submitted; // in the order written to the device
+  std::unique_ptr<WaveSink>      waveOut = CreateWaveSink();
+  const PcmData*                 pcmData = nullptr; // sharedPcmData, pcmDataCopy or borrowed
+  std::shared_ptr<const PcmData> sharedPcmData;
+  PcmData                        pcmDataCopy; // keeps its capacity across Open() calls
+  const uint8_t*                 nextPcm = nullptr;
+  size_t                         waveBufferBytes = 0;
+  size_t                         extraWaveBuffers = 0; // added after underruns
+  uint32_t                       latencyMs = kDefaultLatencyMs; // requested; applied by Prepare()
+  std::atomic<uint32_t>          queuedLatencyMs = 0; // what the buffers actually hold
+  std::atomic<size_t>            underrunCount = 0;
+  std::atomic<size_t>            recycledCount = 0; // by the last Update()
+  PlaybackClock                  clock;
+  std::atomic<bool>              isPlaying = false; // atomic so readers never wait on the audio thread
+  std::atomic<bool>              hasEnded = false;
+
+  // Seek() stores the latest position; Update() applies it
+  HANDLE                         callbackEvent = NULL;
+  std::atomic<uint32_t>          pendingSeekMs = kNoSeek;
+  std::atomic<size_t>            coalescedSeekCount = 0; // requests replaced before being applied
+  std::atomic<size_t>            seekCount = 0;          // requests applied
+  size_t                         deviceStartOffset = 0;  // PCM byte offset at device position zero
+  const WAVEHDR*                 crossfadeHdr = nullptr; // holds crossfadePcm until done
+  std::vector<float>             crossfadeOld;           // float scratch; sized by Open()
+  std::vector<float>             crossfadeNew;
+  std::vector<uint8_t>           crossfadePcm;           // first buffer after a seek; empty if not crossfading
+
+  // Optional thread that waits on callbackEvent and calls Update() itself
+  struct AudioCommand
+  {
+    enum class Type
+    {
+      Start,
+      Pause,
+      SetVolume
+    };
+
+    Type               type;
+    WaveOut::VolumeType left;
+    WaveOut::VolumeType right;
+  };
+
+  std::thread                    audioThread;
+  std::atomic<bool>              isAudioThreadRunning = false; // set before the thread starts, cleared after join
+  std::atomic<bool>              isAudioThreadQuitting = false;
+  std::mutex                     audioCommandMutex; // serializes control threads; the audio thread never takes it
+  SpscRingBuffer<AudioCommand>   audioCommands{ kMaxAudioCommands };
+
+  Impl() = default;
+  Impl( const Impl& ) = delete;
+  Impl( Impl&& ) = delete;
+  Impl& operator=( const Impl& ) = delete;
+  Impl& operator=( Impl&& ) = delete;
+
+  ~Impl()
+  {
+    StopAudioThread();
+  }
+
+  // pcm must stay alive and unmodified until Clear()
+  bool Open( const PcmData& pcm, HANDLE hEvent )
+  {
+    pcmData = &pcm;
+    callbackEvent = hEvent;
+    clock.Open( pcm.GetSamplesPerSecond(), pcm.GetBlockAlignment() );
+
+    // Crossfading needs a format ConvertSamples() handles
+    auto crossfadeBytes = GetWaveBufferBytes( pcm.GetSamplesPerSecond(), pcm.GetBlockAlignment(), kSeekCrossfadeMs );
+    auto crossfadeSamples = ( crossfadeBytes / pcm.GetBlockAlignment() ) * static_cast<size_t>( pcm.GetChannelCountAsInt() );
+    bool isCrossfading = ( pcm.GetBitsPerSample() == 16 || pcm.GetBitsPerSample() == 24 ||
+                           pcm.GetBitsPerSample() == 32 );
+    crossfadeOld.resize( crossfadeSamples );
+    crossfadeNew.resize( crossfadeSamples );
+    crossfadePcm.resize( isCrossfading ? crossfadeBytes : 0 );
+
+    WAVEFORMATEX wfx = { 0 };
+    wfx.wFormatTag      = WAVE_FORMAT_PCM;
+    wfx.nChannels       = static_cast<uint16_t>( pcm.GetChannelCountAsInt() );
+    wfx.wBitsPerSample  = static_cast<uint16_t>( pcm.GetBitsPerSample() );
+    wfx.nSamplesPerSec  = pcm.GetSamplesPerSecond();
+    wfx.nBlockAlign     = static_cast<uint16_t>( pcm.GetBlockAlignment() );
+    wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
+    wfx.cbSize          = 0; // not used for PCM
+
+    // hEvent is signalled when it's time to refill the next audio buffer
+    return waveOut->Open( wfx, hEvent );
+  }
+
+  void SetQueuedLatency()
+  {
+    auto bytes = uint64_t( waveBufferBytes ) * waveHdr.size();
+    auto bytesPerSec = uint64_t( pcmData->GetSamplesPerSecond() ) * pcmData->GetBlockAlignment();
+    queuedLatencyMs.store( static_cast<uint32_t>( bytes * 1000 / bytesPerSec ), std::memory_order_relaxed );
+  }
+
+  uint64_t GetFrameOffset( const uint8_t* pcm ) const
+  {
+    return static_cast<uint64_t>( pcm - pcmData->GetPtr() ) / pcmData->GetBlockAlignment();
+  }
+
+  void Start();
+  void Pause();
+  void Update();
+  void RecordRefillLatency( uint32_t devicePosition, AudioMetrics::Clock::time_point refillTime ) const;
+  void Seek( uint32_t positionMs );
+  size_t Crossfade( const uint8_t* oldPcm, size_t oldBytes, const uint8_t* newPcm, size_t newBytes );
+
+  bool IsAudioThreadRunning() const
+  {
+    return isAudioThreadRunning.load( std::memory_order_acquire );
+  }
+
+  void RunAudioCommand( AudioCommand::Type type, const WaveOut::Volume& volume = {} );
+  void ApplyAudioCommand( const AudioCommand& command );
+  void ApplyAudioCommands();
+  void StartAudioThread();
+  void RunAudioThread();
+  void StopAudioThread();
 
   void Clear()
   {
     waveHdr.clear();
-    waveOut.Close();
+    submitted.Clear();
+    waveOut->Close();
+    pcmData = nullptr;
+    sharedPcmData.reset();
     nextPcm = nullptr;
-    lastStartOffsetBytes = 0;
+    waveBufferBytes = 0;
+    extraWaveBuffers = 0;
+    queuedLatencyMs = 0;
+    underrunCount = 0;
+    recycledCount = 0;
     isPlaying = false;
     hasEnded = false;
+    callbackEvent = NULL;
+    pendingSeekMs = kNoSeek;
+    coalescedSeekCount = 0;
+    seekCount = 0;
+    deviceStartOffset = 0;
+    crossfadeHdr = nullptr;
   }
 };
 
@@ -71,15 +212,100 @@ public:
 //
 // Handy helper sets the pointer/len and returns number of bytes filled
 
-size_t SetWaveHeader( WAVEHDR& wh, const uint8_t* pcmPtr, size_t bytes )
+size_t SetWaveHeader( WAVEHDR& wh, const uint8_t* pcmPtr, size_t bytes, size_t waveBufferBytes )
 {
   assert( pcmPtr != nullptr );
-  auto bytesFilled = std::min( kWaveBufferBytes, bytes );
+  auto bytesFilled = std::min( waveBufferBytes, bytes );
   wh.dwBufferLength = static_cast<DWORD>( bytesFilled );
   wh.lpData = reinterpret_cast<LPSTR>( const_cast<uint8_t*>( pcmPtr ) );
   return bytesFilled;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// Replaces the queued audio with audio from positionMs. Unlike Prepare(), the
+// device isn't paused and the WAVEHDRs stay prepared, so playback carries on
+// within one wake-up of the refill thread. The first buffer written is a
+// short equal-power crossfade from where the listener is now to the new
+// position, so the jump doesn't click.
+
+void WaveOut::Impl::Seek( uint32_t positionMs )
+{
+  auto* pcmPtr = pcmData->GetPtr();
+  auto pcmBytes = pcmData->GetSize();
+  auto blockAlign = pcmData->GetBlockAlignment();
+
+  // The old audio fades out from what's audible now, not from what's queued.
+  // A crossfade stands in for as many bytes at its position, so device
+  // bytes map straight to PCM bytes.
+  auto devicePosition = waveOut->GetPositionBytes();
+  auto oldOffset = std::min( deviceStartOffset + devicePosition - ( devicePosition % blockAlign ), pcmBytes );
+  auto newOffset = std::min( pcmData->MillisecondsToBytes( positionMs ), pcmBytes );
+
+  // Returns every buffer; the pause state is unchanged
+  waveOut->Reset();
+  submitted.Clear();
+
+  auto bytesLeft = pcmBytes - newOffset;
+  nextPcm = pcmPtr + newOffset;
+  auto crossfadeBytes = Crossfade( pcmPtr + oldOffset, pcmBytes - oldOffset, nextPcm, bytesLeft );
+  crossfadeHdr = ( crossfadeBytes != 0 ) ? &waveHdr.front() : nullptr;
+  for( auto& wh : waveHdr )
+  {
+    wh.dwFlags = WHDR_PREPARED; // see Close()
+    auto bytesFilled = ( crossfadeBytes != 0 ) ? SetWaveHeader( wh, crossfadePcm.data(), crossfadeBytes, crossfadeBytes )
+                                               : SetWaveHeader( wh, nextPcm, bytesLeft, waveBufferBytes );
+    crossfadeBytes = 0;
+    bytesLeft -= bytesFilled;
+    nextPcm += bytesFilled;
+    waveOut->Write( wh );
+    submitted.Push( &wh );
+  }
+
+  deviceStartOffset = newOffset;
+  clock.Reset( GetFrameOffset( pcmPtr + newOffset ) );
+  clock.SetLimit( GetFrameOffset( nextPcm ) );
+  if( isPlaying )
+    clock.Start();
+  hasEnded = false;
+  seekCount.fetch_add( 1, std::memory_order_relaxed );
+}
+
+// Blends the start of oldPcm (fading out) with the start of newPcm (fading
+// in) into crossfadePcm. Returns the bytes blended, which stand in for the
+// same number of bytes of newPcm; zero if the format can't be crossfaded.
+
+size_t WaveOut::Impl::Crossfade( const uint8_t* oldPcm, size_t oldBytes, const uint8_t* newPcm, size_t newBytes )
+{
+  if( crossfadePcm.empty() )
+    return 0;
+  auto blockAlign = pcmData->GetBlockAlignment();
+  auto bytes = std::min( { crossfadePcm.size(), oldBytes, newBytes } );
+  auto frames = bytes / blockAlign;
+  if( frames == 0 )
+    return 0;
+
+  auto sampleFormat = ( pcmData->GetBitsPerSample() == 16 ) ? SampleFormat::Int16
+                    : ( pcmData->GetBitsPerSample() == 24 ) ? SampleFormat::Int24 : SampleFormat::Int32;
+  auto channelCount = static_cast<size_t>( pcmData->GetChannelCountAsInt() );
+  auto samples = frames * channelCount;
+  ConvertSamples( oldPcm, sampleFormat, crossfadeOld.data(), SampleFormat::Float32, samples );
+  ConvertSamples( newPcm, sampleFormat, crossfadeNew.data(), SampleFormat::Float32, samples );
+  for( size_t frame = 0; frame < frames; ++frame )
+  {
+    auto angle = ( ( static_cast<float>( frame ) + 0.5f ) / static_cast<float>( frames ) ) * 1.5707963f;
+    auto oldGain = std::cos( angle );
+    auto newGain = std::sin( angle );
+    for( size_t c = 0; c < channelCount; ++c )
+    {
+      auto i = ( frame * channelCount ) + c;
+      crossfadeNew[ i ] = ( crossfadeOld[ i ] * oldGain ) + ( crossfadeNew[ i ] * newGain );
+    }
+  }
+  ConvertSamples( crossfadeNew.data(), SampleFormat::Float32, crossfadePcm.data(), sampleFormat, samples );
+  return frames * blockAlign;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 WaveOut::WaveOut()
@@ -87,151 +313,452 @@ WaveOut::WaveOut()
 {
 }
 
+// Copies pcmData, so the caller may release or modify it immediately. The
+// copy reuses the previous one's memory when it's large enough.
+
 bool WaveOut::Open( const PcmData& pcmData, Util::Event& callbackEvent )
 {
   Close();
-  impl_->pcmData = pcmData;
+  impl_->pcmDataCopy = pcmData;
+  return impl_->Open( impl_->pcmDataCopy, callbackEvent.GetHandle() );
+}
+
+// Shares ownership; playing the same decoded track repeatedly or from several
+// players never copies it. The PCM must not be modified while shared.
+
+bool WaveOut::Open( std::shared_ptr<const PcmData> pcmData, Util::Event& callbackEvent )
+{
+  assert( pcmData );
+  Close();
+  impl_->sharedPcmData = std::move( pcmData );
+  return impl_->Open( *impl_->sharedPcmData, callbackEvent.GetHandle() );
+}
 
-  WAVEFORMATEX wfx = { 0 };
-  wfx.wFormatTag      = WAVE_FORMAT_PCM;
-  wfx.nChannels       = static_cast<uint16_t>( pcmData.GetChannelCountAsInt() );
-  wfx.wBitsPerSample  = static_cast<uint16_t>( pcmData.GetBitsPerSample() );
-  wfx.nSamplesPerSec  = pcmData.GetSamplesPerSecond();
-  wfx.nBlockAlign     = static_cast<uint16_t>( pcmData.GetBlockAlignment() );
-  wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
-  wfx.cbSize          = 0; // not used for PCM
+// Plays pcmData in place. The caller must keep it alive and unmodified until
+// Close(), the next Open() or the WaveOut is destroyed.
 
-  // callbackEvent is signalled when it's time to refill the next audio buffer
-  return impl_->waveOut.Open( wfx, callbackEvent.GetHandle() );
+bool WaveOut::OpenBorrowed( const PcmData& pcmData, Util::Event& callbackEvent )
+{
+  Close();
+  return impl_->Open( pcmData, callbackEvent.GetHandle() );
 }
 
-// Chromium (link above) supports a minimum of 2 and a maximum of 4 buffers (waveBufferCount)
+// Chromium (link above) supports a minimum of 2 and a maximum of 4 buffers (waveBufferCount).
+// The latency set by SetLatencyMs() is split evenly across them, in whole
+// sample frames. Buffers added by Update() after an underrun are kept across
+// Prepare() calls. Prepare() pauses the device; use Seek() to jump while playing.
 
 void WaveOut::Prepare( uint32_t positionMs, size_t waveBufferCount )
 {
   assert( waveBufferCount > 1 );
   assert( waveBufferCount <= kMaxWaveBuffers );
-  static_cast<void>(kMaxWaveBuffers); // [[maybe_unused]] above not working
+  assert( !impl_->IsAudioThreadRunning() ); // use Seek()
+  assert( impl_->pcmData != nullptr );
+  auto bufferMs = static_cast<uint32_t>( impl_->latencyMs / waveBufferCount );
+  impl_->waveBufferBytes = GetWaveBufferBytes( impl_->pcmData->GetSamplesPerSecond(),
+                                               impl_->pcmData->GetBlockAlignment(), bufferMs );
+  waveBufferCount = std::min( waveBufferCount + impl_->extraWaveBuffers, kMaxWaveBuffers );
+  impl_->pendingSeekMs = kNoSeek; // superseded
+  impl_->crossfadeHdr = nullptr;
+  impl_->waveHdr.reserve( kMaxWaveBuffers ); // WAVEHDRs must not move once prepared
   impl_->waveHdr.resize( waveBufferCount );
-  impl_->waveOut.Reset();
+  impl_->waveOut->Reset();
   Pause(); // pause so no events are fired
 
-  auto* pcmPtr = impl_->pcmData.GetPtr();
-  auto pcmBytes = impl_->pcmData.GetSize();
+  auto* pcmPtr = impl_->pcmData->GetPtr();
+  auto pcmBytes = impl_->pcmData->GetSize();
 
-  auto byteOffset = impl_->pcmData.MillisecondsToBytes( positionMs );
+  auto byteOffset = impl_->pcmData->MillisecondsToBytes( positionMs );
   assert( byteOffset <= pcmBytes );
   auto bytesLeft = pcmBytes - byteOffset;
   impl_->nextPcm = pcmPtr + byteOffset;
+  impl_->submitted.Clear();
   for( auto i = 0u; i < impl_->waveHdr.size(); ++i )
   {
     // Set buffers to point at audio data
     auto& wh = impl_->waveHdr[ i ];
     wh = { 0 };
-    auto bytesFilled = SetWaveHeader( wh, impl_->nextPcm, bytesLeft );
+    auto bytesFilled = SetWaveHeader( wh, impl_->nextPcm, bytesLeft, impl_->waveBufferBytes );
 
     bytesLeft -= bytesFilled;
     assert( bytesLeft < pcmBytes );
     impl_->nextPcm += bytesFilled;
 
     // Inform OS about this WAVEHDR and send buffer to audio driver
-    impl_->waveOut.Prepare( wh ); 
-    impl_->waveOut.Write( wh );
+    impl_->waveOut->Prepare( wh ); 
+    impl_->waveOut->Write( wh );
+    impl_->submitted.Push( &wh );
   }
-  impl_->lastStartOffsetBytes = byteOffset;
+
+  impl_->SetQueuedLatency();
+
+  // Device position restarts at zero after Reset()
+  impl_->deviceStartOffset = byteOffset;
+  impl_->clock.Reset( impl_->GetFrameOffset( pcmPtr + byteOffset ) );
+  impl_->clock.SetLimit( impl_->GetFrameOffset( impl_->nextPcm ) );
+}
+
+// Sets how much audio to queue on the device. Lower latency makes Pause(),
+// Seek() and volume changes more responsive but requires Update() to be
+// called promptly; after an underrun, Update() adds a buffer. Applied by the
+// next Prepare().
+
+void WaveOut::SetLatencyMs( uint32_t latencyMs )
+{
+  assert( latencyMs > 0 );
+  impl_->latencyMs = latencyMs;
+}
+
+// Audio the device may have queued, including buffers added after underruns.
+// Callable from any thread.
+
+uint32_t WaveOut::GetLatencyMs() const
+{
+  return impl_->queuedLatencyMs.load( std::memory_order_relaxed );
+}
+
+// Number of times the device ran dry while more data was waiting, since Open().
+// Callable from any thread.
+
+size_t WaveOut::GetUnderrunCount() const
+{
+  return impl_->underrunCount.load( std::memory_order_relaxed );
+}
+
+// Requests playback from positionMs; may be called from any thread while
+// open and prepared. The refill thread is woken to apply it at once, but
+// while playing, a seek isn't applied until the previous seek's crossfade has
+// been heard; requests made in the meantime are coalesced and only the latest
+// is applied. Scrubbing can call this on every drag event and hears a short
+// snippet at most every kSeekCrossfadeMs.
+
+void WaveOut::Seek( uint32_t positionMs )
+{
+  assert( positionMs != kNoSeek );
+  if( impl_->pendingSeekMs.exchange( positionMs ) != kNoSeek )
+    impl_->coalescedSeekCount.fetch_add( 1, std::memory_order_relaxed );
+  if( impl_->callbackEvent != NULL )
+    SignalWaveEvent( impl_->callbackEvent );
+}
+
+// Seek() requests applied, and requests replaced by a later one before they
+// could be applied, since Open(). Callable from any thread.
+
+size_t WaveOut::GetSeekCount() const
+{
+  return impl_->seekCount.load( std::memory_order_relaxed );
+}
+
+size_t WaveOut::GetCoalescedSeekCount() const
+{
+  return impl_->coalescedSeekCount.load( std::memory_order_relaxed );
+}
+
+void WaveOut::Impl::Start()
+{
+  waveOut->Restart();
+  clock.Start();
+  isPlaying = true;
+  hasEnded = false;
+}
+
+void WaveOut::Impl::Pause()
+{
+  waveOut->Pause();
+  clock.Stop();
+  isPlaying = false;
 }
 
 void WaveOut::Start()
 {
-  impl_->waveOut.Restart();
-  impl_->isPlaying = true;
-  impl_->hasEnded = false;
+  impl_->RunAudioCommand( Impl::AudioCommand::Type::Start );
 }
 
 void WaveOut::Pause()
 {
-  impl_->waveOut.Pause();
-  impl_->isPlaying = false;
+  impl_->RunAudioCommand( Impl::AudioCommand::Type::Pause );
 }
 
-void WaveOut::Update() // invoke when callbackEvent is signalled
+void WaveOut::Impl::Update()
 {
-  auto* pcmPtr = impl_->pcmData.GetPtr();
-  auto pcmBytes = impl_->pcmData.GetSize();
-  auto waveBufferCount = impl_->waveHdr.size();
+  recycledCount.store( 0, std::memory_order_relaxed );
+  if( submitted.IsEmpty() )
+    return;
+
+  // One clock read serves both the playback clock and the metrics
+  auto now = PlaybackClock::Clock::now();
+  AudioMetricTimer refillTimer( AudioMetric::RefillTime, now );
+  if( refillTimer.IsEnabled() )
+  {
+    GetAudioMetrics().Add( AudioCounter::Refills );
+    GetAudioMetrics().Record( AudioMetric::QueueDepthAtRefill, submitted.GetQueuedCount(), refillTimer.GetStart() );
+  }
+
+  // A seek rewrites every buffer, so there's nothing else to do this time.
+  // The crossfade buffer is refilled below once done, so forget it first.
+  if( crossfadeHdr != nullptr && IsWaveHdrDone( *crossfadeHdr ) )
+    crossfadeHdr = nullptr;
+  bool isCrossfading = ( crossfadeHdr != nullptr );
+  if( pendingSeekMs.load() != kNoSeek && !( isCrossfading && isPlaying ) )
+  {
+    Seek( pendingSeekMs.exchange( kNoSeek ) );
+    return;
+  }
+
+  auto* pcmPtr = pcmData->GetPtr();
+  auto pcmBytes = pcmData->GetSize();
+
+  // One device position query per wake-up keeps the playback clock in sync
+  auto devicePosition = waveOut->GetPositionBytes();
+  clock.Sync( devicePosition, now );
+
+  // Buffers complete in submission order; if the last one written is done, all are
+  bool isWaveDonePlaying = IsWaveHdrDone( *submitted.Back() );
 
   // No more data to queue
-  if( impl_->nextPcm >= pcmPtr + pcmBytes )
+  if( nextPcm >= pcmPtr + pcmBytes )
   {
     // If all buffers are complete, wave is done playing
-    uint32_t isWaveDonePlaying = WHDR_DONE;
-    for( auto i = 0u; i < waveBufferCount; ++i )
-      isWaveDonePlaying &= (impl_->waveHdr[ i ].dwFlags & WHDR_DONE);
     if( isWaveDonePlaying )
-      impl_->hasEnded = true;
+      hasEnded = true;
     return;
   }
 
   // Data remains to queue
-  auto bytesLeft = pcmPtr - impl_->nextPcm + pcmBytes;
+  auto bytesLeft = static_cast<size_t>( pcmPtr - nextPcm + pcmBytes );
   assert( bytesLeft );
-  for( auto i = 0u; i < waveBufferCount; ++i )
+
+  // Only a wake-up with something to refill is waiting on the event
+  if( refillTimer.IsEnabled() && isPlaying )
+    RecordRefillLatency( devicePosition, refillTimer.GetStart() );
+
+  // If every buffer came back before we were called, the device ran dry.
+  // Add a buffer so the deeper queue absorbs the next late wake-up.
+  if( isWaveDonePlaying && isPlaying )
   {
-    auto& wh = impl_->waveHdr[ i ];
-    if( wh.dwFlags & WHDR_DONE ) // if this is the buffer that was signalled
+    underrunCount.fetch_add( 1, std::memory_order_relaxed );
+    if( refillTimer.IsEnabled() )
+      GetAudioMetrics().Mark( AudioCounter::Underruns, refillTimer.GetStart() );
+    if( waveHdr.size() < kMaxWaveBuffers )
     {
-      // Refill it with new data
-      auto bytesFilled = SetWaveHeader( wh, impl_->nextPcm, bytesLeft );
+      ++extraWaveBuffers;
+      auto& wh = waveHdr.emplace_back();
+      wh = { 0 };
+      auto bytesFilled = SetWaveHeader( wh, nextPcm, bytesLeft, waveBufferBytes );
       bytesLeft -= bytesFilled;
-      assert( bytesLeft < pcmBytes );
-      impl_->nextPcm += bytesFilled;
+      nextPcm += bytesFilled;
+      waveOut->Prepare( wh );
+      waveOut->Write( wh );
+      submitted.Push( &wh );
+      SetQueuedLatency();
+    }
+  }
 
-      // waveOut.Prepare() is not necessary since we're reusing the buffers
-      impl_->waveOut.Write( wh );
+  // Refill every completed buffer in one pass, so catching up after a stall
+  // takes a single wake-up. Each buffer is visited at most once.
+  size_t recycled = 0;
+  for( auto i = submitted.GetSize(); i && bytesLeft; --i )
+  {
+    if( !IsWaveHdrDone( *submitted.Front() ) )
       break;
-    }
+    auto& wh = *submitted.Pop();
+    auto bytesFilled = SetWaveHeader( wh, nextPcm, bytesLeft, waveBufferBytes );
+    bytesLeft -= bytesFilled;
+    assert( bytesLeft < pcmBytes );
+    nextPcm += bytesFilled;
+
+    // waveOut.Prepare() is not necessary since we're reusing the buffers
+    waveOut->Write( wh );
+    submitted.Push( &wh );
+    ++recycled;
   }
+  recycledCount.store( recycled, std::memory_order_relaxed );
+  clock.SetLimit( GetFrameOffset( nextPcm ) );
+}
+
+// The event carries no timestamp, so the wait is inferred from how far the
+// device has played past the end of the oldest returned buffer. Crossfade
+// buffers don't map to a PCM offset and are skipped.
+
+void WaveOut::Impl::RecordRefillLatency( uint32_t devicePosition, AudioMetrics::Clock::time_point refillTime ) const
+{
+  const auto* wh = submitted.Front();
+  const auto* pcm = reinterpret_cast<const uint8_t*>( wh->lpData );
+  const auto* pcmPtr = pcmData->GetPtr();
+  if( !IsWaveHdrDone( *wh ) || pcm < pcmPtr || pcm >= pcmPtr + pcmData->GetSize() )
+    return;
+
+  // Device bytes wrap at 32 bits, so compare them that way
+  auto endOffset = static_cast<size_t>( pcm - pcmPtr ) + wh->dwBufferLength;
+  auto lateBytes = static_cast<int32_t>( devicePosition - static_cast<uint32_t>( endOffset - deviceStartOffset ) );
+  if( lateBytes < 0 )
+    return;
+  auto lateFrames = static_cast<uint64_t>( lateBytes ) / pcmData->GetBlockAlignment();
+  auto lateNs = ( lateFrames * 1000000000 ) / pcmData->GetSamplesPerSecond();
+  GetAudioMetrics().Record( AudioMetric::EventToRefillLatency, lateNs,
+                            refillTime - std::chrono::nanoseconds( lateNs ) );
 }
 
+void WaveOut::Update() // invoke when callbackEvent is signalled
+{
+  assert( !impl_->IsAudioThreadRunning() ); // the audio thread calls it instead
+  impl_->Update();
+}
+
+// Buffers refilled by the last Update(), not counting buffers a seek rewrote
+// or one added after an underrun. More than one means the refill thread woke
+// late and caught up in a single pass. Callable from any thread.
+
+size_t WaveOut::GetRecycledCount() const
+{
+  return impl_->recycledCount.load( std::memory_order_relaxed );
+}
+
+// Wait-free; with the audio thread running, these reflect the commands it
+// has applied so far
+
 bool WaveOut::IsPlaying() const
 {
-  return impl_->isPlaying;
+  return impl_->isPlaying.load( std::memory_order_acquire );
 }
 
 bool WaveOut::HasEnded() const
 {
-  return impl_->hasEnded;
+  return impl_->hasEnded.load( std::memory_order_acquire );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Self-driven mode. The audio thread runs at audio priority (see
+// AudioThreadPriority), waits on the callback event and refills, so a busy
+// UI thread can no longer starve the device. Start(), Pause() and SetVolume()
+// are queued to it and may come from any number of threads; they serialize
+// among themselves, but the audio thread never waits on them. Seek() is
+// lock-free. The caller must not wait on the callback event or call Update()
+// or Prepare() while it runs. Call after Prepare(); Close() stops it.
+
+void WaveOut::StartAudioThread()
+{
+  impl_->StartAudioThread();
+}
+
+void WaveOut::StopAudioThread()
+{
+  impl_->StopAudioThread();
+}
+
+void WaveOut::Impl::StartAudioThread()
+{
+  assert( callbackEvent != NULL );
+  assert( !submitted.IsEmpty() ); // Prepare() first
+  std::lock_guard<std::mutex> lock( audioCommandMutex );
+  if( IsAudioThreadRunning() )
+    return;
+  isAudioThreadQuitting = false;
+  isAudioThreadRunning.store( true, std::memory_order_release );
+  audioThread = std::thread( [this] { RunAudioThread(); } ); // Impl is pinned, unlike the WaveOut itself
+}
+
+void WaveOut::Impl::RunAudioThread()
+{
+  AudioThreadPriority priority;
+  for( ;; )
+  {
+    WaitWaveEvent( callbackEvent, UINT32_MAX );
+    if( isAudioThreadQuitting.load( std::memory_order_acquire ) )
+      return;
+    ApplyAudioCommands();
+    Update();
+  }
+}
+
+// Commands still queued when the thread stops are applied by the caller, so
+// a Pause() just before Close() isn't lost
+
+void WaveOut::Impl::StopAudioThread()
+{
+  std::lock_guard<std::mutex> lock( audioCommandMutex );
+  if( !IsAudioThreadRunning() )
+    return;
+  isAudioThreadQuitting.store( true, std::memory_order_release );
+  SignalWaveEvent( callbackEvent );
+  audioThread.join();
+  isAudioThreadRunning.store( false, std::memory_order_release );
+  ApplyAudioCommands();
+}
+
+// Applies the command here, or queues it for the audio thread if that's
+// running. The mutex makes the queue's single producer whichever control
+// thread holds it, and keeps the thread from stopping in between. A full
+// queue means the audio thread is stalled; rather than drop the command,
+// wait until it drains some.
+
+void WaveOut::Impl::RunAudioCommand( AudioCommand::Type type, const WaveOut::Volume& volume )
+{
+  AudioCommand command = { type, volume.first, volume.second };
+  std::lock_guard<std::mutex> lock( audioCommandMutex );
+  if( !IsAudioThreadRunning() )
+  {
+    ApplyAudioCommand( command );
+    return;
+  }
+  while( audioCommands.Write( &command, 1 ) == 0 )
+  {
+    SignalWaveEvent( callbackEvent );
+    std::this_thread::yield();
+  }
+  SignalWaveEvent( callbackEvent );
+}
+
+void WaveOut::Impl::ApplyAudioCommand( const AudioCommand& command )
+{
+  switch( command.type )
+  {
+  case AudioCommand::Type::Start:     Start(); break;
+  case AudioCommand::Type::Pause:     Pause(); break;
+  case AudioCommand::Type::SetVolume: waveOut->SetVolume( { command.left, command.right } ); break;
+  default: assert( false ); break;
+  }
+}
+
+void WaveOut::Impl::ApplyAudioCommands()
+{
+  AudioCommand command;
+  while( audioCommands.Read( &command, 1 ) )
+    ApplyAudioCommand( command );
 }
 
 void WaveOut::Close()
 {
-  impl_->waveOut.Reset();
+  impl_->StopAudioThread();
+  impl_->waveOut->Reset();
   for( auto i = 0u; i < impl_->waveHdr.size(); ++i )
   {
     auto& wh = impl_->waveHdr[ i ];
     // waveOutReset() leaves buffers in unpredictable state; fix it here
     // before calling waveOutUnprepare()
     wh.dwFlags = WHDR_PREPARED; 
-    impl_->waveOut.Unprepare( wh );
+    impl_->waveOut->Unprepare( wh );
   }
   impl_->Clear();
 }
 
 WaveOut::Volume WaveOut::GetVolume() const // left, right
 {
-  return impl_->waveOut.GetVolume();
+  return impl_->waveOut->GetVolume();
 }
 
 void WaveOut::SetVolume( const WaveOut::Volume& volume ) // left, right
 {
-  impl_->waveOut.SetVolume( volume );
+  impl_->RunAudioCommand( Impl::AudioCommand::Type::SetVolume, volume );
 }
 
+// Interpolated from the device position sampled by Update(), so this is cheap
+// enough to poll at display rates and may be called from any thread
+
 uint32_t WaveOut::GetPositionMs() const
 {
-  auto bytePosition = impl_->lastStartOffsetBytes;
-  bytePosition += impl_->waveOut.GetPositionBytes();
-  return impl_->pcmData.BytesToMilliseconds( bytePosition );
+  return static_cast<uint32_t>( impl_->clock.GetMilliseconds() );
 }
 
 } // namespace PKIsensee
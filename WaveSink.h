@@ -0,0 +1,311 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WaveSink.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#if defined( _WIN32 )
+#define NOMINMAX 1
+#include "windows.h"
+#include "mmeapi.h"
+#include "mmreg.h"
+#else
+#include "FutexEvent.h"
+#endif
+
+namespace PKIsensee
+{
+
+#if !defined( _WIN32 )
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Linux stand-ins for the winmm types, so WaveOut and WinWaveStream build
+// unchanged against NullWaveSink. HANDLE is the event's Util::Event handle,
+// which on Linux is its FutexEvent.
+
+using BYTE = uint8_t;
+using WORD = uint16_t;
+using DWORD = uint32_t;
+using DWORD_PTR = uintptr_t;
+using LPSTR = char*;
+using HANDLE = void*;
+
+constexpr WORD  WAVE_FORMAT_PCM = 1;
+constexpr WORD  WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+constexpr DWORD WHDR_DONE = 0x00000001;
+constexpr DWORD WHDR_PREPARED = 0x00000002;
+constexpr DWORD WHDR_INQUEUE = 0x00000010;
+
+struct WAVEFORMATEX
+{
+  WORD  wFormatTag;
+  WORD  nChannels;
+  DWORD nSamplesPerSec;
+  DWORD nAvgBytesPerSec;
+  WORD  nBlockAlign;
+  WORD  wBitsPerSample;
+  WORD  cbSize;
+};
+
+struct GUID
+{
+  uint32_t Data1;
+  uint16_t Data2;
+  uint16_t Data3;
+  uint8_t  Data4[ 8 ];
+};
+
+struct WAVEFORMATEXTENSIBLE
+{
+  WAVEFORMATEX Format;
+  union
+  {
+    WORD wValidBitsPerSample;
+    WORD wSamplesPerBlock;
+    WORD wReserved;
+  } Samples;
+  DWORD        dwChannelMask;
+  GUID         SubFormat;
+};
+
+struct WAVEHDR
+{
+  LPSTR     lpData;
+  DWORD     dwBufferLength;
+  DWORD     dwBytesRecorded;
+  DWORD_PTR dwUser;
+  DWORD     dwFlags;
+  DWORD     dwLoops;
+  WAVEHDR*  lpNext;
+  DWORD_PTR reserved;
+};
+
+#endif // !_WIN32
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Formats of more than two channels or 16 bits are WAVE_FORMAT_EXTENSIBLE,
+// whose WAVEFORMATEX is followed by cbSize more bytes. Whatever stores a
+// format keeps the whole WAVEFORMATEXTENSIBLE, so that copying one doesn't
+// slice off the channel mask and subformat.
+
+inline WAVEFORMATEXTENSIBLE CopyWaveFormat( const WAVEFORMATEX& wfx )
+{
+  WAVEFORMATEXTENSIBLE copy = {};
+  auto bytes = sizeof( WAVEFORMATEX );
+  if( wfx.wFormatTag == WAVE_FORMAT_EXTENSIBLE )
+    bytes += std::min<size_t>( wfx.cbSize, sizeof( WAVEFORMATEXTENSIBLE ) - sizeof( WAVEFORMATEX ) );
+  std::memcpy( &copy, &wfx, bytes );
+  return copy;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The callback event. Sinks signal it from their own thread; WaveOut's audio
+// thread waits on it.
+
+inline void SignalWaveEvent( HANDLE hEvent )
+{
+#if defined( _WIN32 )
+  ::SetEvent( hEvent );
+#else
+  static_cast<FutexEvent*>( hEvent )->Signal();
+#endif
+}
+
+// True if signalled within timeoutMs; UINT32_MAX waits forever
+inline bool WaitWaveEvent( HANDLE hEvent, uint32_t timeoutMs )
+{
+#if defined( _WIN32 )
+  return ::WaitForSingleObject( hEvent, timeoutMs ) == WAIT_OBJECT_0;
+#else
+  return static_cast<FutexEvent*>( hEvent )->Wait( timeoutMs );
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// WHDR_DONE is set by the device on its own thread while the refill thread
+// polls it, so both sides go through these. The release store publishes the
+// sink's last use of the buffer along with the flag.
+
+inline bool IsWaveHdrDone( const WAVEHDR& wh )
+{
+  auto& flags = const_cast<DWORD&>( wh.dwFlags );
+  return ( std::atomic_ref<DWORD>( flags ).load( std::memory_order_acquire ) & WHDR_DONE ) != 0;
+}
+
+// Called by sinks with no other thread writing the flags
+inline void SetWaveHdrDone( WAVEHDR& wh )
+{
+  std::atomic_ref<DWORD> flags( wh.dwFlags );
+  DWORD done = ( flags.load( std::memory_order_relaxed ) & ~static_cast<DWORD>( WHDR_INQUEUE ) ) | WHDR_DONE;
+  flags.store( done, std::memory_order_release );
+}
+
+// Left, right. Converts to and from WaveOut::Volume.
+using WaveVolume = std::pair<uint16_t, uint16_t>;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Abstract audio output device. Mirrors the waveOut API: buffers are described
+// by WAVEHDRs, and the sink marks each one WHDR_DONE and signals hEvent when
+// it has been consumed, just as CALLBACK_EVENT does. WinWaveOut is the winmm
+// implementation; NullWaveSink and FileWaveSink allow the WaveOut scheduling
+// logic to run without a sound card.
+
+class WaveSink
+{
+public:
+  WaveSink() = default;
+  virtual ~WaveSink() = default;
+
+  // Disable copy/move
+  WaveSink( const WaveSink& ) = delete;
+  WaveSink& operator=( const WaveSink& ) = delete;
+  WaveSink( WaveSink&& ) = delete;
+  WaveSink& operator=( WaveSink&& ) = delete;
+
+  virtual bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent ) = 0;
+  virtual void Prepare( WAVEHDR& wh ) = 0;
+  virtual void Unprepare( WAVEHDR& wh ) = 0;
+  virtual void Write( WAVEHDR& wh ) = 0;
+  virtual uint32_t GetPositionBytes() const = 0;
+  virtual WaveVolume GetVolume() const = 0;
+  virtual void SetVolume( const WaveVolume& volume ) = 0;
+  virtual void Reset() = 0;
+  virtual void Close() = 0;
+  virtual void Restart() = 0;
+  virtual void Pause() = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Buffer sizing. Chromium (see WaveOut.cpp) queues 2 to 4 buffers; more are
+// allowed so the queue can grow when the refill thread is late.
+
+constexpr size_t kMaxWaveBuffers = 16;
+
+// Bytes needed to hold bufferMs of audio, rounded down to whole sample frames
+inline size_t GetWaveBufferBytes( uint32_t samplesPerSec, uint32_t blockAlign, uint32_t bufferMs )
+{
+  assert( blockAlign > 0 );
+  auto frames = ( uint64_t( samplesPerSec ) * bufferMs ) / 1000;
+  return static_cast<size_t>( std::max<uint64_t>( frames, 1 ) * blockAlign );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Fixed-capacity FIFO of WAVEHDRs. Devices return buffers in the order they
+// were written, so tracking submission order means only the front buffer
+// needs to be checked for WHDR_DONE, and if the back buffer is done, they
+// all are.
+
+class WaveHdrQueue
+{
+public:
+  bool IsEmpty() const
+  {
+    return count_ == 0;
+  }
+
+  size_t GetSize() const
+  {
+    return count_;
+  }
+
+  WAVEHDR* Front() const
+  {
+    assert( !IsEmpty() );
+    return waveHdr_[ head_ ];
+  }
+
+  WAVEHDR* Back() const
+  {
+    assert( !IsEmpty() );
+    return waveHdr_[ ( head_ + count_ - 1 ) % kMaxWaveBuffers ];
+  }
+
+  // Buffers the device hasn't returned yet. They're returned in order, so
+  // the done ones are all at the front.
+  size_t GetQueuedCount() const
+  {
+    size_t doneCount = 0;
+    while( doneCount < count_ && IsWaveHdrDone( *waveHdr_[ ( head_ + doneCount ) % kMaxWaveBuffers ] ) )
+      ++doneCount;
+    return count_ - doneCount;
+  }
+
+  void Push( WAVEHDR* wh )
+  {
+    assert( wh != nullptr );
+    assert( count_ < kMaxWaveBuffers );
+    waveHdr_[ ( head_ + count_ ) % kMaxWaveBuffers ] = wh;
+    ++count_;
+  }
+
+  WAVEHDR* Pop()
+  {
+    auto* wh = Front();
+    head_ = ( head_ + 1 ) % kMaxWaveBuffers;
+    --count_;
+    return wh;
+  }
+
+  void Clear()
+  {
+    head_ = 0;
+    count_ = 0;
+  }
+
+private:
+  std::array<WAVEHDR*, kMaxWaveBuffers> waveHdr_ = {};
+  size_t head_ = 0;
+  size_t count_ = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// WaveOut creates its device through CreateWaveSink() (see WinWaveOut.h).
+// Install a factory before opening any WaveOut to substitute another sink,
+// e.g. SetWaveSinkFactory( [] { return std::make_unique<NullWaveSink>( 0.0 ); } );
+
+using WaveSinkFactory = std::function<std::unique_ptr<WaveSink>()>;
+
+inline WaveSinkFactory& GetWaveSinkFactory()
+{
+  static WaveSinkFactory waveSinkFactory;
+  return waveSinkFactory;
+}
+
+inline void SetWaveSinkFactory( WaveSinkFactory waveSinkFactory ) // empty to restore default
+{
+  GetWaveSinkFactory() = std::move( waveSinkFactory );
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
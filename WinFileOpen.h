@@ -34,8 +34,6 @@ namespace PKIsensee
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#pragma warning(push)
-#pragma warning(disable: 4626 5026 5027) // constructor/assignment implicitly defined as deleted
 class WinShellItem : public ComPtr< IShellItem >
 {
 public:
@@ -70,9 +68,8 @@ public:
   WinShellItemArray() = default;
   WinShellItemArray( const WinShellItemArray& ) = default;
   WinShellItemArray( WinShellItemArray&& ) = default;
-
-  WinShellItemArray& operator=( const WinShellItemArray& ) = delete;
-  WinShellItemArray& operator=( WinShellItemArray&& ) = delete;
+  WinShellItemArray& operator=( const WinShellItemArray& ) = default;
+  WinShellItemArray& operator=( WinShellItemArray&& ) = default;
 
   size_t GetCount()
   {
@@ -92,7 +89,6 @@ public:
   }
 
 };
-#pragma warning(pop)
 
 ///////////////////////////////////////////////////////////////////////////////
 
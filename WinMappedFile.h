@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinMappedFile.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+
+#define NOMINMAX 1
+#include "Windows.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Read-only view of an entire file. Pages are read from disk on first touch,
+// so opening is nearly free regardless of file size. Other processes may read,
+// rename or delete the file while it is mapped.
+
+class WinMappedFile
+{
+public:
+
+  WinMappedFile() = default;
+
+  // Disable copy/move
+  WinMappedFile( const WinMappedFile& ) = delete;
+  WinMappedFile& operator=( const WinMappedFile& ) = delete;
+  WinMappedFile( WinMappedFile&& ) = delete;
+  WinMappedFile& operator=( WinMappedFile&& ) = delete;
+
+  ~WinMappedFile()
+  {
+    Close();
+  }
+
+  // False if the file can't be opened or is empty
+  bool Open( const std::filesystem::path& file, DWORD flagsAndAttributes = FILE_ATTRIBUTE_NORMAL )
+  {
+    Close();
+    file_ = ::CreateFileW( file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                           OPEN_EXISTING, flagsAndAttributes, NULL );
+    if( file_ == INVALID_HANDLE_VALUE )
+      return false;
+
+    LARGE_INTEGER fileSize = {};
+    if( !::GetFileSizeEx( file_, &fileSize ) || fileSize.QuadPart == 0 )
+    {
+      Close();
+      return false;
+    }
+    mapping_ = ::CreateFileMappingW( file_, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( mapping_ == NULL )
+    {
+      Close();
+      return false;
+    }
+    view_ = static_cast<const uint8_t*>( ::MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 ) );
+    if( view_ == nullptr )
+    {
+      Close();
+      return false;
+    }
+    size_ = static_cast<uint64_t>( fileSize.QuadPart );
+    return true;
+  }
+
+  void Close()
+  {
+    if( view_ != nullptr )
+      ::UnmapViewOfFile( view_ );
+    if( mapping_ != NULL )
+      ::CloseHandle( mapping_ );
+    if( file_ != INVALID_HANDLE_VALUE )
+      ::CloseHandle( file_ );
+    view_ = nullptr;
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+    size_ = 0;
+  }
+
+  bool IsOpen() const
+  {
+    return view_ != nullptr;
+  }
+
+  const uint8_t* GetData() const
+  {
+    return view_;
+  }
+
+  uint64_t GetSize() const
+  {
+    return size_;
+  }
+
+private:
+  HANDLE         file_ = INVALID_HANDLE_VALUE;
+  HANDLE         mapping_ = NULL;
+  const uint8_t* view_ = nullptr;
+  uint64_t       size_ = 0;
+
+}; // class WinMappedFile
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,353 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinMappedWaveSource.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "MediaProbe.h"
+#include "PcmBufferChain.h"
+#include "WaveSink.h"
+
+#define NOMINMAX 1
+#include "Windows.h"
+#include "mmeapi.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Plays a WAV file straight from the file cache. Open() reads only the RIFF
+// headers, so it returns immediately regardless of file size. Read() hands out
+// PcmBuffers that point into a mapped view of the file; pass them to a
+// WinWaveStream opened without a ring and the samples are never copied.
+//
+// The file is mapped one window at a time. When reading moves into a window,
+// the window after it is mapped and prefetched, so the disk stays one window
+// ahead of the device. Make the window at least as long as the WAVEHDR queue
+// (the latencyMs given to WinWaveStream::Prepare()). A view is unmapped once
+// the device has returned every buffer in it, so resident memory is a few
+// windows no matter how long the recording. Buffer objects are recycled, so
+// steady playback makes no heap allocations; only mapping a window does.
+//
+// Typical use:
+//
+//    source.Open( file, latencyMs );
+//    stream.Open( source.GetFormat(), event.GetHandle() );
+//    // producer: while( auto pcm = source.Read( bytes ) ) while( !stream.Write( std::move( pcm ) ) ) wait;
+//    // consumer as for any other WinWaveStream
+
+class WinMappedPcmBuffer : public PcmBuffer
+{
+public:
+  WinMappedPcmBuffer( std::shared_ptr<const uint8_t> view, const uint8_t* data, size_t size )
+    : view_( std::move( view ) ),
+      data_( data ),
+      size_( size )
+  {
+  }
+
+  const uint8_t* GetData() const override
+  {
+    return data_;
+  }
+
+  size_t GetSize() const override
+  {
+    return size_;
+  }
+
+  // One buffer is made per Read() on the producer thread and destroyed on the
+  // device thread, so blocks go round a free list rather than the heap
+  static void* operator new( size_t bytes )
+  {
+    assert( bytes == sizeof( WinMappedPcmBuffer ) );
+    auto& freeList = GetFreeList();
+    {
+      std::lock_guard<std::mutex> lock( freeList.mutex );
+      if( !freeList.blocks.empty() )
+      {
+        void* block = freeList.blocks.back();
+        freeList.blocks.pop_back();
+        return block;
+      }
+    }
+    return ::operator new( bytes );
+  }
+
+  static void operator delete( void* block, size_t bytes )
+  {
+    auto& freeList = GetFreeList();
+    {
+      std::lock_guard<std::mutex> lock( freeList.mutex );
+      if( freeList.blocks.size() < kMaxFreeBlocks )
+      {
+        freeList.blocks.push_back( block );
+        return;
+      }
+    }
+    ::operator delete( block, bytes );
+  }
+
+private:
+  // Enough for the WAVEHDR queues of several streams
+  static constexpr size_t kMaxFreeBlocks = 256;
+
+  struct FreeList
+  {
+    FreeList()
+    {
+      blocks.reserve( kMaxFreeBlocks );
+    }
+
+    ~FreeList()
+    {
+      for( auto* block : blocks )
+        ::operator delete( block, sizeof( WinMappedPcmBuffer ) );
+    }
+
+    std::mutex         mutex;
+    std::vector<void*> blocks;
+  };
+
+  static FreeList& GetFreeList()
+  {
+    static FreeList freeList;
+    return freeList;
+  }
+
+private:
+  std::shared_ptr<const uint8_t> view_; // unmapped with the last buffer that uses it
+  const uint8_t*                 data_;
+  size_t                         size_;
+};
+
+class WinMappedWaveSource
+{
+public:
+  static constexpr uint32_t kDefaultWindowMs = 2000;
+
+  WinMappedWaveSource() = default;
+
+  // Disable copy/move
+  WinMappedWaveSource( const WinMappedWaveSource& ) = delete;
+  WinMappedWaveSource& operator=( const WinMappedWaveSource& ) = delete;
+  WinMappedWaveSource( WinMappedWaveSource&& ) = delete;
+  WinMappedWaveSource& operator=( WinMappedWaveSource&& ) = delete;
+
+  ~WinMappedWaveSource()
+  {
+    Close();
+  }
+
+  // False if the file can't be opened or isn't integer or float PCM WAV
+  bool Open( const std::filesystem::path& file, uint32_t windowMs = kDefaultWindowMs )
+  {
+    Close();
+    file_ = ::CreateFileW( file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( file_ == INVALID_HANDLE_VALUE )
+      return false;
+
+    LARGE_INTEGER fileSize = {};
+    if( !::GetFileSizeEx( file_, &fileSize ) || fileSize.QuadPart == 0 )
+    {
+      Close();
+      return false;
+    }
+    mapping_ = ::CreateFileMappingW( file_, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( mapping_ == NULL || !ReadHeader( static_cast<uint64_t>( fileSize.QuadPart ) ) )
+    {
+      Close();
+      return false;
+    }
+
+    SYSTEM_INFO systemInfo = {};
+    ::GetSystemInfo( &systemInfo );
+    granularity_ = systemInfo.dwAllocationGranularity;
+
+    windowBytes_ = GetWaveBufferBytes( wfx_.nSamplesPerSec, wfx_.nBlockAlign, windowMs );
+    return true;
+  }
+
+  // Buffers already handed out stay valid
+  void Close()
+  {
+    current_ = {};
+    next_ = {};
+    if( mapping_ != NULL )
+      ::CloseHandle( mapping_ );
+    if( file_ != INVALID_HANDLE_VALUE )
+      ::CloseHandle( file_ );
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+    wfx_ = {};
+    dataOffset_ = 0;
+    dataBytes_ = 0;
+    position_ = 0;
+  }
+
+  bool IsOpen() const
+  {
+    return mapping_ != NULL;
+  }
+
+  const WAVEFORMATEX& GetFormat() const
+  {
+    return wfx_;
+  }
+
+  uint64_t GetFrameCount() const
+  {
+    return IsOpen() ? dataBytes_ / wfx_.nBlockAlign : 0;
+  }
+
+  uint64_t GetPositionFrames() const
+  {
+    return IsOpen() ? position_ / wfx_.nBlockAlign : 0;
+  }
+
+  // Next Read() starts here; clamped to the end of the data
+  void Seek( uint64_t frame )
+  {
+    assert( IsOpen() );
+    position_ = std::min( frame * wfx_.nBlockAlign, dataBytes_ );
+  }
+
+  bool IsEnd() const
+  {
+    return position_ >= dataBytes_;
+  }
+
+  // Up to maxBytes of whole sample frames, never crossing a window boundary.
+  // Returns nullptr at the end of the data or if the file can't be mapped.
+  std::unique_ptr<PcmBuffer> Read( size_t maxBytes )
+  {
+    assert( IsOpen() );
+    if( IsEnd() )
+      return nullptr;
+    if( !current_.Contains( position_ ) )
+    {
+      current_ = ( next_.Contains( position_ ) ) ? std::move( next_ ) : MapWindow( position_ );
+      next_ = ( current_.end < dataBytes_ ) ? MapWindow( current_.end ) : Window{};
+      if( !current_.view )
+        return nullptr;
+    }
+
+    maxBytes = std::max( maxBytes - ( maxBytes % wfx_.nBlockAlign ), size_t( wfx_.nBlockAlign ) );
+    auto bytes = static_cast<size_t>( std::min<uint64_t>( maxBytes, current_.end - position_ ) );
+    auto* data = current_.data + ( position_ - current_.begin );
+    position_ += bytes;
+    return std::make_unique<WinMappedPcmBuffer>( current_.view, data, bytes );
+  }
+
+private:
+  static constexpr size_t kMaxHeaderBytes = 1024 * 1024; // metadata chunks may precede the samples
+
+  // Data bytes [begin, end) mapped at data
+  struct Window
+  {
+    std::shared_ptr<const uint8_t> view;
+    const uint8_t*                 data = nullptr;
+    uint64_t                       begin = 0;
+    uint64_t                       end = 0;
+
+    bool Contains( uint64_t position ) const
+    {
+      return view && position >= begin && position < end;
+    }
+  };
+
+  bool ReadHeader( uint64_t fileBytes )
+  {
+    auto headerBytes = static_cast<size_t>( std::min<uint64_t>( fileBytes, kMaxHeaderBytes ) );
+    auto* header = static_cast<const uint8_t*>( ::MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, headerBytes ) );
+    if( header == nullptr )
+      return false;
+    MediaProbe::WavLayout layout;
+    bool isWav = MediaProbe::ParseWavLayout( header, headerBytes, layout );
+    ::UnmapViewOfFile( header );
+    if( !isWav || ( layout.formatTag != WAVE_FORMAT_PCM && layout.formatTag != WAVE_FORMAT_IEEE_FLOAT ) )
+      return false;
+    if( layout.dataOffset >= fileBytes )
+      return false;
+
+    // Recorders that were interrupted leave the header size wrong
+    auto dataBytes = std::min( layout.dataBytes, fileBytes - layout.dataOffset );
+    dataBytes_ = dataBytes - ( dataBytes % layout.blockAlign );
+    dataOffset_ = layout.dataOffset;
+
+    wfx_.wFormatTag      = static_cast<WORD>( layout.formatTag );
+    wfx_.nChannels       = static_cast<WORD>( layout.channels );
+    wfx_.nSamplesPerSec  = layout.samplesPerSec;
+    wfx_.wBitsPerSample  = static_cast<WORD>( layout.bitsPerSample );
+    wfx_.nBlockAlign     = static_cast<WORD>( layout.blockAlign );
+    wfx_.nAvgBytesPerSec = wfx_.nSamplesPerSec * wfx_.nBlockAlign;
+    wfx_.cbSize          = 0;
+    return dataBytes_ > 0;
+  }
+
+  // Views must start on an allocation granularity boundary, so the view may
+  // begin up to granularity_ bytes before the window
+  Window MapWindow( uint64_t begin ) const
+  {
+    Window window;
+    window.begin = begin;
+    window.end = std::min( begin + windowBytes_, dataBytes_ );
+    auto fileBegin = dataOffset_ + begin;
+    auto viewOffset = fileBegin - ( fileBegin % granularity_ );
+    auto viewBytes = static_cast<size_t>( dataOffset_ + window.end - viewOffset );
+    auto* view = static_cast<const uint8_t*>( ::MapViewOfFile( mapping_, FILE_MAP_READ,
+                                                               static_cast<DWORD>( viewOffset >> 32 ),
+                                                               static_cast<DWORD>( viewOffset ),
+                                                               viewBytes ) );
+    if( view == nullptr )
+      return {};
+
+    // Starts the reads now rather than page by page as the device gets there;
+    // failure only costs the read-ahead
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t*>( view ), viewBytes };
+    ::PrefetchVirtualMemory( ::GetCurrentProcess(), 1, &range, 0 );
+
+    window.view.reset( view, []( const uint8_t* v ) { ::UnmapViewOfFile( v ); } );
+    window.data = view + ( fileBegin - viewOffset );
+    return window;
+  }
+
+private:
+  HANDLE       file_ = INVALID_HANDLE_VALUE;
+  HANDLE       mapping_ = NULL;
+  WAVEFORMATEX wfx_ = {};
+  uint64_t     dataOffset_ = 0; // from the start of the file
+  uint64_t     dataBytes_ = 0;  // whole frames only
+  uint64_t     position_ = 0;   // into the data
+  size_t       windowBytes_ = 0;
+  DWORD        granularity_ = 65536;
+  Window       current_;
+  Window       next_;
+
+}; // class WinMappedWaveSource
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinMediaBatchDecoder.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "BatchDecoder.h"
+#include "WinMediaFoundation.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// One decoded file, as returned by WinMediaBatchDecoder::GetResult()
+
+struct WinMediaDecodeResult
+{
+  std::filesystem::path     file;
+  size_t                    fileIndex = 0; // position in the list passed to Start()
+  WAVEFORMATEXTENSIBLE      wfx = {};
+  std::vector<uint8_t>      pcm;
+  std::chrono::nanoseconds  decodeTime = {};
+  bool                      isDecoded = false; // false if the file couldn't be opened or decoded
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The BatchDecoder FileDecoder for Media Foundation: each worker initializes
+// COM and Media Foundation once
+
+class WinMediaFileDecoder
+{
+public:
+  using Result = WinMediaDecodeResult;
+
+  // Decodes the first audio stream of file to PCM on the calling thread, which
+  // must have initialized Media Foundation (see WinMediaFoundation). Batches
+  // are often picked by the user, so a missing, damaged or non-audio file
+  // fails its result rather than asserting.
+  static WinMediaDecodeResult Decode( const std::filesystem::path& file )
+  {
+    auto start = std::chrono::steady_clock::now();
+    WinMediaDecodeResult result;
+    result.file = file;
+    WinMediaSourceReader sourceReader;
+    if( FAILED( sourceReader.Open( file ) ) )
+      return result;
+    if( !sourceReader.SelectOnly( kFirstAudioStream ) ||
+        !sourceReader.SelectOutput( kFirstAudioStream, WinMediaOutputType::PCM ) ||
+        !sourceReader.GetWaveFormat( kFirstAudioStream, result.wfx ) )
+      return result;
+
+    WinMediaSample mediaSample;
+    WinMediaBufferPool bufferPool( 1 ); // each buffer is copied out before the next read
+    for( bool isEndOfStream = false; !isEndOfStream; )
+    {
+      if( FAILED( sourceReader.TryReadSample( kFirstAudioStream, mediaSample, isEndOfStream ) ) )
+      {
+        result.pcm.clear();
+        return result;
+      }
+      if( mediaSample.Get() == nullptr ) // end of stream or a gap
+        continue;
+      auto mediaBuffer = mediaSample.GetMediaBuffer( bufferPool );
+      WinMediaBufferLock bufferLock( mediaBuffer.Get() );
+      result.pcm.insert( result.pcm.end(), bufferLock.GetData(), bufferLock.GetData() + bufferLock.GetSize() );
+    }
+    result.isDecoded = true;
+    result.decodeTime = std::chrono::steady_clock::now() - start;
+    return result;
+  }
+
+private:
+  WinMediaFoundation mediaFoundation_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Decodes a list of files to PCM across a pool of worker threads; see
+// BatchDecoder.
+//
+// Typical use:
+//
+//    WinMediaBatchDecoder batchDecoder;
+//    batchDecoder.Start( Util::GetFileDialog( window ) );
+//    WinMediaDecodeResult result;
+//    while( batchDecoder.GetResult( result ) )
+//      Import( result );
+
+class WinMediaBatchDecoder : public BatchDecoder<WinMediaFileDecoder>
+{
+public:
+
+  explicit WinMediaBatchDecoder( size_t workerCount = std::thread::hardware_concurrency() )
+    :
+    BatchDecoder( workerCount )
+  {
+  }
+
+  static WinMediaDecodeResult Decode( const std::filesystem::path& file )
+  {
+    return WinMediaFileDecoder::Decode( file );
+  }
+
+}; // class WinMediaBatchDecoder
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
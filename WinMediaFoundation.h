@@ -15,14 +15,25 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #pragma once
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <future>
+#include <mutex>
 
 #define NOMINMAX 1
+#include "AudioMetrics.h"
+#include "BufferPool.h"
 #include "ComPtr.h"
+#include "PcmAsyncReader.h"
+#include "PcmBufferChain.h"
 #include "MFapi.h"
 #include "MFidl.h"
 #include "MFReadWrite.h"
+#include "mmeapi.h"
+#include "mmreg.h"
 
 // Link with these media libraries
 #pragma comment(lib, "mfplat.lib")
@@ -80,6 +91,12 @@ public:
   HRESULT hr;
   CHECK_HR( hr = Get()->SetGUID( key, value ) );
   }
+
+  void SetUint32( const GUID& key, UINT32 value )
+  {
+  HRESULT hr;
+  CHECK_HR( hr = Get()->SetUINT32( key, value ) );
+  }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -107,6 +124,30 @@ private:
   uint8_t* pData_ = nullptr;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// Contiguous memory buffers for samples that arrive in several pieces; see
+// WinMediaSample::GetMediaBuffer( WinMediaBufferPool& ). One pool per stream
+// is typical; leases may be released on any thread.
+
+class WinMediaBufferPool : public BufferPool<WinMediaBuffer>
+{
+public:
+  explicit WinMediaBufferPool( size_t maxIdleBuffers = kDefaultMaxIdleBuffers )
+    : BufferPool<WinMediaBuffer>( CreateBuffer, maxIdleBuffers )
+  {
+  }
+
+private:
+  static WinMediaBuffer CreateBuffer( size_t capacity )
+  {
+    HRESULT hr;
+    WinMediaBuffer mediaBuffer;
+    CHECK_HR( hr = MFCreateMemoryBuffer( static_cast<DWORD>( capacity ), &mediaBuffer ) );
+    return mediaBuffer;
+  }
+};
+
 class WinMediaBufferLock
 {
 public:
@@ -144,8 +185,18 @@ class WinMediaSample : public ComPtr< IMFSample >
 {
 public:
 
-  using ComPtr<IMFSample>::operator=; // See ReadSample
+  using ComPtr<IMFSample>::operator=; // borrowed IMFSample*; see OnReadSample
+
+  size_t GetBufferCount()
+  {
+    HRESULT hr;
+    DWORD bufferCount = 0;
+    CHECK_HR( hr = Get()->GetBufferCount( &bufferCount ) );
+    return bufferCount;
+  }
 
+  // If the sample holds several buffers, Media Foundation allocates a new one
+  // and copies them into it
   WinMediaBuffer GetMediaBuffer()
   {
     HRESULT hr;
@@ -153,25 +204,152 @@ public:
     CHECK_HR( hr = Get()->ConvertToContiguousBuffer( &mediaBuffer ) );
     return mediaBuffer;
   }
+
+  // As above, but a sample with several buffers is copied into one from the
+  // pool, so steady-state decoding doesn't allocate. A single buffer is
+  // returned as is, in a lease that doesn't belong to the pool
+  WinMediaBufferPool::Lease GetMediaBuffer( WinMediaBufferPool& bufferPool )
+  {
+    HRESULT hr;
+    if( GetBufferCount() == 1 )
+    {
+      WinMediaBuffer mediaBuffer;
+      CHECK_HR( hr = Get()->GetBufferByIndex( 0, &mediaBuffer ) );
+      return WinMediaBufferPool::Lease( std::move( mediaBuffer ) );
+    }
+
+    DWORD totalBytes = 0;
+    CHECK_HR( hr = Get()->GetTotalLength( &totalBytes ) );
+    auto lease = bufferPool.Acquire( totalBytes );
+    CHECK_HR( hr = Get()->CopyToBuffer( lease.Get() ) ); // sets the current length
+    return lease;
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Decoded PCM handed to WinWaveStream::Write() without copying. The media
+// buffer stays locked and referenced until the stream releases this object,
+// which happens after the device returns the last WAVEHDR pointing into it.
+// The stream hands it back to the writing thread to destroy, so the unlock
+// and release run there rather than on the refill thread.
+
+class WinMediaPcmBuffer : public PcmBuffer
+{
+public:
+  explicit WinMediaPcmBuffer( WinMediaSample& mediaSample )
+    :
+    mediaBuffer_( mediaSample.GetMediaBuffer() ),
+    lock_( mediaBuffer_.Get() )
+  {
+  }
+
+  // The pooled buffer, if any, returns to bufferPool when this is released
+  WinMediaPcmBuffer( WinMediaSample& mediaSample, WinMediaBufferPool& bufferPool )
+    :
+    mediaBuffer_( mediaSample.GetMediaBuffer( bufferPool ) ),
+    lock_( mediaBuffer_.Get() )
+  {
+  }
+
+  const uint8_t* GetData() const override
+  {
+    return lock_.GetData();
+  }
+
+  size_t GetSize() const override
+  {
+    return lock_.GetSize();
+  }
+
+private:
+  WinMediaBufferPool::Lease mediaBuffer_;
+  WinMediaBufferLock        lock_; // unlocks before mediaBuffer_ releases
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// PCM lets the decoder pick the bit depth. The others request a specific
+// sample format, which not every decoder can produce. Decoding to Float32 and
+// converting with ConvertSamples() (PcmConvert.h) works for any device depth.
+
 enum class WinMediaOutputType
 {
-  PCM
+  PCM,
+  Int16,
+  Int24, // packed
+  Int32,
+  Float32
 };
 
+// Format for waveOut and WAV files. More than two channels or 16 bits need
+// WAVE_FORMAT_EXTENSIBLE; drivers may refuse or misplay them otherwise. Media
+// Foundation's audio subtypes are the KSDATAFORMAT subtypes the extension
+// names. A channelMask of 0 picks the usual layout for the channel count.
+
+inline WAVEFORMATEXTENSIBLE MakeWaveFormat( bool isFloat, uint32_t channels, uint32_t samplesPerSec,
+                                            uint32_t bitsPerSample, DWORD channelMask = 0 )
+{
+  WAVEFORMATEXTENSIBLE wfx = {};
+  wfx.Format.wFormatTag      = isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+  wfx.Format.nChannels       = static_cast<WORD>( channels );
+  wfx.Format.wBitsPerSample  = static_cast<WORD>( bitsPerSample );
+  wfx.Format.nSamplesPerSec  = samplesPerSec;
+  wfx.Format.nBlockAlign     = static_cast<WORD>( channels * bitsPerSample / 8 );
+  wfx.Format.nAvgBytesPerSec = wfx.Format.nSamplesPerSec * wfx.Format.nBlockAlign;
+  if( channels <= 2 && bitsPerSample <= 16 )
+    return wfx;
+
+  if( channelMask == 0 )
+  {
+    switch( channels )
+    {
+    case 1: channelMask = SPEAKER_FRONT_CENTER; break;
+    case 2: channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT; break;
+    case 4: channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT; break;
+    case 6: channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+                          SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT; break;
+    case 8: channelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+                          SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT; break;
+    default: break; // no particular speakers
+    }
+  }
+  wfx.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+  wfx.Format.cbSize = sizeof( WAVEFORMATEXTENSIBLE ) - sizeof( WAVEFORMATEX );
+  wfx.Samples.wValidBitsPerSample = static_cast<WORD>( bitsPerSample );
+  wfx.dwChannelMask = channelMask;
+  wfx.SubFormat = isFloat ? MFAudioFormat_Float : MFAudioFormat_PCM;
+  return wfx;
+}
+
+using WinMediaReadStatus = AsyncReadStatus; // shared with PcmAsyncReader
+
 class WinMediaSourceReader : public ComPtr< IMFSourceReader >
 {
 public:
 
-  explicit WinMediaSourceReader( const std::filesystem::path& songFile )
+  WinMediaSourceReader() = default; // see Open()
+
+  explicit WinMediaSourceReader( const std::filesystem::path& songFile, IMFAttributes* attributes = NULL )
+  {
+    HRESULT hr;
+    CHECK_HR( hr = Open( songFile, attributes ) );
+  }
+
+  // The methods that return a result rather than asserting are for files that
+  // may be missing or damaged, such as those picked by the user
+  HRESULT Open( const std::filesystem::path& songFile, IMFAttributes* attributes = NULL )
   {
     std::filesystem::path song = songFile;
     std::wstring songWide = song.make_preferred().generic_wstring();
-    HRESULT hr;
-    CHECK_HR( hr = MFCreateSourceReaderFromURL( songWide.c_str(), NULL, &( *this ) ) );
+    return MFCreateSourceReaderFromURL( songWide.c_str(), attributes, &( *this ) );
+  }
+
+  // False if the file has no such stream
+  bool SelectOnly( DWORD streamIndex )
+  {
+    return SUCCEEDED( Get()->SetStreamSelection( kAllStreams, FALSE ) ) &&
+           SUCCEEDED( Get()->SetStreamSelection( streamIndex, TRUE ) );
   }
 
   void SelectStream( DWORD streamIndex ) {
@@ -187,29 +365,113 @@ public:
     CHECK_HR( hr = Get()->SetCurrentMediaType( streamIndex, NULL, mediaType.Get() ) );
   }
 
-  void SelectOutput( DWORD streamIndex, WinMediaOutputType outputType )
+  // False if the stream can't be decoded to outputType
+  bool SelectOutput( DWORD streamIndex, WinMediaOutputType outputType )
   {
     WinMediaType mediaType;
     mediaType.SetGuid( MF_MT_MAJOR_TYPE, MFMediaType_Audio );
 
+    UINT32 bitsPerSample = 0; // decoder's choice
     switch( outputType )
     {
-    case WinMediaOutputType::PCM: mediaType.SetGuid( MF_MT_SUBTYPE, MFAudioFormat_PCM ); break;
+    case WinMediaOutputType::PCM:     break;
+    case WinMediaOutputType::Int16:   bitsPerSample = 16; break;
+    case WinMediaOutputType::Int24:   bitsPerSample = 24; break;
+    case WinMediaOutputType::Int32:   bitsPerSample = 32; break;
+    case WinMediaOutputType::Float32: bitsPerSample = 32; break;
     default: assert( false ); break;
     }
+    bool isFloat = ( outputType == WinMediaOutputType::Float32 );
+    mediaType.SetGuid( MF_MT_SUBTYPE, isFloat ? MFAudioFormat_Float : MFAudioFormat_PCM );
+    if( bitsPerSample != 0 )
+      mediaType.SetUint32( MF_MT_AUDIO_BITS_PER_SAMPLE, bitsPerSample );
+
+    return SUCCEEDED( Get()->SetCurrentMediaType( streamIndex, NULL, mediaType.Get() ) );
+  }
+
+  // Format of the samples ReadSample() returns once an output type is selected;
+  // pass wfx.Format wherever a WAVEFORMATEX is wanted (see MakeWaveFormat())
+  WAVEFORMATEXTENSIBLE GetWaveFormat( DWORD streamIndex )
+  {
+    WAVEFORMATEXTENSIBLE wfx = {};
+    [[maybe_unused]] bool hasFormat = GetWaveFormat( streamIndex, wfx );
+    assert( hasFormat );
+    return wfx;
+  }
+
+  // False if the output type is incomplete
+  bool GetWaveFormat( DWORD streamIndex, WAVEFORMATEXTENSIBLE& wfx )
+  {
+    ComPtr<IMFMediaType> mediaType;
+    if( FAILED( Get()->GetCurrentMediaType( streamIndex, &mediaType ) ) )
+      return false;
+    GUID subtype = {};
+    UINT32 channels = 0;
+    UINT32 samplesPerSec = 0;
+    UINT32 bitsPerSample = 0;
+    if( FAILED( mediaType->GetUINT32( MF_MT_AUDIO_NUM_CHANNELS, &channels ) ) ||
+        FAILED( mediaType->GetUINT32( MF_MT_AUDIO_SAMPLES_PER_SECOND, &samplesPerSec ) ) ||
+        FAILED( mediaType->GetUINT32( MF_MT_AUDIO_BITS_PER_SAMPLE, &bitsPerSample ) ) ||
+        FAILED( mediaType->GetGUID( MF_MT_SUBTYPE, &subtype ) ) )
+      return false;
+    UINT32 channelMask = 0;
+    if( FAILED( mediaType->GetUINT32( MF_MT_AUDIO_CHANNEL_MASK, &channelMask ) ) ) // optional
+      channelMask = 0;
+    wfx = MakeWaveFormat( subtype == MFAudioFormat_Float, channels, samplesPerSec, bitsPerSample, channelMask );
+    return true;
+  }
 
-    SetCurrentMediaType( streamIndex, mediaType );
+  // Format as stored in the file. Compressed formats have no bit depth, so
+  // bitsPerSample is 0 for those. False if the file has no such stream.
+  bool GetNativeFormat( DWORD streamIndex, uint32_t& samplesPerSec, uint32_t& channels, uint32_t& bitsPerSample )
+  {
+    ComPtr<IMFMediaType> mediaType;
+    UINT32 rate = 0;
+    UINT32 channelCount = 0;
+    if( FAILED( Get()->GetNativeMediaType( streamIndex, 0, &mediaType ) ) ||
+        FAILED( mediaType->GetUINT32( MF_MT_AUDIO_SAMPLES_PER_SECOND, &rate ) ) ||
+        FAILED( mediaType->GetUINT32( MF_MT_AUDIO_NUM_CHANNELS, &channelCount ) ) )
+      return false;
+    samplesPerSec = rate;
+    channels = channelCount;
+    UINT32 bits = 0;
+    HRESULT hr = mediaType->GetUINT32( MF_MT_AUDIO_BITS_PER_SAMPLE, &bits ); // optional
+    bitsPerSample = SUCCEEDED( hr ) ? bits : 0;
+    return true;
+  }
+
+  // Duration from the media source, without building a presentation descriptor;
+  // 0 if the source doesn't know it, as for some streams
+  uint64_t GetDurationInMilliseconds()
+  {
+    PROPVARIANT duration;
+    PropVariantInit( &duration );
+    HRESULT hr = Get()->GetPresentationAttribute( MF_SOURCE_READER_MEDIASOURCE, MF_PD_DURATION, &duration );
+    uint64_t milliSeconds = SUCCEEDED( hr ) ? duration.uhVal.QuadPart / 10000 : 0; // 100-nanosecond units
+    PropVariantClear( &duration );
+    return milliSeconds;
   }
 
-  bool ReadSample( DWORD streamIndex, WinMediaSample& mediaSample ) // false if end of stream
+  // False at end of stream, and on a decode error, which ends the stream
+  bool ReadSample( DWORD streamIndex, WinMediaSample& mediaSample )
   {
     HRESULT hr = 0;
     DWORD controlFlags = 0;
     DWORD streamFlags = 0;
-    IMFSample* pSample = NULL;
-    CHECK_HR( hr = Get()->ReadSample( streamIndex, controlFlags, NULL, &streamFlags, NULL, &pSample ) );
-    mediaSample = pSample;
-    assert( !( streamFlags & MF_SOURCE_READERF_ERROR ) );
+    // The reader returns the sample with a reference we take over; any
+    // previous sample is released first, so a reused mediaSample doesn't leak
+    {
+      AudioMetricTimer decodeTimer( AudioMetric::DecodeTime );
+      hr = Get()->ReadSample( streamIndex, controlFlags, NULL, &streamFlags, NULL,
+                              mediaSample.ReleaseAndGetAddressOf() );
+    }
+    if( FAILED( hr ) || ( streamFlags & MF_SOURCE_READERF_ERROR ) )
+    {
+      mediaSample.Reset();
+      return false;
+    }
+    if( mediaSample.Get() != nullptr )
+      GetAudioMetrics().Add( AudioCounter::SamplesDecoded );
     assert( !( streamFlags & MF_SOURCE_READERF_NEWSTREAM ) );
     assert( !( streamFlags & MF_SOURCE_READERF_NATIVEMEDIATYPECHANGED ) );
     assert( !( streamFlags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED ) );
@@ -219,6 +481,29 @@ public:
     return !( streamFlags & MF_SOURCE_READERF_ENDOFSTREAM );
   }
 
+  // As ReadSample(), but a decode error or a change of stream or format fails
+  // the read. mediaSample is null at end of stream and for a gap in the stream.
+  HRESULT TryReadSample( DWORD streamIndex, WinMediaSample& mediaSample, bool& isEndOfStream )
+  {
+    HRESULT hr = 0;
+    DWORD streamFlags = 0;
+    {
+      AudioMetricTimer decodeTimer( AudioMetric::DecodeTime );
+      hr = Get()->ReadSample( streamIndex, 0, NULL, &streamFlags, NULL, mediaSample.ReleaseAndGetAddressOf() );
+    }
+    if( FAILED( hr ) )
+      return hr;
+    if( streamFlags & MF_SOURCE_READERF_ERROR )
+      return E_FAIL;
+    if( streamFlags & ( MF_SOURCE_READERF_NEWSTREAM | MF_SOURCE_READERF_NATIVEMEDIATYPECHANGED |
+                        MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED ) )
+      return MF_E_INVALIDMEDIATYPE;
+    if( mediaSample.Get() != nullptr )
+      GetAudioMetrics().Add( AudioCounter::SamplesDecoded );
+    isEndOfStream = ( streamFlags & MF_SOURCE_READERF_ENDOFSTREAM ) != 0;
+    return S_OK;
+  }
+
 private:
 
   void SetStreamSelection( DWORD streamIndex, BOOL enabled )
@@ -228,6 +513,349 @@ private:
   }
 };
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// Attributes for creating Media Foundation objects
+
+class WinMediaAttributes : public ComPtr< IMFAttributes >
+{
+public:
+
+  explicit WinMediaAttributes( uint32_t initialSize = 1 )
+  {
+    HRESULT hr;
+    CHECK_HR( hr = MFCreateAttributes( &( *this ), initialSize ) );
+  }
+
+  void SetUnknown( const GUID& key, IUnknown* value )
+  {
+    HRESULT hr;
+    CHECK_HR( hr = Get()->SetUnknown( key, value ) );
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Receives decoded samples from a source reader created in asynchronous mode
+// (MF_SOURCE_READER_ASYNC_CALLBACK) and keeps up to samplesInFlight of them
+// requested or waiting to be read. Callbacks arrive on a Media Foundation
+// work queue thread. A decode error ends the stream. Use through
+// WinMediaAsyncSourceReader.
+
+class WinMediaReadCallback : public IMFSourceReaderCallback
+{
+public:
+
+  explicit WinMediaReadCallback( size_t samplesInFlight )
+    :
+    samplesInFlight_( samplesInFlight )
+  {
+    assert( samplesInFlight_ > 0 );
+  }
+
+  // Disable copy/move
+  WinMediaReadCallback( const WinMediaReadCallback& ) = delete;
+  WinMediaReadCallback& operator=( const WinMediaReadCallback& ) = delete;
+  WinMediaReadCallback( WinMediaReadCallback&& ) = delete;
+  WinMediaReadCallback& operator=( WinMediaReadCallback&& ) = delete;
+
+  // The reader holds a reference to this callback, and this one to the
+  // reader until Stop()
+  void Start( IMFSourceReader* sourceReader, DWORD streamIndex )
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      assert( sourceReader_.Get() == nullptr );
+      sourceReader_ = sourceReader;
+      streamIndex_ = streamIndex;
+    }
+    RequestSamples();
+  }
+
+  // Cancels outstanding requests and waits until the reader acknowledges
+  void Stop()
+  {
+    ComPtr<IMFSourceReader> sourceReader;
+    DWORD streamIndex = 0;
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      if( sourceReader_.Get() == nullptr )
+        return;
+      sourceReader = std::move( sourceReader_ ); // RequestSamples() asks for no more
+      streamIndex = streamIndex_;
+      isFlushed_ = false;
+    }
+
+    // Flush without the lock held; like ReadSample() (see RequestSamples()),
+    // the reader may take its own lock while invoking OnReadSample(), which
+    // takes ours
+    HRESULT hr;
+    CHECK_HR( hr = sourceReader->Flush( streamIndex ) );
+
+    std::unique_lock<std::mutex> lock( mutex_ );
+    if( SUCCEEDED( hr ) )
+      flushed_.wait( lock, [this] { return isFlushed_; } );
+    requested_ = 0;
+    ready_.clear();
+    promises_.clear(); // waiting futures see broken_promise
+  }
+
+  WinMediaReadStatus TryRead( WinMediaSample& mediaSample )
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      assert( promises_.empty() ); // ReadAsync() results would arrive out of order
+      if( ready_.empty() )
+        return isEnded_ ? WinMediaReadStatus::EndOfStream : WinMediaReadStatus::Pending;
+      mediaSample = std::move( ready_.front() );
+      ready_.pop_front();
+    }
+    RequestSamples();
+    return WinMediaReadStatus::Ready;
+  }
+
+  // The sample is null at end of stream
+  std::future<WinMediaSample> ReadAsync()
+  {
+    std::promise<WinMediaSample> promise;
+    auto result = promise.get_future();
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      if( ready_.empty() && !isEnded_ )
+      {
+        promises_.push_back( std::move( promise ) );
+        return result;
+      }
+      if( ready_.empty() )
+      {
+        promise.set_value( WinMediaSample() );
+        return result;
+      }
+      promise.set_value( std::move( ready_.front() ) );
+      ready_.pop_front();
+    }
+    RequestSamples();
+    return result;
+  }
+
+  // IUnknown
+  HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv ) override
+  {
+    if( ppv == nullptr )
+      return E_POINTER;
+    if( iid == __uuidof( IUnknown ) || iid == __uuidof( IMFSourceReaderCallback ) )
+    {
+      *ppv = static_cast<IMFSourceReaderCallback*>( this );
+      AddRef();
+      return S_OK;
+    }
+    *ppv = nullptr;
+    return E_NOINTERFACE;
+  }
+
+  // Starts at zero; the owning ComPtr takes the first reference
+  ULONG STDMETHODCALLTYPE AddRef() override
+  {
+    return ++refCount_;
+  }
+
+  ULONG STDMETHODCALLTYPE Release() override
+  {
+    auto refCount = --refCount_;
+    if( refCount == 0 )
+      delete this;
+    return refCount;
+  }
+
+  // IMFSourceReaderCallback
+  HRESULT STDMETHODCALLTYPE OnReadSample( HRESULT hrStatus, DWORD, DWORD streamFlags, LONGLONG,
+                                          IMFSample* pSample ) override
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      if( requested_ > 0 )
+        --requested_;
+
+      // A null sample without end of stream is a stream tick or gap; RequestSamples() asks again
+      if( pSample != nullptr )
+      {
+        GetAudioMetrics().Add( AudioCounter::SamplesDecoded );
+        WinMediaSample mediaSample;
+        mediaSample = pSample; // borrowed from the reader; takes our own reference
+        if( promises_.empty() )
+          ready_.push_back( std::move( mediaSample ) );
+        else
+          Fulfill( std::move( mediaSample ) );
+      }
+      if( FAILED( hrStatus ) || ( streamFlags & ( MF_SOURCE_READERF_ERROR | MF_SOURCE_READERF_ENDOFSTREAM ) ) )
+      {
+        isEnded_ = true;
+        while( !promises_.empty() )
+          Fulfill( WinMediaSample() );
+      }
+    }
+    RequestSamples();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnFlush( DWORD ) override
+  {
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      isFlushed_ = true;
+    }
+    flushed_.notify_all();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnEvent( DWORD, IMFMediaEvent* ) override
+  {
+    return S_OK;
+  }
+
+private:
+
+  virtual ~WinMediaReadCallback() = default; // see Release()
+
+  void Fulfill( WinMediaSample mediaSample )
+  {
+    promises_.front().set_value( std::move( mediaSample ) );
+    promises_.pop_front();
+  }
+
+  // Tops up outstanding requests so that requested plus unread samples
+  // equals samplesInFlight. Called without the lock held, since the reader
+  // may take its own lock while invoking OnReadSample().
+  // The reference taken under the lock keeps the reader alive should Stop()
+  // and the owner's destructor run meanwhile.
+  void RequestSamples()
+  {
+    ComPtr<IMFSourceReader> sourceReader;
+    DWORD streamIndex = 0;
+    size_t count = 0;
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      if( sourceReader_.Get() == nullptr || isEnded_ )
+        return;
+      auto inFlight = requested_ + ready_.size();
+      count = inFlight < samplesInFlight_ ? samplesInFlight_ - inFlight : 0;
+      requested_ += count;
+      sourceReader = sourceReader_;
+      streamIndex = streamIndex_;
+    }
+    for( ; count; --count )
+    {
+      // In asynchronous mode the output parameters must be NULL. A request
+      // the reader refuses won't be answered, so the stream ends there.
+      if( FAILED( sourceReader->ReadSample( streamIndex, 0, NULL, NULL, NULL, NULL ) ) )
+      {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        requested_ -= count;
+        if( sourceReader_.Get() != nullptr )
+        {
+          isEnded_ = true;
+          while( !promises_.empty() )
+            Fulfill( WinMediaSample() );
+        }
+        return;
+      }
+    }
+  }
+
+private:
+  std::mutex                                mutex_;
+  std::condition_variable                   flushed_;
+  std::deque<WinMediaSample>                ready_;    // in decode order
+  std::deque<std::promise<WinMediaSample>>  promises_; // from ReadAsync(), oldest first
+  std::atomic<ULONG>                        refCount_ = 0;
+  ComPtr<IMFSourceReader>                   sourceReader_; // until Stop()
+  size_t                                    samplesInFlight_;
+  size_t                                    requested_ = 0;
+  DWORD                                     streamIndex_ = 0;
+  bool                                      isEnded_ = false;
+  bool                                      isFlushed_ = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Source reader that decodes ahead on Media Foundation's threads, so decoding
+// overlaps whatever the caller does with each sample. Select the stream and
+// output type, then Start(); samples are read with the non-blocking TryRead()
+// or with ReadAsync(), whose future can be waited on or polled. Don't mix the
+// two while a ReadAsync() is outstanding. PcmAsyncReader (PcmAsyncReader.h)
+// does the same on a thread of its own for any PcmSource.
+
+class WinMediaAsyncSourceReader
+{
+public:
+
+  explicit WinMediaAsyncSourceReader( const std::filesystem::path& songFile, size_t samplesInFlight = 4 )
+    :
+    callback_( new WinMediaReadCallback( samplesInFlight ) ),
+    sourceReader_( songFile, CreateAttributes( callback_ ) )
+  {
+  }
+
+  // Disable copy/move
+  WinMediaAsyncSourceReader( const WinMediaAsyncSourceReader& ) = delete;
+  WinMediaAsyncSourceReader& operator=( const WinMediaAsyncSourceReader& ) = delete;
+  WinMediaAsyncSourceReader( WinMediaAsyncSourceReader&& ) = delete;
+  WinMediaAsyncSourceReader& operator=( WinMediaAsyncSourceReader&& ) = delete;
+
+  ~WinMediaAsyncSourceReader()
+  {
+    callback_->Stop();
+  }
+
+  void SelectStream( DWORD streamIndex ) {
+    sourceReader_.SelectStream( streamIndex );
+  }
+  void UnselectStream( DWORD streamIndex ) {
+    sourceReader_.UnselectStream( streamIndex );
+  }
+
+  bool SelectOutput( DWORD streamIndex, WinMediaOutputType outputType )
+  {
+    return sourceReader_.SelectOutput( streamIndex, outputType );
+  }
+
+  // Begins decoding ahead; call once the output type is selected
+  void Start( DWORD streamIndex )
+  {
+    callback_->Start( sourceReader_.Get(), streamIndex );
+  }
+
+  // Cancels decoding ahead and discards what was decoded; waiting futures
+  // see broken_promise
+  void Stop()
+  {
+    callback_->Stop();
+  }
+
+  WinMediaReadStatus TryRead( WinMediaSample& mediaSample )
+  {
+    return callback_->TryRead( mediaSample );
+  }
+
+  std::future<WinMediaSample> ReadAsync() // null sample at end of stream
+  {
+    return callback_->ReadAsync();
+  }
+
+private:
+
+  static WinMediaAttributes CreateAttributes( WinMediaReadCallback* callback )
+  {
+    WinMediaAttributes attributes;
+    attributes.SetUnknown( MF_SOURCE_READER_ASYNC_CALLBACK, callback );
+    return attributes;
+  }
+
+private:
+  ComPtr<WinMediaReadCallback> callback_;
+  WinMediaSourceReader         sourceReader_;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 class WinMediaSourceResolver : public ComPtr< IMFSourceResolver >
@@ -254,7 +882,8 @@ public:
     MF_OBJECT_TYPE ObjectType = MF_OBJECT_INVALID;
     HRESULT hr;
     CHECK_HR( hr = sourceResolver->CreateObjectFromURL( songWide.c_str(), MF_RESOLUTION_MEDIASOURCE, NULL, &ObjectType, &pSource_ ) );
-    CHECK_HR( hr = pSource_->QueryInterface( __uuidof( IMFMediaSource ), (void**)&( *this ) ) );
+    Attach( pSource_.As<IMFMediaSource>().Detach() );
+    assert( Get() != nullptr );
   }
 
 private:
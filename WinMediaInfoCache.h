@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinMediaInfoCache.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "MediaInfoCache.h"
+#include "WinMappedFile.h"
+#include "WinMediaProbe.h"
+
+#define NOMINMAX 1
+#include "Windows.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// MediaInfoCache backed by an index file. Construction maps the index; each
+// GetMediaInfo() costs one file attribute query plus a hash lookup, and only
+// new or changed files are probed. Save() writes a new index beside the old
+// one and swaps it in, so a crash never leaves a partial index. Thread-safe.
+//
+// Typical use:
+//
+//    WinMediaInfoCache mediaInfoCache( appDataDir / "media.idx" );
+//    for( const auto& file : library )
+//      if( mediaInfoCache.GetMediaInfo( file, info ) ) ...
+//    mediaInfoCache.RemoveMissing(); // now and then; checks every cached file
+//    mediaInfoCache.Save();
+
+class WinMediaInfoCache
+{
+public:
+
+  explicit WinMediaInfoCache( const std::filesystem::path& indexFile )
+    :
+    indexPath_( indexFile )
+  {
+    LoadIndex();
+  }
+
+  // Disable copy/move
+  WinMediaInfoCache( const WinMediaInfoCache& ) = delete;
+  WinMediaInfoCache& operator=( const WinMediaInfoCache& ) = delete;
+  WinMediaInfoCache( WinMediaInfoCache&& ) = delete;
+  WinMediaInfoCache& operator=( WinMediaInfoCache&& ) = delete;
+
+  // Probes the file if it isn't cached or has changed (see ProbeMedia())
+  bool GetMediaInfo( const std::filesystem::path& file, MediaInfo& info )
+  {
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    if( !GetFileStamp( file, fileSize, modifiedTime ) )
+      return false;
+
+    auto u8Path = file.generic_u8string();
+    std::string_view path( reinterpret_cast<const char*>( u8Path.data() ), u8Path.size() );
+    {
+      std::shared_lock<std::shared_mutex> lock( mutex_ );
+      if( mediaInfoCache_.Find( path, fileSize, modifiedTime, info ) )
+        return true;
+    }
+
+    // Probing can take as long as opening a media source, so it runs unlocked;
+    // holding even the shared lock would stall Save(), and lookups queued
+    // behind it. Two threads probing the same file both insert the same info.
+    if( !ProbeMedia( file, info ) )
+      return false;
+    std::shared_lock<std::shared_mutex> lock( mutex_ );
+    mediaInfoCache_.Insert( path, fileSize, modifiedTime, info );
+    return true;
+  }
+
+  // Drops the entries of files that no longer exist, so the index doesn't
+  // grow forever; returns how many. The files are checked unlocked.
+  size_t RemoveMissing()
+  {
+    std::vector<std::string> paths;
+    {
+      std::shared_lock<std::shared_mutex> lock( mutex_ );
+      paths = mediaInfoCache_.GetPaths();
+    }
+    std::vector<std::string> missing;
+    for( auto& path : paths )
+    {
+      std::u8string u8Path( path.begin(), path.end() );
+      std::error_code error;
+      if( !std::filesystem::exists( std::filesystem::path( u8Path ), error ) && !error )
+        missing.push_back( std::move( path ) );
+    }
+
+    std::shared_lock<std::shared_mutex> lock( mutex_ );
+    for( const auto& path : missing )
+      mediaInfoCache_.Remove( path );
+    return missing.size();
+  }
+
+  // Writes the index if anything was added; false if it couldn't be replaced,
+  // for example because another process has it open, in which case the
+  // additions are kept for the next attempt
+  bool Save()
+  {
+    std::unique_lock<std::shared_mutex> lock( mutex_ );
+    if( !mediaInfoCache_.IsModified() )
+      return true;
+
+    auto tempFile = indexPath_;
+    tempFile += ".tmp";
+    {
+      auto image = mediaInfoCache_.Serialize();
+      std::ofstream stream( tempFile, std::ios::binary | std::ios::trunc );
+      stream.write( reinterpret_cast<const char*>( image.data() ), static_cast<std::streamsize>( image.size() ) );
+      if( !stream.flush() )
+        return false;
+    }
+
+    // The old index can't be replaced while this process has it mapped
+    mediaInfoCache_.Load( nullptr, 0 );
+    mappedIndex_.Close();
+    bool isReplaced = ::MoveFileExW( tempFile.c_str(), indexPath_.c_str(), MOVEFILE_REPLACE_EXISTING );
+    if( isReplaced )
+      mediaInfoCache_.Clear(); // additions are now in the index
+    LoadIndex();
+    return isReplaced;
+  }
+
+private:
+
+  void LoadIndex()
+  {
+    if( mappedIndex_.Open( indexPath_, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS ) )
+      mediaInfoCache_.Load( mappedIndex_.GetData(), static_cast<size_t>( mappedIndex_.GetSize() ) );
+  }
+
+  static bool GetFileStamp( const std::filesystem::path& file, uint64_t& fileSize, int64_t& modifiedTime )
+  {
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+    if( !::GetFileAttributesExW( file.c_str(), GetFileExInfoStandard, &attributes ) )
+      return false;
+    fileSize = ( uint64_t( attributes.nFileSizeHigh ) << 32 ) | attributes.nFileSizeLow;
+    modifiedTime = static_cast<int64_t>( ( uint64_t( attributes.ftLastWriteTime.dwHighDateTime ) << 32 ) |
+                                         attributes.ftLastWriteTime.dwLowDateTime );
+    return true;
+  }
+
+private:
+  std::filesystem::path     indexPath_;
+  WinMappedFile             mappedIndex_;
+  MediaInfoCache            mediaInfoCache_;
+  std::shared_mutex         mutex_; // exclusive only while Save() swaps the index
+
+}; // class WinMediaInfoCache
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinMediaProbe.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <filesystem>
+
+#include "MediaProbe.h"
+#include "WinMediaFoundation.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Duration and format of any file Media Foundation can play. Common formats
+// are parsed directly from their headers (see MediaProbe.h), which is far
+// cheaper than resolving a media source. Other formats fall back to a source
+// reader, which requires Media Foundation to be initialized on this thread
+// (see WinMediaFoundation).
+
+inline bool ProbeMedia( const std::filesystem::path& file, MediaInfo& info )
+{
+  if( ProbeMediaHeaders( file, info ) )
+    return true;
+
+  info = {};
+  // Files Media Foundation can't open, or that have no audio, are not media
+  // files; that's an answer, not an error
+  WinMediaSourceReader sourceReader;
+  if( FAILED( sourceReader.Open( file ) ) ||
+      !sourceReader.GetNativeFormat( kFirstAudioStream, info.samplesPerSec, info.channels, info.bitsPerSample ) )
+  {
+    info = {};
+    return false;
+  }
+  info.durationMs = sourceReader.GetDurationInMilliseconds();
+  return true;
+}
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinPcmPipeline.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+#include "PcmPipeline.h"
+#include "WinMediaFoundation.h"
+#include "WinWaveStream.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+
+inline WAVEFORMATEXTENSIBLE ToWaveFormat( const PcmStreamFormat& format )
+{
+  return MakeWaveFormat( format.sampleFormat == SampleFormat::Float32, format.channelCount, format.samplesPerSec,
+                         static_cast<uint32_t>( GetBytesPerSample( format.sampleFormat ) * 8 ) );
+}
+
+// False if wfx isn't 16/24/32-bit integer or 32-bit float PCM
+inline bool ToPcmStreamFormat( const WAVEFORMATEXTENSIBLE& wfxe, PcmStreamFormat& format )
+{
+  const auto& wfx = wfxe.Format;
+  bool isFloat = ( wfx.wFormatTag == WAVE_FORMAT_IEEE_FLOAT );
+  bool isPcm = ( wfx.wFormatTag == WAVE_FORMAT_PCM );
+  if( wfx.wFormatTag == WAVE_FORMAT_EXTENSIBLE )
+  {
+    isFloat = ( wfxe.SubFormat == MFAudioFormat_Float );
+    isPcm = ( wfxe.SubFormat == MFAudioFormat_PCM );
+    if( wfxe.Samples.wValidBitsPerSample != wfx.wBitsPerSample ) // e.g. 20 bits in 24
+      return false;
+  }
+  if( !isFloat && !isPcm )
+    return false;
+  switch( wfx.wBitsPerSample )
+  {
+  case 16: format.sampleFormat = SampleFormat::Int16; break;
+  case 24: format.sampleFormat = SampleFormat::Int24; break;
+  case 32: format.sampleFormat = isFloat ? SampleFormat::Float32 : SampleFormat::Int32; break;
+  default: return false;
+  }
+  if( isFloat && wfx.wBitsPerSample != 32 )
+    return false;
+  format.channelCount = wfx.nChannels;
+  format.samplesPerSec = wfx.nSamplesPerSec;
+  return format.channelCount != 0 && format.GetBlockAlign() == wfx.nBlockAlign;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Decodes the first audio stream of a file with Media Foundation. Pipeline
+// workers don't initialize COM; keep a WinMediaFoundation alive on the
+// thread that opens the source, and the workers use its multithreaded
+// apartment. Samples made of several buffers are gathered through a
+// WinMediaBufferPool, so steady-state decoding doesn't allocate.
+
+class WinMediaPcmSource : public PcmSource
+{
+public:
+  WinMediaPcmSource() = default;
+
+  // False if the file can't be opened or decoded to outputType
+  bool Open( const std::filesystem::path& file, WinMediaOutputType outputType = WinMediaOutputType::Float32 )
+  {
+    pcmBuffer_.reset();
+    offset_ = 0;
+    isEnded_ = false;
+    sourceReader_ = std::make_unique<WinMediaSourceReader>( file );
+    if( sourceReader_->Get() == nullptr )
+      return false;
+    sourceReader_->UnselectStream( kAllStreams );
+    sourceReader_->SelectStream( kFirstAudioStream );
+    if( !sourceReader_->SelectOutput( kFirstAudioStream, outputType ) )
+      return false;
+    return ToPcmStreamFormat( sourceReader_->GetWaveFormat( kFirstAudioStream ), format_ );
+  }
+
+  PcmStreamFormat GetFormat() const override
+  {
+    return format_;
+  }
+
+  size_t Read( void* out, size_t maxFrames ) override
+  {
+    assert( sourceReader_ );
+    auto* dst = static_cast<uint8_t*>( out );
+    auto bytes = maxFrames * format_.GetBlockAlign();
+    size_t written = 0;
+    while( written < bytes )
+    {
+      if( !pcmBuffer_ || offset_ == pcmBuffer_->GetSize() )
+      {
+        pcmBuffer_.reset();
+        offset_ = 0;
+        if( isEnded_ || !sourceReader_->ReadSample( kFirstAudioStream, mediaSample_ ) )
+        {
+          isEnded_ = true;
+          break;
+        }
+        if( mediaSample_.Get() != nullptr ) // null for a stream tick
+          pcmBuffer_.emplace( mediaSample_, bufferPool_ );
+        continue;
+      }
+      auto copyBytes = std::min( bytes - written, pcmBuffer_->GetSize() - offset_ );
+      std::memcpy( dst + written, pcmBuffer_->GetData() + offset_, copyBytes );
+      written += copyBytes;
+      offset_ += copyBytes;
+    }
+    return written / format_.GetBlockAlign(); // samples hold whole frames
+  }
+
+private:
+  std::unique_ptr<WinMediaSourceReader> sourceReader_;
+  WinMediaSample                        mediaSample_;
+  WinMediaBufferPool                    bufferPool_;
+  std::optional<WinMediaPcmBuffer>      pcmBuffer_; // current sample, locked
+  size_t                                offset_ = 0;
+  PcmStreamFormat                       format_;
+  bool                                  isEnded_ = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Plays through a WinWaveStream, which the sink opens in the pipeline's
+// output format with a ring of ringBytes. The app drives the consumer side
+// as usual: Prepare() once enough is buffered, Start(), and Update() when
+// hEvent is signalled. The ring filling up is what holds the pipeline back.
+
+class WinWaveStreamPcmSink : public PcmSink
+{
+public:
+  WinWaveStreamPcmSink( WinWaveStream& stream, HANDLE hEvent, size_t ringBytes )
+    : stream_( stream ),
+      hEvent_( hEvent ),
+      ringBytes_( ringBytes )
+  {
+  }
+
+  bool Open( const PcmStreamFormat& format ) override
+  {
+    blockAlign_ = format.GetBlockAlign();
+    carryBytes_ = 0;
+    return stream_.Open( ToWaveFormat( format ).Format, hEvent_, ringBytes_ );
+  }
+
+  // The ring takes bytes, not frames; a frame it takes only part of is
+  // finished on the next call, which offers the same frame again
+  size_t Write( const void* pcm, size_t frameCount ) override
+  {
+    assert( frameCount > 0 );
+    auto* bytes = static_cast<const uint8_t*>( pcm );
+    auto written = carryBytes_ + stream_.Write( bytes + carryBytes_, frameCount * blockAlign_ - carryBytes_ );
+    carryBytes_ = written % blockAlign_;
+    return written / blockAlign_;
+  }
+
+  void SetEndOfStream() override
+  {
+    stream_.SetEndOfStream();
+  }
+
+private:
+  WinWaveStream& stream_;
+  HANDLE         hEvent_;
+  size_t         ringBytes_;
+  size_t         blockAlign_ = 1;
+  size_t         carryBytes_ = 0; // of the first frame offered next
+};
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
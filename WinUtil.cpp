@@ -14,7 +14,6 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-#pragma once
 
 #include <cassert>
 #include <string>
@@ -22,6 +21,7 @@
 
 #define NOMINMAX 1
 #include "Windows.h"
+#include "RegistryBackend.h"
 #include "WinFileOpen.h"
 #include "Util.h"
 
@@ -47,10 +47,14 @@ void DebugBreak()
 // 
 // Currently assumes HKEY_LOCAL_MACHINE; if different keys required need to
 // define platform-specific enum as new first param. Assume REG_SZ string value.
+// An installed RegistryBackend answers instead (see RegistryBackend.h).
 
 std::string GetRegistryValue( const std::string& registryPath, 
                               const std::string& registryEntry )
 {
+  if( const auto& registryBackend = GetRegistryBackend() )
+    return registryBackend( registryPath, registryEntry );
+
   HKEY registryKey = NULL;
   DWORD optionsDefault = 0;
   REGSAM accessRights = KEY_QUERY_VALUE;
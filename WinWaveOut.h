@@ -16,24 +16,33 @@
 
 #pragma once
 #include <cassert>
+#include <memory>
 #include <utility>
 
-// Windows-specific
+#include "AudioMetrics.h"
+#include "WaveSink.h"
+
+#if defined( _WIN32 )
 #define NOMINMAX 1
 #include "windows.h"
 #include "mmeapi.h"
 #pragma comment(lib, "winmm.lib")
+#else
+#include "NullWaveSink.h"
+#endif
 
 namespace PKIsensee
 {
 
+#if defined( _WIN32 )
+
 #ifdef _DEBUG
 #define CHECK_MM(mm) assert( (mm) == MMSYSERR_NOERROR );
 #else
 #define CHECK_MM(mm) static_cast<void>(mm);
 #endif
 
-class WinWaveOut
+class WinWaveOut : public WaveSink
 {
   static constexpr uint32_t kVolChannelBits = ( sizeof( uint16_t ) * CHAR_BIT );  // 16
   static constexpr uint32_t kVolChannelLeftMask = ~( ( -1 ) << kVolChannelBits ); // 0x0000FFFF
@@ -47,20 +56,20 @@ public:
   WinWaveOut( WinWaveOut&& ) = delete;
   WinWaveOut& operator=( WinWaveOut&& ) = delete;
 
-  ~WinWaveOut()
+  ~WinWaveOut() override
   {
     Reset();
     Close();
   }
 
-  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent )
+  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent ) override
   {
     assert( waveOutHandle_ == NULL );
     CHECK_MM( mm_ = ::waveOutOpen( &waveOutHandle_, WAVE_MAPPER, &wfx, (DWORD_PTR)( hEvent ), NULL, CALLBACK_EVENT ) );
     return mm_ == MMSYSERR_NOERROR;
   }
 
-  void Prepare( WAVEHDR& wh )
+  void Prepare( WAVEHDR& wh ) override
   {
     if( wh.dwFlags & WHDR_PREPARED )
       Unprepare( wh );
@@ -72,21 +81,23 @@ public:
     assert( wh.dwFlags & WHDR_PREPARED );
   }
 
-  void Unprepare( WAVEHDR& wh )
+  void Unprepare( WAVEHDR& wh ) override
   {
     // Tell the OS to remove the reference to the memory pages
     assert( waveOutHandle_ != NULL );
     CHECK_MM( mm_ = ::waveOutUnprepareHeader( waveOutHandle_, &wh, sizeof( wh ) ) );
   }
 
-  void Write( WAVEHDR& wh )
+  void Write( WAVEHDR& wh ) override
   {
     // Send buffer to audio driver
     assert( waveOutHandle_ != NULL );
+    AudioMetricTimer writeTimer( AudioMetric::DeviceWriteTime );
     CHECK_MM( mm_ = ::waveOutWrite( waveOutHandle_, &wh, sizeof( wh ) ) );
+    GetAudioMetrics().Add( AudioCounter::BuffersWritten );
   }
 
-  uint32_t GetPositionBytes() const
+  uint32_t GetPositionBytes() const override
   {
     assert( waveOutHandle_ != NULL );
 
@@ -103,19 +114,19 @@ public:
     return bytes;
   }
 
-  WaveOut::Volume GetVolume() const
+  WaveVolume GetVolume() const override
   {
     assert( waveOutHandle_ != NULL );
     // Left channel is in the low WORD and right channel is in the high WORD
     DWORD vol = 0;
     CHECK_MM( mm_ = ::waveOutGetVolume( waveOutHandle_, &vol ) );
 
-    WaveOut::VolumeType leftChannel = vol & kVolChannelLeftMask;
-    WaveOut::VolumeType rightChannel = vol >> kVolChannelBits;
+    auto leftChannel = static_cast<uint16_t>( vol & kVolChannelLeftMask );
+    auto rightChannel = static_cast<uint16_t>( vol >> kVolChannelBits );
     return std::make_pair( leftChannel, rightChannel );
   }
 
-  void SetVolume( const WaveOut::Volume& volume )
+  void SetVolume( const WaveVolume& volume ) override
   {
     assert( waveOutHandle_ != NULL );
     auto leftChannel = volume.first;
@@ -128,13 +139,13 @@ public:
     CHECK_MM( mm_ = ::waveOutSetVolume( waveOutHandle_, vol ) );
   }
 
-  void Reset()
+  void Reset() override
   {
     if( waveOutHandle_ != NULL )
       CHECK_MM( mm_ = ::waveOutReset( waveOutHandle_ ) );
   }
 
-  void Close()
+  void Close() override
   {
     if( waveOutHandle_ != NULL )
     {
@@ -143,13 +154,13 @@ public:
     }
   }
 
-  void Restart()
+  void Restart() override
   {
     assert( waveOutHandle_ != NULL );
     CHECK_MM( mm_ = ::waveOutRestart( waveOutHandle_ ) );
   }
 
-  void Pause()
+  void Pause() override
   {
     assert( waveOutHandle_ != NULL );
     CHECK_MM( mm_ = ::waveOutPause( waveOutHandle_ ) );
@@ -160,6 +171,26 @@ private:
   mutable MMRESULT mm_ = MMSYSERR_NOERROR;
 };
 
+#endif // _WIN32
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The device used by WaveOut; winmm unless another factory has been installed.
+// Elsewhere there is no device to open, so audio plays into a real-time
+// NullWaveSink.
+
+inline std::unique_ptr<WaveSink> CreateWaveSink()
+{
+  const auto& waveSinkFactory = GetWaveSinkFactory();
+  if( waveSinkFactory )
+    return waveSinkFactory();
+#if defined( _WIN32 )
+  return std::make_unique<WinWaveOut>();
+#else
+  return std::make_unique<NullWaveSink>();
+#endif
+}
+
 } // namespace PKIsensee
 
 ///////////////////////////////////////////////////////////////////////////////
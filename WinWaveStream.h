@@ -0,0 +1,721 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  WinWaveStream.h
+//
+//  Copyright  Pete Isensee (PKIsensee@msn.com).
+//  All rights reserved worldwide.
+//
+//  Permission to copy, modify, reproduce or redistribute this source code is
+//  granted provided the above copyright notice is retained in the resulting 
+//  source code.
+// 
+//  This software is provided "as is" and without any express or implied
+//  warranties.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "PcmBufferChain.h"
+#include "PlaybackClock.h"
+#include "SpscRingBuffer.h"
+#include "WinWaveOut.h"
+
+namespace PKIsensee
+{
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Streaming PCM playback. Unlike WaveOut, which plays a fully decoded PcmData,
+// WinWaveStream is fed incrementally: a decoder thread (the producer) calls
+// Write() to push PCM into a lock-free ring buffer, and the thread waiting on
+// the callback event (the consumer) calls Update() to copy from the ring into
+// the WAVEHDR buffers owned by this object. Playback can begin as soon as the
+// ring holds a few hundred milliseconds, and memory is bounded by the ring.
+//
+// Typical use:
+//
+//    stream.Open( wfx, event.GetHandle(), ringBytes );
+//    // decoder thread: while( ... ) stream.Write( pcm, bytes ); stream.SetEndOfStream();
+//    // wait until stream.GetBufferedBytes() is large enough, then
+//    stream.Prepare( waveBufferCount, latencyMs );
+//    stream.Start();
+//    while( !stream.HasEnded() ) if( event.IsSignalled( timeout ) ) stream.Update();
+//
+// Playlists play gaplessly: the producer calls EndTrack() after writing each
+// track and continues straight into the next one, so WAVEHDRs are filled
+// across the boundary. The consumer learns when each track has finished via
+// GetEndedTrack(). If the next track has a different format, the new device is
+// opened on a helper thread while the current track plays out, and the old
+// one is closed on a helper thread, so Update() never waits on the driver. If
+// the new device isn't open by the time the old one has played out, Update()
+// returns and the helper thread signals the callback event once it is.
+//
+// Decoders that already hold PCM in memory they can give away, such as Media
+// Foundation samples (see WinMediaPcmBuffer), can skip the ring entirely: open
+// without a ring size and Write() PcmBuffers instead of bytes. Each WAVEHDR
+// then points straight into a PcmBuffer, which is released once the device
+// has returned every WAVEHDR that referenced it, so PCM is never copied.
+// PcmBuffers too small to fill half a WAVEHDR are the exception: they're
+// copied together into the WAVEHDR's own memory, so a decoder producing tiny
+// buffers doesn't cost a device round trip for each. Update() neither
+// allocates nor frees: released PcmBuffers go back to the producer, which
+// destroys them, and with them perhaps a locked Media Foundation sample, in
+// its next Write() or in FreePlayedBuffers().
+
+class WinWaveStream
+{
+  static constexpr size_t kMaxQueuedTracks = 64;
+  static constexpr size_t kMaxQueuedBuffers = 256;
+
+public:
+  explicit WinWaveStream( WaveSinkFactory waveSinkFactory = CreateWaveSink )
+    : waveSinkFactory_( std::move( waveSinkFactory ) ),
+      waveOut_( waveSinkFactory_() )
+  {
+    assert( waveOut_ );
+  }
+
+  // Disable copy/move
+  WinWaveStream( const WinWaveStream& ) = delete;
+  WinWaveStream& operator=( const WinWaveStream& ) = delete;
+  WinWaveStream( WinWaveStream&& ) = delete;
+  WinWaveStream& operator=( WinWaveStream&& ) = delete;
+
+  ~WinWaveStream()
+  {
+    Close();
+  }
+
+  // PCM is copied through a ring of ringBytes
+  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent, size_t ringBytes )
+  {
+    assert( ringBytes >= wfx.nBlockAlign );
+    Close();
+    ring_ = std::make_unique<SpscRingBuffer<uint8_t>>( ringBytes );
+    return OpenDevice( wfx, hEvent );
+  }
+
+  // PCM is played in place from the PcmBuffers passed to Write()
+  bool Open( const WAVEFORMATEX& wfx, HANDLE hEvent )
+  {
+    Close();
+    bufferQueue_ = std::make_unique<SpscRingBuffer<PcmBuffer*>>( kMaxQueuedBuffers );
+    playedBuffers_ = std::make_unique<SpscRingBuffer<PcmBuffer*>>( kMaxQueuedBuffers );
+    bufferChain_.Reserve( kMaxQueuedBuffers );
+    return OpenDevice( wfx, hEvent );
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  //
+  // Producer side; may be called from any single thread other than the consumer
+
+  // Returns number of bytes accepted; if less than bytes, the ring is full
+  size_t Write( const uint8_t* pcm, size_t bytes )
+  {
+    assert( ring_ );
+    auto written = ring_->Write( pcm, bytes );
+    bytesWritten_ += written;
+    if( written )
+      WakeConsumer();
+    return written;
+  }
+
+  // Takes ownership of pcmBuffer, which must hold whole sample frames. Returns
+  // false, leaving pcmBuffer untouched, if too many buffers are in flight.
+  bool Write( std::unique_ptr<PcmBuffer>&& pcmBuffer )
+  {
+    assert( bufferQueue_ );
+    assert( pcmBuffer );
+    FreePlayedBuffers();
+    if( buffersInFlight_ == kMaxQueuedBuffers )
+      return false;
+    auto bytes = pcmBuffer->GetSize();
+    auto* queued = pcmBuffer.get();
+    [[maybe_unused]] auto written = bufferQueue_->Write( &queued, 1 );
+    assert( written == 1 ); // no more are in flight than the queue holds
+    pcmBuffer.release(); // now owned by the consumer
+    ++buffersInFlight_;
+    bytesWritten_ += bytes;
+    queuedBytes_.fetch_add( bytes, std::memory_order_release );
+    WakeConsumer();
+    return true;
+  }
+
+  // Destroys the PcmBuffers the device is done with. Write() does this too; a
+  // producer that has stopped writing can call it to let go of them sooner.
+  void FreePlayedBuffers()
+  {
+    PcmBuffer* pcmBuffer = nullptr;
+    while( playedBuffers_ && playedBuffers_->Read( &pcmBuffer, 1 ) )
+    {
+      delete pcmBuffer;
+      --buffersInFlight_;
+    }
+  }
+
+  // Marks the end of a track at the current write position. If nextFormat is
+  // given, data written afterwards is in that format and the device is reopened
+  // once this track has played out. Returns false if too many tracks are queued.
+  bool EndTrack( uint32_t trackId, const WAVEFORMATEX* nextFormat = nullptr )
+  {
+    assert( trackMarks_ );
+    TrackMark trackMark = { bytesWritten_, {}, trackId, nextFormat != nullptr };
+    if( nextFormat != nullptr )
+    {
+      assert( nextFormat->nBlockAlign > 0 );
+      trackMark.nextFormat = CopyWaveFormat( *nextFormat );
+    }
+    return trackMarks_->Write( &trackMark, 1 ) == 1;
+  }
+
+  // No more data will be written; playback ends when the ring drains
+  void SetEndOfStream()
+  {
+    isEndOfStream_.store( true, std::memory_order_release );
+    SignalWaveEvent( hEvent_ );
+  }
+
+  size_t GetBufferedBytes() const
+  {
+    if( ring_ )
+      return ring_->GetReadAvailable();
+    return static_cast<size_t>( queuedBytes_.load( std::memory_order_acquire ) );
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  //
+  // Consumer side
+
+  // Queue up to latencyMs of audio split across waveBufferCount buffers. Lower
+  // latency makes Pause and volume changes more responsive but requires
+  // Update() to be called promptly; after an underrun another buffer of the
+  // same size is added, up to kMaxWaveBuffers.
+  void Prepare( size_t waveBufferCount, uint32_t latencyMs )
+  {
+    assert( waveBufferCount > 1 );
+    assert( waveBufferCount <= kMaxWaveBuffers );
+    waveOut_->Reset();
+    UnprepareAll();
+    Pause(); // pause so no events are fired
+
+    // Anything the device hadn't played yet was discarded by Reset(), so
+    // playback resumes from the next unread byte in the ring
+    framesWritten_ = clock_.GetFrames();
+    clock_.Reset( framesWritten_ );
+    streamByteBase_ = bytesRead_ - ( framesWritten_ * blockAlign_ );
+
+    latencyMs_ = latencyMs;
+    CreateWaveBuffers( waveBufferCount );
+    Update();
+  }
+
+  // Total audio the device may have queued
+  uint32_t GetLatencyMs() const
+  {
+    auto bytes = uint64_t( waveBufferBytes_ ) * waveHdr_.size();
+    return static_cast<uint32_t>( bytes * 1000 / ( uint64_t( samplesPerSec_ ) * blockAlign_ ) );
+  }
+
+  void Start()
+  {
+    waveOut_->Restart();
+    clock_.Start();
+    isPlaying_ = true;
+    hasEnded_ = false;
+  }
+
+  void Pause()
+  {
+    waveOut_->Pause();
+    clock_.Stop();
+    isPlaying_ = false;
+  }
+
+  // Invoke when callbackEvent is signalled. Refills every completed buffer
+  // in one pass and returns the number of buffers sent back to the device.
+  size_t Update()
+  {
+    if( waveHdr_.empty() )
+      return 0;
+
+    // One device position query per wake-up keeps the playback clock in sync
+    clock_.Sync( waveOut_->GetPositionBytes() );
+
+    // Buffers complete in submission order, so only the front needs checking
+    while( !submitted_.IsEmpty() && IsWaveHdrDone( *submitted_.Front() ) )
+    {
+      auto* wh = submitted_.Pop();
+      ReleasePcm( *wh );
+      idle_.Push( wh );
+    }
+    NotifyEndedTracks();
+
+    DrainRetiredWaveOuts();
+
+    // At a format change, switch devices once the old one has played out and
+    // the new one is open. The old device ran dry on purpose, so that isn't
+    // an underrun.
+    bool isSwitching = submitted_.IsEmpty() && IsAtFormatChange();
+    if( isSwitching && !SwitchFormat() )
+      return 0;
+
+    // If every buffer came back while data was waiting, this thread was late
+    // rather than the producer; a deeper queue absorbs the next late wake-up
+    if( submitted_.IsEmpty() && isPlaying_ && !isStarving_.load( std::memory_order_relaxed ) &&
+        GetReadAvailable() >= blockAlign_ && !isSwitching )
+    {
+      ++underrunCount_;
+      if( waveHdr_.size() < kMaxWaveBuffers )
+        AddWaveBuffer();
+    }
+
+    size_t recycled = 0;
+    while( !idle_.IsEmpty() && Fill( *idle_.Front() ) )
+    {
+      // waveOut.Prepare() is not necessary since we're reusing the buffers
+      auto* wh = idle_.Pop();
+      waveOut_->Write( *wh );
+      submitted_.Push( wh );
+      ++recycled;
+    }
+    ReturnPlayedBuffers();
+    clock_.SetLimit( framesWritten_ );
+
+    // Open the next device while the current one plays out its last buffers
+    if( IsAtFormatChange() && !nextWaveOut_.valid() )
+      OpenNextWaveOut( GetFormatMark()->nextFormat );
+    if( !submitted_.IsEmpty() )
+    {
+      isStarving_.store( false, std::memory_order_release );
+      return recycled;
+    }
+
+    // Nothing in the driver. Either we're done, or the producer fell behind.
+    // Check end of stream before the ring so all data written prior is visible.
+    if( isEndOfStream_.load( std::memory_order_acquire ) && GetReadAvailable() < blockAlign_ )
+    {
+      DrainTrackMarks();
+      for( const auto& trackMark : pendingMarks_ )
+        endedTracks_.push_back( trackMark.trackId );
+      pendingMarks_.clear();
+      hasEnded_ = true;
+      return recycled;
+    }
+    if( !isStarving_.load( std::memory_order_relaxed ) )
+    {
+      if( isPlaying_ )
+        ++underrunCount_;
+      isStarving_.store( true, std::memory_order_release );
+
+      // Data may have landed between our Fill() and setting the flag
+      if( GetReadAvailable() >= blockAlign_ )
+        SignalWaveEvent( hEvent_ );
+    }
+    return recycled;
+  }
+
+  bool IsPlaying() const
+  {
+    return isPlaying_;
+  }
+
+  bool HasEnded() const
+  {
+    return hasEnded_;
+  }
+
+  // Retrieves, in playback order, the ids of tracks that have finished playing
+  bool GetEndedTrack( uint32_t& trackId )
+  {
+    if( endedTracks_.empty() )
+      return false;
+    trackId = endedTracks_.front();
+    endedTracks_.pop_front();
+    return true;
+  }
+
+  // Number of times playback ran dry while more data was expected
+  size_t GetUnderrunCount() const
+  {
+    return underrunCount_;
+  }
+
+  // Interpolated playback position; cheap and callable from any thread
+  uint64_t GetPositionFrames() const
+  {
+    return clock_.GetFrames();
+  }
+
+  uint64_t GetPositionNs() const
+  {
+    return clock_.GetNanoseconds();
+  }
+
+  WaveVolume GetVolume() const // left, right
+  {
+    return waveOut_->GetVolume();
+  }
+
+  void SetVolume( const WaveVolume& volume ) // left, right
+  {
+    waveOut_->SetVolume( volume );
+  }
+
+  void Close()
+  {
+    waveOut_->Reset();
+    UnprepareAll();
+    waveOut_->Close();
+    if( nextWaveOut_.valid() )
+      nextWaveOut_.get()->Close();
+    retiredWaveOuts_.clear(); // waits for each close
+    waveHdr_.clear();
+    submitted_.Clear();
+    idle_.Clear();
+    pcmBuffers_.clear();
+    heldPcm_.clear();
+    ring_.reset();
+    DrainBufferQueue();
+    bufferQueue_.reset();
+    bufferChain_.Clear();
+    ReturnPlayedBuffers();
+    FreePlayedBuffers();
+    playedBuffers_.reset();
+    buffersInFlight_ = 0;
+    queuedBytes_ = 0;
+    trackMarks_.reset();
+    pendingMarks_.clear();
+    endedTracks_.clear();
+    bytesWritten_ = 0;
+    bytesRead_ = 0;
+    streamByteBase_ = 0;
+    framesWritten_ = 0;
+    isStarving_ = false;
+    isEndOfStream_ = false;
+    isPlaying_ = false;
+    hasEnded_ = false;
+    underrunCount_ = 0;
+  }
+
+private:
+
+  struct TrackMark
+  {
+    uint64_t             endByte;    // stream offset where the track ends
+    WAVEFORMATEXTENSIBLE nextFormat; // valid if isFormatChange
+    uint32_t             trackId;
+    bool                 isFormatChange;
+  };
+
+  bool OpenDevice( const WAVEFORMATEX& wfx, HANDLE hEvent )
+  {
+    assert( wfx.nBlockAlign > 0 );
+    blockAlign_ = wfx.nBlockAlign;
+    samplesPerSec_ = wfx.nSamplesPerSec;
+    clock_.Open( wfx.nSamplesPerSec, wfx.nBlockAlign );
+    hEvent_ = hEvent;
+    trackMarks_ = std::make_unique<SpscRingBuffer<TrackMark>>( kMaxQueuedTracks );
+    return waveOut_->Open( wfx, hEvent );
+  }
+
+  void WakeConsumer()
+  {
+    // If the consumer ran dry, no buffer is queued to fire the callback event
+    if( isStarving_.load( std::memory_order_acquire ) )
+      SignalWaveEvent( hEvent_ );
+  }
+
+  void CreateWaveBuffers( size_t waveBufferCount )
+  {
+    // Sized in whole sample frames so a frame is never split across buffers
+    auto bufferMs = static_cast<uint32_t>( latencyMs_ / waveBufferCount );
+    waveBufferBytes_ = GetWaveBufferBytes( samplesPerSec_, static_cast<uint32_t>( blockAlign_ ), bufferMs );
+    pcmBuffers_.clear();
+    heldPcm_.clear();
+    waveHdr_.clear();
+    submitted_.Clear();
+    idle_.Clear();
+    waveHdr_.reserve( kMaxWaveBuffers ); // WAVEHDRs must not move once prepared
+    for( auto i = 0u; i < waveBufferCount; ++i )
+      AddWaveBuffer();
+  }
+
+  void AddWaveBuffer()
+  {
+    auto& wh = waveHdr_.emplace_back();
+    wh = { 0 };
+    wh.dwUser = waveHdr_.size() - 1; // index into heldPcm_
+    heldPcm_.push_back( PcmBufferChain::kNoBuffer );
+    auto& pcmBuffer = pcmBuffers_.emplace_back( waveBufferBytes_ ); // zero-copy: for small PcmBuffers
+    if( ring_ )
+    {
+      // The buffer memory never moves, so each WAVEHDR is prepared exactly once
+      wh.lpData = reinterpret_cast<LPSTR>( pcmBuffer.data() );
+      wh.dwBufferLength = static_cast<DWORD>( waveBufferBytes_ );
+      waveOut_->Prepare( wh );
+    }
+    wh.dwFlags |= WHDR_DONE; // available for filling
+    idle_.Push( &wh );
+  }
+
+  // Bytes the consumer can read now
+  size_t GetReadAvailable()
+  {
+    if( ring_ )
+      return ring_->GetReadAvailable();
+    DrainBufferQueue();
+    return bufferChain_.GetSize();
+  }
+
+  void DrainBufferQueue()
+  {
+    PcmBuffer* pcmBuffer = nullptr;
+    while( bufferQueue_ && bufferQueue_->Read( &pcmBuffer, 1 ) )
+    {
+      [[maybe_unused]] bool isPushed = bufferChain_.Push( pcmBuffer );
+      assert( isPushed ); // the chain holds every buffer in flight
+    }
+  }
+
+  // Hands released PcmBuffers back to the producer to destroy. The queue
+  // holds every buffer in flight, so it never fills.
+  void ReturnPlayedBuffers()
+  {
+    PcmBuffer* pcmBuffer = nullptr;
+    while( bufferChain_.GetReleased( pcmBuffer ) )
+    {
+      [[maybe_unused]] auto written = playedBuffers_->Write( &pcmBuffer, 1 );
+      assert( written == 1 );
+    }
+  }
+
+  bool Fill( WAVEHDR& wh )
+  {
+    // Check for data before the marks; a mark is always published before the
+    // data that follows it, so data from the next format can't slip in
+    auto bytes = std::min( GetReadAvailable(), waveBufferBytes_ );
+    DrainTrackMarks();
+    if( const auto* formatMark = GetFormatMark() )
+      bytes = static_cast<size_t>( std::min<uint64_t>( bytes, formatMark->endByte - bytesRead_ ) );
+
+    // One PcmBuffer per WAVEHDR, unless the front one would fill less than half
+    bool isZeroCopy = !ring_ && ( bufferChain_.GetFrontSize() * 2 >= bytes );
+    if( isZeroCopy )
+      bytes = std::min( bytes, bufferChain_.GetFrontSize() );
+    bytes -= bytes % blockAlign_;
+    if( bytes == 0 )
+      return false;
+
+    if( ring_ )
+    {
+      [[maybe_unused]] auto bytesRead = ring_->Read( reinterpret_cast<uint8_t*>( wh.lpData ), bytes );
+      assert( bytesRead == bytes );
+    }
+    else
+    {
+      // Point the WAVEHDR at the PcmBuffer, or at its own memory holding copies
+      // of several; it must be prepared for each new address
+      auto index = wh.dwUser;
+      wh = { 0 };
+      wh.dwUser = index;
+      if( isZeroCopy )
+      {
+        wh.lpData = reinterpret_cast<LPSTR>( const_cast<uint8_t*>( bufferChain_.GetFront( heldPcm_[ index ] ) ) );
+        bufferChain_.Skip( bytes );
+      }
+      else
+      {
+        wh.lpData = reinterpret_cast<LPSTR>( pcmBuffers_[ index ].data() );
+        [[maybe_unused]] auto bytesRead = bufferChain_.Read( pcmBuffers_[ index ].data(), bytes );
+        assert( bytesRead == bytes );
+      }
+      wh.dwBufferLength = static_cast<DWORD>( bytes );
+      queuedBytes_.fetch_sub( bytes, std::memory_order_relaxed );
+      waveOut_->Prepare( wh );
+    }
+    wh.dwBufferLength = static_cast<DWORD>( bytes );
+    bytesRead_ += bytes;
+    framesWritten_ += bytes / blockAlign_;
+    return true;
+  }
+
+  // Once the device is done with a zero-copy WAVEHDR, it's unprepared and its
+  // PcmBuffer, if any, may be released
+  void ReleasePcm( WAVEHDR& wh )
+  {
+    if( ring_ || wh.lpData == nullptr )
+      return;
+    waveOut_->Unprepare( wh );
+    wh.lpData = nullptr;
+    bufferChain_.Release( heldPcm_[ wh.dwUser ] );
+  }
+
+  void DrainTrackMarks()
+  {
+    TrackMark trackMark;
+    while( trackMarks_->Read( &trackMark, 1 ) )
+      pendingMarks_.push_back( trackMark );
+  }
+
+  const TrackMark* GetFormatMark() const
+  {
+    for( const auto& trackMark : pendingMarks_ )
+      if( trackMark.isFormatChange )
+        return &trackMark;
+    return nullptr;
+  }
+
+  bool IsAtFormatChange() const
+  {
+    const auto* formatMark = GetFormatMark();
+    return formatMark != nullptr && formatMark->endByte == bytesRead_;
+  }
+
+  void NotifyEndedTracks()
+  {
+    // Format changes are reported by SwitchFormat()
+    auto playedBytes = streamByteBase_ + ( clock_.GetFrames() * blockAlign_ );
+    while( !pendingMarks_.empty() && !pendingMarks_.front().isFormatChange &&
+           pendingMarks_.front().endByte <= playedBytes )
+    {
+      endedTracks_.push_back( pendingMarks_.front().trackId );
+      pendingMarks_.pop_front();
+    }
+  }
+
+  void OpenNextWaveOut( const WAVEFORMATEXTENSIBLE& wfx )
+  {
+    nextWaveOut_ = std::async( std::launch::async, [this, wfx]
+    {
+      auto waveOut = waveSinkFactory_();
+      [[maybe_unused]] bool isOpen = waveOut->Open( wfx.Format, hEvent_ );
+      assert( isOpen );
+
+      // Update() may have found the old device played out and this one not
+      // yet open; nothing else would wake it
+      SignalWaveEvent( hEvent_ );
+      return waveOut;
+    } );
+  }
+
+  bool IsNextWaveOutOpen() const
+  {
+    return nextWaveOut_.valid() && nextWaveOut_.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+  }
+
+  // Closed devices are released in the order retired, without waiting
+  void DrainRetiredWaveOuts()
+  {
+    while( !retiredWaveOuts_.empty() &&
+           retiredWaveOuts_.front().wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready )
+      retiredWaveOuts_.pop_front();
+  }
+
+  // Returns false if the next device isn't open yet
+  bool SwitchFormat()
+  {
+    if( !nextWaveOut_.valid() )
+      OpenNextWaveOut( GetFormatMark()->nextFormat );
+    if( !IsNextWaveOutOpen() )
+      return false;
+
+    // The old device has played everything up to and including the format change
+    TrackMark formatMark = {};
+    while( !formatMark.isFormatChange )
+    {
+      formatMark = pendingMarks_.front();
+      pendingMarks_.pop_front();
+      endedTracks_.push_back( formatMark.trackId );
+    }
+
+    // Buffers are reused with the new device, so unprepare them here and
+    // leave only the close, which can be slow, to a helper thread
+    waveOut_->Reset();
+    UnprepareAll();
+    retiredWaveOuts_.push_back( std::async( std::launch::async, []( std::unique_ptr<WaveSink> waveOut )
+    {
+      waveOut->Close();
+    }, std::move( waveOut_ ) ) );
+    waveOut_ = nextWaveOut_.get();
+
+    const auto& wfx = formatMark.nextFormat.Format;
+    blockAlign_ = wfx.nBlockAlign;
+    samplesPerSec_ = wfx.nSamplesPerSec;
+    clock_.Open( wfx.nSamplesPerSec, wfx.nBlockAlign );
+    streamByteBase_ = bytesRead_;
+    framesWritten_ = 0;
+    if( isPlaying_ )
+      clock_.Start();
+    else
+      waveOut_->Pause(); // devices open in the playing state
+    CreateWaveBuffers( waveHdr_.size() );
+    return true;
+  }
+
+  void UnprepareAll()
+  {
+    for( auto& wh : waveHdr_ )
+    {
+      if( wh.lpData == nullptr ) // zero-copy WAVEHDR not pointing at a PcmBuffer
+        continue;
+
+      // waveOutReset() leaves buffers in unpredictable state; fix it here
+      // before calling waveOutUnprepare()
+      wh.dwFlags = WHDR_PREPARED;
+      ReleasePcm( wh );
+      if( ring_ )
+        waveOut_->Unprepare( wh );
+    }
+  }
+
+private:
+  WaveSinkFactory                             waveSinkFactory_;
+  std::unique_ptr<WaveSink>                   waveOut_;
+  std::future<std::unique_ptr<WaveSink>>      nextWaveOut_;     // opened in the next format
+  std::deque<std::future<void>>               retiredWaveOuts_; // closing on helper threads
+  std::vector<WAVEHDR>                        waveHdr_;
+  WaveHdrQueue                                submitted_; // in the order written to the device
+  WaveHdrQueue                                idle_;      // completed, awaiting data
+  std::vector<std::vector<uint8_t>>           pcmBuffers_;
+  std::unique_ptr<SpscRingBuffer<uint8_t>>    ring_;
+  std::unique_ptr<SpscRingBuffer<PcmBuffer*>> bufferQueue_;    // owns the PcmBuffers in flight
+  std::unique_ptr<SpscRingBuffer<PcmBuffer*>> playedBuffers_;  // back to the producer to destroy
+  PcmBufferChain                              bufferChain_;    // consumer side
+  std::vector<PcmBufferChain::BufferRef>      heldPcm_;        // by WAVEHDR, until WHDR_DONE
+  size_t                                      buffersInFlight_ = 0; // producer side
+  std::unique_ptr<SpscRingBuffer<TrackMark>>  trackMarks_;
+  std::deque<TrackMark>                       pendingMarks_; // consumer side
+  std::deque<uint32_t>                        endedTracks_;
+  PlaybackClock                               clock_;
+  uint64_t                                    framesWritten_ = 0;  // since the last Reset() or format change
+  uint64_t                                    bytesWritten_ = 0;   // producer side
+  uint64_t                                    bytesRead_ = 0;      // consumer side
+  uint64_t                                    streamByteBase_ = 0; // stream offset of clock frame 0
+  HANDLE                                      hEvent_ = NULL;
+  size_t                                      blockAlign_ = 1;
+  uint32_t                                    samplesPerSec_ = 0;
+  size_t                                      waveBufferBytes_ = 0;
+  uint32_t                                    latencyMs_ = 0;
+  size_t                                      underrunCount_ = 0;
+  std::atomic<uint64_t>                       queuedBytes_ = 0; // in bufferQueue_ and bufferChain_
+  std::atomic<bool>                           isStarving_ = false;
+  std::atomic<bool>                           isEndOfStream_ = false;
+  bool                                        isPlaying_ = false;
+  bool                                        hasEnded_ = false;
+
+}; // class WinWaveStream
+
+} // namespace PKIsensee
+
+///////////////////////////////////////////////////////////////////////////////
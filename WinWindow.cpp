@@ -14,7 +14,6 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-#pragma once
 #include "Util.h"
 #include <cassert>
 